@@ -0,0 +1,261 @@
+#include "boards/common/afsk_demod.h"
+#include "test_check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace audio_wifi_config;
+
+#if CONFIG_ACOUSTIC_WIFI_SLIDING_DFT
+static const char* const kDetectorName = "sliding DFT";
+#else
+static const char* const kDetectorName = "Goertzel bank";
+#endif
+
+static const std::string kCredentials = "MyHomeWiFi_5G\nsecretpass123";
+static constexpr size_t kReadSamples = 480;     // What ReceiveWifiCredentialsFromAudio reads at a time
+
+// The sender's frame: start marker, text, 8-bit sum, end marker, MSB first
+static std::vector<uint8_t> FrameBits(const std::string& text) {
+    std::vector<uint8_t> bytes = {0x01, 0x02};
+    bytes.insert(bytes.end(), text.begin(), text.end());
+    bytes.push_back(AudioDataBuffer::CalculateChecksum(text));
+    bytes.push_back(0x03);
+    bytes.push_back(0x04);
+
+    std::vector<uint8_t> bits;
+    for (uint8_t byte : bytes) {
+        for (int i = 7; i >= 0; i--) {
+            bits.push_back((byte >> i) & 1);
+        }
+    }
+    return bits;
+}
+
+// Continuous phase AFSK with white noise, half a second of silence around the
+// frame, a random bit phase and the sender's clock off by drift_ppm
+static std::vector<int16_t> Transmit(const std::string& text, double snr_db, double drift_ppm, std::mt19937& rng) {
+    const double amplitude = 6000;
+    const double bit_length = static_cast<double>(kWindowSize) * (1 + drift_ppm * 1e-6);
+    auto bits = FrameBits(text);
+
+    std::uniform_real_distribution<double> uniform(0, 1);
+    double start = kAudioSampleRate / 2 + uniform(rng) * kWindowSize;
+    double duration = bits.size() * bit_length;
+    size_t total = static_cast<size_t>(start + duration) + kAudioSampleRate / 2;
+    double phase = uniform(rng) * 2 * M_PI;
+    double noise_sigma = std::sqrt(amplitude * amplitude / 2 / std::pow(10, snr_db / 10));
+    std::normal_distribution<double> noise(0, noise_sigma);
+
+    std::vector<int16_t> audio(total);
+    for (size_t n = 0; n < total; n++) {
+        double sample = 0;
+        double t = n - start;
+        if (t >= 0 && t < duration) {
+            size_t frequency = bits[static_cast<size_t>(t / bit_length)] ? kMarkFrequency : kSpaceFrequency;
+            phase += 2 * M_PI * frequency / kAudioSampleRate;
+            sample = amplitude * std::sin(phase);
+        }
+        sample += noise(rng);
+        audio[n] = static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, sample)));
+    }
+    return audio;
+}
+
+// The receive loop of ReceiveWifiCredentialsFromAudio without the device around it
+class Receiver {
+public:
+    Receiver() : processor_(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate, kWindowSize, kSlicerPhases),
+        buffers_(kSlicerPhases) {}
+
+    // Returns the first transmission decoded from audio, stride is the number of channels
+    std::optional<std::string> Receive(const std::vector<int16_t>& audio, size_t stride = 1) {
+        size_t block = kReadSamples * stride;
+        for (size_t offset = 0; offset + block <= audio.size(); offset += block) {
+            bits_.clear();
+            processor_.ProcessAudioSamples(audio.data() + offset, kReadSamples, stride, bits_);
+            for (const auto& bit : bits_) {
+                auto& buffer = buffers_[bit.phase];
+                if (buffer.ProcessProbability(bit.mark_probability) &&
+                    processor_.GetPhaseQuality(bit.phase) >= kMinPhaseQuality) {
+                    return buffer.decoded_text;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    AudioSignalProcessor processor_;
+    std::vector<AudioDataBuffer> buffers_;
+    std::vector<SlicedBit> bits_;
+};
+
+TEST_CASE(DecodesCleanFrame) {
+    std::mt19937 rng(1);
+    auto audio = Transmit(kCredentials, 30, 0, rng);
+    Receiver receiver;
+    auto text = receiver.Receive(audio);
+    CHECK(text.has_value());
+    CHECK(text && *text == kCredentials);
+}
+
+TEST_CASE(DecodesFirstChannelOfStereo) {
+    std::mt19937 rng(2);
+    auto mono = Transmit(kCredentials, 20, 0, rng);
+    std::vector<int16_t> stereo(mono.size() * 2);
+    std::normal_distribution<double> noise(0, 8000);
+    for (size_t i = 0; i < mono.size(); i++) {
+        stereo[2 * i] = mono[i];
+        stereo[2 * i + 1] = static_cast<int16_t>(noise(rng));     // Reference channel
+    }
+    Receiver receiver;
+    auto text = receiver.Receive(stereo, 2);
+    CHECK(text && *text == kCredentials);
+}
+
+TEST_CASE(DecodesAcrossSnrAndClockDrift) {
+    // 300 帧/每个信噪比，随机比特相位，发送端时钟 +-1000 ppm
+    // Below 0 dB the 8-bit sum lets a few frames with cancelling errors
+    // through, they only cost a failed connection attempt
+    struct Point {
+        double snr_db;
+        int min_percent;
+        int max_wrong;
+    };
+    const Point points[] = {{20, 100, 0}, {6, 100, 0}, {0, 99, 0}, {-3, 97, 3}, {-6, 90, 6}};
+    const int frames = 300;
+    std::mt19937 rng(1234);
+
+    for (const auto& point : points) {
+        int decoded = 0;
+        int wrong = 0;
+        size_t samples = 0;
+        double seconds = 0;
+        for (int i = 0; i < frames; i++) {
+            double drift_ppm = static_cast<int>(rng() % 2001) - 1000;
+            auto audio = Transmit(kCredentials, point.snr_db, drift_ppm, rng);
+            samples += audio.size();
+
+            auto start = std::chrono::steady_clock::now();
+            Receiver receiver;
+            auto text = receiver.Receive(audio);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (text) {
+                *text == kCredentials ? decoded++ : wrong++;
+            }
+        }
+        printf("%s, SNR %5.1f dB: %d/%d frames, %d wrong, %.0fx realtime\n", kDetectorName, point.snr_db,
+               decoded, frames, wrong, samples / static_cast<double>(kAudioSampleRate) / seconds);
+        CHECK(decoded * 100 >= point.min_percent * frames);
+        CHECK(wrong <= point.max_wrong);
+    }
+}
+
+TEST_CASE(NoFalseDecodesInNoise) {
+    // 半小时纯噪声不能解出任何数据
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0, 3000);
+    AudioSignalProcessor processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate, kWindowSize,
+                                   kSlicerPhases);
+    std::vector<AudioDataBuffer> buffers(kSlicerPhases);
+    std::vector<SlicedBit> bits;
+    std::vector<int16_t> audio(kReadSamples);
+    const size_t seconds = 30 * 60;
+    int decoded = 0;
+
+    for (size_t block = 0; block < seconds * kAudioSampleRate / kReadSamples; block++) {
+        for (auto& sample : audio) {
+            sample = static_cast<int16_t>(noise(rng));
+        }
+        bits.clear();
+        processor.ProcessAudioSamples(audio.data(), audio.size(), 1, bits);
+        for (const auto& bit : bits) {
+            if (buffers[bit.phase].ProcessProbability(bit.mark_probability)) {
+                decoded++;
+            }
+        }
+    }
+    CHECK_EQ(decoded, 0);
+}
+
+TEST_CASE(DetectorsAgree) {
+    // Both detectors compute the same DFT bins, only the fixed-point rounding differs
+    std::mt19937 rng(3);
+    auto audio = Transmit(kCredentials, 6, 300, rng);
+    float mark = static_cast<float>(kMarkFrequency) / kAudioSampleRate;
+    float space = static_cast<float>(kSpaceFrequency) / kAudioSampleRate;
+    GoertzelBank goertzel(mark, space, kWindowSize, kSlicerPhases);
+    SlidingDft sdft(mark, space, kWindowSize, kSlicerPhases);
+
+    std::vector<TonePower> a;
+    std::vector<TonePower> b;
+    for (size_t offset = 0; offset + kReadSamples <= audio.size(); offset += kReadSamples) {
+        goertzel.ProcessBlock(audio.data() + offset, kReadSamples, 1, a);
+        sdft.ProcessBlock(audio.data() + offset, kReadSamples, 1, b);
+    }
+    CHECK_EQ(a.size(), b.size());
+    CHECK(a.size() > 1000);
+
+    float peak = 0;
+    float max_error = 0;
+    for (size_t i = 0; i < std::min(a.size(), b.size()); i++) {
+        peak = std::max({peak, a[i].mark, a[i].space});
+        max_error = std::max({max_error, std::fabs(a[i].mark - b[i].mark), std::fabs(a[i].space - b[i].space)});
+    }
+    CHECK(peak > 0);
+    CHECK(max_error <= peak * 0.01f);
+}
+
+// Feeds a frame to a buffer as mark probabilities, weak bits are sent close to 0.5
+static bool FeedFrame(AudioDataBuffer& buffer, const std::vector<uint8_t>& bits,
+                      const std::vector<size_t>& flipped, const std::vector<size_t>& weak) {
+    // Idle tone before the frame so the buffer is waiting for the start marker
+    for (int i = 0; i < 16; i++) {
+        buffer.ProcessProbability(0.9f);
+    }
+    bool decoded = false;
+    for (size_t i = 0; i < bits.size(); i++) {
+        bool bit = bits[i];
+        if (std::find(flipped.begin(), flipped.end(), i) != flipped.end()) {
+            bit = !bit;
+        }
+        bool is_weak = std::find(weak.begin(), weak.end(), i) != weak.end();
+        float probability = bit ? (is_weak ? 0.52f : 0.95f) : (is_weak ? 0.48f : 0.05f);
+        decoded = buffer.ProcessProbability(probability) || decoded;
+    }
+    return decoded;
+}
+
+TEST_CASE(CorrectsOneWeakBit) {
+    auto bits = FrameBits(kCredentials);
+    const size_t payload_bit = 16 + 8 * 3 + 5;
+    AudioDataBuffer buffer;
+    CHECK(FeedFrame(buffer, bits, {payload_bit}, {payload_bit}));
+    CHECK(buffer.decoded_text && *buffer.decoded_text == kCredentials);
+}
+
+TEST_CASE(RejectsConfidentBitError) {
+    // 置信度高的错误比特不去猜，校验和不对就丢弃
+    auto bits = FrameBits(kCredentials);
+    const size_t payload_bit = 16 + 8 * 3 + 5;
+    AudioDataBuffer buffer;
+    CHECK(!FeedFrame(buffer, bits, {payload_bit}, {}));
+    CHECK(!buffer.decoded_text);
+}
+
+TEST_CASE(RejectsTwoBitErrors) {
+    // Two errors in different bit positions change the sum, one flip cannot fix them
+    auto bits = FrameBits(kCredentials);
+    const size_t first = 16 + 8 * 2 + 6;
+    const size_t second = 16 + 8 * 9 + 3;
+    AudioDataBuffer buffer;
+    CHECK(!FeedFrame(buffer, bits, {first, second}, {first, second}));
+    CHECK(!buffer.decoded_text);
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,343 @@
+#include "boards/common/camera_image_ops.h"
+#include "test_check.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Camera buffers are 128-byte aligned, the 32-bit swap relies on it
+class Buffer {
+public:
+    explicit Buffer(size_t size) : size_(size), data_(static_cast<uint8_t*>(aligned_alloc(128, (size + 127) / 128 * 128 + 128))) {}
+    ~Buffer() { free(data_); }
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    uint8_t* data() { return data_; }
+    size_t size() const { return size_; }
+    bool operator==(const std::vector<uint8_t>& other) const {
+        return other.size() == size_ && memcmp(data_, other.data(), size_) == 0;
+    }
+
+private:
+    size_t size_;
+    uint8_t* data_;
+};
+
+static void Fill(uint8_t* data, size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>(rng());
+    }
+}
+
+// Byte pairs swapped one by one, a trailing odd byte left alone
+static std::vector<uint8_t> ReferenceSwap(const uint8_t* src, size_t len) {
+    std::vector<uint8_t> out(src, src + len);
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        std::swap(out[i], out[i + 1]);
+    }
+    return out;
+}
+
+// Swaps the whole buffer, then moves every source pixel to where the turn puts it
+static std::vector<uint8_t> ReferenceRotateSwap(const uint8_t* src, int w, int h, int bpp, bool clockwise) {
+    auto swapped = ReferenceSwap(src, (size_t)w * h * bpp);
+    std::vector<uint8_t> out(swapped.size());
+    int dst_w = h;
+    for (int sy = 0; sy < h; sy++) {
+        for (int sx = 0; sx < w; sx++) {
+            int dx = clockwise ? h - 1 - sy : sy;
+            int dy = clockwise ? sx : w - 1 - sx;
+            memcpy(&out[((size_t)dy * dst_w + dx) * bpp], &swapped[((size_t)sy * w + sx) * bpp], bpp);
+        }
+    }
+    return out;
+}
+
+TEST_CASE(SwapBytes16MatchesBytePairs) {
+    for (size_t len = 0; len <= 70; len++) {
+        Buffer src(len), dst(len + 1);
+        Fill(src.data(), len, len);
+        memset(dst.data(), 0xA5, len + 1);
+        SwapBytes16(src.data(), dst.data(), len);
+        auto expected = ReferenceSwap(src.data(), len);
+        if (len & 1) {
+            // The odd byte is not written
+            expected[len - 1] = 0xA5;
+        }
+        CHECK(len == 0 || memcmp(dst.data(), expected.data(), len) == 0);
+        CHECK_EQ(dst.data()[len], 0xA5);
+    }
+
+    // In place, as Capture does for frames without rotation
+    Buffer frame(640 * 480 * 2);
+    Fill(frame.data(), frame.size(), 1);
+    auto expected = ReferenceSwap(frame.data(), frame.size());
+    SwapBytes16(frame.data(), frame.data(), frame.size());
+    CHECK(frame == expected);
+}
+
+TEST_CASE(RotateSwapMatchesReference) {
+    struct Size {
+        int w, h;
+    };
+    // Odd sizes only where the buffer length stays even
+    const Size sizes[] = {{1, 2}, {2, 1}, {2, 2}, {4, 3}, {3, 4}, {16, 9}, {62, 38}, {320, 240}};
+    int checked = 0;
+    for (auto size : sizes) {
+        for (int bpp : {2, 3, 4}) {
+            size_t len = (size_t)size.w * size.h * bpp;
+            if (len & 1) {
+                continue;
+            }
+            for (bool clockwise : {true, false}) {
+                Buffer src(len), dst(len);
+                Fill(src.data(), len, size.w * 131 + size.h * 7 + bpp);
+                RotateSwapImage(src.data(), dst.data(), size.w, size.h, bpp, clockwise);
+                bool ok = dst == ReferenceRotateSwap(src.data(), size.w, size.h, bpp, clockwise);
+                if (!ok) {
+                    printf("  %dx%d, %d bytes per pixel, %s: differs from the reference\n", size.w, size.h, bpp,
+                           clockwise ? "90" : "270");
+                }
+                CHECK(ok);
+                checked++;
+            }
+        }
+    }
+    CHECK(checked > 40);
+}
+
+TEST_CASE(TurnsComposeToTheOriginal) {
+    // Clockwise then counter-clockwise swaps twice and turns back, four clockwise turns likewise
+    const int w = 160, h = 120;
+    Buffer original(w * h * 2), a(w * h * 2), b(w * h * 2);
+    Fill(original.data(), original.size(), 9);
+    std::vector<uint8_t> expected(original.data(), original.data() + original.size());
+
+    RotateSwapImage(original.data(), a.data(), w, h, 2, true);
+    RotateSwapImage(a.data(), b.data(), h, w, 2, false);
+    CHECK(b == expected);
+
+    RotateSwapImage(original.data(), a.data(), w, h, 2, true);
+    RotateSwapImage(a.data(), b.data(), h, w, 2, true);
+    RotateSwapImage(b.data(), a.data(), w, h, 2, true);
+    RotateSwapImage(a.data(), b.data(), h, w, 2, true);
+    CHECK(b == expected);
+}
+
+TEST_CASE(FusedPassAgainstSwapThenRotate) {
+    // Host timing of the single pass against the two passes it replaced, for the log only
+    const int w = 640, h = 480;
+    Buffer src(w * h * 2), tmp(w * h * 2), dst(w * h * 2);
+    Fill(src.data(), src.size(), 3);
+    auto time_us = [](auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10; i++) {
+            fn();
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 10;
+    };
+    double fused = time_us([&] { RotateSwapImage(src.data(), dst.data(), w, h, 2, true); });
+    std::vector<uint8_t> expected(dst.data(), dst.data() + dst.size());
+    double separate = time_us([&] {
+        SwapBytes16(src.data(), tmp.data(), src.size());
+        // The swap pass followed by a plain rotation, the two passes the fused loop replaced
+        auto in = reinterpret_cast<const uint16_t*>(tmp.data());
+        auto out = reinterpret_cast<uint16_t*>(dst.data());
+        for (int dy = 0; dy < w; dy++) {
+            for (int dx = 0; dx < h; dx++) {
+                *out++ = in[(size_t)(h - 1 - dx) * w + dy];
+            }
+        }
+    });
+    CHECK(dst == expected);
+    printf("  640x480 RGB565 on the host: fused %.0f us, swap then rotate %.0f us\n", fused, separate);
+}
+
+static int BytesPerPixel(uint32_t format) {
+    return format == V4L2_PIX_FMT_RGB24 ? 3 : format == V4L2_PIX_FMT_GREY ? 1 : 2;
+}
+
+static const char* FormatName(uint32_t format) {
+    switch (format) {
+        case V4L2_PIX_FMT_RGB565:
+            return "RGB565";
+        case V4L2_PIX_FMT_RGB24:
+            return "RGB24";
+        case V4L2_PIX_FMT_YUYV:
+            return "YUYV";
+        default:
+            return "GREY";
+    }
+}
+
+// Channels of a source pixel: R G B fields, Y U V with the chroma of its YUYV pair, or grey
+static std::array<int, 3> SourceChannels(uint32_t format, const uint8_t* src, int src_w, int x, int y) {
+    switch (format) {
+        case V4L2_PIX_FMT_RGB565: {
+            uint16_t p;
+            memcpy(&p, src + ((size_t)y * src_w + x) * 2, 2);
+            return {p >> 11, (p >> 5) & 0x3F, p & 0x1F};
+        }
+        case V4L2_PIX_FMT_RGB24: {
+            const uint8_t* p = src + ((size_t)y * src_w + x) * 3;
+            return {p[0], p[1], p[2]};
+        }
+        case V4L2_PIX_FMT_YUYV: {
+            const uint8_t* pair = src + ((size_t)y * src_w + (x & ~1)) * 2;
+            return {src[((size_t)y * src_w + x) * 2], pair[1], pair[3]};
+        }
+        default:
+            return {src[(size_t)y * src_w + x], 0, 0};
+    }
+}
+
+// Compares every output channel with the plain average of the source pixels
+// the output pixel covers, returns the largest difference
+static double CompareWithAverage(uint32_t format, const uint8_t* src, int src_w, int cx, int cy, int cw, int ch,
+                                 const uint8_t* dst, int ow, int oh) {
+    double worst = 0;
+    for (int oy = 0; oy < oh; oy++) {
+        for (int ox = 0; ox < ow; ox++) {
+            // Output pixel i covers [i * size / out, (i + 1) * size / out) of the crop
+            int x0 = cx + ox * cw / ow, x1 = cx + (ox + 1) * cw / ow;
+            int y0 = cy + oy * ch / oh, y1 = cy + (oy + 1) * ch / oh;
+            double mean[3] = {0, 0, 0};
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    auto c = SourceChannels(format, src, src_w, x, y);
+                    for (int i = 0; i < 3; i++) {
+                        mean[i] += c[i];
+                    }
+                }
+            }
+            for (auto& m : mean) {
+                m /= (double)(x1 - x0) * (y1 - y0);
+            }
+
+            std::array<int, 3> got = {0, 0, 0};
+            int channels = 3;
+            size_t i = (size_t)oy * ow + ox;
+            if (format == V4L2_PIX_FMT_RGB565) {
+                uint16_t p;
+                memcpy(&p, dst + i * 2, 2);
+                got = {p >> 11, (p >> 5) & 0x3F, p & 0x1F};
+            } else if (format == V4L2_PIX_FMT_RGB24) {
+                got = {dst[i * 3], dst[i * 3 + 1], dst[i * 3 + 2]};
+            } else if (format == V4L2_PIX_FMT_YUYV) {
+                // Even pixels carry U, odd pixels V
+                got = {dst[i * 2], dst[i * 2 + 1], 0};
+                mean[1] = (ox & 1) ? mean[2] : mean[1];
+                channels = 2;
+            } else {
+                got = {dst[i], 0, 0};
+                channels = 1;
+            }
+            for (int c = 0; c < channels; c++) {
+                worst = std::max(worst, std::fabs(got[c] - mean[c]));
+            }
+        }
+    }
+    return worst;
+}
+
+static void CropAndScale(uint32_t format, const uint8_t* src, int src_w, int cx, int cy, int cw, int ch, uint8_t* dst,
+                         int ow, int oh) {
+    switch (format) {
+        case V4L2_PIX_FMT_RGB565:
+            CropAndScaleImage<V4L2_PIX_FMT_RGB565>(src, src_w, cx, cy, cw, ch, dst, ow, oh);
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            CropAndScaleImage<V4L2_PIX_FMT_RGB24>(src, src_w, cx, cy, cw, ch, dst, ow, oh);
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            CropAndScaleImage<V4L2_PIX_FMT_YUYV>(src, src_w, cx, cy, cw, ch, dst, ow, oh);
+            break;
+        default:
+            CropAndScaleImage<V4L2_PIX_FMT_GREY>(src, src_w, cx, cy, cw, ch, dst, ow, oh);
+            break;
+    }
+}
+
+static const uint32_t kScaleFormats[] = {V4L2_PIX_FMT_RGB565, V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUYV,
+                                         V4L2_PIX_FMT_GREY};
+
+TEST_CASE(BoxFilterMatchesReferenceAverage) {
+    struct Case {
+        int src_w, src_h, cx, cy, cw, ch, ow, oh;
+    };
+    // Exact sized buffers, so a read past the crop or a write past the output trips AddressSanitizer
+    const Case cases[] = {
+        {64, 48, 0, 0, 64, 48, 64, 48},         // Crop only, a copy
+        {64, 48, 0, 0, 64, 48, 32, 16},         // Whole factors
+        {640, 480, 0, 0, 640, 480, 336, 256},   // max_size 336, uneven boxes
+        {320, 240, 96, 72, 224, 168, 16, 16},   // Bottom right corner, the crop ends at the frame edge
+        {100, 60, 33, 7, 61, 53, 48, 32},       // Odd crop origin and size, YUYV pairs split at x0
+        {48, 40, 0, 0, 48, 40, 1, 1},           // One pixel, the mean of the whole frame
+        {32, 2, 5, 1, 17, 1, 16, 1},            // A single source row
+    };
+    int checked = 0;
+    for (auto& c : cases) {
+        for (uint32_t format : kScaleFormats) {
+            int bpp = BytesPerPixel(format);
+            std::vector<uint8_t> src((size_t)c.src_w * c.src_h * bpp);
+            std::vector<uint8_t> dst((size_t)c.ow * c.oh * bpp);
+            Fill(src.data(), src.size(), c.src_w + c.cx * 3 + format);
+            CropAndScale(format, src.data(), c.src_w, c.cx, c.cy, c.cw, c.ch, dst.data(), c.ow, c.oh);
+            double worst = CompareWithAverage(format, src.data(), c.src_w, c.cx, c.cy, c.cw, c.ch, dst.data(), c.ow,
+                                              c.oh);
+            if (worst > 0.5) {
+                printf("  %s %dx%d crop (%d,%d %dx%d) -> %dx%d: off by %.2f from the average\n", FormatName(format),
+                       c.src_w, c.src_h, c.cx, c.cy, c.cw, c.ch, c.ow, c.oh, worst);
+            }
+            // Rounded to the nearest value
+            CHECK(worst <= 0.5);
+            checked++;
+        }
+    }
+    CHECK_EQ(checked, 28);
+
+    // A crop that is not scaled is the crop itself
+    std::vector<uint8_t> frame(64 * 48 * 2), crop(20 * 10 * 2);
+    Fill(frame.data(), frame.size(), 5);
+    CropAndScaleImage<V4L2_PIX_FMT_RGB565>(frame.data(), 64, 7, 30, 20, 10, crop.data(), 20, 10);
+    for (int y = 0; y < 10; y++) {
+        CHECK(memcmp(&crop[y * 20 * 2], &frame[((30 + y) * 64 + 7) * 2], 20 * 2) == 0);
+    }
+}
+
+TEST_CASE(CropAndScaleTimings) {
+    // Host timing of the sizes PrepareExplainImage produces, for the log only
+    struct Case {
+        const char* what;
+        int src_w, src_h, cx, cy, cw, ch, ow, oh;
+    };
+    const Case cases[] = {
+        {"max_size 320", 640, 480, 0, 0, 640, 480, 320, 240},
+        {"max_size 512", 1280, 720, 0, 0, 1280, 720, 512, 288},
+        {"center 50%", 640, 480, 160, 120, 320, 240, 320, 240},
+    };
+    for (auto& c : cases) {
+        for (uint32_t format : {V4L2_PIX_FMT_RGB565, V4L2_PIX_FMT_YUYV}) {
+            int bpp = BytesPerPixel(format);
+            std::vector<uint8_t> src((size_t)c.src_w * c.src_h * bpp), dst((size_t)c.ow * c.oh * bpp);
+            Fill(src.data(), src.size(), 1);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < 5; i++) {
+                CropAndScale(format, src.data(), c.src_w, c.cx, c.cy, c.cw, c.ch, dst.data(), c.ow, c.oh);
+            }
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 5;
+            printf("  %-12s %-6s %4dx%-3d -> %3dx%-3d %7zu -> %6zu bytes, %6.0f us\n", c.what, FormatName(format),
+                   c.src_w, c.src_h, c.ow, c.oh, src.size(), dst.size(), us);
+        }
+    }
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+"""
+Writes GIF test vectors for gifdec_test: emoji-like animations encoded with a
+small GIF writer, and the canvas gifdec must show after every frame. The
+expected canvases are composited from the frame pixels directly, not decoded,
+so they check the LZW decoder as well as disposal and transparency.
+
+Canvas semantics are those of main/display/lvgl_display/gif/gifdec.c: BGRA,
+starting as the background colour with alpha 0, disposal 2 restores the
+previous frame rect to the background colour (alpha 0 if that frame had a
+transparent index), disposal 3 leaves the canvas as it is.
+
+Record format, little endian: u32 name length, name, u32 gif length, gif,
+u32 16, (width, height, frames per pass, passes) as u32, u32 canvases length,
+one width * height * 4 canvas per decoded frame, u32 ranges length, (offset,
+length) u32 pairs of LZW data bytes that can be corrupted without touching
+the sub-block lengths.
+"""
+import random
+import struct
+import sys
+
+
+class Frame:
+    def __init__(self, x, y, w, h, pixels, disposal=1, transparent=None, palette=None, interlace=False, delay=5):
+        self.x, self.y, self.w, self.h = x, y, w, h
+        self.pixels = pixels                # w * h palette indices, row by row
+        self.disposal = disposal
+        self.transparent = transparent
+        self.palette = palette              # Local color table, None for the global one
+        self.interlace = interlace
+        self.delay = delay
+
+
+def table_bits(palette):
+    """Size field and padded length of a color table"""
+    bits = max(1, (len(palette) - 1).bit_length())
+    return bits - 1, 1 << bits
+
+
+def color_table(palette):
+    _, size = table_bits(palette)
+    return b''.join(bytes(c) for c in palette) + bytes(3 * (size - len(palette)))
+
+
+def lzw_encode(pixels, min_code_size, clear_when_full=True):
+    """GIF LZW. Without clear_when_full the encoder keeps going with a full
+    12-bit table, which decoders have to accept."""
+    clear = 1 << min_code_size
+    end = clear + 1
+    out = bytearray()
+    acc = 0
+    acc_bits = 0
+
+    def emit(code, size):
+        nonlocal acc, acc_bits
+        acc |= code << acc_bits
+        acc_bits += size
+        while acc_bits >= 8:
+            out.append(acc & 0xFF)
+            acc >>= 8
+            acc_bits -= 8
+
+    def reset():
+        return {(i,): i for i in range(clear)}, end + 1, min_code_size + 1
+
+    table, next_code, size = reset()
+    emit(clear, size)
+    current = ()
+    for p in pixels:
+        candidate = current + (p,)
+        if candidate in table:
+            current = candidate
+            continue
+        emit(table[current], size)
+        if next_code < 4096:
+            table[candidate] = next_code
+            next_code += 1
+            # The decoder adds its entry one code later, so it widens after reading the next code
+            if next_code > (1 << size) and size < 12:
+                size += 1
+        elif clear_when_full:
+            emit(clear, size)
+            table, next_code, size = reset()
+        current = (p,)
+    if current:
+        emit(table[current], size)
+    emit(end, size)
+    if acc_bits:
+        out.append(acc & 0xFF)
+    return bytes(out)
+
+
+def interlaced_rows(h):
+    return list(range(0, h, 8)) + list(range(4, h, 8)) + list(range(2, h, 4)) + list(range(1, h, 2))
+
+
+def write_gif(width, height, palette, frames, background=0, loop=None):
+    """Returns the GIF and the (offset, length) ranges of LZW data bytes"""
+    size_bits, _ = table_bits(palette)
+    gif = bytearray(b'GIF89a')
+    gif += struct.pack('<HHBBB', width, height, 0x80 | (7 << 4) | size_bits, background, 0)
+    gif += color_table(palette)
+    if loop is not None:
+        gif += b'!\xff\x0bNETSCAPE2.0\x03\x01' + struct.pack('<H', loop) + b'\x00'
+    ranges = []
+    for frame in frames:
+        flags = (frame.disposal << 2) | (1 if frame.transparent is not None else 0)
+        gif += b'!\xf9\x04' + struct.pack('<BHB', flags, frame.delay, frame.transparent or 0) + b'\x00'
+        descriptor = 0x40 if frame.interlace else 0
+        if frame.palette is not None:
+            descriptor |= 0x80 | table_bits(frame.palette)[0]
+        gif += b',' + struct.pack('<HHHHB', frame.x, frame.y, frame.w, frame.h, descriptor)
+        if frame.palette is not None:
+            gif += color_table(frame.palette)
+
+        pixels = frame.pixels
+        if frame.interlace:
+            pixels = [p for row in interlaced_rows(frame.h) for p in frame.pixels[row * frame.w:(row + 1) * frame.w]]
+        colors = len(frame.palette if frame.palette is not None else palette)
+        min_code_size = max(2, (colors - 1).bit_length())
+        data = lzw_encode(pixels, min_code_size, getattr(frame, 'clear_when_full', True))
+        gif.append(min_code_size)
+        for pos in range(0, len(data), 255):
+            block = data[pos:pos + 255]
+            gif.append(len(block))
+            ranges.append((len(gif), len(block)))
+            gif += block
+        gif.append(0)
+    gif += b';'
+    return bytes(gif), ranges
+
+
+def canvases(width, height, palette, frames, background, passes):
+    """The canvas after each decoded frame, the way gifdec composites them"""
+    canvas = bytearray()
+    b = palette[background]
+    for _ in range(width * height):
+        canvas += bytes((b[2], b[1], b[0], 0))
+    result = []
+    previous = None
+    for _ in range(passes):
+        for frame in frames:
+            if previous is not None and previous.disposal == 2:
+                colors = previous.palette if previous.palette is not None else palette
+                b = colors[background] if background < len(colors) else (0, 0, 0)
+                alpha = 0 if previous.transparent is not None else 0xFF
+                for y in range(previous.y, previous.y + previous.h):
+                    for x in range(previous.x, previous.x + previous.w):
+                        i = 4 * (y * width + x)
+                        canvas[i:i + 4] = bytes((b[2], b[1], b[0], alpha))
+            colors = frame.palette if frame.palette is not None else palette
+            for j in range(frame.h):
+                for k in range(frame.w):
+                    index = frame.pixels[j * frame.w + k]
+                    if index == frame.transparent:
+                        continue
+                    c = colors[index]
+                    i = 4 * ((frame.y + j) * width + frame.x + k)
+                    canvas[i:i + 4] = bytes((c[2], c[1], c[0], 0xFF))
+            result.append(bytes(canvas))
+            previous = frame
+    return result
+
+
+def face(size, rng, eyes_open=1.0, mouth=0):
+    """An emoji face: background 0, face 1, outline 2, eyes 3, mouth 4, a few shades"""
+    pixels = []
+    c = (size - 1) / 2
+    r = size * 0.45
+    for y in range(size):
+        for x in range(size):
+            d = ((x - c) ** 2 + (y - c) ** 2) ** 0.5
+            if d > r:
+                p = 0
+            elif d > r - 2:
+                p = 2
+            else:
+                p = 1 if (x + y) % 7 else 5
+                for ex in (c - size * 0.15, c + size * 0.15):
+                    ey = c - size * 0.1
+                    if abs(x - ex) < size * 0.05 and abs(y - ey) < size * 0.08 * eyes_open + 0.5:
+                        p = 3
+                my = c + size * 0.18
+                if abs(x - c) < size * 0.2 and abs(y - my - mouth * (abs(x - c) / size)) < 1.5:
+                    p = 4
+            pixels.append(p)
+    return pixels
+
+
+def crop(pixels, stride, x, y, w, h):
+    return [pixels[(y + j) * stride + x + k] for j in range(h) for k in range(w)]
+
+
+PALETTE = [(0, 0, 0), (255, 204, 51), (120, 70, 10), (40, 40, 40), (200, 40, 40), (250, 190, 40),
+           (255, 255, 255), (30, 120, 220)]
+
+
+def vectors():
+    rng = random.Random(27)
+
+    # Blinking face: a full first frame, then only the eye rows change, the
+    # rest of the canvas shows through a transparent index
+    size = 64
+    frames = [Frame(0, 0, size, size, face(size, rng))]
+    for openness in (0.5, 0.0, 0.5, 1.0):
+        full = face(size, rng, openness)
+        x, y, w, h = 12, 16, 40, 14
+        frames.append(Frame(x, y, w, h, crop(full, size, x, y, w, h)))
+    yield 'blink', size, size, PALETTE, frames, 0, None, 1
+
+    # Talking face as the emoji GIFs are usually saved: every frame a sub-rect
+    # with a transparent index for unchanged pixels, looping forever
+    full = [face(size, rng, 1.0, m) for m in (0, 2, 4, 2)]
+    frames = [Frame(0, 0, size, size, full[0], transparent=7)]
+    for i in range(1, len(full)):
+        x, y, w, h = 10, 34, 44, 20
+        now = crop(full[i], size, x, y, w, h)
+        before = crop(full[i - 1], size, x, y, w, h)
+        frames.append(Frame(x, y, w, h, [p if p != q else 7 for p, q in zip(now, before)], transparent=7))
+    yield 'talk loop', size, size, PALETTE, frames, 0, 0, 3
+
+    # Sparkles restored to the background after each frame, and a frame that
+    # asks for the previous canvas back
+    frames = [Frame(0, 0, 48, 48, face(48, rng))]
+    for i in range(6):
+        x, y = rng.randrange(0, 40), rng.randrange(0, 40)
+        pixels = [6 if (k + j) % 3 else 0 for j in range(8) for k in range(8)]
+        frames.append(Frame(x, y, 8, 8, pixels, disposal=2 if i % 3 else 3, transparent=0 if i % 2 else None))
+    yield 'sparkle disposal', 48, 48, PALETTE, frames, 6, 0, 2
+
+    # Local color tables with fewer colours (min code size 2) and an interlaced frame
+    small = [(10, 10, 10), (250, 250, 250)]
+    frames = [Frame(0, 0, 40, 33, [(x // 5 + y // 3) % 2 for y in range(33) for x in range(40)], palette=small),
+              Frame(3, 2, 30, 29, [rng.randrange(8) for _ in range(30 * 29)], interlace=True),
+              Frame(5, 5, 11, 7, [rng.randrange(4) for _ in range(77)], palette=PALETTE[:4], interlace=True)]
+    yield 'local tables interlaced', 40, 33, PALETTE, frames, 0, None, 1
+
+    # Noise fills the 4096-entry code table: once with clear codes, once
+    # carrying on with the full table
+    noise = [Frame(0, 0, 160, 120, [rng.randrange(256) for _ in range(160 * 120)])]
+    gray = [(i, i, 255 - i) for i in range(256)]
+    yield 'full table cleared', 160, 120, gray, noise, 0, None, 1
+    deferred = Frame(0, 0, 160, 120, noise[0].pixels)
+    deferred.clear_when_full = False
+    yield 'full table kept', 160, 120, gray, [deferred], 0, None, 1
+
+    # The size of the bundled emoji animations, a smooth gradient with motion
+    size = 160
+    frames = []
+    for t in range(8):
+        frames.append(Frame(0, 0, size, size,
+                            [((x + 3 * t) // 4 + (y // 6)) % 64 + (64 if (x - 80) ** 2 + (y - 80 - t) ** 2 < 900 else 0)
+                             for y in range(size) for x in range(size)]))
+    ramp = [(i * 4 % 256, 128, 255 - i) for i in range(128)]
+    yield 'gradient 160', size, size, ramp, frames, 0, 0, 2
+
+
+def main():
+    with open(sys.argv[1], 'wb') as out:
+        for name, width, height, palette, frames, background, loop, passes in vectors():
+            gif, ranges = write_gif(width, height, palette, frames, background, loop)
+            expected = canvases(width, height, palette, frames, background, passes)
+            header = struct.pack('<IIII', width, height, len(frames), passes)
+            data_ranges = b''.join(struct.pack('<II', *r) for r in ranges)
+            for block in (name.encode(), gif, header, b''.join(expected), data_ranges):
+                out.write(struct.pack('<I', len(block)) + block)
+
+
+if __name__ == '__main__':
+    main()
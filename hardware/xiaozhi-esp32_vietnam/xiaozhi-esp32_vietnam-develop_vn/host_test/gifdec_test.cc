@@ -0,0 +1,282 @@
+#include "display/lvgl_display/gif/gifdec.h"
+#include "test_check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+int lv_malloc_calls = 0;
+}
+
+// Written by gif_vectors.py at build time
+struct Vector {
+    std::string name;
+    std::vector<uint8_t> gif;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t frames = 0;        // Per pass
+    uint32_t passes = 0;
+    std::vector<uint8_t> canvases;
+    std::vector<std::pair<uint32_t, uint32_t>> data_ranges;
+
+    size_t canvas_size() const { return width * height * 4; }
+    const uint8_t* canvas(size_t i) const { return canvases.data() + i * canvas_size(); }
+};
+
+static std::vector<Vector> LoadVectors() {
+    std::vector<Vector> vectors;
+    FILE* file = fopen(GIF_VECTORS_FILE, "rb");
+    if (file == nullptr) {
+        return vectors;
+    }
+    auto read_block = [file](std::vector<uint8_t>& data) {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, file) != 1) {
+            return false;
+        }
+        data.resize(length);
+        return length == 0 || fread(data.data(), 1, length, file) == length;
+    };
+    while (true) {
+        Vector vector;
+        std::vector<uint8_t> name, header, ranges;
+        if (!read_block(name) || !read_block(vector.gif) || !read_block(header) || !read_block(vector.canvases) ||
+            !read_block(ranges)) {
+            break;
+        }
+        vector.name.assign(name.begin(), name.end());
+        memcpy(&vector.width, &header[0], 4);
+        memcpy(&vector.height, &header[4], 4);
+        memcpy(&vector.frames, &header[8], 4);
+        memcpy(&vector.passes, &header[12], 4);
+        for (size_t pos = 0; pos + 8 <= ranges.size(); pos += 8) {
+            uint32_t offset, length;
+            memcpy(&offset, &ranges[pos], 4);
+            memcpy(&length, &ranges[pos + 4], 4);
+            vector.data_ranges.emplace_back(offset, length);
+        }
+        vectors.push_back(std::move(vector));
+    }
+    fclose(file);
+    return vectors;
+}
+
+static const std::vector<Vector>& Vectors() {
+    static std::vector<Vector> vectors = LoadVectors();
+    return vectors;
+}
+
+static const Vector& Find(const char* name) {
+    for (auto& vector : Vectors()) {
+        if (vector.name == name) {
+            return vector;
+        }
+    }
+    fprintf(stderr, "missing test vector %s\n", name);
+    exit(1);
+}
+
+struct Decoded {
+    bool ok = true;
+    int frames = 0;
+    int mismatches = 0;
+    int first_mismatch = -1;
+    int end = 0;                    // gd_get_frame after the expected frames
+    int allocations = 0;            // lv_malloc calls after opening
+    uint64_t dirty_pixels = 0;
+    uint64_t changes_outside_dirty = 0;
+    double us_per_frame = 0;
+};
+
+// Drives gifdec the way LvglGif does: render once after opening, then
+// gd_get_frame and gd_render_frame onto the canvas for every frame
+static Decoded Decode(gd_GIF* gif, const Vector& vector) {
+    Decoded result;
+    if (gif == nullptr) {
+        result.ok = false;
+        return result;
+    }
+    gd_render_frame(gif, gif->canvas);
+    int allocations_before = lv_malloc_calls;
+    std::vector<uint8_t> previous(gif->canvas, gif->canvas + vector.canvas_size());
+    double total_us = 0;
+
+    for (size_t i = 0; i < vector.frames * vector.passes; i++) {
+        auto start = std::chrono::steady_clock::now();
+        int got = gd_get_frame(gif);
+        if (got == 1) {
+            gd_render_frame(gif, gif->canvas);
+        }
+        total_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (got != 1) {
+            result.ok = false;
+            break;
+        }
+        result.frames++;
+
+        if (memcmp(gif->canvas, vector.canvas(i), vector.canvas_size()) != 0) {
+            if (result.mismatches++ == 0) {
+                result.first_mismatch = i;
+            }
+        }
+
+        // Every pixel that changed has to be inside the area LcdDisplay invalidates
+        result.dirty_pixels += gif->dw * gif->dh;
+        for (uint32_t y = 0; y < vector.height; y++) {
+            for (uint32_t x = 0; x < vector.width; x++) {
+                size_t p = (y * vector.width + x) * 4;
+                bool inside = x >= gif->dx && x < gif->dx + gif->dw && y >= gif->dy && y < gif->dy + gif->dh;
+                if (!inside && memcmp(&gif->canvas[p], &previous[p], 4) != 0) {
+                    result.changes_outside_dirty++;
+                }
+            }
+        }
+        previous.assign(gif->canvas, gif->canvas + vector.canvas_size());
+    }
+    result.end = result.ok ? gd_get_frame(gif) : -1;
+    result.allocations = lv_malloc_calls - allocations_before;
+    result.us_per_frame = result.frames > 0 ? total_us / result.frames : 0;
+    return result;
+}
+
+TEST_CASE(VectorsWereGenerated) {
+    CHECK(Vectors().size() >= 7);
+    CHECK(Find("blink").frames == 5);
+}
+
+TEST_CASE(DecodesEveryFrameFromMemory) {
+    for (auto& vector : Vectors()) {
+        int before = lv_malloc_calls;
+        gd_GIF* gif = gd_open_gif_data(vector.gif.data());
+        CHECK(gif != nullptr);
+        CHECK_EQ(lv_malloc_calls - before, 1);
+        Decoded result = Decode(gif, vector);
+        if (!result.ok || result.mismatches > 0) {
+            printf("  %s: %d frames decoded, %d differ from the expected canvas, first at %d\n", vector.name.c_str(),
+                   result.frames, result.mismatches, result.first_mismatch);
+        }
+        CHECK(result.ok);
+        CHECK_EQ(result.frames, static_cast<int>(vector.frames * vector.passes));
+        CHECK_EQ(result.mismatches, 0);
+        // The code table lives in the gd_GIF allocation, frames do not allocate
+        CHECK_EQ(result.allocations, 0);
+        printf("  %-24s %3ux%-3u %2d frames, %7.1f us/frame (%.0f fps on the host)\n", vector.name.c_str(),
+               vector.width, vector.height, result.frames, result.us_per_frame, 1e6 / result.us_per_frame);
+        gd_close_gif(gif);
+    }
+}
+
+TEST_CASE(StopsAtTheTrailerUnlessLooping) {
+    // Without a NETSCAPE block the animation plays once, with a loop count of 0 forever
+    for (auto name : {"blink", "talk loop"}) {
+        auto& vector = Find(name);
+        gd_GIF* gif = gd_open_gif_data(vector.gif.data());
+        Decoded result = Decode(gif, vector);
+        CHECK_EQ(result.mismatches, 0);
+        CHECK_EQ(result.end, strcmp(name, "blink") == 0 ? 0 : 1);
+        gd_close_gif(gif);
+    }
+}
+
+TEST_CASE(DecodesEveryFrameFromFile) {
+    // Files go through lv_fs one byte at a time for the LZW codes
+    for (auto& vector : Vectors()) {
+        std::string path = "gifdec_test_" + std::to_string(&vector - &Vectors()[0]) + ".gif";
+        FILE* file = fopen(path.c_str(), "wb");
+        fwrite(vector.gif.data(), 1, vector.gif.size(), file);
+        fclose(file);
+
+        gd_GIF* gif = gd_open_gif_file(path.c_str());
+        CHECK(gif != nullptr);
+        Decoded result = Decode(gif, vector);
+        if (result.mismatches > 0) {
+            printf("  %s: %d frames differ reading from a file\n", vector.name.c_str(), result.mismatches);
+        }
+        CHECK(result.ok);
+        CHECK_EQ(result.mismatches, 0);
+        gd_close_gif(gif);
+        remove(path.c_str());
+    }
+}
+
+TEST_CASE(DirtyAreaCoversEveryChange) {
+    for (auto& vector : Vectors()) {
+        gd_GIF* gif = gd_open_gif_data(vector.gif.data());
+        Decoded result = Decode(gif, vector);
+        CHECK_EQ(result.changes_outside_dirty, 0u);
+        uint64_t full = static_cast<uint64_t>(vector.width) * vector.height * result.frames;
+        printf("  %-24s invalidates %5.1f%% of the canvas per frame\n", vector.name.c_str(),
+               full ? result.dirty_pixels * 100.0 / full : 0.0);
+        gd_close_gif(gif);
+    }
+
+    // The blink frames only touch the eye rows
+    auto& blink = Find("blink");
+    gd_GIF* gif = gd_open_gif_data(blink.gif.data());
+    gd_render_frame(gif, gif->canvas);
+    CHECK_EQ(gd_get_frame(gif), 1);
+    gd_render_frame(gif, gif->canvas);
+    CHECK_EQ(gd_get_frame(gif), 1);
+    gd_render_frame(gif, gif->canvas);
+    CHECK_EQ(gif->dx, 12);
+    CHECK_EQ(gif->dy, 16);
+    CHECK_EQ(gif->dw, 40);
+    CHECK_EQ(gif->dh, 14);
+    gd_close_gif(gif);
+}
+
+TEST_CASE(RewindPlaysFromTheFirstFrame) {
+    // LvglGif::Stop rewinds and shows the first frame again
+    auto& vector = Find("blink");
+    gd_GIF* gif = gd_open_gif_data(vector.gif.data());
+    Decoded result = Decode(gif, vector);
+    CHECK_EQ(result.mismatches, 0);
+    gd_rewind(gif);
+    CHECK_EQ(gd_get_frame(gif), 1);
+    gd_render_frame(gif, gif->canvas);
+    CHECK(memcmp(gif->canvas, vector.canvas(0), vector.canvas_size()) == 0);
+    gd_close_gif(gif);
+}
+
+TEST_CASE(CorruptedLzwDataStaysInTheFrame) {
+    // Flipped bits in the code stream give wrong pixels, never a write outside
+    // the frame buffer or the code table (the test runs under AddressSanitizer)
+    std::mt19937 rng(27);
+    int errors = 0;
+    int decoded = 0;
+    for (auto& vector : Vectors()) {
+        for (int i = 0; i < 40; i++) {
+            auto gif_data = vector.gif;
+            for (int flips = 1 + rng() % 4; flips > 0; flips--) {
+                auto& range = vector.data_ranges[rng() % vector.data_ranges.size()];
+                gif_data[range.first + rng() % range.second] ^= 1 << (rng() % 8);
+            }
+            gd_GIF* gif = gd_open_gif_data(gif_data.data());
+            CHECK(gif != nullptr);
+            gd_render_frame(gif, gif->canvas);
+            for (size_t frame = 0; frame < vector.frames; frame++) {
+                int got = gd_get_frame(gif);
+                if (got != 1) {
+                    errors++;
+                    break;
+                }
+                CHECK(gif->dx + gif->dw <= vector.width);
+                CHECK(gif->dy + gif->dh <= vector.height);
+                gd_render_frame(gif, gif->canvas);
+                decoded++;
+            }
+            gd_close_gif(gif);
+        }
+    }
+    printf("  %d corrupted frames decoded, %d streams stopped with an error\n", decoded, errors);
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,175 @@
+#include "boards/common/jpeg_chunk_pipe.h"
+#include "test_check.h"
+
+#include <chrono>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static std::vector<uint8_t> MakeJpeg(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> jpeg(size);
+    for (auto& byte : jpeg) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return jpeg;
+}
+
+struct Upload {
+    std::vector<uint8_t> data;
+    std::vector<size_t> chunk_lengths;
+    std::set<uint8_t*> chunks;
+    int outside_pool = 0;
+};
+
+// The upload loop of Esp32Camera::Explain, with a delay per chunk standing in for http->Write
+static Upload ReadAll(JpegChunkPipe& pipe, const std::vector<uint8_t>& pool, std::chrono::microseconds delay) {
+    Upload upload;
+    JpegChunk chunk;
+    while (pipe.Read(chunk)) {
+        size_t offset = chunk.data - pool.data();
+        if (chunk.data < pool.data() || offset % JPEG_CHUNK_SIZE != 0 || offset >= pool.size()) {
+            upload.outside_pool++;
+        }
+        upload.chunks.insert(chunk.data);
+        upload.data.insert(upload.data.end(), chunk.data, chunk.data + chunk.len);
+        upload.chunk_lengths.push_back(chunk.len);
+        std::this_thread::sleep_for(delay);
+        pipe.Recycle(chunk);
+    }
+    return upload;
+}
+
+// The encoder thread: callback writes of the given sizes, then Finish
+static std::thread Encode(JpegChunkPipe& pipe, const std::vector<uint8_t>& jpeg, std::vector<size_t> writes,
+                          std::chrono::microseconds delay = 0us) {
+    return std::thread([&pipe, &jpeg, writes, delay]() {
+        size_t pos = 0;
+        for (size_t n : writes) {
+            pipe.Write(jpeg.data() + pos, n);
+            pos += n;
+            std::this_thread::sleep_for(delay);
+        }
+        pipe.Finish();
+    });
+}
+
+// Splits size into the uneven pieces the encoder callback hands over, some
+// smaller than a chunk, some spanning several
+static std::vector<size_t> RandomWrites(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<size_t> writes;
+    for (size_t left = size; left > 0;) {
+        size_t n = std::min<size_t>(left, rng() % 3 == 0 ? 1 + rng() % 16 : 1 + rng() % (3 * JPEG_CHUNK_SIZE));
+        writes.push_back(n);
+        left -= n;
+    }
+    return writes;
+}
+
+// With no reader every chunk has to be free again: Write of the whole pool
+// only returns if none was lost, and the chunks read back are all different
+static bool PoolIsComplete(JpegChunkPipe& pipe, const std::vector<uint8_t>& pool) {
+    auto jpeg = MakeJpeg(pool.size(), 1);
+    pipe.Write(jpeg.data(), jpeg.size());
+    pipe.Finish();
+    Upload upload = ReadAll(pipe, pool, 0us);
+    return upload.data == jpeg && upload.chunks.size() == JPEG_CHUNK_COUNT && upload.outside_pool == 0;
+}
+
+TEST_CASE(StreamSurvivesChunkBoundaries) {
+    std::vector<uint8_t> pool(JPEG_CHUNK_SIZE * JPEG_CHUNK_COUNT);
+    for (uint32_t seed = 0; seed < 20; seed++) {
+        // Sizes below, at and above the pool, and exact multiples of a chunk
+        size_t size = seed % 4 == 0 ? (seed / 4 + 1) * JPEG_CHUNK_SIZE : 1 + (seed * 7919) % (5 * pool.size());
+        auto jpeg = MakeJpeg(size, seed);
+        JpegChunkPipe pipe(pool.data());
+        CHECK(pipe.valid());
+        auto encoder = Encode(pipe, jpeg, RandomWrites(size, seed));
+        Upload upload = ReadAll(pipe, pool, 0us);
+        encoder.join();
+
+        CHECK(upload.data == jpeg);
+        CHECK_EQ(upload.outside_pool, 0);
+        // Only the last chunk may be short, and none is sent empty
+        for (size_t i = 0; i < upload.chunk_lengths.size(); i++) {
+            CHECK(upload.chunk_lengths[i] > 0);
+            if (i + 1 < upload.chunk_lengths.size()) {
+                CHECK(upload.chunk_lengths[i] == JPEG_CHUNK_SIZE);
+            }
+        }
+        CHECK(upload.chunk_lengths.size() == (size + JPEG_CHUNK_SIZE - 1) / JPEG_CHUNK_SIZE);
+        CHECK(PoolIsComplete(pipe, pool));
+    }
+}
+
+TEST_CASE(EmptyEncodeEndsTheUpload) {
+    // PrepareExplainImage or the encoder failing only calls Finish
+    std::vector<uint8_t> pool(JPEG_CHUNK_SIZE * JPEG_CHUNK_COUNT);
+    std::vector<uint8_t> jpeg;
+    JpegChunkPipe pipe(pool.data());
+    auto encoder = Encode(pipe, jpeg, {});
+    Upload upload = ReadAll(pipe, pool, 0us);
+    encoder.join();
+    CHECK(upload.data.empty());
+    CHECK(upload.chunk_lengths.empty());
+    CHECK(PoolIsComplete(pipe, pool));
+}
+
+TEST_CASE(SlowUploadStallsTheEncoder) {
+    // A JPEG several times the pool: the encoder has to wait for free chunks
+    // instead of allocating, and gets every byte through
+    std::vector<uint8_t> pool(JPEG_CHUNK_SIZE * JPEG_CHUNK_COUNT);
+    auto jpeg = MakeJpeg(6 * pool.size() + 123, 42);
+    JpegChunkPipe pipe(pool.data());
+    auto start = std::chrono::steady_clock::now();
+    auto encoder = Encode(pipe, jpeg, RandomWrites(jpeg.size(), 42));
+    Upload upload = ReadAll(pipe, pool, 2ms);
+    encoder.join();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(upload.data == jpeg);
+    CHECK(upload.chunks.size() <= JPEG_CHUNK_COUNT);
+    CHECK(pipe.encoder_stalls() > 0);
+    CHECK(pipe.encoder_stall_us() > 0);
+    printf("  %zu KB in %zu chunks over %.0f ms: encoder stalled %u times for %lld ms, uploader waited %lld ms\n",
+           jpeg.size() / 1024, upload.chunk_lengths.size(), ms, (unsigned)pipe.encoder_stalls(),
+           (long long)pipe.encoder_stall_us() / 1000, (long long)pipe.reader_wait_us() / 1000);
+    CHECK(PoolIsComplete(pipe, pool));
+}
+
+TEST_CASE(SlowEncoderMakesTheUploadWait) {
+    std::vector<uint8_t> pool(JPEG_CHUNK_SIZE * JPEG_CHUNK_COUNT);
+    auto jpeg = MakeJpeg(3 * JPEG_CHUNK_SIZE, 7);
+    JpegChunkPipe pipe(pool.data());
+    auto encoder = Encode(pipe, jpeg, {JPEG_CHUNK_SIZE, JPEG_CHUNK_SIZE, JPEG_CHUNK_SIZE}, 3ms);
+    Upload upload = ReadAll(pipe, pool, 0us);
+    encoder.join();
+    CHECK(upload.data == jpeg);
+    CHECK_EQ(pipe.encoder_stalls(), 0u);
+    CHECK(pipe.reader_wait_us() >= 3000);
+}
+
+TEST_CASE(DrainLetsTheEncoderFinish) {
+    // When the HTTP connection fails Explain recycles everything unread so the
+    // encoder thread can be joined
+    std::vector<uint8_t> pool(JPEG_CHUNK_SIZE * JPEG_CHUNK_COUNT);
+    auto jpeg = MakeJpeg(4 * pool.size(), 9);
+    JpegChunkPipe pipe(pool.data());
+    auto encoder = Encode(pipe, jpeg, RandomWrites(jpeg.size(), 9));
+    std::this_thread::sleep_for(5ms);
+    JpegChunk chunk;
+    while (pipe.Read(chunk)) {
+        pipe.Recycle(chunk);
+    }
+    encoder.join();
+    CHECK(pipe.encoder_stalls() > 0);
+    CHECK(PoolIsComplete(pipe, pool));
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,57 @@
+#include "json_writer.h"
+#include "test_check.h"
+
+#include <cmath>
+#include <limits>
+
+static std::string NumberJson(double value) {
+    std::string buffer;
+    JsonWriter(buffer).Number(value);
+    return buffer;
+}
+
+TEST_CASE(NonFiniteNumbersAreNull) {
+    CHECK(NumberJson(std::nan("")) == "null");
+    CHECK(NumberJson(std::numeric_limits<double>::infinity()) == "null");
+    CHECK(NumberJson(-std::numeric_limits<double>::infinity()) == "null");
+}
+
+TEST_CASE(IntegralNumbersPrintAsIntegers) {
+    CHECK(NumberJson(0) == "0");
+    CHECK(NumberJson(-0.0) == "0");
+    CHECK(NumberJson(42) == "42");
+    CHECK(NumberJson(-17) == "-17");
+    CHECK(NumberJson(999999999999999) == "999999999999999");
+}
+
+TEST_CASE(LargeNumbersDoNotGoThroughInt64) {
+    // 超出 int64 范围的值走 %g 格式，而不是先转换成整数
+    CHECK(NumberJson(1e300) == "1e+300");
+    CHECK(NumberJson(-1e300) == "-1e+300");
+    CHECK(NumberJson(9.3e18) == "9.3e+18");
+    CHECK(NumberJson(1e15) == "1e+15");
+}
+
+TEST_CASE(FractionsRoundTrip) {
+    CHECK(NumberJson(0.5) == "0.5");
+    CHECK(NumberJson(-2.25) == "-2.25");
+    double third = 1.0 / 3.0;
+    CHECK(strtod(NumberJson(third).c_str(), nullptr) == third);
+}
+
+TEST_CASE(WritesObjectsAndEscapes) {
+    std::string buffer;
+    JsonWriter json(buffer);
+    json.BeginObject()
+        .Field("type", "listen")
+        .Field("text", "a\"b\\c\n\x01")
+        .Key("values").BeginArray().Int(1).Number(2.5).Bool(true).Null().EndArray()
+        .Key("payload").Raw("{\"x\":1}")
+        .EndObject();
+    CHECK(buffer == "{\"type\":\"listen\",\"text\":\"a\\\"b\\\\c\\n\\u0001\","
+                    "\"values\":[1,2.5,true,null],\"payload\":{\"x\":1}}");
+}
+
+int main() {
+    return RunTests();
+}
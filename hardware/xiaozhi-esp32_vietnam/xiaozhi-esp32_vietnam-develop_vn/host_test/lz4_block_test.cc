@@ -0,0 +1,157 @@
+#include "lz4_block.h"
+#include "test_check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Written by lz4_vectors.py at build time
+struct Vector {
+    std::string name;
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> compressed;
+};
+
+static std::vector<Vector> LoadVectors() {
+    std::vector<Vector> vectors;
+    FILE* file = fopen(LZ4_VECTORS_FILE, "rb");
+    if (file == nullptr) {
+        return vectors;
+    }
+    auto read_block = [file](std::vector<uint8_t>& data) {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, file) != 1) {
+            return false;
+        }
+        data.resize(length);
+        return length == 0 || fread(data.data(), 1, length, file) == length;
+    };
+    while (true) {
+        Vector vector;
+        std::vector<uint8_t> name;
+        if (!read_block(name) || !read_block(vector.raw) || !read_block(vector.compressed)) {
+            break;
+        }
+        vector.name.assign(name.begin(), name.end());
+        vectors.push_back(std::move(vector));
+    }
+    fclose(file);
+    return vectors;
+}
+
+static const std::vector<Vector>& Vectors() {
+    static std::vector<Vector> vectors = LoadVectors();
+    return vectors;
+}
+
+// Decodes into a buffer of exactly dst_size bytes so AddressSanitizer sees any overrun
+static bool Decode(const uint8_t* src, size_t src_size, size_t dst_size, std::vector<uint8_t>* out = nullptr) {
+    std::unique_ptr<uint8_t[]> input(new uint8_t[src_size ? src_size : 1]);
+    memcpy(input.get(), src, src_size);
+    std::unique_ptr<uint8_t[]> output(new uint8_t[dst_size ? dst_size : 1]);
+    bool ok = Lz4Decompress(input.get(), src_size, output.get(), dst_size);
+    if (ok && out != nullptr) {
+        out->assign(output.get(), output.get() + dst_size);
+    }
+    return ok;
+}
+
+static bool Decode(const std::vector<uint8_t>& src, size_t dst_size, std::vector<uint8_t>* out = nullptr) {
+    return Decode(src.data(), src.size(), dst_size, out);
+}
+
+TEST_CASE(VectorsWereGenerated) {
+    CHECK(Vectors().size() >= 16);
+}
+
+TEST_CASE(DecodesWhatThePackScriptWrites) {
+    for (auto& vector : Vectors()) {
+        std::vector<uint8_t> decoded;
+        bool ok = Decode(vector.compressed, vector.raw.size(), &decoded) && decoded == vector.raw;
+        if (!ok) {
+            printf("  %s: round trip failed\n", vector.name.c_str());
+        }
+        CHECK(ok);
+        printf("  %-40s %7zu -> %7zu bytes\n", vector.name.c_str(), vector.raw.size(), vector.compressed.size());
+    }
+}
+
+TEST_CASE(RejectsTruncatedBlocks) {
+    for (auto& vector : Vectors()) {
+        size_t size = vector.compressed.size();
+        size_t step = size > 400 ? size / 200 : 1;
+        int accepted = 0;
+        for (size_t length = 0; length < size; length += (size - length > 20 ? step : 1)) {
+            if (Decode(vector.compressed.data(), length, vector.raw.size())) {
+                accepted++;
+            }
+        }
+        if (accepted > 0) {
+            printf("  %s: %d truncated blocks accepted\n", vector.name.c_str(), accepted);
+        }
+        CHECK_EQ(accepted, 0);
+    }
+}
+
+TEST_CASE(RejectsWrongOutputSize) {
+    for (auto& vector : Vectors()) {
+        if (!vector.raw.empty()) {
+            CHECK(!Decode(vector.compressed, vector.raw.size() - 1));
+        }
+        CHECK(!Decode(vector.compressed, vector.raw.size() + 1));
+    }
+}
+
+TEST_CASE(DecodesOverlappingMatches) {
+    // "ab" then a 10 byte match at offset 2, which reads bytes it is writing
+    std::vector<uint8_t> block = {0x26, 'a', 'b', 0x02, 0x00, 0x00};
+    std::vector<uint8_t> decoded;
+    CHECK(Decode(block, 12, &decoded));
+    CHECK(std::string(decoded.begin(), decoded.end()) == "abababababab");
+
+    // Offset 1 with an extended length: 1 + 4 + 15 + 255 + 3 bytes of 'z'
+    block = {0x1f, 'z', 0x01, 0x00, 0xff, 0x03, 0x00};
+    CHECK(Decode(block, 1 + 4 + 15 + 255 + 3, &decoded));
+    CHECK(decoded == std::vector<uint8_t>(278, 'z'));
+}
+
+TEST_CASE(RejectsBadOffsets) {
+    // Offset 0, and offsets reaching before the start of the output
+    CHECK(!Decode(std::vector<uint8_t>{0x20, 'a', 'b', 0x00, 0x00, 0x00}, 6));
+    CHECK(!Decode(std::vector<uint8_t>{0x20, 'a', 'b', 0x03, 0x00, 0x00}, 6));
+    CHECK(Decode(std::vector<uint8_t>{0x20, 'a', 'b', 0x02, 0x00, 0x00}, 6));
+    // A match running past the end of the output
+    CHECK(!Decode(std::vector<uint8_t>{0x2f, 'a', 'b', 0x02, 0x00, 0x10, 0x00}, 40));
+    // A length that never ends
+    CHECK(!Decode(std::vector<uint8_t>{0xf0, 0xff, 0xff}, 600));
+}
+
+TEST_CASE(SurvivesCorruptBlocks) {
+    // 每个样本随机改几个字节，解码可以失败但不能越界（AddressSanitizer 检查）。
+    // Flipped literal bytes still decode, the entry CRC catches those when the pack has one
+    std::mt19937 rng(7);
+    int decoded = 0;
+    int rejected = 0;
+    for (auto& vector : Vectors()) {
+        if (vector.compressed.size() < 2) {
+            continue;
+        }
+        for (int round = 0; round < 200; round++) {
+            auto block = vector.compressed;
+            int flips = 1 + rng() % 4;
+            for (int i = 0; i < flips; i++) {
+                block[rng() % block.size()] = (uint8_t)rng();
+            }
+            Decode(block, vector.raw.size()) ? decoded++ : rejected++;
+        }
+    }
+    printf("  corrupt blocks: %d rejected, %d decoded to the right size\n", rejected, decoded);
+    CHECK(rejected > 0);
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""
+Writes LZ4 test vectors for lz4_block_test: files from the tree and synthetic
+data compressed with lz4_compress_block from scripts/build_default_assets.py,
+plus the same data from the lz4 package when it is installed.
+
+Record format, little endian: u32 name length, name, u32 raw length, raw,
+u32 compressed length, compressed.
+"""
+import os
+import random
+import struct
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+sys.path.insert(0, os.path.join(ROOT, 'scripts'))
+from build_default_assets import lz4_compress_block  # noqa: E402
+
+
+def read(path):
+    with open(os.path.join(ROOT, path), 'rb') as f:
+        return f.read()
+
+
+def samples():
+    rng = random.Random(1)
+    noise = bytes(rng.getrandbits(8) for _ in range(70000))
+    yield 'empty', b''
+    yield 'short', b'abc'
+    yield 'twelve bytes', b'abcdabcdabcd'
+    yield 'index.json', read('main/assets/locales/en-US/language.json')
+    yield 'font source', read('main/display/fonts/lv_font_ds_digitb_48.c')
+    yield 'ogg', read('main/assets/common/popup.ogg')
+    # Runs and short periods give matches that overlap their own output
+    yield 'run', b'a' * 1000
+    yield 'period 3', b'xyz' * 5000
+    yield 'period 7 with literals', (b'\x00\x01\x02\x03\x04\x05\x06' * 300 + noise[:40]) * 5
+    # Lengths of exactly 15, 270 and 525 hit the extra length byte boundaries
+    for length in (15, 19, 270, 525):
+        yield f'literals {length} then run', noise[:length] + b'\x55' * length + noise[100:120]
+    yield 'noise', noise[:4096]
+    # Repeats further back than the 64 KiB window must be sent as literals
+    yield 'repeat beyond window', noise + noise[:2000]
+    # Glyph-like bitmaps: sparse bytes with repeated rows
+    glyphs = bytearray()
+    for g in range(200):
+        row = bytes(rng.choice((0, 0, 0, 0x3f, 0xff)) for _ in range(16))
+        glyphs += row * rng.randint(1, 4) + bytes(rng.getrandbits(8) for _ in range(4))
+    yield 'glyph bitmaps', bytes(glyphs)
+
+
+def main():
+    try:
+        import lz4.block
+    except ImportError:
+        lz4 = None
+
+    with open(sys.argv[1], 'wb') as out:
+        def write(name, raw, compressed):
+            encoded = name.encode()
+            out.write(struct.pack('<I', len(encoded)) + encoded)
+            out.write(struct.pack('<I', len(raw)) + raw)
+            out.write(struct.pack('<I', len(compressed)) + compressed)
+
+        for name, raw in samples():
+            write(name, raw, lz4_compress_block(raw))
+            if lz4 is not None:
+                write(name + ' (lz4 package)', raw, lz4.block.compress(raw, store_size=False))
+
+
+if __name__ == '__main__':
+    main()
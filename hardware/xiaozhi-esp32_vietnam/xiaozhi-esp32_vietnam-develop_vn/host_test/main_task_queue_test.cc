@@ -0,0 +1,232 @@
+#include "main_task_queue.h"
+#include "test_check.h"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr size_t kCapacity = 32;     // MAIN_TASK_QUEUE_SIZE default
+
+// Counts the live copies of a callable, so leaks and double destroys show up
+struct Counters {
+    int constructed = 0;
+    int moved = 0;
+    int destroyed = 0;
+    int calls = 0;
+
+    int live() const { return constructed + moved - destroyed; }
+};
+
+template<size_t kPadding>
+struct CountedCallable {
+    Counters* counters;
+    std::array<char, kPadding> padding = {};
+
+    explicit CountedCallable(Counters* counters) : counters(counters) { counters->constructed++; }
+    CountedCallable(const CountedCallable& other) : counters(other.counters), padding(other.padding) {
+        counters->constructed++;
+    }
+    CountedCallable(CountedCallable&& other) noexcept : counters(other.counters), padding(other.padding) {
+        counters->moved++;
+    }
+    ~CountedCallable() { counters->destroyed++; }
+
+    void operator()() { counters->calls++; }
+};
+
+using SmallCallable = CountedCallable<8>;
+using LargeCallable = CountedCallable<64>;
+
+TEST_CASE(SmallTaskStoresSmallCallablesInline) {
+    Counters counters;
+    {
+        SmallTask task{SmallCallable(&counters)};
+        CHECK(task.is_inline());
+        task();
+        CHECK_EQ(counters.calls, 1);
+
+        // Moving an inline task moves the callable and destroys the source copy
+        SmallTask moved(std::move(task));
+        CHECK(!task);
+        CHECK(moved.is_inline());
+        moved();
+        CHECK_EQ(counters.calls, 2);
+        CHECK_EQ(counters.live(), 1);
+    }
+    CHECK_EQ(counters.live(), 0);
+}
+
+TEST_CASE(SmallTaskMovesLargeCallablesByPointer) {
+    Counters counters;
+    {
+        SmallTask task{LargeCallable(&counters)};
+        CHECK(!task.is_inline());
+        int moves = counters.moved;
+
+        // 堆上的任务只移动指针，不拷贝也不移动可调用对象本身
+        SmallTask moved(std::move(task));
+        SmallTask assigned;
+        assigned = std::move(moved);
+        CHECK_EQ(counters.moved, moves);
+        CHECK(!task);
+        CHECK(!moved);
+        assigned();
+        CHECK_EQ(counters.calls, 1);
+        CHECK_EQ(counters.live(), 1);
+    }
+    CHECK_EQ(counters.live(), 0);
+}
+
+TEST_CASE(SmallTaskAssignmentDestroysPrevious) {
+    Counters first;
+    Counters second;
+    SmallTask task{SmallCallable(&first)};
+    task = SmallTask{LargeCallable(&second)};
+    CHECK_EQ(first.live(), 0);
+    CHECK_EQ(second.live(), 1);
+    task.Reset();
+    CHECK(!task);
+    CHECK_EQ(second.live(), 0);
+
+    // A std::string capture fits inline
+    std::string text = "hello";
+    SmallTask capture([text, &first]() { first.calls += static_cast<int>(text.size()); });
+    CHECK(capture.is_inline());
+    capture();
+    CHECK_EQ(first.calls, 5);
+}
+
+TEST_CASE(KeepsOrderThroughRingAndOverflow) {
+    MainTaskQueue queue(kCapacity);
+    std::vector<int> order;
+
+    // 先绕环一圈，让 head 不在 0
+    for (int i = 0; i < 20; i++) {
+        queue.Push([&order, i]() { order.push_back(i); }, nullptr);
+    }
+    CHECK(!queue.RunPending());
+
+    // Fills the ring and spills 68 tasks into the overflow list
+    for (int i = 20; i < 120; i++) {
+        queue.Push([&order, i]() { order.push_back(i); }, nullptr);
+    }
+    auto stats = queue.TakeStats();
+    CHECK_EQ(stats.overflows, 120u - 20 - kCapacity);
+    CHECK_EQ(stats.high_water, 100u);
+    CHECK_EQ(stats.heap_tasks, 0u);
+
+    CHECK(!queue.RunPending());
+    CHECK_EQ(order.size(), 120u);
+    bool in_order = true;
+    for (int i = 0; i < static_cast<int>(order.size()); i++) {
+        in_order = in_order && order[i] == i;
+    }
+    CHECK(in_order);
+    CHECK_EQ(queue.TakeStats().tasks, 100u);
+}
+
+TEST_CASE(PushesBehindOverflowWhileRingDrains) {
+    MainTaskQueue queue(4);
+    std::vector<int> order;
+    auto record = [&order](int i) {
+        return [&order, i]() { order.push_back(i); };
+    };
+
+    // The ring has room again once the first task has run, a push from it
+    // must still queue behind the two spilled tasks
+    queue.Push([&]() {
+        order.push_back(0);
+        queue.Push(record(6), nullptr);
+    }, nullptr);
+    for (int i = 1; i < 6; i++) {
+        queue.Push(record(i), nullptr);
+    }
+    CHECK(queue.RunPending());      // Task 6 was pushed during the round and waits for the next
+    CHECK_EQ(order.size(), 6u);
+    CHECK(!queue.RunPending());
+
+    std::vector<int> expected = {0, 1, 2, 3, 4, 5, 6};
+    CHECK(order == expected);
+}
+
+TEST_CASE(RunPendingOnlyRunsTasksQueuedBeforeTheCall) {
+    MainTaskQueue queue(kCapacity);
+    int runs = 0;
+
+    // A task that keeps rescheduling itself runs once per round
+    std::function<void()> again = [&]() {
+        runs++;
+        queue.Push([&]() { again(); }, nullptr);
+    };
+    queue.Push([&]() { again(); }, nullptr);
+    int others = 0;
+    queue.Push([&]() { others++; }, nullptr);
+
+    for (int round = 1; round <= 5; round++) {
+        CHECK(queue.RunPending());
+        CHECK_EQ(runs, round);
+    }
+    CHECK_EQ(others, 1);
+}
+
+TEST_CASE(CountsHeapTasksAndReleasesThem) {
+    Counters counters;
+    {
+        MainTaskQueue queue(2);
+        for (int i = 0; i < 5; i++) {
+            queue.Push(LargeCallable(&counters), nullptr);
+        }
+        CHECK_EQ(queue.TakeStats().heap_tasks, 5u);
+        CHECK(!queue.RunPending());
+        CHECK_EQ(counters.calls, 5);
+        // RunPending 跑完就释放任务，不留在槽里
+        CHECK_EQ(counters.live(), 0);
+
+        // Tasks never run are destroyed with the queue
+        queue.Push(LargeCallable(&counters), nullptr);
+        queue.Push(SmallCallable(&counters), nullptr);
+        queue.Push(SmallCallable(&counters), nullptr);
+    }
+    CHECK_EQ(counters.live(), 0);
+}
+
+TEST_CASE(KeepsEachProducersOrder) {
+    const int kProducers = 4;
+    const int kTasksEach = 5000;
+    MainTaskQueue queue(kCapacity);
+    std::vector<int> last(kProducers, -1);
+    std::atomic<int> done_producers{0};
+    int ran = 0;
+    bool ordered = true;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; p++) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < kTasksEach; i++) {
+                queue.Push([&, p, i]() {
+                    ordered = ordered && last[p] == i - 1;
+                    last[p] = i;
+                    ran++;
+                }, nullptr);
+            }
+            done_producers++;
+        });
+    }
+    while (done_producers < kProducers || queue.RunPending()) {
+        queue.RunPending();
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    while (queue.RunPending()) {
+    }
+
+    CHECK(ordered);
+    CHECK_EQ(ran, kProducers * kTasksEach);
+}
+
+int main() {
+    return RunTests();
+}
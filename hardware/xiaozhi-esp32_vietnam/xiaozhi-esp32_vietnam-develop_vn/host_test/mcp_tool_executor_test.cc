@@ -0,0 +1,264 @@
+#include "mcp_tool_executor.h"
+#include "test_check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// One-shot event a fake tool can block on
+class Gate {
+public:
+    void Open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = true;
+        cv_.notify_all();
+    }
+    bool Wait(std::chrono::milliseconds timeout = 5000ms) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [this]() { return open_; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool open_ = false;
+};
+
+// The board side of the executor: a main loop run by the test, the sent
+// replies and the spawned workers
+class FakePlatform {
+public:
+    struct Spawn {
+        std::string name;
+        size_t stack_size;
+    };
+
+    McpToolExecutor::Callbacks callbacks() {
+        return {
+            .run_on_main = [this](McpToolExecutor::Task task) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                main_loop_.push_back(std::move(task));
+            },
+            .send = [this](std::string payload) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                sent_.push_back(std::move(payload));
+                cv_.notify_all();
+            },
+            .spawn = [this](const char* name, size_t stack_size, McpToolExecutor::Task body) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                spawns_.push_back({name, stack_size});
+                return std::thread(std::move(body));
+            },
+        };
+    }
+
+    // Runs the main loop tasks queued so far
+    void RunMainLoop() {
+        std::deque<McpToolExecutor::Task> tasks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks.swap(main_loop_);
+        }
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+
+    bool WaitForReplies(size_t count, std::chrono::milliseconds timeout = 5000ms) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [this, count]() { return sent_.size() >= count; });
+    }
+
+    std::vector<std::string> sent() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sent_;
+    }
+
+    std::vector<Spawn> spawns() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return spawns_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<McpToolExecutor::Task> main_loop_;
+    std::vector<std::string> sent_;
+    std::vector<Spawn> spawns_;
+};
+
+static McpToolExecutor::Job Returns(std::string payload) {
+    return [payload]() { return payload; };
+}
+
+TEST_CASE(MainThreadToolsRunOnTheMainLoop) {
+    FakePlatform platform;
+    McpToolExecutor executor(platform.callbacks());
+    CHECK(executor.Submit(kMcpToolMainThread, Returns("a")));
+    CHECK(platform.sent().empty());
+
+    platform.RunMainLoop();
+    CHECK(platform.sent() == std::vector<std::string>{"a"});
+    // 只用主线程工具的板子不创建工作线程
+    CHECK(platform.spawns().empty());
+}
+
+TEST_CASE(SlowToolDoesNotHoldBackLaterReplies) {
+    FakePlatform platform;
+    McpToolExecutor executor(platform.callbacks());
+    Gate photo_taken;
+
+    // take_photo on the worker pool blocks, the calls after it still reply
+    CHECK(executor.Submit(kMcpToolBackground, [&]() {
+        photo_taken.Wait();
+        return std::string("photo");
+    }));
+    CHECK(executor.Submit(kMcpToolMainThread, Returns("volume")));
+    executor.Reply("tools/list");
+    platform.RunMainLoop();
+    CHECK(platform.WaitForReplies(2));
+    CHECK((platform.sent() == std::vector<std::string>{"tools/list", "volume"}));
+
+    photo_taken.Open();
+    CHECK(platform.WaitForReplies(3));
+    CHECK(platform.sent().back() == "photo");
+}
+
+TEST_CASE(RejectsWhenTheQueueIsFull) {
+    FakePlatform platform;
+    McpToolExecutor executor(platform.callbacks(), 2, 2);
+    Gate started;
+    Gate release;
+
+    // One call running on the I/O worker, two queued behind it
+    CHECK(executor.Submit(kMcpToolIo, [&]() {
+        started.Open();
+        release.Wait();
+        return std::string("0");
+    }));
+    CHECK(started.Wait());
+    CHECK(executor.Submit(kMcpToolIo, Returns("1")));
+    CHECK(executor.Submit(kMcpToolIo, Returns("2")));
+    CHECK(!executor.Submit(kMcpToolIo, Returns("rejected")));
+
+    // The pools have separate queues, main thread tools are never rejected
+    CHECK(executor.Submit(kMcpToolBackground, Returns("bg")));
+    CHECK(executor.Submit(kMcpToolMainThread, Returns("main")));
+    platform.RunMainLoop();
+
+    release.Open();
+    CHECK(platform.WaitForReplies(5));
+    CHECK(executor.Submit(kMcpToolIo, Returns("3")));
+    CHECK(platform.WaitForReplies(6));
+
+    auto sent = platform.sent();
+    CHECK(std::find(sent.begin(), sent.end(), "rejected") == sent.end());
+    // The I/O worker runs its calls one at a time in submission order
+    std::vector<std::string> io;
+    for (auto& payload : sent) {
+        if (payload.size() == 1) {
+            io.push_back(payload);
+        }
+    }
+    CHECK((io == std::vector<std::string>{"0", "1", "2", "3"}));
+}
+
+TEST_CASE(IoToolsNeverOverlap) {
+    FakePlatform platform;
+    McpToolExecutor executor(platform.callbacks(), 2, 8);
+    std::mutex mutex;
+    int running = 0;
+    int max_running = 0;
+
+    for (int i = 0; i < 8; i++) {
+        CHECK(executor.Submit(kMcpToolIo, [&]() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                max_running = std::max(max_running, ++running);
+            }
+            std::this_thread::sleep_for(2ms);
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            return std::string("io");
+        }));
+    }
+    CHECK(platform.WaitForReplies(8));
+    CHECK_EQ(max_running, 1);
+    CHECK_EQ(platform.spawns().size(), 1u);
+}
+
+TEST_CASE(SpawnsWorkersOnDemandUpToTheLimit) {
+    FakePlatform platform;
+    McpToolExecutor executor(platform.callbacks(), 2, 4, 12288, 6144);
+    Gate release;
+    Gate started[2];
+
+    for (int i = 0; i < 2; i++) {
+        CHECK(executor.Submit(kMcpToolBackground, [&, i]() {
+            started[i].Open();
+            release.Wait();
+            return std::string("bg");
+        }));
+    }
+    // Both calls run at the same time, so two workers were started
+    CHECK(started[0].Wait());
+    CHECK(started[1].Wait());
+    for (int i = 0; i < 4; i++) {
+        CHECK(executor.Submit(kMcpToolBackground, Returns("bg")));
+    }
+    CHECK(executor.Submit(kMcpToolIo, Returns("io")));
+    release.Open();
+    CHECK(platform.WaitForReplies(7));
+
+    auto spawns = platform.spawns();
+    CHECK_EQ(spawns.size(), 3u);
+    int background = 0;
+    for (auto& spawn : spawns) {
+        if (spawn.name == "mcp_bg") {
+            background++;
+            CHECK_EQ(spawn.stack_size, 12288u);
+        } else {
+            CHECK(spawn.name == "mcp_io");
+            CHECK_EQ(spawn.stack_size, 6144u);
+        }
+    }
+    CHECK_EQ(background, 2);
+}
+
+TEST_CASE(RecordsLatency) {
+    FakePlatform platform;
+    McpToolExecutor executor(platform.callbacks());
+    McpLatencyHistogram latency;
+    CHECK(executor.Submit(kMcpToolBackground, []() {
+        std::this_thread::sleep_for(20ms);
+        return std::string("slow");
+    }, &latency));
+    CHECK(executor.Submit(kMcpToolMainThread, Returns("fast"), &latency));
+    platform.RunMainLoop();
+    CHECK(platform.WaitForReplies(2));
+
+    CHECK_EQ(latency.total_count(), 2u);
+    CHECK_EQ(latency.count(0), 1u);
+    CHECK(latency.max_ms() >= 20);
+}
+
+TEST_CASE(DestructorStopsIdleWorkers) {
+    FakePlatform platform;
+    {
+        McpToolExecutor executor(platform.callbacks());
+        CHECK(executor.Submit(kMcpToolBackground, Returns("bg")));
+        CHECK(executor.Submit(kMcpToolIo, Returns("io")));
+        CHECK(platform.WaitForReplies(2));
+    }
+    CHECK_EQ(platform.spawns().size(), 2u);
+}
+
+int main() {
+    return RunTests();
+}
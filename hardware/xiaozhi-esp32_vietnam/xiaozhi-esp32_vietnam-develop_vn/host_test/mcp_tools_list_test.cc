@@ -0,0 +1,242 @@
+#include "mcp_server.h"
+#include "mcp_tools_list.h"
+#include "test_check.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The tools/list builder from before the pages were cached, serializing every
+// tool on every request. The cached pages must match it byte for byte.
+static bool OldGetToolsList(const std::vector<McpTool*>& tools_, const std::string& cursor, bool list_user_only_tools,
+                            size_t max_payload_size, std::string& result, std::string& error) {
+    std::string json = "{\"tools\":[";
+
+    bool found_cursor = cursor.empty();
+    auto it = tools_.begin();
+    std::string next_cursor = "";
+
+    while (it != tools_.end()) {
+        if (!found_cursor) {
+            if ((*it)->name() == cursor) {
+                found_cursor = true;
+            } else {
+                ++it;
+                continue;
+            }
+        }
+
+        if (!list_user_only_tools && (*it)->user_only()) {
+            ++it;
+            continue;
+        }
+
+        std::string tool_json = (*it)->to_json() + ",";
+        if (json.length() + tool_json.length() + 30 > max_payload_size) {
+            next_cursor = (*it)->name();
+            break;
+        }
+
+        json += tool_json;
+        ++it;
+    }
+
+    if (json.back() == ',') {
+        json.pop_back();
+    }
+
+    if (json.back() == '[' && !tools_.empty()) {
+        error = "Failed to add tool " + next_cursor + " because of payload size limit";
+        return false;
+    }
+
+    if (next_cursor.empty()) {
+        json += "]}";
+    } else {
+        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    }
+    result = json;
+    return true;
+}
+
+// The tool list as McpServer keeps it
+class Tools {
+public:
+    void Add(const std::string& name, const std::string& description, bool user_only = false) {
+        PropertyList properties;
+        properties.AddProperty(Property("volume", kPropertyTypeInteger, 50, 0, 100));
+        if (description.size() % 3 == 0) {
+            properties.AddProperty(Property("text", kPropertyTypeString));
+        }
+        auto tool = std::make_unique<McpTool>(name, description, properties,
+                                              [](const PropertyList&) -> ReturnValue { return true; });
+        tool->set_user_only(user_only);
+        index.emplace(name, tools.size());
+        tools.push_back(tool.get());
+        owned_.push_back(std::move(tool));
+    }
+
+    std::vector<McpTool*> tools;
+    std::unordered_map<std::string, size_t> index;
+
+private:
+    std::vector<std::unique_ptr<McpTool>> owned_;
+};
+
+static std::string Description(std::mt19937& rng, size_t min, size_t max) {
+    size_t length = min + rng() % (max - min + 1);
+    // Quotes, backslashes and newlines are escaped, so the JSON is longer than the text
+    static const std::string kLetters = "Sets the speaker volume \"0-100\" \\\n";
+    std::string text;
+    while (text.size() < length) {
+        text += kLetters[rng() % kLetters.size()];
+    }
+    return text;
+}
+
+// Every cursor a client can send: empty, each tool name (page boundaries and
+// not), a name that does not exist
+static std::vector<std::string> Cursors(const Tools& tools) {
+    std::vector<std::string> cursors = {"", "no_such_tool"};
+    for (auto tool : tools.tools) {
+        cursors.push_back(tool->name());
+    }
+    return cursors;
+}
+
+// Compares every cursor, with and without user only tools, returns the number of differences
+static int CompareAll(McpToolsList& list, const Tools& tools, size_t max_payload_size) {
+    int differences = 0;
+    for (bool user_only : {false, true}) {
+        for (const auto& cursor : Cursors(tools)) {
+            std::string result, error, old_result, old_error;
+            bool ok = list.Get(cursor, user_only, result, error);
+            bool old_ok = OldGetToolsList(tools.tools, cursor, user_only, max_payload_size, old_result, old_error);
+            if (ok != old_ok || result != old_result || error != old_error) {
+                if (differences++ == 0) {
+                    printf("  max %zu, cursor \"%s\"%s:\n    cached %s\n    old    %s\n", max_payload_size,
+                           cursor.c_str(), user_only ? " with user tools" : "",
+                           (ok ? result : error).substr(0, 300).c_str(),
+                           (old_ok ? old_result : old_error).substr(0, 300).c_str());
+                }
+            }
+        }
+    }
+    return differences;
+}
+
+TEST_CASE(MatchesOldListAtEveryPageSize) {
+    // Sweeping the limit one byte at a time puts a page boundary on every tool,
+    // exactly at the limit and one byte either side of it
+    std::mt19937 rng(36);
+    Tools tools;
+    for (int i = 0; i < 24; i++) {
+        tools.Add("self.tool_" + std::to_string(i), Description(rng, 20, 400), i % 5 == 3);
+    }
+    int differences = 0;
+    int sizes = 0;
+    for (size_t max = 100; max <= 4000; max++) {
+        McpToolsList list(tools.tools, tools.index, max);
+        differences += CompareAll(list, tools, max);
+        sizes++;
+    }
+    printf("  %d page sizes, %zu cursors each\n", sizes, 2 * Cursors(tools).size());
+    CHECK_EQ(differences, 0);
+}
+
+TEST_CASE(MatchesOldListWithDeviceLimit) {
+    std::mt19937 rng(7);
+    Tools tools;
+    for (int i = 0; i < 80; i++) {
+        tools.Add("self.device.tool_" + std::to_string(i), Description(rng, 50, 900), i % 7 == 0);
+    }
+    McpToolsList list(tools.tools, tools.index);
+    CHECK_EQ(CompareAll(list, tools, McpToolsList::kMaxPayloadSize), 0);
+    CHECK(list.page_count(false) > 3);
+
+    // Following nextCursor walks every tool the AI may see exactly once
+    std::string cursor;
+    int listed = 0;
+    for (int page = 0; page < 100; page++) {
+        std::string result, error;
+        CHECK(list.Get(cursor, false, result, error));
+        CHECK(result.size() <= McpToolsList::kMaxPayloadSize);
+        for (size_t pos = 0; (pos = result.find("\"name\":", pos)) != std::string::npos; pos++) {
+            listed++;
+        }
+        size_t next = result.find("\"nextCursor\":\"");
+        if (next == std::string::npos) {
+            break;
+        }
+        next += 14;
+        cursor = result.substr(next, result.find('"', next) - next);
+    }
+    CHECK_EQ(listed, 80 - 12);
+}
+
+TEST_CASE(EdgeCases) {
+    // No tools at all
+    Tools empty;
+    McpToolsList empty_list(empty.tools, empty.index);
+    std::string result, error;
+    CHECK(empty_list.Get("", false, result, error));
+    CHECK(result == "{\"tools\":[]}");
+    CHECK_EQ(CompareAll(empty_list, empty, McpToolsList::kMaxPayloadSize), 0);
+
+    // Only user only tools, listed without them
+    Tools hidden;
+    hidden.Add("self.user.a", "a", true);
+    hidden.Add("self.user.b", "b", true);
+    McpToolsList hidden_list(hidden.tools, hidden.index);
+    CHECK_EQ(CompareAll(hidden_list, hidden, McpToolsList::kMaxPayloadSize), 0);
+
+    // A tool larger than a page: the pages before it are served, the one starting at it is an error
+    std::mt19937 rng(3);
+    Tools large;
+    large.Add("self.small", "small");
+    large.Add("self.huge", Description(rng, 9000, 9000));
+    large.Add("self.after", "after");
+    McpToolsList large_list(large.tools, large.index);
+    CHECK_EQ(CompareAll(large_list, large, McpToolsList::kMaxPayloadSize), 0);
+    CHECK(large_list.Get("", false, result, error));
+    CHECK(result.find("\"nextCursor\":\"self.huge\"") != std::string::npos);
+    CHECK(!large_list.Get("self.huge", false, result, error));
+    CHECK(error == "Failed to add tool self.huge because of payload size limit");
+}
+
+TEST_CASE(PagesAreRebuiltWhenAToolIsAdded) {
+    std::mt19937 rng(11);
+    Tools tools;
+    for (int i = 0; i < 30; i++) {
+        tools.Add("self.tool_" + std::to_string(i), Description(rng, 100, 600));
+    }
+    McpToolsList list(tools.tools, tools.index, 3000);
+    CHECK_EQ(CompareAll(list, tools, 3000), 0);
+    size_t pages = list.page_count(false);
+
+    // Board tools are added after the common tools, possibly after a tools/list
+    for (int i = 0; i < 10; i++) {
+        tools.Add("board.tool_" + std::to_string(i), Description(rng, 100, 600), i == 4);
+        CHECK_EQ(CompareAll(list, tools, 3000), 0);
+    }
+    CHECK(list.page_count(false) > pages);
+
+    // A reordered list has the same count, the server invalidates the pages
+    std::string before, after, error;
+    CHECK(list.Get("", false, before, error));
+    std::swap(tools.tools[0], tools.tools[1]);
+    tools.index.clear();
+    for (size_t i = 0; i < tools.tools.size(); i++) {
+        tools.index.emplace(tools.tools[i]->name(), i);
+    }
+    list.Invalidate();
+    CHECK(list.Get("", false, after, error));
+    CHECK(before != after);
+    CHECK_EQ(CompareAll(list, tools, 3000), 0);
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,267 @@
+#include "ota_delta.h"
+#include "test_check.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Written by ota_delta_vectors.py at build time
+struct Vector {
+    std::string name;
+    std::vector<uint8_t> base;
+    std::vector<uint8_t> target;
+    std::vector<uint8_t> patch;
+};
+
+static std::vector<Vector> LoadVectors() {
+    std::vector<Vector> vectors;
+    FILE* file = fopen(OTA_DELTA_VECTORS_FILE, "rb");
+    if (file == nullptr) {
+        return vectors;
+    }
+    auto read_block = [file](std::vector<uint8_t>& data) {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, file) != 1) {
+            return false;
+        }
+        data.resize(length);
+        return length == 0 || fread(data.data(), 1, length, file) == length;
+    };
+    while (true) {
+        Vector vector;
+        std::vector<uint8_t> name;
+        if (!read_block(name) || !read_block(vector.base) || !read_block(vector.target) ||
+            !read_block(vector.patch)) {
+            break;
+        }
+        vector.name.assign(name.begin(), name.end());
+        vectors.push_back(std::move(vector));
+    }
+    fclose(file);
+    return vectors;
+}
+
+static const std::vector<Vector>& Vectors() {
+    static std::vector<Vector> vectors = LoadVectors();
+    return vectors;
+}
+
+static const Vector& Find(const char* name) {
+    for (auto& vector : Vectors()) {
+        if (vector.name == name) {
+            return vector;
+        }
+    }
+    fprintf(stderr, "missing test vector %s\n", name);
+    exit(1);
+}
+
+static constexpr uint32_t kPartitionSize = 0x3f0000;     // ota_0 in partitions/v2/16m.csv
+
+struct Result {
+    bool fed = true;        // Every Feed returned true
+    bool finished = false;
+    std::vector<uint8_t> output;
+    size_t output_calls = 0;
+};
+
+// Feeds the patch in pieces of the given sizes, cycling through them, the way
+// it arrives from the network. The running partition is larger than the base
+// image and reads as erased flash after it.
+static Result Apply(std::vector<uint8_t> base, const std::vector<uint8_t>& patch, std::vector<size_t> pieces,
+                    size_t fail_read_at = SIZE_MAX, size_t reject_output_after = SIZE_MAX) {
+    esp_partition_t partition = FakePartition("ota_0", &base, kPartitionSize);
+    partition.fail_read_at = fail_read_at;
+    Result result;
+    OtaDelta delta(&partition, [&](const uint8_t* data, size_t length) {
+        if (result.output.size() + length > reject_output_after) {
+            return false;
+        }
+        result.output.insert(result.output.end(), data, data + length);
+        result.output_calls++;
+        return true;
+    });
+    size_t pos = 0;
+    for (size_t i = 0; pos < patch.size() && result.fed; i++) {
+        size_t n = std::min(pieces[i % pieces.size()], patch.size() - pos);
+        result.fed = delta.Feed(patch.data() + pos, n);
+        pos += n;
+    }
+    result.finished = delta.finished();
+    return result;
+}
+
+TEST_CASE(VectorsWereGenerated) {
+    CHECK(Vectors().size() >= 6);
+    CHECK(Find("release").patch.size() > 44);
+}
+
+TEST_CASE(AppliesWhatTheDiffScriptWrites) {
+    for (auto& vector : Vectors()) {
+        CHECK(OtaDelta::IsDelta(vector.patch.data(), vector.patch.size()));
+        Result result = Apply(vector.base, vector.patch, {vector.patch.size()});
+        bool ok = result.fed && result.finished && result.output == vector.target;
+        if (!ok) {
+            printf("  %s: patch did not reproduce the target\n", vector.name.c_str());
+        }
+        CHECK(ok);
+        printf("  %-20s target %7zu bytes, patch %6zu bytes (%.1f%%)\n", vector.name.c_str(), vector.target.size(),
+               vector.patch.size(), vector.target.empty() ? 0.0 : vector.patch.size() * 100.0 / vector.target.size());
+    }
+}
+
+TEST_CASE(AppliesPatchSplitAnywhere) {
+    // 网络读到多少就喂多少：varint、ADD 字面量和 DATA 都可能被切开
+    std::mt19937 rng(5);
+    for (auto& vector : Vectors()) {
+        std::vector<size_t> random_pieces;
+        for (int i = 0; i < 64; i++) {
+            random_pieces.push_back(1 + rng() % 1500);
+        }
+        for (auto pieces : {std::vector<size_t>{1}, std::vector<size_t>{3, 1, 44}, random_pieces}) {
+            Result result = Apply(vector.base, vector.patch, pieces);
+            bool ok = result.fed && result.finished && result.output == vector.target;
+            if (!ok) {
+                printf("  %s: failed with pieces of %zu bytes\n", vector.name.c_str(), pieces[0]);
+            }
+            CHECK(ok);
+        }
+    }
+}
+
+TEST_CASE(RejectsPatchForAnotherBase) {
+    auto& vector = Find("release");
+    auto base = vector.base;
+    base[base.size() / 2] ^= 0x01;
+    Result result = Apply(base, vector.patch, {vector.patch.size()});
+    CHECK(!result.fed);
+    CHECK(!result.finished);
+    CHECK(result.output.empty());
+
+    // Base image larger than the running partition
+    auto patch = vector.patch;
+    uint32_t too_large = kPartitionSize + 1;
+    memcpy(&patch[4], &too_large, sizeof(too_large));
+    result = Apply(vector.base, patch, {patch.size()});
+    CHECK(!result.fed);
+    CHECK(result.output.empty());
+}
+
+TEST_CASE(RejectsMalformedPatches) {
+    auto& vector = Find("release");
+
+    auto bad_magic = vector.patch;
+    bad_magic[3] = '2';
+    CHECK(!OtaDelta::IsDelta(bad_magic.data(), bad_magic.size()));
+    CHECK(!Apply(vector.base, bad_magic, {bad_magic.size()}).fed);
+
+    // The first op follows the 44-byte header
+    auto unknown_op = vector.patch;
+    unknown_op[44] = 0x07;
+    Result result = Apply(vector.base, unknown_op, {unknown_op.size()});
+    CHECK(!result.fed);
+    CHECK(result.output.empty());
+
+    // COPY of the last bytes of the base image and one more
+    std::vector<uint8_t> copy_past_end(vector.patch.begin(), vector.patch.begin() + 44);
+    uint32_t base_size = vector.base.size();
+    uint32_t src = base_size - 10;
+    copy_past_end.push_back(0x01);
+    while (src >= 0x80) {
+        copy_past_end.push_back((src & 0x7F) | 0x80);
+        src >>= 7;
+    }
+    copy_past_end.push_back(src);
+    copy_past_end.push_back(11);
+    copy_past_end.push_back(0x00);
+    result = Apply(vector.base, copy_past_end, {copy_past_end.size()});
+    CHECK(!result.fed);
+    CHECK(result.output.empty());
+
+    // A varint longer than 32 bits
+    std::vector<uint8_t> long_varint(vector.patch.begin(), vector.patch.begin() + 44);
+    long_varint.push_back(0x03);
+    long_varint.insert(long_varint.end(), 6, 0xFF);
+    CHECK(!Apply(vector.base, long_varint, {1}).fed);
+
+    auto trailing = vector.patch;
+    trailing.push_back(0x00);
+    result = Apply(vector.base, trailing, {trailing.size()});
+    CHECK(!result.fed);
+}
+
+TEST_CASE(TruncatedPatchIsNotFinished) {
+    auto& vector = Find("release");
+    // Each of the first 200 cut points and every 97th after: no overrun, never a complete image
+    for (size_t cut = 0; cut < vector.patch.size(); cut += cut < 200 ? 1 : 97) {
+        std::vector<uint8_t> truncated(vector.patch.begin(), vector.patch.begin() + cut);
+        Result result = Apply(vector.base, truncated, {truncated.size() ? truncated.size() : 1});
+        CHECK(!result.finished);
+        CHECK(result.output.size() <= vector.target.size());
+    }
+}
+
+TEST_CASE(CorruptedPatchNeverPassesAsTheTarget) {
+    // A flipped byte either breaks the op stream or changes the output, which is
+    // then left to the firmware SHA-256 and esp_ota_end in ota.cc to reject
+    auto& vector = Find("release");
+    std::mt19937 rng(9);
+    int rejected = 0;
+    int wrong_output = 0;
+    for (int i = 0; i < 2000; i++) {
+        auto patch = vector.patch;
+        size_t pos = 44 + rng() % (patch.size() - 44);
+        patch[pos] ^= 1 << (rng() % 8);
+        Result result = Apply(vector.base, patch, {1 + rng() % 2048});
+        CHECK(result.output.size() <= vector.target.size());
+        if (!result.fed || !result.finished) {
+            rejected++;
+        } else {
+            CHECK(result.output != vector.target);
+            wrong_output++;
+        }
+    }
+    printf("  2000 corrupted patches: %d rejected by the decoder, %d left to the image hash\n", rejected,
+           wrong_output);
+    CHECK(rejected > 0);
+}
+
+TEST_CASE(StopsOnBaseReadOrOutputFailure) {
+    auto& vector = Find("release");
+    Result result = Apply(vector.base, vector.patch, {vector.patch.size()}, vector.base.size() / 2);
+    CHECK(!result.fed);
+    CHECK(!result.finished);
+
+    // esp_ota_write failing part way through
+    result = Apply(vector.base, vector.patch, {4096}, SIZE_MAX, 100000);
+    CHECK(!result.fed);
+    CHECK(!result.finished);
+    CHECK(result.output.size() <= 100000);
+    CHECK(std::equal(result.output.begin(), result.output.end(), vector.target.begin()));
+}
+
+TEST_CASE(BaseIsReadInSmallBlocks) {
+    // Nothing larger than the 512-byte buffer is read, the whole image is never in RAM
+    auto& vector = Find("same image");
+    std::vector<uint8_t> base = vector.base;
+    esp_partition_t partition = FakePartition("ota_0", &base, kPartitionSize);
+    size_t largest = 0;
+    OtaDelta delta(&partition, [&](const uint8_t* data, size_t length) {
+        largest = std::max(largest, length);
+        return true;
+    });
+    CHECK(delta.Feed(vector.patch.data(), vector.patch.size()));
+    CHECK(delta.finished());
+    CHECK_EQ(delta.target_size(), vector.target.size());
+    CHECK(largest <= 512);
+    // Verifying the base and copying it back out
+    CHECK_EQ(partition.reads, static_cast<int>(2 * ((base.size() + 511) / 512)));
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+Writes delta patch test vectors for ota_delta_test: pairs of images and the
+patch scripts/firmware_delta.py makes between them, checked with its apply().
+
+Record format, little endian: u32 name length, name, u32 base length, base,
+u32 target length, target, u32 patch length, patch.
+"""
+import os
+import random
+import struct
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+sys.path.insert(0, os.path.join(ROOT, 'scripts'))
+from firmware_delta import apply, diff  # noqa: E402
+
+LOAD_ADDRESS = 0x42000000
+
+
+def firmware(rng, functions, strings):
+    """Image made of code-like functions that call each other through absolute
+    addresses, followed by a string table. Returns the image and the functions
+    so a new release can be built from the same parts."""
+    image = bytearray(b'\xe9' + bytes(23))
+    offsets = []
+    for body, calls in functions:
+        offsets.append(len(image))
+        image += body + bytes(4 * len(calls))
+    for i, (body, calls) in enumerate(functions):
+        pos = offsets[i] + len(body)
+        for callee in calls:
+            struct.pack_into('<I', image, pos, LOAD_ADDRESS + offsets[callee])
+            pos += 4
+    for text in strings:
+        image += text.encode() + b'\0'
+    image += bytes(rng.getrandbits(8) for _ in range((-len(image)) % 16))
+    return bytes(image)
+
+
+def release_pair():
+    rng = random.Random(33)
+    # Instruction-like bytes: a small alphabet of opcodes with random operands
+    opcodes = [bytes(rng.getrandbits(8) for _ in range(3)) for _ in range(40)]
+
+    def function():
+        body = b''.join(rng.choice(opcodes)[:2] + bytes([rng.getrandbits(8)]) for _ in range(rng.randint(20, 400)))
+        return body, []
+
+    functions = [function() for _ in range(400)]
+    for body, calls in functions:
+        calls.extend(rng.randrange(len(functions)) for _ in range(rng.randint(0, 6)))
+    strings = [f'component_{i}: state %d, value %s' for i in range(300)] + ['1.6.0']
+    base = firmware(rng, functions, strings)
+
+    # The next release: a new function in the middle moves everything after it,
+    # one function is rewritten, one is deleted and the version string changes
+    new_functions = list(functions)
+    new_functions.insert(150, (function()[0], [3, 10, 200]))
+    new_functions[300] = (function()[0], functions[300][1])
+    del new_functions[350]
+    new_functions = [(body, [c if c < len(new_functions) else 0 for c in calls]) for body, calls in new_functions]
+    new_strings = strings[:-1] + ['wifi: reconnect in %d ms', '1.6.1']
+    target = firmware(rng, new_functions, new_strings)
+    return base, target
+
+
+def pairs():
+    rng = random.Random(1)
+    base, target = release_pair()
+    yield 'release', base, target
+    yield 'same image', base, base
+    yield 'unrelated image', base, bytes(rng.getrandbits(8) for _ in range(20000))
+    yield 'empty target', base, b''
+    yield 'shorter target', base, base[:len(base) // 3]
+    # Every word changed by the same amount, all of it must come out of ADD ops
+    shifted = bytearray(base)
+    for pos in range(24, len(shifted) - 3, 64):
+        value, = struct.unpack_from('<I', shifted, pos)
+        struct.pack_into('<I', shifted, pos, (value + 0x1234) & 0xFFFFFFFF)
+    yield 'relocated words', base, bytes(shifted)
+
+
+def main():
+    with open(sys.argv[1], 'wb') as out:
+        for name, base, target in pairs():
+            patch = diff(base, target)
+            if apply(base, patch) != target:
+                raise RuntimeError(f'{name}: firmware_delta.py does not reproduce the target')
+            for block in (name.encode(), base, target, patch):
+                out.write(struct.pack('<I', len(block)) + block)
+
+
+if __name__ == '__main__':
+    main()
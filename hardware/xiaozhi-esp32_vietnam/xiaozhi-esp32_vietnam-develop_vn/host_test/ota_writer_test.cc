@@ -0,0 +1,264 @@
+#include "ota_writer.h"
+#include "test_check.h"
+
+#include <esp_heap_caps.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static constexpr size_t kChunkSize = 4096;
+static constexpr size_t kChunkCount = 2;
+static constexpr uint32_t kPartitionSize = 0x3f0000;    // ota_1 in partitions/v2/16m.csv
+
+static std::vector<uint8_t> MakeImage(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> image(size);
+    for (auto& byte : image) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return image;
+}
+
+static std::string Sha256(const uint8_t* data, size_t length) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, data, length);
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+    return std::string(reinterpret_cast<char*>(digest), sizeof(digest));
+}
+
+static std::string Hex(const std::string& digest) {
+    std::string hex;
+    char byte[3];
+    for (unsigned char c : digest) {
+        snprintf(byte, sizeof(byte), "%02x", c);
+        hex += byte;
+    }
+    return hex;
+}
+
+// Starts every test with the fakes cleared
+static void Reset() {
+    FakeOta::GetInstance().Reset();
+    FakeTasks::GetInstance().fail_create = false;
+    FakeHeap::GetInstance().failing_caps = 0;
+}
+
+// Feeds image to the writer in pieces of random size, the way HTTP reads and
+// the delta decoder hand them over
+static bool WriteInPieces(OtaWriter& writer, const std::vector<uint8_t>& image, uint32_t seed) {
+    std::mt19937 rng(seed);
+    size_t pos = 0;
+    while (pos < image.size()) {
+        size_t n = std::min<size_t>(1 + rng() % (2 * kChunkSize + 100), image.size() - pos);
+        if (!writer.Write(image.data() + pos, n)) {
+            return false;
+        }
+        pos += n;
+    }
+    return true;
+}
+
+TEST_CASE(Sha256MatchesKnownAnswers) {
+    // The ota.cc check compares against the hex digest sent by the server
+    CHECK(Hex(Sha256(nullptr, 0)) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    const char* abc = "abc";
+    CHECK(Hex(Sha256(reinterpret_cast<const uint8_t*>(abc), 3)) ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    std::string million(1000000, 'a');
+    CHECK(Hex(Sha256(reinterpret_cast<const uint8_t*>(million.data()), million.size())) ==
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST_CASE(WritesImageThroughRecycledChunks) {
+    Reset();
+    auto& ota = FakeOta::GetInstance();
+    ota.write_delay = 200us;        // Flash slower than the network, Write has to wait for chunks
+    int tasks_before = FakeTasks::GetInstance().created;
+    int allocations_before = FakeHeap::GetInstance().allocations;
+
+    auto image = MakeImage(100 * 1024 + 123, 1);
+    std::vector<uint8_t> flash;
+    esp_partition_t partition = FakePartition("ota_1", &flash, kPartitionSize);
+    uint8_t sha256[32];
+    {
+        OtaWriter writer(kChunkSize, kChunkCount);
+        std::vector<uint8_t> first_chunk;
+        writer.on_first_chunk = [&](const uint8_t* data, size_t length) {
+            first_chunk.assign(data, data + length);
+        };
+        CHECK_EQ(writer.Begin(&partition), ESP_OK);
+        CHECK(WriteInPieces(writer, image, 2));
+        CHECK_EQ(writer.Finish(true, sha256), ESP_OK);
+        CHECK_EQ(writer.End(), ESP_OK);
+
+        CHECK(std::equal(first_chunk.begin(), first_chunk.end(), image.begin()));
+        CHECK_EQ(first_chunk.size(), kChunkSize);
+        CHECK(writer.reader_stall_us() > 0);
+    }
+
+    CHECK(flash == image);
+    CHECK(std::string(reinterpret_cast<char*>(sha256), 32) == Sha256(image.data(), image.size()));
+    CHECK_EQ(ota.begins, 1);
+    CHECK_EQ(ota.ends, 1);
+    CHECK_EQ(ota.aborts, 0);
+    CHECK_EQ(FakeTasks::GetInstance().created - tasks_before, 1);
+
+    // Whole chunks except the last, all from the same two buffers
+    CHECK_EQ(ota.writes.size(), (image.size() + kChunkSize - 1) / kChunkSize);
+    std::set<const void*> buffers;
+    bool whole = true;
+    for (size_t i = 0; i < ota.writes.size(); i++) {
+        buffers.insert(ota.writes[i].data);
+        whole = whole && (i + 1 == ota.writes.size() || ota.writes[i].length == kChunkSize);
+    }
+    CHECK(whole);
+    CHECK_EQ(ota.writes.back().length, image.size() % kChunkSize);
+    CHECK_EQ(buffers.size(), kChunkCount);
+    CHECK_EQ(FakeHeap::GetInstance().allocations - allocations_before, static_cast<int>(kChunkCount));
+    CHECK_EQ(FakeHeap::GetInstance().allocations, FakeHeap::GetInstance().frees);
+}
+
+TEST_CASE(HashCoversOnlyWrittenBytes) {
+    // A failed download keeps its partial chunk out of the partition and the hash
+    Reset();
+    auto image = MakeImage(3 * kChunkSize + 1000, 3);
+    std::vector<uint8_t> flash;
+    esp_partition_t partition = FakePartition("ota_1", &flash, kPartitionSize);
+    OtaWriter writer(kChunkSize, kChunkCount);
+    CHECK_EQ(writer.Begin(&partition), ESP_OK);
+    CHECK(writer.Write(image.data(), image.size()));
+    uint8_t sha256[32];
+    CHECK_EQ(writer.Finish(false, sha256), ESP_OK);
+    writer.Abort();
+
+    size_t written = 3 * kChunkSize;
+    CHECK_EQ(flash.size(), written);
+    CHECK(std::equal(flash.begin(), flash.end(), image.begin()));
+    CHECK(std::string(reinterpret_cast<char*>(sha256), 32) == Sha256(image.data(), written));
+    CHECK_EQ(FakeOta::GetInstance().aborts, 1);
+    CHECK_EQ(FakeOta::GetInstance().ends, 0);
+}
+
+TEST_CASE(StopsAfterMidStreamWriteFailure) {
+    Reset();
+    auto& ota = FakeOta::GetInstance();
+    ota.fail_write = 5;
+    ota.write_delay = 100us;
+
+    auto image = MakeImage(64 * kChunkSize, 4);
+    std::vector<uint8_t> flash;
+    esp_partition_t partition = FakePartition("ota_1", &flash, kPartitionSize);
+    OtaWriter writer(kChunkSize, kChunkCount);
+    CHECK_EQ(writer.Begin(&partition), ESP_OK);
+
+    // Write notices the error within the chunks already queued, it does not hang
+    // on the free queue and does not copy the rest of the image
+    size_t accepted = 0;
+    for (size_t pos = 0; pos < image.size(); pos += 1000) {
+        size_t n = std::min<size_t>(1000, image.size() - pos);
+        if (!writer.Write(image.data() + pos, n)) {
+            break;
+        }
+        accepted += n;
+    }
+    CHECK(accepted < image.size());
+    CHECK(accepted <= (6 + kChunkCount + 1) * kChunkSize);
+
+    uint8_t sha256[32];
+    CHECK_EQ(writer.Finish(true, sha256), ESP_ERR_FLASH_OP_FAIL);
+    writer.Abort();
+
+    // No write after the failed one, and the flash holds the five good chunks
+    CHECK_EQ(ota.writes.size(), 6u);
+    CHECK_EQ(flash.size(), 5 * kChunkSize);
+    CHECK(std::equal(flash.begin(), flash.end(), image.begin()));
+    CHECK_EQ(ota.aborts, 1);
+    CHECK_EQ(ota.ends, 0);
+
+    // Writes after the failure are refused straight away
+    CHECK(!writer.Write(image.data(), 10));
+}
+
+TEST_CASE(FailedWriteOfTheLastChunk) {
+    // The error shows up in Finish when nothing was left to write after it
+    Reset();
+    auto& ota = FakeOta::GetInstance();
+    ota.fail_write = 2;
+    auto image = MakeImage(2 * kChunkSize + 10, 5);
+    std::vector<uint8_t> flash;
+    esp_partition_t partition = FakePartition("ota_1", &flash, kPartitionSize);
+    OtaWriter writer(kChunkSize, kChunkCount);
+    CHECK_EQ(writer.Begin(&partition), ESP_OK);
+    CHECK(writer.Write(image.data(), image.size()));
+    uint8_t sha256[32];
+    CHECK_EQ(writer.Finish(true, sha256), ESP_ERR_FLASH_OP_FAIL);
+    CHECK_EQ(ota.writes.size(), 3u);
+}
+
+TEST_CASE(CleansUpWhenBeginFails) {
+    auto& heap = FakeHeap::GetInstance();
+    auto& ota = FakeOta::GetInstance();
+    std::vector<uint8_t> flash;
+    esp_partition_t partition = FakePartition("ota_1", &flash, kPartitionSize);
+
+    // No memory for the chunks: the partition is never opened
+    Reset();
+    heap.failing_caps = MALLOC_CAP_8BIT;
+    {
+        OtaWriter writer(kChunkSize, kChunkCount);
+        CHECK_EQ(writer.Begin(&partition), ESP_ERR_NO_MEM);
+    }
+    CHECK_EQ(ota.begins, 0);
+    heap.failing_caps = 0;
+
+    Reset();
+    ota.begin_error = ESP_ERR_INVALID_ARG;
+    {
+        OtaWriter writer(kChunkSize, kChunkCount);
+        CHECK_EQ(writer.Begin(&partition), ESP_ERR_INVALID_ARG);
+    }
+    CHECK_EQ(ota.aborts, 0);
+    CHECK_EQ(heap.allocations, heap.frees);
+
+    // No writer task: the opened partition is aborted
+    Reset();
+    FakeTasks::GetInstance().fail_create = true;
+    {
+        OtaWriter writer(kChunkSize, kChunkCount);
+        CHECK(writer.Begin(&partition) != ESP_OK);
+    }
+    CHECK_EQ(ota.begins, 1);
+    CHECK_EQ(ota.aborts, 1);
+    CHECK_EQ(heap.allocations, heap.frees);
+    FakeTasks::GetInstance().fail_create = false;
+}
+
+TEST_CASE(DestructorStopsTheWriterTask) {
+    // Upgrade returning early still ends the task and aborts the partition
+    Reset();
+    auto image = MakeImage(5 * kChunkSize, 6);
+    std::vector<uint8_t> flash;
+    esp_partition_t partition = FakePartition("ota_1", &flash, kPartitionSize);
+    {
+        OtaWriter writer(kChunkSize, kChunkCount);
+        CHECK_EQ(writer.Begin(&partition), ESP_OK);
+        CHECK(writer.Write(image.data(), image.size()));
+    }
+    CHECK_EQ(FakeOta::GetInstance().aborts, 1);
+    CHECK_EQ(FakeOta::GetInstance().writes.size(), 5u);
+}
+
+int main() {
+    return RunTests();
+}
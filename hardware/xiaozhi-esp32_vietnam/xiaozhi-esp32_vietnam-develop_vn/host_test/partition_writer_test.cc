@@ -0,0 +1,244 @@
+#include "partition_writer.h"
+#include "test_check.h"
+
+#include <esp_rom_crc.h>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static constexpr size_t kSectorSize = 4096;
+static constexpr size_t kBlockSize = 64 * 1024;
+
+// NOR flash model: erase sets a sector to 0xFF, a write can only clear bits
+class FakeFlash : public FlashRegion {
+public:
+    explicit FakeFlash(size_t size) : data_(size, 0x00) {}
+
+    size_t size() const override { return data_.size(); }
+    size_t sector_size() const override { return kSectorSize; }
+
+    esp_err_t Erase(size_t offset, size_t size) override {
+        if (offset % kSectorSize != 0 || size % kSectorSize != 0 || offset + size > data_.size()) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        lowest_erase = std::min(lowest_erase, offset);
+        memset(&data_[offset], 0xFF, size);
+        return ESP_OK;
+    }
+
+    esp_err_t Write(size_t offset, const void* data, size_t size) override {
+        if (offset + size > data_.size()) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            data_[offset + i] &= bytes[i];
+        }
+        return ESP_OK;
+    }
+
+    esp_err_t Read(size_t offset, void* data, size_t size) override {
+        if (offset + size > data_.size()) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(data, &data_[offset], size);
+        return ESP_OK;
+    }
+
+    uint8_t* raw() { return data_.data(); }
+    bool Matches(const std::vector<uint8_t>& image) const {
+        return memcmp(data_.data(), image.data(), image.size()) == 0;
+    }
+
+    size_t lowest_erase = SIZE_MAX;
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+static std::vector<uint8_t> MakeImage(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> image(size);
+    for (auto& byte : image) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return image;
+}
+
+// Feeds image[from, to) in HTTP sized reads, the last checkpoint is stored in nvs
+static esp_err_t Feed(PartitionWriter& writer, const std::vector<uint8_t>& image, size_t to,
+                      PartitionWriter::State& nvs, size_t read_size = 512) {
+    while (writer.state().offset < to) {
+        size_t chunk = std::min(read_size, to - writer.state().offset);
+        bool committed = false;
+        esp_err_t err = writer.Write(&image[writer.state().offset], chunk, committed);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (committed) {
+            nvs = writer.committed();
+        }
+    }
+    return ESP_OK;
+}
+
+TEST_CASE(WritesWholeImage) {
+    FakeFlash flash(1024 * 1024);
+    auto image = MakeImage(300 * 1024 + 123, 1);
+    PartitionWriter writer(flash, kBlockSize);
+    PartitionWriter::State nvs;
+    nvs.content_length = image.size();
+    writer.Begin(nvs);
+
+    CHECK_EQ(Feed(writer, image, image.size(), nvs), ESP_OK);
+    CHECK(flash.Matches(image));
+    CHECK_EQ(nvs.offset, image.size());
+    CHECK_EQ(nvs.crc, esp_rom_crc32_le(0, image.data(), image.size()));
+    CHECK_EQ(writer.erased_sectors(), (image.size() + kSectorSize - 1) / kSectorSize);
+}
+
+TEST_CASE(CheckpointsAreSectorAligned) {
+    FakeFlash flash(1024 * 1024);
+    auto image = MakeImage(200 * 1024 + 7, 2);
+    PartitionWriter writer(flash, kBlockSize);
+    PartitionWriter::State state;
+    state.content_length = image.size();
+    writer.Begin(state);
+
+    // 不规则的读取长度，断点也必须落在扇区边界或文件末尾
+    std::mt19937 rng(2);
+    size_t offset = 0;
+    while (offset < image.size()) {
+        size_t chunk = std::min<size_t>(1 + rng() % 1500, image.size() - offset);
+        bool committed = false;
+        CHECK_EQ(writer.Write(&image[offset], chunk, committed), ESP_OK);
+        offset += chunk;
+        if (committed) {
+            size_t at = writer.committed().offset;
+            CHECK(at % kSectorSize == 0 || at == image.size());
+        }
+    }
+    CHECK(flash.Matches(image));
+}
+
+TEST_CASE(ResumesFromUnalignedCheckpoint) {
+    // 旧固件按 512 字节读取提交断点，断点可能落在扇区中间
+    FakeFlash flash(1024 * 1024);
+    auto image = MakeImage(100 * 1024, 3);
+    const size_t checkpoint = 3 * kSectorSize + 1234;
+    flash.Erase(0, 4 * kSectorSize);
+    flash.Write(0, image.data(), checkpoint);
+    flash.lowest_erase = SIZE_MAX;
+
+    PartitionWriter::State nvs;
+    nvs.offset = checkpoint;
+    nvs.content_length = image.size();
+    nvs.crc = esp_rom_crc32_le(0, image.data(), checkpoint);
+    CHECK_EQ(PartitionWriter::CalculateCrc(flash, 0, checkpoint, 0), nvs.crc);
+
+    PartitionWriter writer(flash, kBlockSize);
+    writer.Begin(nvs);
+    CHECK_EQ(Feed(writer, image, image.size(), nvs, 700), ESP_OK);
+
+    // 断点前已提交的字节没有被擦除
+    CHECK(flash.lowest_erase >= 4 * kSectorSize);
+    CHECK(flash.Matches(image));
+    CHECK_EQ(nvs.crc, esp_rom_crc32_le(0, image.data(), image.size()));
+}
+
+TEST_CASE(UnalignedCheckpointRecoversFromBadReadback) {
+    // 断点所在扇区的尾部有残留数据时回读失败，回退到扇区起点重新擦除
+    FakeFlash flash(1024 * 1024);
+    auto image = MakeImage(100 * 1024, 4);
+    const size_t checkpoint = 2 * kSectorSize + 100;
+    flash.Erase(0, 3 * kSectorSize);
+    flash.Write(0, image.data(), checkpoint);
+    flash.raw()[checkpoint + 10] = 0x00;
+
+    PartitionWriter::State nvs;
+    nvs.offset = checkpoint;
+    nvs.content_length = image.size();
+    nvs.crc = esp_rom_crc32_le(0, image.data(), checkpoint);
+
+    PartitionWriter writer(flash, kBlockSize);
+    writer.Begin(nvs);
+    esp_err_t err = Feed(writer, image, image.size(), nvs);
+    if (err == ESP_ERR_INVALID_CRC) {
+        CHECK_EQ(writer.state().offset, 2 * kSectorSize);
+        CHECK_EQ(writer.state().crc, esp_rom_crc32_le(0, image.data(), 2 * kSectorSize));
+        err = Feed(writer, image, image.size(), nvs);
+    }
+    CHECK_EQ(err, ESP_OK);
+    CHECK(flash.Matches(image));
+}
+
+TEST_CASE(SurvivesRandomDisconnectsAndReboots) {
+    const size_t image_size = 2 * 1024 * 1024 + 777;
+    FakeFlash flash(4 * 1024 * 1024);
+    auto image = MakeImage(image_size, 5);
+    std::mt19937 rng(5);
+
+    // 分区里原来是旧的资源
+    auto old_image = MakeImage(flash.size(), 6);
+    flash.Erase(0, flash.size());
+    flash.Write(0, old_image.data(), old_image.size());
+
+    PartitionWriter::State nvs;
+    nvs.content_length = image_size;
+    size_t downloaded = 0;
+    int interruptions = 0;
+    int boots = 0;
+
+    while (nvs.offset < image_size && boots < 1000) {
+        // 开机：校验断点，然后从断点继续
+        boots++;
+        if (PartitionWriter::CalculateCrc(flash, 0, nvs.offset, 0) != nvs.crc) {
+            nvs = PartitionWriter::State();
+            nvs.content_length = image_size;
+        }
+        PartitionWriter writer(flash, kBlockSize);
+        writer.Begin(nvs);
+
+        bool reboot = false;
+        while (!reboot && writer.state().offset < image_size) {
+            // 一次连接读取的数据量，之后断线或掉电
+            size_t session = rng() % (3 * kBlockSize);
+            size_t end = std::min(image_size, writer.state().offset + session);
+            while (writer.state().offset < end) {
+                size_t chunk = std::min<size_t>(1 + rng() % 512, end - writer.state().offset);
+                bool committed = false;
+                esp_err_t err = writer.Write(&image[writer.state().offset], chunk, committed);
+                CHECK(err == ESP_OK || err == ESP_ERR_INVALID_CRC);
+                downloaded += chunk;
+                if (committed) {
+                    nvs = writer.committed();
+                }
+                // 偶尔模拟写入出错的位
+                if (rng() % 5000 == 0 && writer.state().offset > writer.committed().offset) {
+                    flash.raw()[writer.state().offset - 1] ^= 0x01;
+                }
+            }
+            if (writer.state().offset == image_size) {
+                break;
+            }
+            interruptions++;
+            if (rng() % 2) {
+                reboot = true;
+            } else {
+                writer.Rollback();
+            }
+        }
+    }
+
+    CHECK(nvs.offset == image_size);
+    CHECK(flash.Matches(image));
+    CHECK(boots < 1000);
+    // 每次中断最多重新下载一个块加一个扇区
+    CHECK(downloaded <= image_size + (size_t)interruptions * (kBlockSize + kSectorSize) + 16 * kBlockSize);
+    printf("boots %d, interruptions %d, downloaded %zu of %zu bytes\n", boots, interruptions, downloaded, image_size);
+}
+
+int main() {
+    return RunTests();
+}
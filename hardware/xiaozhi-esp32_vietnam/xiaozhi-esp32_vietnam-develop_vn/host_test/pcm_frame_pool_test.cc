@@ -0,0 +1,213 @@
+#include "audio/pcm_frame_pool.h"
+#include "audio/processors/no_audio_processor.h"
+#include "test_check.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Counts every heap allocation of the test process
+static size_t heap_allocations = 0;
+
+void* operator new(size_t size) {
+    heap_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static constexpr size_t kFrameSamples = 960;    // OPUS_FRAME_DURATION_MS at 16 kHz
+static constexpr size_t kEncodeQueueSize = 2;   // MAX_ENCODE_TASKS_IN_QUEUE
+
+// AudioCodec without the I2S driver
+AudioCodec::AudioCodec() {}
+AudioCodec::~AudioCodec() {}
+void AudioCodec::SetOutputVolume(int volume) {}
+void AudioCodec::SetInputGain(float gain) {}
+void AudioCodec::EnableInput(bool enable) {}
+void AudioCodec::EnableOutput(bool enable) {}
+bool AudioCodec::SetOutputSampleRate(int sample_rate) { return true; }
+void AudioCodec::OutputData(std::vector<int16_t>& data) {}
+bool AudioCodec::InputData(std::vector<int16_t>& data) { return true; }
+void AudioCodec::Start() {}
+
+class FakeCodec : public AudioCodec {
+public:
+    explicit FakeCodec(int channels) { input_channels_ = channels; }
+
+protected:
+    int Read(int16_t* dest, int samples) override { return samples; }
+    int Write(const int16_t* data, int samples) override { return samples; }
+};
+
+// The encode side of AudioService: a bounded queue of frames, encoded in
+// order and returned to the pool
+class FakeEncoder {
+public:
+    explicit FakeEncoder(PcmFramePool& pool) : pool_(pool), queue_(kEncodeQueueSize) {}
+
+    void Push(std::vector<int16_t>&& frame) {
+        if (count_ == queue_.size()) {
+            EncodeOne();
+        }
+        queue_[(head_ + count_) % queue_.size()] = std::move(frame);
+        count_++;
+    }
+
+    void EncodeOne() {
+        auto& frame = queue_[head_];
+        for (int16_t sample : frame) {
+            in_order_ = in_order_ && sample == next_sample_;
+            next_sample_++;
+        }
+        frames_++;
+        pool_.Release(std::move(frame));
+        frame = std::vector<int16_t>();
+        head_ = (head_ + 1) % queue_.size();
+        count_--;
+    }
+
+    size_t frames() const { return frames_; }
+    bool in_order() const { return in_order_; }
+
+private:
+    PcmFramePool& pool_;
+    std::vector<std::vector<int16_t>> queue_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    size_t frames_ = 0;
+    int16_t next_sample_ = 0;
+    bool in_order_ = true;
+};
+
+// Interleaved input whose first channel counts up from first_sample
+static std::vector<int16_t> MakeInput(size_t samples, int channels, int16_t& first_sample) {
+    std::vector<int16_t> data(samples * channels);
+    for (size_t i = 0; i < samples; i++) {
+        data[i * channels] = first_sample++;
+        for (int c = 1; c < channels; c++) {
+            data[i * channels + c] = -1;
+        }
+    }
+    return data;
+}
+
+TEST_CASE(PoolAllocatesUpToItsSizeThenRecycles) {
+    PcmFramePool pool(3, kFrameSamples);
+    std::vector<std::vector<int16_t>> frames;
+    for (int i = 0; i < 3; i++) {
+        frames.push_back(pool.Acquire());
+        CHECK_EQ(frames.back().size(), kFrameSamples);
+    }
+    CHECK_EQ(pool.allocated(), 3u);
+    CHECK_EQ(pool.misses(), 0u);
+
+    // A fourth frame in flight means the consumer is behind, it is counted
+    frames.push_back(pool.Acquire());
+    CHECK_EQ(pool.misses(), 1u);
+
+    const int16_t* first = frames[0].data();
+    for (auto& frame : frames) {
+        pool.Release(std::move(frame));
+    }
+    // 多出来的那一帧不留在池里
+    size_t before = heap_allocations;
+    auto again = pool.Acquire();
+    CHECK_EQ(heap_allocations, before);
+    CHECK(again.data() != first);
+
+    // Wake word audio handed over in one piece is never kept
+    std::vector<int16_t> handover(5 * kFrameSamples);
+    pool.Release(std::move(handover));
+    CHECK_EQ(handover.size(), 5 * kFrameSamples);
+}
+
+TEST_CASE(AfeOutputIsCutIntoPoolFrames) {
+    // The AFE fetches 512 samples at a time, frames are 960
+    PcmFramePool pool(kEncodeQueueSize + 2, kFrameSamples);
+    PcmFrameAssembler assembler;
+    assembler.Reset(&pool);
+    FakeEncoder encoder(pool);
+    auto on_frame = [&encoder](std::vector<int16_t>&& frame) { encoder.Push(std::move(frame)); };
+
+    int16_t next = 0;
+    auto fetch = MakeInput(512, 1, next);
+    size_t warmup_allocations = 0;
+    for (int i = 0; i < 3000; i++) {
+        for (size_t j = 0; j < fetch.size(); j++) {
+            fetch[j] = (int16_t)(i * 512 + j);
+        }
+        if (i == 100) {
+            warmup_allocations = heap_allocations;
+        }
+        assembler.Append(fetch.data(), fetch.size(), 1, on_frame);
+    }
+    size_t steady_allocations = heap_allocations - warmup_allocations;
+
+    CHECK_EQ(encoder.frames() + kEncodeQueueSize, 3000u * 512 / kFrameSamples);
+    CHECK(encoder.in_order());
+    CHECK_EQ(steady_allocations, 0u);
+    CHECK_EQ(pool.misses(), 0u);
+    CHECK(pool.allocated() <= kEncodeQueueSize + 2);
+}
+
+static void CheckNoAudioProcessor(int channels) {
+    FakeCodec codec(channels);
+    PcmFramePool pool(kEncodeQueueSize + 2, kFrameSamples);
+    FakeEncoder encoder(pool);
+    NoAudioProcessor processor;
+    processor.Initialize(&codec, 60, nullptr, &pool);
+    processor.OnOutput([&encoder](std::vector<int16_t>&& frame) { encoder.Push(std::move(frame)); });
+    processor.Start();
+    CHECK_EQ(processor.GetFeedSize(), kFrameSamples);
+
+    // The audio input task reads into the same feed buffer every time
+    int16_t next = 0;
+    auto feed = MakeInput(kFrameSamples, channels, next);
+    size_t warmup_allocations = 0;
+    const int frames = 2000;
+    for (int i = 0; i < frames; i++) {
+        if (i == 10) {
+            warmup_allocations = heap_allocations;
+        }
+        for (size_t j = 0; j < kFrameSamples; j++) {
+            feed[j * channels] = (int16_t)(i * kFrameSamples + j);
+        }
+        processor.Feed(std::move(feed));
+        CHECK_EQ(feed.size(), kFrameSamples * channels);
+    }
+    size_t steady_allocations = heap_allocations - warmup_allocations;
+    printf("%d channel input: %zu allocations in %d frames after warm-up\n", channels, steady_allocations, frames - 10);
+
+    CHECK_EQ(encoder.frames() + kEncodeQueueSize, (size_t)frames);
+    CHECK(encoder.in_order());
+    CHECK_EQ(steady_allocations, 0u);
+    CHECK_EQ(pool.misses(), 0u);
+
+    // Stopped processors drop their input
+    processor.Stop();
+    processor.Feed(std::move(feed));
+    CHECK_EQ(encoder.frames() + kEncodeQueueSize, (size_t)frames);
+}
+
+TEST_CASE(NoAudioProcessorReusesFramesMono) {
+    CheckNoAudioProcessor(1);
+}
+
+TEST_CASE(NoAudioProcessorReusesFramesStereo) {
+    CheckNoAudioProcessor(2);
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,181 @@
+#include "audio/pcm_ring.h"
+#include "test_check.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static constexpr size_t kFrameSamples = 960;    // 60 ms at 16 kHz
+
+// Sample n of the test signal, so any read can be checked against its position
+static int16_t SampleAt(uint32_t position) {
+    return (int16_t)(position * 7919u);
+}
+
+static void WriteSignal(PcmRing& ring, size_t samples) {
+    std::vector<int16_t> data(samples);
+    uint32_t position = ring.write_position();
+    for (size_t i = 0; i < samples; i++) {
+        data[i] = SampleAt(position + i);
+    }
+    ring.Write(data.data(), samples);
+}
+
+static bool MatchesSignal(const std::vector<int16_t>& pcm, uint32_t position) {
+    for (size_t i = 0; i < pcm.size(); i++) {
+        if (pcm[i] != SampleAt(position + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE(ReadsAreContinuousAcrossTheWrap) {
+    PcmRing ring(64);
+    CHECK(ring.valid());
+    std::vector<int16_t> pcm;
+    bool continuous = true;
+    // 奇数长度的写入让每次回绕都落在不同的位置
+    for (int i = 0; i < 200; i++) {
+        WriteSignal(ring, 1 + i % 37);
+        uint32_t end = ring.write_position();
+        uint32_t oldest = ring.oldest_position();
+        CHECK_EQ(end - oldest, std::min<uint32_t>(end, 64));
+
+        pcm.assign(end - oldest, 0);
+        continuous = continuous && ring.Read(oldest, pcm.data(), pcm.size()) && MatchesSignal(pcm, oldest);
+    }
+    CHECK(continuous);
+}
+
+TEST_CASE(StoresTheFirstChannel) {
+    PcmRing ring(64);
+    std::vector<int16_t> stereo(2 * 100);
+    for (uint32_t i = 0; i < 100; i++) {
+        stereo[2 * i] = SampleAt(i);
+        stereo[2 * i + 1] = -1;
+    }
+    ring.Write(stereo.data(), 100, 2);
+    CHECK_EQ(ring.write_position(), 100u);
+
+    std::vector<int16_t> pcm(64);
+    CHECK(ring.Read(36, pcm.data(), pcm.size()));
+    CHECK(MatchesSignal(pcm, 36));
+}
+
+TEST_CASE(RefusesRangesOutsideTheRing) {
+    PcmRing ring(64);
+    WriteSignal(ring, 100);
+    std::vector<int16_t> pcm(16);
+
+    CHECK(ring.Read(84, pcm.data(), 16));
+    CHECK(!ring.Read(85, pcm.data(), 16));      // Not written yet
+    CHECK(ring.Read(36, pcm.data(), 16));
+    CHECK(!ring.Read(35, pcm.data(), 16));      // Overwritten
+    CHECK(ring.Read(100, pcm.data(), 0));
+}
+
+TEST_CASE(DetectsWriterLappingTheReader) {
+    // The writer keeps going while the reader copies, a read must either fail
+    // or return exactly the samples at its position. Reads from the oldest
+    // end are usually lapped, reads of the newest samples usually are not.
+    PcmRing ring(256);
+    std::atomic<bool> stop{false};
+    std::thread writer([&]() {
+        while (!stop) {
+            WriteSignal(ring, 48);
+        }
+    });
+
+    std::vector<int16_t> pcm(192);
+    int succeeded = 0;
+    int lapped = 0;
+    int corrupted = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    for (int i = 0; (succeeded < 1000 || lapped < 1000) && std::chrono::steady_clock::now() < deadline; i++) {
+        uint32_t position = i % 2 ? ring.oldest_position() + i % 32 : ring.write_position() - pcm.size();
+        if (ring.write_position() < pcm.size()) {
+            continue;
+        }
+        if (!ring.Read(position, pcm.data(), pcm.size())) {
+            lapped++;
+        } else if (!MatchesSignal(pcm, position)) {
+            corrupted++;
+        } else {
+            succeeded++;
+        }
+    }
+    stop = true;
+    writer.join();
+
+    CHECK_EQ(corrupted, 0);
+    CHECK(lapped > 0);
+    CHECK(succeeded > 0);
+}
+
+TEST_CASE(ReadSinceRoundsToWholeFrames) {
+    PcmRing ring(16384);
+    WriteSignal(ring, 5000);
+    std::vector<int16_t> pcm;
+
+    // 250 samples since the wake word: two frames, reaching 710 samples back
+    CHECK_EQ(ring.ReadSince(5000 - 250, kFrameSamples / 4, pcm), 0u);
+    CHECK_EQ(pcm.size(), 2 * kFrameSamples / 4);
+    CHECK(MatchesSignal(pcm, 5000 - 2 * kFrameSamples / 4));
+
+    CHECK_EQ(ring.ReadSince(5000 - 2 * kFrameSamples, kFrameSamples, pcm), 0u);
+    CHECK_EQ(pcm.size(), 2 * kFrameSamples);
+    CHECK(MatchesSignal(pcm, 5000 - 2 * kFrameSamples));
+
+    CHECK_EQ(ring.ReadSince(5000 - 1, kFrameSamples, pcm), 0u);
+    CHECK_EQ(pcm.size(), kFrameSamples);
+    CHECK(MatchesSignal(pcm, 5000 - kFrameSamples));
+
+    CHECK_EQ(ring.ReadSince(5000, kFrameSamples, pcm), 0u);
+    CHECK(pcm.empty());
+}
+
+TEST_CASE(ReadSinceDropsWhatTheRingLost) {
+    PcmRing ring(4096);
+    WriteSignal(ring, 10000);
+    std::vector<int16_t> pcm;
+
+    // 11 frames since position 0, the ring holds 4 whole frames of them
+    size_t dropped = ring.ReadSince(0, kFrameSamples, pcm);
+    CHECK_EQ(pcm.size(), 4 * kFrameSamples);
+    CHECK_EQ(dropped, 7 * kFrameSamples);
+    CHECK(MatchesSignal(pcm, 10000 - 4 * kFrameSamples));
+}
+
+TEST_CASE(FallsBackToInternalRam) {
+    auto& heap = FakeHeap::GetInstance();
+    heap.failing_caps = MALLOC_CAP_SPIRAM;
+    {
+        PcmRing ring(64);
+        CHECK(ring.valid());
+    }
+    heap.failing_caps = 0;
+}
+
+TEST_CASE(SurvivesAllocationFailure) {
+    auto& heap = FakeHeap::GetInstance();
+    heap.failing_caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    {
+        PcmRing ring(65536);
+        CHECK(!ring.valid());
+
+        // Positions move on, every read fails, nothing crashes
+        WriteSignal(ring, 3000);
+        CHECK_EQ(ring.write_position(), 3000u);
+        std::vector<int16_t> pcm(16);
+        CHECK(!ring.Read(2984, pcm.data(), pcm.size()));
+        ring.ReadSince(1000, kFrameSamples, pcm);
+        CHECK(pcm.empty());
+    }
+    heap.failing_caps = 0;
+}
+
+int main() {
+    return RunTests();
+}
@@ -0,0 +1,268 @@
+#include "boards/common/power_policy.h"
+#include "test_check.h"
+
+#include <vector>
+
+static constexpr int64_t kSecond = 1000 * 1000;
+static constexpr int64_t kMinute = 60 * kSecond;
+static constexpr int kMaxFreqMhz = 240;
+static constexpr int kAwakeMinFreqMhz = 80;      // PowerSaveTimer while awake
+static constexpr int kSleepMinFreqMhz = 40;      // PowerSaveTimer in power save mode
+static constexpr float kBatteryMah = 1000.0f;
+
+// Records the lock calls in place of esp_pm
+class RecordingBackend : public PowerLockBackend {
+public:
+    struct Event {
+        bool acquire;
+        PowerLevel level;
+    };
+
+    void Acquire(PowerLevel level) override {
+        held[level]++;
+        events.push_back({true, level});
+    }
+
+    void Release(PowerLevel level) override {
+        if (held[level] == 0) {
+            bad_releases++;
+        } else {
+            held[level]--;
+        }
+        events.push_back({false, level});
+    }
+
+    int HeldCount() const { return held[kPowerLevelIdle] + held[kPowerLevelAwake] + held[kPowerLevelMax]; }
+
+    int held[kPowerLevelCount] = {};
+    int bad_releases = 0;
+    std::vector<Event> events;
+};
+
+struct Device {
+    int64_t now = 0;
+    RecordingBackend backend;
+    PowerPolicy policy{[this]() { return now; }, &backend};
+
+    void Run(int64_t us) { now += us; }
+};
+
+static int64_t TotalUs(const PowerPolicy::Stats& stats) {
+    return stats.residency_us[kPowerLevelIdle] + stats.residency_us[kPowerLevelAwake] +
+        stats.residency_us[kPowerLevelMax];
+}
+
+TEST_CASE(LevelFollowsStrongestRequest) {
+    Device device;
+    CHECK_EQ(device.policy.level(), kPowerLevelIdle);
+    CHECK_EQ(device.backend.HeldCount(), 0);
+
+    device.policy.Acquire(kPowerRequestNetwork);
+    CHECK_EQ(device.policy.level(), kPowerLevelAwake);
+    device.policy.Acquire(kPowerRequestAudioCodec);
+    CHECK_EQ(device.policy.level(), kPowerLevelMax);
+    CHECK_EQ(device.backend.HeldCount(), 1);
+    CHECK_EQ(device.backend.held[kPowerLevelMax], 1);
+
+    device.policy.Release(kPowerRequestAudioCodec);
+    CHECK_EQ(device.policy.level(), kPowerLevelAwake);
+    CHECK_EQ(device.backend.held[kPowerLevelAwake], 1);
+    device.policy.Release(kPowerRequestNetwork);
+    CHECK_EQ(device.policy.level(), kPowerLevelIdle);
+    CHECK_EQ(device.backend.HeldCount(), 0);
+    CHECK_EQ(device.backend.bad_releases, 0);
+}
+
+TEST_CASE(RequestsAreCounted) {
+    Device device;
+    device.policy.Acquire(kPowerRequestMusicDecode);
+    device.policy.Acquire(kPowerRequestMusicDecode);
+    CHECK(device.policy.Release(kPowerRequestMusicDecode));
+    CHECK_EQ(device.policy.level(), kPowerLevelMax);
+    CHECK(device.policy.Release(kPowerRequestMusicDecode));
+    CHECK_EQ(device.policy.level(), kPowerLevelIdle);
+
+    // 多余的释放不能把计数减成负数
+    CHECK(!device.policy.Release(kPowerRequestMusicDecode));
+    device.policy.Acquire(kPowerRequestMusicDecode);
+    CHECK_EQ(device.policy.level(), kPowerLevelMax);
+    CHECK_EQ(device.backend.bad_releases, 0);
+}
+
+TEST_CASE(NewLockTakenBeforeOldReleased) {
+    Device device;
+    device.policy.Acquire(kPowerRequestNetwork);
+    device.policy.Acquire(kPowerRequestAudioInput);
+    device.policy.Release(kPowerRequestAudioInput);
+
+    // awake -> max -> awake, the chip is never left without a lock in between
+    auto& events = device.backend.events;
+    CHECK_EQ(events.size(), 5u);
+    if (events.size() == 5) {
+        CHECK(events[0].acquire && events[0].level == kPowerLevelAwake);
+        CHECK(events[1].acquire && events[1].level == kPowerLevelMax);
+        CHECK(!events[2].acquire && events[2].level == kPowerLevelAwake);
+        CHECK(events[3].acquire && events[3].level == kPowerLevelAwake);
+        CHECK(!events[4].acquire && events[4].level == kPowerLevelMax);
+    }
+}
+
+TEST_CASE(AnimationDoesNotBlockLightSleep) {
+    // 表情 GIF 一直循环播放，进入省电模式后不能再挡住 light sleep
+    Device device;
+    device.policy.Acquire(kPowerRequestDisplayAnimation);
+    CHECK_EQ(device.policy.level(), kPowerLevelAwake);
+    CHECK_EQ(device.backend.held[kPowerLevelMax], 0);
+
+    device.policy.SetLightSleep(true);
+    CHECK_EQ(device.policy.level(), kPowerLevelIdle);
+    CHECK_EQ(device.backend.HeldCount(), 0);
+    device.Run(10 * kMinute);
+
+    // Audio still wins in the sleep profile
+    device.policy.Acquire(kPowerRequestAudioCodec);
+    CHECK_EQ(device.policy.level(), kPowerLevelMax);
+    device.policy.Release(kPowerRequestAudioCodec);
+    CHECK_EQ(device.policy.level(), kPowerLevelIdle);
+
+    device.policy.SetLightSleep(false);
+    CHECK_EQ(device.policy.level(), kPowerLevelAwake);
+    CHECK_EQ(device.backend.held[kPowerLevelAwake], 1);
+
+    auto stats = device.policy.TakeStats();
+    CHECK_EQ(stats.light_sleep_us, 10 * kMinute);
+    CHECK_EQ(device.backend.bad_releases, 0);
+}
+
+TEST_CASE(ResidencyCoversElapsedTime) {
+    Device device;
+    device.Run(3 * kSecond);
+    device.policy.Acquire(kPowerRequestNetwork);
+    device.Run(2 * kSecond);
+    device.policy.Acquire(kPowerRequestAudioCodec);
+    device.Run(5 * kSecond);
+    device.policy.Release(kPowerRequestAudioCodec);
+    device.policy.ReportDeadlineMiss(kPowerRequestAudioCodec);
+    device.Run(1 * kSecond);
+
+    auto stats = device.policy.TakeStats();
+    CHECK_EQ(stats.residency_us[kPowerLevelIdle], 3 * kSecond);
+    CHECK_EQ(stats.residency_us[kPowerLevelAwake], 3 * kSecond);
+    CHECK_EQ(stats.residency_us[kPowerLevelMax], 5 * kSecond);
+    CHECK_EQ(stats.light_sleep_us, 0);
+    CHECK_EQ(stats.deadline_misses[kPowerRequestAudioCodec], 1u);
+
+    // TakeStats 之后重新计数
+    device.Run(kSecond);
+    stats = device.policy.TakeStats();
+    CHECK_EQ(TotalUs(stats), kSecond);
+    CHECK_EQ(stats.residency_us[kPowerLevelAwake], kSecond);
+    CHECK_EQ(stats.deadline_misses[kPowerRequestAudioCodec], 0u);
+}
+
+// One hour of use, the way Application, AudioService and PowerSaveTimer drive
+// the governor: a short conversation, a song, idle with the emoji GIF looping
+// until PowerSaveTimer enters power save mode, which stops the wake word.
+static void SimulateHour(Device& device, bool wake_word) {
+    auto& policy = device.policy;
+    policy.SetLightSleep(false);
+    policy.Acquire(kPowerRequestDisplayAnimation);
+    if (wake_word) {
+        policy.Acquire(kPowerRequestAudioInput);
+    }
+
+    // Conversation: the channel is open, the mic is streamed and replies decoded
+    policy.Acquire(kPowerRequestNetwork);
+    for (int turn = 0; turn < 4; turn++) {
+        if (!wake_word) {
+            policy.Acquire(kPowerRequestAudioInput);
+        }
+        policy.Acquire(kPowerRequestAudioCodec);
+        device.Run(10 * kSecond);
+        if (!wake_word) {
+            policy.Release(kPowerRequestAudioInput);
+        }
+        device.Run(10 * kSecond);
+        policy.Release(kPowerRequestAudioCodec);
+        device.Run(5 * kSecond);    // waiting for the server
+    }
+    policy.Release(kPowerRequestNetwork);
+
+    // Music
+    policy.Acquire(kPowerRequestMusicDecode);
+    policy.Acquire(kPowerRequestAudioCodec);
+    device.Run(4 * kMinute);
+    policy.Release(kPowerRequestAudioCodec);
+    policy.Release(kPowerRequestMusicDecode);
+
+    // Idle with the screen on
+    device.Run(5 * kMinute - 40 * kSecond);
+
+    // Power save mode, the GIF keeps running
+    if (wake_word) {
+        policy.Release(kPowerRequestAudioInput);
+    }
+    policy.SetLightSleep(true);
+    device.Run(50 * kMinute);
+    policy.Release(kPowerRequestDisplayAnimation);
+}
+
+static void CheckSimulatedDay(bool wake_word) {
+    const int hours = 16;
+    Device device;
+    int64_t awake_us = 0;
+    int64_t sleep_us = 0;
+    float current_ma = 0;
+
+    // 前后两个省电模式的最低频率不同，按小时分段统计
+    for (int hour = 0; hour < hours; hour++) {
+        int64_t start = device.now;
+        SimulateHour(device, wake_word);
+        auto stats = device.policy.TakeStats();
+        CHECK_EQ(TotalUs(stats), device.now - start);
+        CHECK_EQ(stats.light_sleep_us, 50 * kMinute);
+        awake_us += device.now - start - stats.light_sleep_us;
+        sleep_us += stats.light_sleep_us;
+
+        PowerPolicy::Stats awake = stats;
+        awake.residency_us[kPowerLevelIdle] -= stats.light_sleep_us;
+        awake.light_sleep_us = 0;
+        PowerPolicy::Stats asleep = {};
+        asleep.residency_us[kPowerLevelIdle] = stats.light_sleep_us;
+        asleep.light_sleep_us = stats.light_sleep_us;
+        current_ma += (PowerPolicy::EstimateCurrentMa(awake, kMaxFreqMhz, kAwakeMinFreqMhz) * TotalUs(awake) +
+            PowerPolicy::EstimateCurrentMa(asleep, kMaxFreqMhz, kSleepMinFreqMhz) * TotalUs(asleep)) /
+            TotalUs(stats) / hours;
+    }
+    CHECK_EQ(device.policy.level(), kPowerLevelIdle);
+    CHECK_EQ(device.backend.HeldCount(), 0);
+    CHECK_EQ(device.backend.bad_releases, 0);
+
+    // Before the governor: pinned to the maximum while awake, light sleep in power save mode
+    PowerPolicy::Stats pinned = {};
+    pinned.residency_us[kPowerLevelMax] = awake_us;
+    pinned.residency_us[kPowerLevelIdle] = sleep_us;
+    pinned.light_sleep_us = sleep_us;
+    float pinned_ma = PowerPolicy::EstimateCurrentMa(pinned, kMaxFreqMhz, kSleepMinFreqMhz);
+
+    CHECK(current_ma <= pinned_ma);
+    if (!wake_word) {
+        CHECK(current_ma < pinned_ma * 0.9f);
+    }
+    printf("%s: CPU ~%.2f mA (pinned %.2f mA), ~%.0f h on %.0f mAh (pinned %.0f h), "
+        "modeled CPU current only, radio and display excluded\n",
+        wake_word ? "wake word board" : "push to talk board", current_ma, pinned_ma,
+        kBatteryMah / current_ma, kBatteryMah, kBatteryMah / pinned_ma);
+}
+
+TEST_CASE(SimulatedDayWithWakeWord) {
+    CheckSimulatedDay(true);
+}
+
+TEST_CASE(SimulatedDayPushToTalk) {
+    CheckSimulatedDay(false);
+}
+
+int main() {
+    return RunTests();
+}
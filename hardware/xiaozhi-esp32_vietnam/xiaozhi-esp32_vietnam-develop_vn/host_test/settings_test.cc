@@ -0,0 +1,260 @@
+#include "settings.h"
+#include "test_check.h"
+
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+static constexpr int64_t kMs = 1000;
+
+// Waits until the commit task has handled every wakeup
+static void Settle() {
+    if (FakeTask::Last() != nullptr) {
+        FakeTask::Last()->WaitIdle();
+    }
+}
+
+static void Advance(int64_t us) {
+    FakeTimers::GetInstance().Advance(us);
+    Settle();
+}
+
+// Every test starts with nothing pending and the counters cleared
+static FakeNvs::Counters Start() {
+    Settings::Flush();
+    Advance(10 * 1000 * kMs);
+    return FakeNvs::GetInstance().TakeCounters();
+}
+
+static FakeNvs::Counters Counters() {
+    Settle();
+    return FakeNvs::GetInstance().TakeCounters();
+}
+
+static std::mutex changes_mutex;
+static std::vector<std::pair<std::string, std::string>> changes;
+
+static std::vector<std::pair<std::string, std::string>> TakeChanges(const std::string& ns) {
+    std::lock_guard<std::mutex> lock(changes_mutex);
+    std::vector<std::pair<std::string, std::string>> result;
+    for (auto& change : changes) {
+        if (change.first == ns) {
+            result.push_back(change);
+        }
+    }
+    changes.clear();
+    return result;
+}
+
+TEST_CASE(BurstOfWritesCommitsOnce) {
+    Settings settings("burst", true);
+    Start();
+
+    // Turning the volume knob: a change every 100 ms, each restarts the 1 s window
+    for (int volume = 0; volume < 20; volume++) {
+        settings.SetInt("volume", volume);
+        Advance(100 * kMs);
+    }
+    auto counters = Counters();
+    CHECK_EQ(counters.commits, 0);
+    CHECK_EQ(counters.writes, 0);
+
+    Advance(1000 * kMs);
+    counters = Counters();
+    CHECK_EQ(counters.commits, 1);
+    CHECK_EQ(counters.writes, 1);
+    int32_t stored = -1;
+    CHECK(FakeNvs::GetInstance().GetI32Direct("burst", "volume", stored));
+    CHECK_EQ(stored, 19);
+
+    // Several keys changed in the same window share the commit
+    settings.SetInt("a", 1);
+    settings.SetString("b", "x");
+    settings.SetBool("c", true);
+    Advance(1000 * kMs);
+    counters = Counters();
+    CHECK_EQ(counters.commits, 1);
+    CHECK_EQ(counters.writes, 3);
+}
+
+TEST_CASE(MaximumDelayForcesCommit) {
+    Settings settings("busy", true);
+    Start();
+
+    // 一直在改：每 500 ms 一次，1 s 的窗口永远等不到，5 s 上限强制提交
+    int64_t start = esp_timer_get_time();
+    int64_t first_commit = -1;
+    int commits = 0;
+    for (int i = 0; i < 20; i++) {
+        settings.SetInt("level", i);
+        Advance(500 * kMs);
+        int committed = Counters().commits;
+        if (committed > 0 && first_commit < 0) {
+            first_commit = esp_timer_get_time() - start;
+        }
+        commits += committed;
+    }
+    CHECK_EQ(first_commit, 5000 * kMs);
+    CHECK_EQ(commits, 2);       // At 5 s and 10 s
+
+    // The 10 s commit already carried the last write
+    Advance(1000 * kMs);
+    CHECK_EQ(Counters().commits, 0);
+}
+
+TEST_CASE(FlushCommitsSynchronously) {
+    Settings settings("flush", true);
+    Start();
+
+    settings.SetString("token", "abc");
+    Settings::Flush();
+    auto counters = FakeNvs::GetInstance().TakeCounters();
+    CHECK_EQ(counters.commits, 1);
+    CHECK_EQ(counters.writes, 1);
+
+    // The timer started by the write finds nothing left to do
+    Advance(2000 * kMs);
+    CHECK_EQ(Counters().commits, 0);
+
+    // Nothing pending, nothing written
+    Settings::Flush();
+    CHECK_EQ(Counters().commits, 0);
+}
+
+TEST_CASE(ShutdownHandlerFlushes) {
+    Settings settings("shutdown", true);
+    Start();
+
+    settings.SetInt("boot_count", 7);
+    FakeRestart();
+    auto counters = FakeNvs::GetInstance().TakeCounters();
+    CHECK_EQ(counters.commits, 1);
+    int32_t stored = 0;
+    CHECK(FakeNvs::GetInstance().GetI32Direct("shutdown", "boot_count", stored));
+    CHECK_EQ(stored, 7);
+}
+
+TEST_CASE(UnchangedValuesAreNotWritten) {
+    Settings settings("unchanged", true);
+    settings.SetInt("brightness", 50);
+    Start();
+    TakeChanges("unchanged");
+
+    settings.SetInt("brightness", 50);
+    Advance(2000 * kMs);
+    CHECK_EQ(Counters().commits, 0);
+    CHECK(TakeChanges("unchanged").empty());
+
+    // Erasing a key twice before the commit writes once
+    settings.EraseKey("brightness");
+    settings.EraseKey("brightness");
+    Advance(2000 * kMs);
+    auto counters = Counters();
+    CHECK_EQ(counters.commits, 1);
+    CHECK_EQ(counters.writes, 1);
+    CHECK_EQ(settings.GetInt("brightness", -1), -1);
+}
+
+TEST_CASE(ReadsHitNvsOnce) {
+    FakeNvs::GetInstance().SetStrDirect("cache", "name", "box");
+    Start();
+
+    // New Settings objects share the namespace cache, hits and misses alike
+    for (int i = 0; i < 10; i++) {
+        Settings settings("cache");
+        CHECK(settings.GetString("name") == "box");
+        CHECK(settings.GetString("missing", "default") == "default");
+    }
+    auto counters = Counters();
+    CHECK_EQ(counters.reads, 3);     // Length and data of "name", the miss of "missing"
+    CHECK_EQ(counters.opens, 1);
+}
+
+TEST_CASE(CachedMissIsInvalidatedByWrite) {
+    Settings reader("miss");
+    Settings writer("miss", true);
+    Start();
+
+    CHECK(reader.GetString("url", "none") == "none");
+    writer.SetString("url", "wss://example");
+    // Visible before the commit, and after it
+    CHECK(reader.GetString("url", "none") == "wss://example");
+    Advance(1000 * kMs);
+    CHECK_EQ(Counters().commits, 1);
+    CHECK(reader.GetString("url", "none") == "wss://example");
+
+    // Erase turns it back into a miss
+    writer.EraseKey("url");
+    CHECK(reader.GetString("url", "none") == "none");
+
+    // A miss of another type does not hide the stored value
+    writer.SetInt("port", 443);
+    CHECK(reader.GetString("port", "none") == "none");
+    CHECK_EQ(reader.GetInt("port"), 443);
+}
+
+TEST_CASE(WifiNamespaceBypassesCache) {
+    Settings wifi("wifi");
+    Settings other("not_wifi");
+    Start();
+
+    CHECK(wifi.GetString("ssid") == "");
+    CHECK(other.GetString("ssid") == "");
+
+    // esp-wifi-connect writes NVS directly
+    FakeNvs::GetInstance().SetStrDirect("wifi", "ssid", "home");
+    FakeNvs::GetInstance().SetStrDirect("not_wifi", "ssid", "home");
+    CHECK(wifi.GetString("ssid") == "home");
+    // A cached namespace keeps its cached miss, which is why "wifi" is not cached
+    CHECK(other.GetString("ssid") == "");
+
+    FakeNvs::GetInstance().SetStrDirect("wifi", "ssid", "office");
+    CHECK(wifi.GetString("ssid") == "office");
+    auto counters = Counters();
+    CHECK(counters.reads >= 4);
+
+    // A local write still pending wins over NVS until it is committed
+    Settings wifi_writer("wifi", true);
+    wifi_writer.SetString("ssid", "phone");
+    CHECK(wifi.GetString("ssid") == "phone");
+    Settings::Flush();
+    FakeNvs::GetInstance().SetStrDirect("wifi", "ssid", "cafe");
+    CHECK(wifi.GetString("ssid") == "cafe");
+}
+
+TEST_CASE(ListenersSeeEveryChange) {
+    Settings settings("listen", true);
+    Start();
+    TakeChanges("listen");
+
+    settings.SetInt("volume", 10);
+    settings.SetInt("volume", 10);
+    settings.SetInt("volume", 20);
+    settings.SetBool("mute", true);
+    settings.EraseKey("volume");
+    settings.EraseAll();
+
+    std::vector<std::pair<std::string, std::string>> expected = {
+        {"listen", "volume"}, {"listen", "volume"}, {"listen", "mute"}, {"listen", "volume"}, {"listen", ""},
+    };
+    CHECK(TakeChanges("listen") == expected);
+
+    // EraseAll is immediate and drops what was pending
+    CHECK_EQ(Counters().commits, 1);
+    Advance(2000 * kMs);
+    CHECK_EQ(Counters().commits, 0);
+    CHECK_EQ(settings.GetBool("mute"), false);
+}
+
+int main() {
+    Settings::AddChangeListener([](const std::string& ns, const std::string& key) {
+        std::lock_guard<std::mutex> lock(changes_mutex);
+        changes.emplace_back(ns, key);
+    });
+    return RunTests();
+}
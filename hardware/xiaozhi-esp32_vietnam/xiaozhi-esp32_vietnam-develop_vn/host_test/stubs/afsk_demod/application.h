@@ -0,0 +1,30 @@
+#pragma once
+// Host stand-ins for what afsk_demod.cc uses from Application and FreeRTOS,
+// only the signal processing classes are tested
+
+#include <cstdint>
+#include <vector>
+
+#include "display.h"
+
+enum DeviceState {
+    kDeviceStateWifiConfiguring,
+};
+
+class AudioService {
+public:
+    bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) { return false; }
+};
+
+class Application {
+public:
+    DeviceState GetDeviceState() { return kDeviceStateWifiConfiguring; }
+    AudioService& GetAudioService() { return audio_service_; }
+
+private:
+    AudioService audio_service_;
+};
+
+#define pdMS_TO_TICKS(ms) (ms)
+inline void vTaskDelay(int ticks) {}
+inline void esp_restart() {}
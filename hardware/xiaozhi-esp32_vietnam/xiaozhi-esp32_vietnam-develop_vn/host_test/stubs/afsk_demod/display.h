@@ -0,0 +1,7 @@
+#pragma once
+// Host stand-in for Display, see application.h
+
+class Display {
+public:
+    void SetChatMessage(const char* role, const char* content) {}
+};
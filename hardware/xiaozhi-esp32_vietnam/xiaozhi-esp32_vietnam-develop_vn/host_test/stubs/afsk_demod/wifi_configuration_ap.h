@@ -0,0 +1,10 @@
+#pragma once
+// Host stand-in for WifiConfigurationAp, see application.h
+
+#include <string>
+
+class WifiConfigurationAp {
+public:
+    bool ConnectToWifi(const std::string& ssid, const std::string& password) { return false; }
+    void Save(const std::string& ssid, const std::string& password) {}
+};
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-ins for what audio_codec.h and audio_processor.h pull in, only
+// the processors that need no esp-sr are built
@@ -0,0 +1,4 @@
+#pragma once
+// See board.h
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
@@ -0,0 +1,7 @@
+#pragma once
+// See board.h
+
+typedef struct {
+    int num;
+    char** model_name;
+} srmodel_list_t;
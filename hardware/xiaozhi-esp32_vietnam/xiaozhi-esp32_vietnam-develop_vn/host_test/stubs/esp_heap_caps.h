@@ -0,0 +1,50 @@
+#pragma once
+// heap_caps_* on top of malloc, with per-capability counters and failure
+// injection so tests can check allocation counts and out of memory paths
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#define MALLOC_CAP_EXEC     (1 << 0)
+#define MALLOC_CAP_32BIT    (1 << 1)
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+struct FakeHeap {
+    int allocations = 0;
+    int frees = 0;
+    uint32_t failing_caps = 0;      // Allocations asking for any of these caps fail
+
+    static FakeHeap& GetInstance() {
+        static FakeHeap instance;
+        return instance;
+    }
+};
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) {
+    auto& heap = FakeHeap::GetInstance();
+    if (caps & heap.failing_caps) {
+        return nullptr;
+    }
+    heap.allocations++;
+    return malloc(size);
+}
+
+inline void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    void* p = heap_caps_malloc(n * size, caps);
+    if (p != nullptr) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+inline void heap_caps_free(void* p) {
+    if (p != nullptr) {
+        FakeHeap::GetInstance().frees++;
+    }
+    free(p);
+}
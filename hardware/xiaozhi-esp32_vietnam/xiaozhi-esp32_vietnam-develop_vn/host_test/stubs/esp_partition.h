@@ -0,0 +1,43 @@
+#pragma once
+// Partitions backed by host memory, with a read failure that can be armed at an offset
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <esp_err.h>
+
+typedef struct esp_partition_t {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    // Host only
+    std::vector<uint8_t>* data;     // Reads past data->size() return 0xFF like erased flash
+    size_t fail_read_at;            // A read touching this offset fails, SIZE_MAX disables
+    int reads;
+} esp_partition_t;
+
+inline esp_partition_t FakePartition(const char* label, std::vector<uint8_t>* data, uint32_t size = 0) {
+    esp_partition_t partition = {};
+    partition.size = size != 0 ? size : static_cast<uint32_t>(data->size());
+    strncpy(partition.label, label, sizeof(partition.label) - 1);
+    partition.data = data;
+    partition.fail_read_at = SIZE_MAX;
+    return partition;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    auto p = const_cast<esp_partition_t*>(partition);
+    p->reads++;
+    if (partition->fail_read_at >= offset && partition->fail_read_at < offset + size) {
+        return ESP_FAIL;
+    }
+    auto bytes = static_cast<uint8_t*>(dst);
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = offset + i < partition->data->size() ? (*partition->data)[offset + i] : 0xFF;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,81 @@
+#pragma once
+// The parts of LVGL gifdec.c uses: lv_malloc/lv_free with a call counter and
+// lv_fs_* on top of stdio
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LV_DRAW_SW_ASM_NONE     0
+#define LV_DRAW_SW_ASM_HELIUM   2
+#define LV_USE_DRAW_SW_ASM      LV_DRAW_SW_ASM_NONE
+
+// Defined by the test
+extern int lv_malloc_calls;
+
+static inline void* lv_malloc(size_t size) {
+    lv_malloc_calls++;
+    return malloc(size);
+}
+
+static inline void lv_free(void* p) {
+    free(p);
+}
+
+typedef enum {
+    LV_FS_RES_OK = 0,
+    LV_FS_RES_UNKNOWN = 1,
+} lv_fs_res_t;
+
+typedef enum {
+    LV_FS_MODE_WR = 0x01,
+    LV_FS_MODE_RD = 0x02,
+} lv_fs_mode_t;
+
+typedef enum {
+    LV_FS_SEEK_SET = 0x00,
+    LV_FS_SEEK_CUR = 0x01,
+    LV_FS_SEEK_END = 0x02,
+} lv_fs_whence_t;
+
+typedef struct {
+    FILE* file;
+} lv_fs_file_t;
+
+static inline lv_fs_res_t lv_fs_open(lv_fs_file_t* fd, const char* path, lv_fs_mode_t mode) {
+    (void)mode;
+    fd->file = fopen(path, "rb");
+    return fd->file != NULL ? LV_FS_RES_OK : LV_FS_RES_UNKNOWN;
+}
+
+static inline lv_fs_res_t lv_fs_read(lv_fs_file_t* fd, void* buf, uint32_t btr, uint32_t* br) {
+    size_t n = fread(buf, 1, btr, fd->file);
+    if (br != NULL) {
+        *br = (uint32_t)n;
+    }
+    return LV_FS_RES_OK;
+}
+
+static inline lv_fs_res_t lv_fs_seek(lv_fs_file_t* fd, uint32_t pos, lv_fs_whence_t whence) {
+    fseek(fd->file, (long)pos, whence == LV_FS_SEEK_SET ? SEEK_SET : whence == LV_FS_SEEK_CUR ? SEEK_CUR : SEEK_END);
+    return LV_FS_RES_OK;
+}
+
+static inline lv_fs_res_t lv_fs_tell(lv_fs_file_t* fd, uint32_t* pos) {
+    *pos = (uint32_t)ftell(fd->file);
+    return LV_FS_RES_OK;
+}
+
+static inline lv_fs_res_t lv_fs_close(lv_fs_file_t* fd) {
+    fclose(fd->file);
+    return LV_FS_RES_OK;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+// Standard base64 behind mbedtls_base64_encode, including its size query
+
+#include <cstddef>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+inline int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src,
+                                 size_t slen) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t needed = (slen + 2) / 3 * 4 + 1;
+    if (dst == nullptr || dlen < needed) {
+        *olen = needed;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < slen; i += 3) {
+        unsigned value = src[i] << 16;
+        if (i + 1 < slen) value |= src[i + 1] << 8;
+        if (i + 2 < slen) value |= src[i + 2];
+        dst[n++] = kAlphabet[(value >> 18) & 0x3F];
+        dst[n++] = kAlphabet[(value >> 12) & 0x3F];
+        dst[n++] = i + 1 < slen ? kAlphabet[(value >> 6) & 0x3F] : '=';
+        dst[n++] = i + 2 < slen ? kAlphabet[value & 0x3F] : '=';
+    }
+    dst[n] = 0;
+    *olen = n;
+    return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+// Only what mcp_server.h declares inline, tools/list does not touch cJSON
+
+#include <cstdlib>
+
+typedef struct cJSON {
+    int type;
+} cJSON;
+
+inline char* cJSON_PrintUnformatted(const cJSON* item) {
+    return nullptr;
+}
+
+inline void cJSON_free(void* object) {
+    free(object);
+}
+
+inline void cJSON_Delete(cJSON* item) {
+}
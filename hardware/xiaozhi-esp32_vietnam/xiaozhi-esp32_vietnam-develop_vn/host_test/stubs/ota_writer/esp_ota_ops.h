@@ -0,0 +1,107 @@
+#pragma once
+// OTA writes into the fake partition's backing vector, with a failure that can
+// be armed at the nth esp_ota_write and a delay standing in for slow flash
+
+#include <esp_err.h>
+#include <esp_partition.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef uint32_t esp_ota_handle_t;
+
+#define OTA_SIZE_UNKNOWN            0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES  0xfffffffe
+#define ESP_ERR_OTA_BASE            0x1500
+#define ESP_ERR_OTA_VALIDATE_FAILED (ESP_ERR_OTA_BASE + 0x03)
+#define ESP_ERR_FLASH_OP_FAIL       0x4001
+
+struct FakeOta {
+    struct Write {
+        const void* data;
+        size_t length;
+    };
+
+    std::mutex mutex;
+    const esp_partition_t* partition = nullptr;
+    std::vector<Write> writes;
+    size_t written = 0;
+    int begins = 0;
+    int ends = 0;
+    int aborts = 0;
+    esp_err_t begin_error = ESP_OK;
+    int fail_write = -1;                                // Index of the esp_ota_write call that fails
+    std::chrono::microseconds write_delay{0};
+
+    static FakeOta& GetInstance() {
+        static FakeOta instance;
+        return instance;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        partition = nullptr;
+        writes.clear();
+        written = 0;
+        begins = ends = aborts = 0;
+        begin_error = ESP_OK;
+        fail_write = -1;
+        write_delay = std::chrono::microseconds(0);
+    }
+};
+
+inline esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle) {
+    auto& ota = FakeOta::GetInstance();
+    std::lock_guard<std::mutex> lock(ota.mutex);
+    if (ota.begin_error != ESP_OK) {
+        return ota.begin_error;
+    }
+    ota.begins++;
+    ota.partition = partition;
+    ota.written = 0;
+    *out_handle = ota.begins;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    auto& ota = FakeOta::GetInstance();
+    std::chrono::microseconds delay;
+    {
+        std::lock_guard<std::mutex> lock(ota.mutex);
+        delay = ota.write_delay;
+    }
+    std::this_thread::sleep_for(delay);
+
+    std::lock_guard<std::mutex> lock(ota.mutex);
+    int index = static_cast<int>(ota.writes.size());
+    ota.writes.push_back({data, size});
+    if (index == ota.fail_write) {
+        return ESP_ERR_FLASH_OP_FAIL;
+    }
+    auto& flash = *ota.partition->data;
+    if (ota.written + size > ota.partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash.size() < ota.written + size) {
+        flash.resize(ota.written + size);
+    }
+    memcpy(&flash[ota.written], data, size);
+    ota.written += size;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    auto& ota = FakeOta::GetInstance();
+    std::lock_guard<std::mutex> lock(ota.mutex);
+    ota.ends++;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    auto& ota = FakeOta::GetInstance();
+    std::lock_guard<std::mutex> lock(ota.mutex);
+    ota.aborts++;
+    return ESP_OK;
+}
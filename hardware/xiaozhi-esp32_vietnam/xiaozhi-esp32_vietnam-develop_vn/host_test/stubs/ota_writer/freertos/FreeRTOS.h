@@ -0,0 +1,15 @@
+#pragma once
+// Just enough FreeRTOS for the OTA writer task, see queue.h and task.h
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          1
+#define pdFAIL          0
+#define errQUEUE_FULL   0
+#define portMAX_DELAY   0xffffffffu
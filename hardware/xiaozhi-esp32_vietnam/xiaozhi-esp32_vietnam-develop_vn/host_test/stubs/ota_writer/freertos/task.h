@@ -0,0 +1,39 @@
+#pragma once
+// Tasks are detached std::threads, vTaskDelete(NULL) at the end of the task
+// function lets the thread return
+
+#include "FreeRTOS.h"
+
+#include <atomic>
+#include <thread>
+
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+
+struct FakeTasks {
+    std::atomic<int> created{0};
+    bool fail_create = false;
+
+    static FakeTasks& GetInstance() {
+        static FakeTasks instance;
+        return instance;
+    }
+};
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+                              UBaseType_t priority, TaskHandle_t* out_handle) {
+    auto& tasks = FakeTasks::GetInstance();
+    if (tasks.fail_create) {
+        return pdFAIL;
+    }
+    tasks.created++;
+    std::thread(function, arg).detach();
+    return pdPASS;
+}
+
+inline void vTaskDelete(TaskHandle_t task) {
+}
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return 5;
+}
@@ -0,0 +1,24 @@
+#pragma once
+// Shutdown handlers for the settings test, FakeRestart runs them like esp_restart()
+
+#include <esp_err.h>
+
+#include <vector>
+
+typedef void (*shutdown_handler_t)(void);
+
+inline std::vector<shutdown_handler_t>& FakeShutdownHandlers() {
+    static std::vector<shutdown_handler_t> handlers;
+    return handlers;
+}
+
+inline esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    FakeShutdownHandlers().push_back(handler);
+    return ESP_OK;
+}
+
+inline void FakeRestart() {
+    for (auto handler : FakeShutdownHandlers()) {
+        handler();
+    }
+}
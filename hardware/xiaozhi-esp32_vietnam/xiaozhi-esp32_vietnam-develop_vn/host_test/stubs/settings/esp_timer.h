@@ -0,0 +1,104 @@
+#pragma once
+// Manual clock and one-shot timers for the settings test. Time only moves in
+// FakeTimers::Advance, due timers fire on the calling thread.
+
+#include <esp_err.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+typedef enum {
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    void (*callback)(void* arg);
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    bool active = false;
+    int64_t deadline_us = 0;
+};
+typedef esp_timer* esp_timer_handle_t;
+
+class FakeTimers {
+public:
+    static FakeTimers& GetInstance() {
+        static FakeTimers instance;
+        return instance;
+    }
+
+    std::recursive_mutex mutex;
+    int64_t now_us = 1;
+    std::vector<esp_timer_handle_t> timers;
+
+    void Advance(int64_t us) {
+        int64_t end = now_us + us;
+        while (true) {
+            esp_timer_handle_t next = nullptr;
+            {
+                std::lock_guard<std::recursive_mutex> lock(mutex);
+                for (auto timer : timers) {
+                    if (timer->active && timer->deadline_us <= end &&
+                            (next == nullptr || timer->deadline_us < next->deadline_us)) {
+                        next = timer;
+                    }
+                }
+                if (next == nullptr) {
+                    now_us = end;
+                    return;
+                }
+                now_us = next->deadline_us;
+                next->active = false;
+            }
+            next->args.callback(next->args.arg);
+        }
+    }
+};
+
+inline int64_t esp_timer_get_time() {
+    auto& timers = FakeTimers::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(timers.mutex);
+    return timers.now_us;
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle) {
+    auto& timers = FakeTimers::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(timers.mutex);
+    *out_handle = new esp_timer{*args};
+    timers.timers.push_back(*out_handle);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    auto& timers = FakeTimers::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(timers.mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->deadline_us = timers.now_us + static_cast<int64_t>(timeout_us);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    auto& timers = FakeTimers::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(timers.mutex);
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+inline bool esp_timer_is_active(esp_timer_handle_t timer) {
+    auto& timers = FakeTimers::GetInstance();
+    std::lock_guard<std::recursive_mutex> lock(timers.mutex);
+    return timer->active;
+}
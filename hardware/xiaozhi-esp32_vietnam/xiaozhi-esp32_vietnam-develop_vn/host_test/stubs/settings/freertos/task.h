@@ -0,0 +1,67 @@
+#pragma once
+// Tasks are std::threads, notifications a counter. FakeTask::WaitIdle returns
+// once a task has handled every notification and is blocked again, so tests
+// can check the result of a notification without sleeping.
+
+#include "FreeRTOS.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef void (*TaskFunction_t)(void*);
+
+struct FakeTask {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+    bool waiting = false;
+
+    // The last task created, the settings store creates only one
+    static FakeTask*& Last() {
+        static FakeTask* task = nullptr;
+        return task;
+    }
+
+    static FakeTask*& Current() {
+        thread_local FakeTask* task = nullptr;
+        return task;
+    }
+
+    void WaitIdle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return waiting && notifications == 0; });
+    }
+};
+typedef FakeTask* TaskHandle_t;
+
+// The task runs for the rest of the process, like a FreeRTOS task that never returns
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+                              UBaseType_t priority, TaskHandle_t* out_handle) {
+    auto task = new FakeTask();
+    *out_handle = task;
+    FakeTask::Last() = task;
+    std::thread([task, function, arg]() {
+        FakeTask::Current() = task;
+        function(arg);
+    }).detach();
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    FakeTask* task = FakeTask::Current();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->waiting = true;
+    task->cv.notify_all();
+    task->cv.wait(lock, [task]() { return task->notifications > 0; });
+    task->waiting = false;
+    uint32_t count = task->notifications;
+    task->notifications = clear_on_exit ? 0 : count - 1;
+    return count;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+    task->cv.notify_all();
+}
@@ -0,0 +1,192 @@
+#pragma once
+// In-memory NVS for the settings test. Keys are stored per namespace and
+// type like the real NVS, every call is counted so tests can check how often
+// the flash would be touched.
+
+#include <esp_err.h>
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define ESP_ERR_NVS_NOT_FOUND   0x1102
+#define ESP_ERR_NVS_READ_ONLY   0x1107
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+class FakeNvs {
+public:
+    struct Value {
+        int type;       // 0 string, 1 i32, 2 u8
+        std::string str;
+        int32_t num = 0;
+    };
+
+    struct Counters {
+        int opens = 0;
+        int reads = 0;
+        int writes = 0;     // set and erase calls
+        int commits = 0;
+    };
+
+    static FakeNvs& GetInstance() {
+        static FakeNvs instance;
+        return instance;
+    }
+
+    std::mutex mutex;
+    std::map<std::string, std::map<std::string, Value>> namespaces;
+    std::map<nvs_handle_t, std::pair<std::string, bool>> handles;   // namespace, writable
+    nvs_handle_t next_handle = 1;
+    Counters counters;
+
+    Counters TakeCounters() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Counters result = counters;
+        counters = Counters();
+        return result;
+    }
+
+    // What another component writing NVS directly (esp-wifi-connect) would do
+    void SetStrDirect(const std::string& ns, const std::string& key, const std::string& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        namespaces[ns][key + "#0"] = Value{0, value};
+    }
+
+    bool GetI32Direct(const std::string& ns, const std::string& key, int32_t& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = namespaces[ns].find(key + "#1");
+        if (it == namespaces[ns].end()) {
+            return false;
+        }
+        value = it->second.num;
+        return true;
+    }
+
+    esp_err_t Get(nvs_handle_t handle, const char* key, int type, Value& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.reads++;
+        auto& ns = namespaces[handles.at(handle).first];
+        auto it = ns.find(std::string(key) + "#" + std::to_string(type));
+        if (it == ns.end()) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        value = it->second;
+        return ESP_OK;
+    }
+
+    esp_err_t Set(nvs_handle_t handle, const char* key, const Value& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.writes++;
+        auto& [name, writable] = handles.at(handle);
+        if (!writable) {
+            return ESP_ERR_NVS_READ_ONLY;
+        }
+        auto& ns = namespaces[name];
+        // One type per key, setting a new type replaces the old entry
+        for (int type = 0; type < 3; type++) {
+            ns.erase(std::string(key) + "#" + std::to_string(type));
+        }
+        ns[std::string(key) + "#" + std::to_string(value.type)] = value;
+        return ESP_OK;
+    }
+};
+
+inline esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* out_handle) {
+    auto& nvs = FakeNvs::GetInstance();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    nvs.counters.opens++;
+    if (mode == NVS_READONLY && nvs.namespaces.find(name) == nvs.namespaces.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    nvs.namespaces[name];
+    *out_handle = nvs.next_handle++;
+    nvs.handles[*out_handle] = {name, mode == NVS_READWRITE};
+    return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle_t handle) {
+    auto& nvs = FakeNvs::GetInstance();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    nvs.handles.erase(handle);
+}
+
+inline esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    FakeNvs::Value value;
+    esp_err_t err = FakeNvs::GetInstance().Get(handle, key, 0, value);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (out_value != nullptr) {
+        if (*length < value.str.size() + 1) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out_value, value.str.c_str(), value.str.size() + 1);
+    }
+    *length = value.str.size() + 1;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* out_value) {
+    FakeNvs::Value value;
+    esp_err_t err = FakeNvs::GetInstance().Get(handle, key, 1, value);
+    if (err == ESP_OK) {
+        *out_value = value.num;
+    }
+    return err;
+}
+
+inline esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+    FakeNvs::Value value;
+    esp_err_t err = FakeNvs::GetInstance().Get(handle, key, 2, value);
+    if (err == ESP_OK) {
+        *out_value = static_cast<uint8_t>(value.num);
+    }
+    return err;
+}
+
+inline esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    return FakeNvs::GetInstance().Set(handle, key, FakeNvs::Value{0, value});
+}
+
+inline esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value) {
+    return FakeNvs::GetInstance().Set(handle, key, FakeNvs::Value{1, "", value});
+}
+
+inline esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+    return FakeNvs::GetInstance().Set(handle, key, FakeNvs::Value{2, "", value});
+}
+
+inline esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    auto& nvs = FakeNvs::GetInstance();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    nvs.counters.writes++;
+    auto& ns = nvs.namespaces[nvs.handles.at(handle).first];
+    bool found = false;
+    for (int type = 0; type < 3; type++) {
+        found = ns.erase(std::string(key) + "#" + std::to_string(type)) > 0 || found;
+    }
+    return found ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+inline esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    auto& nvs = FakeNvs::GetInstance();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    nvs.counters.writes++;
+    nvs.namespaces[nvs.handles.at(handle).first].clear();
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_commit(nvs_handle_t handle) {
+    auto& nvs = FakeNvs::GetInstance();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    nvs.counters.commits++;
+    return ESP_OK;
+}
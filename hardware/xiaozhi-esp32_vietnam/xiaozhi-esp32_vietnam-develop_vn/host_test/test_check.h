@@ -0,0 +1,65 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+// Minimal assertion helpers for the host tests, each test binary is one ctest case.
+//
+//   TEST_CASE(Something) { CHECK(1 + 1 == 2); }
+//   int main() { return RunTests(); }
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+struct TestCase {
+    const char* name;
+    std::function<void()> body;
+};
+
+inline std::vector<TestCase>& TestRegistry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, std::function<void()> body) { TestRegistry().push_back({name, body}); }
+};
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static TestRegistrar name##_registrar(#name, name); \
+    static void name()
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            TestFailures()++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        auto _a = (a); \
+        auto _b = (b); \
+        if (!(_a == _b)) { \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, \
+                    (long long)_a, (long long)_b); \
+            TestFailures()++; \
+        } \
+    } while (0)
+
+inline int RunTests() {
+    for (auto& test : TestRegistry()) {
+        int before = TestFailures();
+        test.body();
+        printf("[%s] %s\n", TestFailures() == before ? "PASS" : "FAIL", test.name);
+    }
+    return TestFailures() == 0 ? 0 : 1;
+}
+
+#endif // TEST_CHECK_H
@@ -9,6 +9,7 @@
 #include "mcp_server.h"
 #include "assets.h"
 #include "settings.h"
+#include "power_governor.h"
 #include "ota_server.h"
 #include "wifi_station.h"
 #include "sd_card.h"
@@ -89,7 +90,6 @@ void Application::CheckAssetsVersion() {
     std::string download_url = settings.GetString("download_url");
 
     if (!download_url.empty()) {
-        settings.EraseKey("download_url");
 
         char message[256];
         snprintf(message, sizeof(message), Lang::Strings::FOUND_NEW_ASSETS, download_url.c_str());
@@ -112,6 +112,11 @@ void Application::CheckAssetsVersion() {
         board.SetPowerSaveMode(true);
         vTaskDelay(pdMS_TO_TICKS(1000));
 
+        // Keep the URL while a partial download can be resumed on the next boot
+        if (success || !assets.CanResumeDownload(download_url)) {
+            settings.EraseKey("download_url");
+        }
+
         if (!success) {
             Alert(Lang::Strings::ERROR, Lang::Strings::DOWNLOAD_ASSETS_FAILED, "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
             vTaskDelay(pdMS_TO_TICKS(2000));
@@ -497,6 +502,9 @@ void Application::Start() {
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveMode(false);
+        if (!network_power_requested_.exchange(true)) {
+            PowerGovernor::GetInstance().Acquire(kPowerRequestNetwork);
+        }
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -504,100 +512,17 @@ void Application::Start() {
     });
     protocol_->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveMode(true);
+        if (network_power_requested_.exchange(false)) {
+            PowerGovernor::GetInstance().Release(kPowerRequestNetwork);
+        }
         Schedule([this]() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
-                        SetDeviceState(kDeviceStateSpeaking);
-                    }
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
-                }
-            }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
-                McpServer::GetInstance().ParseMessage(payload);
-            }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
-                    // Do a reboot if user requests a OTA update
-                    Schedule([this]() {
-                        Reboot();
-                    });
-                } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
-                }
-            }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::OGG_VIBRATION);
-            } else {
-                ESP_LOGW(TAG, "Alert command requires status, message and emotion");
-            }
-#if CONFIG_RECEIVE_CUSTOM_MESSAGE
-        } else if (strcmp(type->valuestring, "custom") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
-            if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
-                    display->SetChatMessage("system", payload_str.c_str());
-                });
-            } else {
-                ESP_LOGW(TAG, "Invalid custom message format: missing payload");
-            }
-#endif
-        } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
-        }
+    protocol_->OnIncomingJson([this](const cJSON* root) {
+        OnIncomingJson(root);
     });
     bool protocol_started = protocol_->Start();
 
@@ -614,15 +539,220 @@ void Application::Start() {
     }
 }
 
-// Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
+// FNV-1a, evaluated at compile time for the message tables and switch labels below
+static constexpr uint32_t MessageHash(const char* text) {
+    uint32_t hash = 2166136261u;
+    while (*text) {
+        hash ^= (uint8_t)*text++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void Application::OnIncomingJson(const cJSON* root) {
+    struct Handler {
+        uint32_t hash;
+        const char* type;
+        void (Application::*handle)(const cJSON* root);
+    };
+    // Ordered by how often the server sends them during a conversation
+    static const Handler handlers[] = {
+        { MessageHash("tts"), "tts", &Application::HandleTtsMessage },
+        { MessageHash("llm"), "llm", &Application::HandleLlmMessage },
+        { MessageHash("stt"), "stt", &Application::HandleSttMessage },
+        { MessageHash("mcp"), "mcp", &Application::HandleMcpMessage },
+        { MessageHash("system"), "system", &Application::HandleSystemMessage },
+        { MessageHash("alert"), "alert", &Application::HandleAlertMessage },
+#if CONFIG_RECEIVE_CUSTOM_MESSAGE
+        { MessageHash("custom"), "custom", &Application::HandleCustomMessage },
+#endif
+    };
+
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (!cJSON_IsString(type)) {
+        ESP_LOGW(TAG, "Message without type");
+        return;
+    }
+    uint32_t hash = MessageHash(type->valuestring);
+    for (const auto& handler : handlers) {
+        if (handler.hash == hash && strcmp(handler.type, type->valuestring) == 0) {
+            (this->*handler.handle)(root);
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+}
+
+void Application::HandleTtsMessage(const cJSON* root) {
+    auto state = cJSON_GetObjectItem(root, "state");
+    if (!cJSON_IsString(state)) {
+        return;
+    }
+    switch (MessageHash(state->valuestring)) {
+        case MessageHash("start"):
+            Schedule([this]() {
+                aborted_ = false;
+                if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
+                    SetDeviceState(kDeviceStateSpeaking);
+                }
+            });
+            break;
+        case MessageHash("stop"):
+            Schedule([this]() {
+                if (device_state_ == kDeviceStateSpeaking) {
+                    if (listening_mode_ == kListeningModeManualStop) {
+                        SetDeviceState(kDeviceStateIdle);
+                    } else {
+                        SetDeviceState(kDeviceStateListening);
+                    }
+                }
+            });
+            break;
+        case MessageHash("sentence_start"): {
+            auto text = cJSON_GetObjectItem(root, "text");
+            if (cJSON_IsString(text)) {
+                ESP_LOGI(TAG, "<< %s", text->valuestring);
+                PostChatMessage(kChatRoleAssistant, text->valuestring);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void Application::HandleSttMessage(const cJSON* root) {
+    auto text = cJSON_GetObjectItem(root, "text");
+    if (cJSON_IsString(text)) {
+        ESP_LOGI(TAG, ">> %s", text->valuestring);
+        PostChatMessage(kChatRoleUser, text->valuestring);
+    }
+}
+
+void Application::HandleLlmMessage(const cJSON* root) {
+    auto emotion = cJSON_GetObjectItem(root, "emotion");
+    if (cJSON_IsString(emotion)) {
+        // Emotion names fit in the string's inline buffer, no allocation
+        Schedule([emotion_str = std::string(emotion->valuestring)]() {
+            Board::GetInstance().GetDisplay()->SetEmotion(emotion_str.c_str());
+        });
+    }
+}
+
+void Application::HandleMcpMessage(const cJSON* root) {
+    auto payload = cJSON_GetObjectItem(root, "payload");
+    if (cJSON_IsObject(payload)) {
+        McpServer::GetInstance().ParseMessage(payload);
+    }
+}
+
+void Application::HandleSystemMessage(const cJSON* root) {
+    auto command = cJSON_GetObjectItem(root, "command");
+    if (cJSON_IsString(command)) {
+        ESP_LOGI(TAG, "System command: %s", command->valuestring);
+        if (strcmp(command->valuestring, "reboot") == 0) {
+            // Do a reboot if user requests a OTA update
+            Schedule([this]() {
+                Reboot();
+            });
+        } else {
+            ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+        }
+    }
+}
+
+void Application::HandleAlertMessage(const cJSON* root) {
+    auto status = cJSON_GetObjectItem(root, "status");
+    auto message = cJSON_GetObjectItem(root, "message");
+    auto emotion = cJSON_GetObjectItem(root, "emotion");
+    if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
+        Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::OGG_VIBRATION);
+    } else {
+        ESP_LOGW(TAG, "Alert command requires status, message and emotion");
+    }
+}
+
+#if CONFIG_RECEIVE_CUSTOM_MESSAGE
+void Application::HandleCustomMessage(const cJSON* root) {
+    auto payload = cJSON_GetObjectItem(root, "payload");
+    if (cJSON_IsObject(payload)) {
+        char* payload_str = cJSON_PrintUnformatted(payload);
+        if (payload_str == nullptr) {
+            ESP_LOGE(TAG, "Failed to print custom message payload");
+            return;
+        }
+        ESP_LOGI(TAG, "Received custom message: %s", payload_str);
+        Schedule([payload = std::string(payload_str)]() {
+            Board::GetInstance().GetDisplay()->SetChatMessage("system", payload.c_str());
+        });
+        cJSON_free(payload_str);
+    } else {
+        ESP_LOGW(TAG, "Invalid custom message format: missing payload");
+    }
+}
+#endif
+
+// Messages are queued in order, only when the main loop falls kChatQueueSize
+// messages behind the oldest one is dropped
+void Application::PostChatMessage(ChatRole role, const char* text) {
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
+        std::lock_guard<std::mutex> lock(chat_mutex_);
+        if (chat_count_ == kChatQueueSize) {
+            ESP_LOGW(TAG, "Chat queue is full, dropping the oldest message");
+            chat_head_ = (chat_head_ + 1) % kChatQueueSize;
+            chat_count_--;
+        }
+        auto& entry = chat_queue_[(chat_head_ + chat_count_) % kChatQueueSize];
+        entry.role = role;
+        entry.text.assign(text);
+        chat_count_++;
+        if (chat_scheduled_) {
+            return;
+        }
+        chat_scheduled_ = true;
+    }
+    Schedule([this]() {
+        ShowPendingChatMessages();
+    });
+}
+
+void Application::ShowPendingChatMessages() {
+    auto display = Board::GetInstance().GetDisplay();
+    while (true) {
+        ChatRole role;
+        {
+            std::lock_guard<std::mutex> lock(chat_mutex_);
+            if (chat_count_ == 0) {
+                chat_scheduled_ = false;
+                return;
+            }
+            auto& entry = chat_queue_[chat_head_];
+            role = entry.role;
+            shown_chat_.swap(entry.text);
+            chat_head_ = (chat_head_ + 1) % kChatQueueSize;
+            chat_count_--;
+        }
+        display->SetChatMessage(role == kChatRoleAssistant ? "assistant" : "user", shown_chat_.c_str());
     }
+}
+
+// Add a async task to MainLoop
+void Application::Schedule(SmallTask callback) {
+    main_tasks_.Push(std::move(callback), __builtin_return_address(0));
     xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
+// The origin is the return address inside the caller of Schedule, the monitor decodes it to a source line
+void Application::PrintScheduleStats() {
+    auto stats = main_tasks_.TakeStats();
+    if (stats.tasks == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Main tasks: %lu run, avg %lu us, max %lu us scheduled from %p, queue high water %u/%u, %lu overflowed, %lu on heap",
+        stats.tasks, (uint32_t)(stats.total_us / stats.tasks), stats.max_us, stats.max_origin,
+        stats.high_water, main_tasks_.capacity(), stats.overflows, stats.heap_tasks);
+}
+
 // The Main Event Loop controls the chat state and websocket connection
 // If other tasks need to access the websocket or chat state,
 // they should use Schedule to call this function
@@ -660,11 +790,8 @@ void Application::MainEventLoop() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
+            if (main_tasks_.RunPending()) {
+                xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
             }
         }
 
@@ -678,6 +805,8 @@ void Application::MainEventLoop() {
                 // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
                 // SystemInfo::PrintTaskList();
                 SystemInfo::PrintHeapStats();
+                PrintScheduleStats();
+                PowerGovernor::GetInstance().PrintStats();
             }
 #ifdef CONFIG_WEATHER_IDLE_DISPLAY_ENABLE
             if (device_state_ == kDeviceStateIdle) {
@@ -859,6 +988,7 @@ void Application::Reboot() {
     }
     protocol_.reset();
     audio_service_.Stop();
+    Settings::Flush();
 
     vTaskDelay(pdMS_TO_TICKS(1000));
     esp_restart();
@@ -889,6 +1019,8 @@ bool Application::UpgradeFirmware(Ota& ota, const std::string& url) {
 
     board.SetPowerSaveMode(false);
     audio_service_.Stop();
+    // 升级期间会长时间写 flash，先把还没写入的设置落盘
+    Settings::Flush();
     vTaskDelay(pdMS_TO_TICKS(1000));
 
     bool upgrade_success = ota.StartUpgradeFromUrl(upgrade_url, [display](int progress, size_t speed) {
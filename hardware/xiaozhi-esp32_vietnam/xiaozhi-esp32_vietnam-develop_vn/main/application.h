@@ -8,10 +8,11 @@
 
 #include <string>
 #include <mutex>
-#include <deque>
 #include <memory>
+#include <atomic>
 
 #include "protocol.h"
+#include "main_task_queue.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state_event.h"
@@ -33,6 +34,9 @@
 #define MAIN_EVENT_CHECK_NEW_VERSION_DONE (1 << 5)
 #define MAIN_EVENT_CLOCK_TICK (1 << 6)
 
+// Slots in the main loop task ring, more than this spill into a heap backed list
+#define MAIN_TASK_QUEUE_SIZE 32
+
 
 enum AecMode {
     kAecOff,
@@ -54,7 +58,7 @@ public:
     void MainEventLoop();
     DeviceState GetDeviceState() const { return device_state_; }
     bool IsVoiceDetected() const { return audio_service_.IsVoiceDetected(); }
-    void Schedule(std::function<void()> callback);
+    void Schedule(SmallTask callback);
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -81,8 +85,7 @@ private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    MainTaskQueue main_tasks_{MAIN_TASK_QUEUE_SIZE};
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -98,14 +101,44 @@ private:
     bool has_server_time_ = false;
     bool aborted_ = false;
     int clock_ticks_ = 0;
+    std::atomic<bool> network_power_requested_ = false;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
     TaskHandle_t main_event_loop_task_handle_ = nullptr;
 
+    // Chat text filled by the network task and shown by the main loop, in order.
+    // Bubble style displays append every message, so none are coalesced. The slots
+    // keep their capacity, so sentences do not allocate once warmed up.
+    enum ChatRole { kChatRoleAssistant, kChatRoleUser, kChatRoleCount };
+    static constexpr size_t kChatQueueSize = 8;
+    struct ChatEntry {
+        ChatRole role;
+        std::string text;
+    };
+    std::mutex chat_mutex_;
+    ChatEntry chat_queue_[kChatQueueSize];
+    size_t chat_head_ = 0;
+    size_t chat_count_ = 0;
+    bool chat_scheduled_ = false;
+    std::string shown_chat_;
+
     void OnWakeWordDetected();
     void CheckNewVersion(Ota& ota);
     void CheckAssetsVersion();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
+    void OnIncomingJson(const cJSON* root);
+    void HandleTtsMessage(const cJSON* root);
+    void HandleSttMessage(const cJSON* root);
+    void HandleLlmMessage(const cJSON* root);
+    void HandleMcpMessage(const cJSON* root);
+    void HandleSystemMessage(const cJSON* root);
+    void HandleAlertMessage(const cJSON* root);
+#if CONFIG_RECEIVE_CUSTOM_MESSAGE
+    void HandleCustomMessage(const cJSON* root);
+#endif
+    void PostChatMessage(ChatRole role, const char* text);
+    void ShowPendingChatMessages();
+    void PrintScheduleStats();
 
 #ifdef CONFIG_WEATHER_IDLE_DISPLAY_ENABLE
     // --- Weather Info ---
@@ -4,15 +4,36 @@
 #include "application.h"
 #include "lvgl_theme.h"
 #include "emote_display.h"
+#include "settings.h"
+#include "lz4_block.h"
 
 #include <esp_log.h>
 #include <spi_flash_mmap.h>
 #include <esp_timer.h>
 #include <cbin_font.h>
+#include <esp_rom_crc.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <algorithm>
+#include <vector>
 
 
 #define TAG "Assets"
 
+// Rendered glyph bitmaps kept in PSRAM for the text font
+#define TEXT_FONT_GLYPH_CACHE_BYTES (128 * 1024)
+
+// Download checkpoints are verified and persisted every block
+#define ASSETS_DOWNLOAD_BLOCK_SIZE (64 * 1024)
+#define ASSETS_DOWNLOAD_MAX_RETRIES 5
+
+// Decompressed entries released by every user are kept up to this size for
+// later reuse. Entries still in use (the text font, emoji images) are not
+// counted and stay resident until the assets partition changes.
+#define ASSETS_RELEASED_CACHE_BYTES (512 * 1024)
+
 struct mmap_assets_table {
     char asset_name[32];          /*!< Name of the asset */
     uint32_t asset_size;          /*!< Size of the asset */
@@ -28,6 +49,8 @@ Assets::Assets() {
 }
 
 Assets::~Assets() {
+    StopBackgroundVerify();
+    ClearDecompressedCache();
     if (mmap_handle_ != 0) {
         esp_partition_munmap(mmap_handle_);
     }
@@ -45,6 +68,7 @@ bool Assets::InitializePartition() {
     partition_valid_ = false;
     checksum_valid_ = false;
     assets_.clear();
+    ClearDecompressedCache();
 
     partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, "assets");
     if (partition_ == nullptr) {
@@ -78,29 +102,146 @@ bool Assets::InitializePartition() {
         return false;
     }
 
-    auto start_time = esp_timer_get_time();
-    uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
-    auto end_time = esp_timer_get_time();
-    ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
-
-    if (calculated_checksum != stored_chksum) {
-        ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+    // 文件表必须完整地落在数据区内
+    uint64_t table_size = static_cast<uint64_t>(stored_files) * sizeof(mmap_assets_table);
+    if (table_size > stored_len) {
+        ESP_LOGE(TAG, "The assets table (%lu entries) does not fit in %lu bytes", stored_files, stored_len);
         return false;
     }
 
+    // Newer packs end with "CRC1" + one CRC32 per entry, so entries can be verified lazily
+    const uint32_t* entry_crcs = nullptr;
+    uint64_t crc_table_size = 4 + static_cast<uint64_t>(stored_files) * sizeof(uint32_t);
+    if (stored_files > 0 && stored_len >= table_size + crc_table_size) {
+        const char* crc_table = mmap_root_ + 12 + stored_len - crc_table_size;
+        if (memcmp(crc_table, "CRC1", 4) == 0) {
+            entry_crcs = reinterpret_cast<const uint32_t*>(crc_table + 4);
+        }
+    }
+    uint64_t data_end = 12 + static_cast<uint64_t>(stored_len) - (entry_crcs != nullptr ? crc_table_size : 0);
+
+    // 条目 CRC 不覆盖文件表本身，加载前逐项检查名称和范围
+    auto table = reinterpret_cast<const mmap_assets_table*>(mmap_root_ + 12);
+    for (uint32_t i = 0; i < stored_files; i++) {
+        const auto& item = table[i];
+        uint64_t start = 12 + table_size + item.asset_offset;
+        // 每个条目前面有 2 字节的 "ZZ"/"ZL" 前缀
+        if (start + 2 + item.asset_size > data_end) {
+            ESP_LOGE(TAG, "The asset entry %lu is out of bounds (offset 0x%lx, size 0x%lx)", i, item.asset_offset, item.asset_size);
+            return false;
+        }
+        if (strnlen(item.asset_name, sizeof(item.asset_name)) == sizeof(item.asset_name)) {
+            ESP_LOGE(TAG, "The asset entry %lu has an unterminated name", i);
+            return false;
+        }
+    }
+
+    // Fingerprint of this pack (header, table and entry CRCs), persisted once it passed a full verification
+    uint32_t fingerprint = esp_rom_crc32_le(0, (const uint8_t*)mmap_root_, static_cast<uint32_t>(12 + table_size));
+    if (entry_crcs != nullptr) {
+        fingerprint = esp_rom_crc32_le(fingerprint, (const uint8_t*)entry_crcs, stored_files * sizeof(uint32_t));
+    }
+    verified_fingerprint_ = fingerprint;
+    bool verified = Settings("assets").GetInt("verified") == static_cast<int32_t>(fingerprint);
+
+    if (verified) {
+        ESP_LOGI(TAG, "The assets were verified on a previous boot, skip checksum");
+    } else if (entry_crcs != nullptr) {
+        ESP_LOGI(TAG, "The assets will be verified per entry on first access and in the background");
+    } else {
+        auto start_time = esp_timer_get_time();
+        uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
+        auto end_time = esp_timer_get_time();
+        ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
+
+        if (calculated_checksum != stored_chksum) {
+            ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+            return false;
+        }
+        Settings("assets", true).SetInt("verified", static_cast<int32_t>(fingerprint));
+        verified = true;
+    }
+
     checksum_valid_ = true;
 
     for (uint32_t i = 0; i < stored_files; i++) {
-        auto item = (const mmap_assets_table*)(mmap_root_ + 12 + i * sizeof(mmap_assets_table));
+        const auto& item = table[i];
         auto asset = Asset{
-            .size = static_cast<size_t>(item->asset_size),
-            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * stored_files + item->asset_offset)
+            .size = static_cast<size_t>(item.asset_size),
+            .offset = static_cast<size_t>(12 + table_size + item.asset_offset),
+            .crc = entry_crcs != nullptr ? entry_crcs[i] : 0,
+            .verified = verified,
         };
-        assets_[item->asset_name] = asset;
+        assets_[item.asset_name] = asset;
+    }
+
+    if (!verified) {
+        StartBackgroundVerify();
     }
     return checksum_valid_;
 }
 
+// 校验条目（包括 "ZZ"/"ZL" 前缀）的 CRC32，调用时需持有 verify_mutex_
+bool Assets::VerifyAsset(const std::string& name, Asset& asset) {
+    auto data = reinterpret_cast<const uint8_t*>(mmap_root_ + asset.offset);
+    uint32_t crc = 0;
+    for (size_t done = 0; done < asset.size + 2; ) {
+        // 分段计算，让出 CPU 给其他任务
+        size_t chunk = std::min<size_t>(asset.size + 2 - done, 64 * 1024);
+        crc = esp_rom_crc32_le(crc, data + done, chunk);
+        done += chunk;
+        taskYIELD();
+    }
+    if (crc != asset.crc) {
+        ESP_LOGE(TAG, "The asset %s is corrupted, crc 0x%08lx, expected 0x%08lx", name.c_str(), crc, asset.crc);
+        checksum_valid_ = false;
+        return false;
+    }
+    asset.verified = true;
+    return true;
+}
+
+void Assets::StartBackgroundVerify() {
+    verify_abort_ = false;
+    verify_running_ = true;
+    auto ret = xTaskCreate([](void* arg) {
+        auto assets = static_cast<Assets*>(arg);
+        assets->BackgroundVerifyTask();
+        assets->verify_running_ = false;
+        vTaskDelete(NULL);
+    }, "assets_verify", 4096, this, tskIDLE_PRIORITY + 1, nullptr);
+    if (ret != pdPASS) {
+        verify_running_ = false;
+        ESP_LOGW(TAG, "Failed to start background verification, entries are verified on access");
+    }
+}
+
+void Assets::StopBackgroundVerify() {
+    verify_abort_ = true;
+    while (verify_running_) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void Assets::BackgroundVerifyTask() {
+    auto start_time = esp_timer_get_time();
+    bool all_valid = true;
+    for (auto& [name, asset] : assets_) {
+        if (verify_abort_) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(verify_mutex_);
+        if (!asset.verified && !VerifyAsset(name, asset)) {
+            all_valid = false;
+        }
+    }
+    ESP_LOGI(TAG, "Background verification %s in %d ms", all_valid ? "passed" : "failed",
+        int((esp_timer_get_time() - start_time) / 1000));
+    if (all_valid) {
+        Settings("assets", true).SetInt("verified", static_cast<int32_t>(verified_fingerprint_));
+    }
+}
+
 bool Assets::Apply() {
     void* ptr = nullptr;
     size_t size = 0;
@@ -110,14 +251,16 @@ bool Assets::Apply() {
     }
 
     cJSON* root = cJSON_ParseWithLength(static_cast<char*>(ptr), size);
+    ReleaseAssetData("index.json");
     if (root == nullptr) {
         ESP_LOGE(TAG, "The index.json file is not valid");
         return false;
     }
 
+    // Version 2 may contain LZ4 compressed entries
     cJSON* version = cJSON_GetObjectItem(root, "version");
     if (cJSON_IsNumber(version)) {
-        if (version->valuedouble > 1) {
+        if (version->valuedouble > 2) {
             ESP_LOGE(TAG, "The assets version %d is not supported, please upgrade the firmware", version->valueint);
             return false;
         }
@@ -152,11 +295,14 @@ bool Assets::Apply() {
     if (cJSON_IsString(font)) {
         std::string fonts_text_file = font->valuestring;
         if (GetAssetData(fonts_text_file, ptr, size)) {
-            auto text_font = std::make_shared<LvglCBinFont>(ptr);
+            std::shared_ptr<LvglFont> text_font = std::make_shared<LvglCBinFont>(ptr);
             if (text_font->font() == nullptr) {
                 ESP_LOGE(TAG, "Failed to load fonts.bin");
                 return false;
             }
+#ifdef CONFIG_SPIRAM
+            text_font = std::make_shared<LvglCachedFont>(text_font, TEXT_FONT_GLYPH_CACHE_BYTES);
+#endif
             if (light_theme != nullptr) {
                 light_theme->set_text_font(text_font);
             }
@@ -183,7 +329,12 @@ bool Assets::Apply() {
                         ESP_LOGE(TAG, "Emoji %s image file %s is not found", name->valuestring, file->valuestring);
                         continue;
                     }
-                    custom_emoji_collection->AddEmoji(name->valuestring, new LvglRawImage(ptr, size));
+                    if (LvglMappedImage::IsMappedImage(ptr, size)) {
+                        // Pre-converted to the panel pixel format, drawn from flash without decoding
+                        custom_emoji_collection->AddEmoji(name->valuestring, new LvglMappedImage(ptr, size));
+                    } else {
+                        custom_emoji_collection->AddEmoji(name->valuestring, new LvglRawImage(ptr, size));
+                    }
                 }
             }
         }
@@ -367,9 +518,33 @@ bool Assets::Apply() {
     return true;
 }
 
+// 资源分区的原始读写，供 PartitionWriter 使用
+class AssetsPartitionFlash : public FlashRegion {
+public:
+    explicit AssetsPartitionFlash(const esp_partition_t* partition) : partition_(partition) {}
+
+    size_t size() const override { return partition_->size; }
+    size_t sector_size() const override { return esp_partition_get_main_flash_sector_size(); }
+    esp_err_t Erase(size_t offset, size_t size) override { return esp_partition_erase_range(partition_, offset, size); }
+    esp_err_t Write(size_t offset, const void* data, size_t size) override { return esp_partition_write(partition_, offset, data, size); }
+    esp_err_t Read(size_t offset, void* data, size_t size) override { return esp_partition_read(partition_, offset, data, size); }
+
+private:
+    const esp_partition_t* partition_;
+};
+
+bool Assets::CanResumeDownload(const std::string& url) {
+    Settings checkpoint("assets_dl");
+    return checkpoint.GetString("url") == url && checkpoint.GetInt("offset") > 0;
+}
+
 bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback) {
     ESP_LOGI(TAG, "Downloading new version of assets from %s", url.c_str());
     
+    // 停止后台校验，新的资源需要重新校验
+    StopBackgroundVerify();
+    Settings("assets", true).EraseKey("verified");
+
     // 取消当前资源分区的内存映射
     if (mmap_handle_ != 0) {
         esp_partition_munmap(mmap_handle_);
@@ -378,101 +553,155 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
     }
     checksum_valid_ = false;
     assets_.clear();
+    ClearDecompressedCache();
+
+    // 读取断点，只有同一个 URL 且已写入的数据校验一致才续传
+    DownloadState state;
+    {
+        Settings checkpoint("assets_dl", true);
+        if (checkpoint.GetString("url") == url) {
+            state.offset = checkpoint.GetInt("offset");
+            state.content_length = checkpoint.GetInt("total");
+            state.crc = static_cast<uint32_t>(checkpoint.GetInt("crc"));
+        } else {
+            checkpoint.EraseAll();
+        }
+    }
+    if (state.offset > 0) {
+        AssetsPartitionFlash flash(partition_);
+        if (state.offset > partition_->size || PartitionWriter::CalculateCrc(flash, 0, state.offset, 0) != state.crc) {
+            ESP_LOGW(TAG, "Download checkpoint does not match the partition, restarting from 0");
+            state = DownloadState();
+        } else {
+            ESP_LOGI(TAG, "Resuming assets download at %u/%u", state.offset, state.content_length);
+        }
+    }
 
-    // 下载新的资源文件
+    // 网络中断时从最后一个校验通过的块继续，重试间隔 1s, 2s, 4s...
+    esp_err_t err = ESP_FAIL;
+    for (int retry = 0; retry <= ASSETS_DOWNLOAD_MAX_RETRIES; retry++) {
+        if (retry > 0) {
+            ESP_LOGW(TAG, "Assets download interrupted at %u, retry %d", state.offset, retry);
+            vTaskDelay(pdMS_TO_TICKS(1000 << (retry - 1)));
+        }
+        size_t offset_before = state.offset;
+        err = DownloadRange(url, state, progress_callback);
+        if (err != ESP_FAIL) {
+            break;
+        }
+        // 有进展时重新计数
+        if (state.offset > offset_before) {
+            retry = 0;
+        }
+    }
+    if (err != ESP_OK) {
+        return false;
+    }
+
+    Settings("assets_dl", true).EraseAll();
+    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes", state.offset);
+
+    // 重新初始化资源分区
+    if (!InitializePartition()) {
+        ESP_LOGE(TAG, "Failed to re-initialize assets partition");
+        return false;
+    }
+
+    return true;
+}
+
+// 返回 ESP_FAIL 表示可以重试，state 会回退到最后一个已提交的块
+esp_err_t Assets::DownloadRange(const std::string& url, DownloadState& state, std::function<void(int progress, size_t speed)>& progress_callback) {
     auto network = Board::GetInstance().GetNetwork();
     auto http = network->CreateHttp(0);
-    
+    if (state.offset > 0) {
+        http->SetHeader("Range", "bytes=" + std::to_string(state.offset) + "-");
+    }
+
     if (!http->Open("GET", url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
+        return ESP_FAIL;
     }
 
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
-        return false;
+    int status_code = http->GetStatusCode();
+    if (status_code == 200 && state.offset > 0) {
+        ESP_LOGW(TAG, "Server does not support range requests, restarting from 0");
+        state = DownloadState();
+    } else if (status_code != 200 && status_code != 206) {
+        ESP_LOGE(TAG, "Failed to get assets, status code: %d", status_code);
+        return status_code >= 500 ? ESP_FAIL : ESP_ERR_INVALID_RESPONSE;
     }
 
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
+    size_t body_length = http->GetBodyLength();
+    if (body_length == 0) {
         ESP_LOGE(TAG, "Failed to get content length");
-        return false;
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (state.content_length == 0) {
+        state.content_length = state.offset + body_length;
+    } else if (state.offset + body_length != state.content_length) {
+        // 服务器上的文件已经变化，旧的断点作废
+        ESP_LOGW(TAG, "Assets size changed on server, restarting from 0");
+        state = DownloadState();
+        Settings("assets_dl", true).EraseAll();
+        return ESP_FAIL;
     }
 
-    if (content_length > partition_->size) {
-        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
-        return false;
+    if (state.content_length > partition_->size) {
+        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", state.content_length, partition_->size);
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    // 定义扇区大小为4KB（ESP32的标准扇区大小）
-    const size_t SECTOR_SIZE = esp_partition_get_main_flash_sector_size();
-    
-    // 计算需要擦除的扇区数量
-    size_t sectors_to_erase = (content_length + SECTOR_SIZE - 1) / SECTOR_SIZE; // 向上取整
-    size_t total_erase_size = sectors_to_erase * SECTOR_SIZE;
-    
-    ESP_LOGI(TAG, "Sector size: %u, content length: %u, sectors to erase: %u, total erase size: %u", 
-             SECTOR_SIZE, content_length, sectors_to_erase, total_erase_size);
-    
-    // 写入新的资源文件到分区，一边erase一边写入
+    AssetsPartitionFlash flash(partition_);
+    PartitionWriter writer(flash, ASSETS_DOWNLOAD_BLOCK_SIZE);
+    writer.Begin(state);
+    ESP_LOGI(TAG, "Sector size: %u, content length: %u, start offset: %u",
+             flash.sector_size(), state.content_length, state.offset);
+
     char buffer[512];
-    size_t total_written = 0;
     size_t recent_written = 0;
-    size_t current_sector = 0;
     auto last_calc_time = esp_timer_get_time();
     
     while (true) {
         int ret = http->Read(buffer, sizeof(buffer));
         if (ret < 0) {
             ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
+            writer.Rollback();
+            state = writer.state();
+            return ESP_FAIL;
         }
 
         if (ret == 0) {
             break;
         }
 
-        // 检查是否需要擦除新的扇区
-        size_t write_end_offset = total_written + ret;
-        size_t needed_sectors = (write_end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        // 擦除需要的新扇区
-        while (current_sector < needed_sectors) {
-            size_t sector_start = current_sector * SECTOR_SIZE;
-            size_t sector_end = (current_sector + 1) * SECTOR_SIZE;
-            
-            // 确保擦除范围不超过分区大小
-            if (sector_end > partition_->size) {
-                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", sector_end, partition_->size);
-                return false;
-            }
-            
-            ESP_LOGD(TAG, "Erasing sector %u (offset: %u, size: %u)", current_sector, sector_start, SECTOR_SIZE);
-            esp_err_t err = esp_partition_erase_range(partition_, sector_start, SECTOR_SIZE);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to erase sector %u at offset %u: %s", current_sector, sector_start, esp_err_to_name(err));
-                return false;
-            }
-            
-            current_sector++;
+        // 扇区在首次写入前擦除，断点只落在扇区边界上，回读校验通过后写入 NVS
+        bool committed = false;
+        esp_err_t err = writer.Write(buffer, ret, committed);
+        state = writer.state();
+        if (err == ESP_ERR_INVALID_CRC) {
+            ESP_LOGE(TAG, "Block before offset %u failed verification", writer.committed().offset);
+            return ESP_FAIL;
+        } else if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", state.offset, esp_err_to_name(err));
+            return err;
         }
+        recent_written += ret;
 
-        // 写入数据到分区
-        esp_err_t err = esp_partition_write(partition_, total_written, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", total_written, esp_err_to_name(err));
-            return false;
+        if (committed) {
+            Settings checkpoint("assets_dl", true);
+            checkpoint.SetString("url", url);
+            checkpoint.SetInt("offset", state.offset);
+            checkpoint.SetInt("total", state.content_length);
+            checkpoint.SetInt("crc", static_cast<int32_t>(state.crc));
         }
 
-        total_written += ret;
-        recent_written += ret;
-
         // 计算进度和速度
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_written == content_length || ret == 0) {
-            size_t progress = total_written * 100 / content_length;
+        if (esp_timer_get_time() - last_calc_time >= 1000000 || state.offset == state.content_length) {
+            size_t progress = state.offset * 100 / state.content_length;
             size_t speed = recent_written; // 每秒的字节数
             ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Sectors erased: %u", 
-                     progress, total_written, content_length, speed, current_sector);
+                     progress, state.offset, state.content_length, speed, writer.erased_sectors());
             if (progress_callback) {
                 progress_callback(progress, speed);
             }
@@ -483,21 +712,13 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
     
     http->Close();
 
-    if (total_written != content_length) {
-        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", total_written, content_length);
-        return false;
+    if (state.offset != state.content_length) {
+        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", state.offset, state.content_length);
+        writer.Rollback();
+        state = writer.state();
+        return ESP_FAIL;
     }
-
-    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total sectors erased: %u", 
-             total_written, current_sector);
-
-    // 重新初始化资源分区
-    if (!InitializePartition()) {
-        ESP_LOGE(TAG, "Failed to re-initialize assets partition");
-        return false;
-    }
-
-    return true;
+    return ESP_OK;
 }
 
 bool Assets::GetAssetData(const std::string& name, void*& ptr, size_t& size) {
@@ -505,7 +726,17 @@ bool Assets::GetAssetData(const std::string& name, void*& ptr, size_t& size) {
     if (asset == assets_.end()) {
         return false;
     }
+    if (!asset->second.verified) {
+        std::lock_guard<std::mutex> lock(verify_mutex_);
+        if (!asset->second.verified && !VerifyAsset(name, asset->second)) {
+            return false;
+        }
+    }
+
     auto data = (const char*)(mmap_root_ + asset->second.offset);
+    if (data[0] == 'Z' && data[1] == 'L') {
+        return GetCompressedAssetData(name, asset->second, data + 2, ptr, size);
+    }
     if (data[0] != 'Z' || data[1] != 'Z') {
         ESP_LOGE(TAG, "The asset %s is not valid with magic %02x%02x", name.c_str(), data[0], data[1]);
         return false;
@@ -515,3 +746,83 @@ bool Assets::GetAssetData(const std::string& name, void*& ptr, size_t& size) {
     size = asset->second.size;
     return true;
 }
+
+// 压缩的条目（"ZL" + u32 原始大小 + LZ4 块）首次访问时解压到 PSRAM。
+// 字体、表情图片会一直持有返回的指针，这些条目常驻，不受预算限制；
+// 只有 index.json 这类用完即 ReleaseAssetData 的条目才进入已释放缓存，
+// 超出 ASSETS_RELEASED_CACHE_BYTES 时先淘汰最早释放的
+bool Assets::GetCompressedAssetData(const std::string& name, const Asset& asset, const char* data, void*& ptr, size_t& size) {
+    auto cached = decompressed_.find(name);
+    if (cached != decompressed_.end()) {
+        auto& entry = cached->second;
+        if (!entry.pinned) {
+            entry.pinned = true;
+            released_.remove(name);
+            released_bytes_ -= entry.size;
+        }
+        cache_hits_++;
+        ptr = entry.data;
+        size = entry.size;
+        return true;
+    }
+
+    if (asset.size < 4) {
+        ESP_LOGE(TAG, "The compressed asset %s is truncated", name.c_str());
+        return false;
+    }
+    uint32_t raw_size;
+    memcpy(&raw_size, data, sizeof(raw_size));
+
+    // 为新条目腾出空间，只能淘汰已释放的条目
+    while (released_bytes_ + raw_size > ASSETS_RELEASED_CACHE_BYTES && !released_.empty()) {
+        auto victim = decompressed_.find(released_.back());
+        released_.pop_back();
+        released_bytes_ -= victim->second.size;
+        heap_caps_free(victim->second.data);
+        decompressed_.erase(victim);
+    }
+
+    auto start_time = esp_timer_get_time();
+    auto buffer = static_cast<uint8_t*>(heap_caps_malloc(raw_size, MALLOC_CAP_SPIRAM));
+    if (buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %lu bytes to decompress %s", raw_size, name.c_str());
+        return false;
+    }
+    if (!Lz4Decompress((const uint8_t*)data + 4, asset.size - 4, buffer, raw_size)) {
+        ESP_LOGE(TAG, "Failed to decompress %s", name.c_str());
+        heap_caps_free(buffer);
+        return false;
+    }
+    cache_misses_++;
+    decompressed_[name] = DecompressedAsset{buffer, raw_size, true};
+    size_t resident_bytes = 0;
+    for (auto& [entry_name, entry] : decompressed_) {
+        resident_bytes += entry.size;
+    }
+    ESP_LOGI(TAG, "Decompressed %s: %u -> %lu bytes in %d ms (cache hits %lu, misses %lu, %u bytes in PSRAM, %u released)",
+        name.c_str(), asset.size, raw_size, int((esp_timer_get_time() - start_time) / 1000), cache_hits_, cache_misses_,
+        resident_bytes, released_bytes_);
+
+    ptr = buffer;
+    size = raw_size;
+    return true;
+}
+
+void Assets::ReleaseAssetData(const std::string& name) {
+    auto cached = decompressed_.find(name);
+    if (cached == decompressed_.end() || !cached->second.pinned) {
+        return;
+    }
+    cached->second.pinned = false;
+    released_.push_front(name);
+    released_bytes_ += cached->second.size;
+}
+
+void Assets::ClearDecompressedCache() {
+    for (auto& [name, entry] : decompressed_) {
+        heap_caps_free(entry.data);
+    }
+    decompressed_.clear();
+    released_.clear();
+    released_bytes_ = 0;
+}
@@ -2,17 +2,24 @@
 #define ASSETS_H
 
 #include <map>
+#include <list>
 #include <string>
 #include <functional>
+#include <mutex>
+#include <atomic>
 
 #include <cJSON.h>
 #include <esp_partition.h>
 #include <model_path.h>
 
+#include "partition_writer.h"
+
 
 struct Asset {
     size_t size;
     size_t offset;
+    uint32_t crc;       // CRC32 of the entry including its prefix, 0 for packs without a CRC table
+    bool verified;
 };
 
 class Assets {
@@ -24,8 +31,14 @@ public:
     ~Assets();
 
     bool Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback);
+    bool CanResumeDownload(const std::string& url);
     bool Apply();
     bool GetAssetData(const std::string& name, void*& ptr, size_t& size);
+    // Tells the cache a caller no longer uses the data. Compressed assets are
+    // decompressed into PSRAM and only released ones can be evicted, so
+    // callers that parse and drop the data should release it; do not use the
+    // pointer afterwards.
+    void ReleaseAssetData(const std::string& name);
 
     inline bool partition_valid() const { return partition_valid_; }
     inline bool checksum_valid() const { return checksum_valid_; }
@@ -36,8 +49,25 @@ private:
     Assets(const Assets&) = delete;
     Assets& operator=(const Assets&) = delete;
 
+    // Decompressed copy of a compressed entry in PSRAM, pinned until its user releases it
+    struct DecompressedAsset {
+        uint8_t* data;
+        size_t size;
+        bool pinned;
+    };
+
+    // Progress of an interrupted download, persisted in NVS after each verified block
+    using DownloadState = PartitionWriter::State;
+
     bool InitializePartition();
     uint32_t CalculateChecksum(const char* data, uint32_t length);
+    bool GetCompressedAssetData(const std::string& name, const Asset& asset, const char* data, void*& ptr, size_t& size);
+    void ClearDecompressedCache();
+    bool VerifyAsset(const std::string& name, Asset& asset);
+    void StartBackgroundVerify();
+    void StopBackgroundVerify();
+    void BackgroundVerifyTask();
+    esp_err_t DownloadRange(const std::string& url, DownloadState& state, std::function<void(int progress, size_t speed)>& progress_callback);
 
     const esp_partition_t* partition_ = nullptr;
     esp_partition_mmap_handle_t mmap_handle_ = 0;
@@ -47,6 +77,15 @@ private:
     std::string default_assets_url_;
     srmodel_list_t* models_list_ = nullptr;
     std::map<std::string, Asset> assets_;
+    std::map<std::string, DecompressedAsset> decompressed_;
+    std::list<std::string> released_;
+    size_t released_bytes_ = 0;
+    uint32_t cache_hits_ = 0;
+    uint32_t cache_misses_ = 0;
+    std::mutex verify_mutex_;
+    std::atomic<bool> verify_abort_ = false;
+    std::atomic<bool> verify_running_ = false;
+    uint32_t verified_fingerprint_ = 0;
 };
 
 #endif
@@ -7,12 +7,18 @@
 
 #include <model_path.h>
 #include "audio_codec.h"
+#include "pcm_frame_pool.h"
 
 class AudioProcessor {
 public:
     virtual ~AudioProcessor() = default;
     
-    virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) = 0;
+    // Output frames are taken from frame_pool, the consumer of OnOutput
+    // returns them once they are encoded
+    virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list,
+                            PcmFramePool* frame_pool) = 0;
+    // Processors that do not keep the data leave the vector untouched, so the
+    // caller can read the next chunk into the same buffer
     virtual void Feed(std::vector<int16_t>&& data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
@@ -1,6 +1,9 @@
 #include "audio_service.h"
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
+
+#include "power_governor.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -133,6 +136,11 @@ void AudioService::Stop() {
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+    InputBuffers buffers;
+    return ReadAudioData(data, sample_rate, samples, buffers);
+}
+
+bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples, InputBuffers& buffers) {
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
@@ -140,19 +148,24 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     }
 
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        auto& raw = buffers.raw;
+        raw.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
+        if (!codec_->InputData(raw)) {
             return false;
         }
         if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
+            auto& mic_channel = buffers.mic;
+            auto& reference_channel = buffers.reference;
+            mic_channel.resize(raw.size() / 2);
+            reference_channel.resize(raw.size() / 2);
             for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
+                mic_channel[i] = raw[j];
+                reference_channel[i] = raw[j + 1];
             }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
+            auto& resampled_mic = buffers.resampled_mic;
+            auto& resampled_reference = buffers.resampled_reference;
+            resampled_mic.resize(input_resampler_.GetOutputSamples(mic_channel.size()));
+            resampled_reference.resize(reference_resampler_.GetOutputSamples(reference_channel.size()));
             input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
             reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
             data.resize(resampled_mic.size() + resampled_reference.size());
@@ -161,9 +174,8 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
                 data[j + 1] = resampled_reference[i];
             }
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            data.resize(input_resampler_.GetOutputSamples(raw.size()));
+            input_resampler_.Process(raw.data(), raw.size(), data.data());
         }
     } else {
         data.resize(samples * codec_->input_channels());
@@ -196,10 +208,16 @@ void AudioService::AudioInputTask() {
         if (service_stopped_) {
             break;
         }
-        if (audio_input_need_warmup_) {
+        // Wait until the wake word has been fed its last chunk, so the switch
+        // to the audio processor happens between two reads
+        if (audio_input_need_warmup_ && !(bits & AS_EVENT_WAKE_WORD_RUNNING)) {
             audio_input_need_warmup_ = false;
-            vTaskDelay(pdMS_TO_TICKS(120));
-            continue;
+            // Coming from a wake word the input is already running, and the
+            // speech since the wake word goes out ahead of the processed audio
+            if (!HandOverWakeWordAudio()) {
+                vTaskDelay(pdMS_TO_TICKS(120));
+                continue;
+            }
         }
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
@@ -211,7 +229,7 @@ void AudioService::AudioInputTask() {
             }
             std::vector<int16_t> data;
             int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
-            if (ReadAudioData(data, 16000, samples)) {
+            if (ReadAudioData(data, 16000, samples, input_buffers_)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
                     auto mono_data = std::vector<int16_t>(data.size() / 2);
@@ -227,11 +245,13 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
+            auto& data = input_buffers_.feed;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
-                if (ReadAudioData(data, 16000, samples)) {
+                if (ReadAudioData(data, 16000, samples, input_buffers_)) {
+                    int64_t start_time = esp_timer_get_time();
                     wake_word_->Feed(data);
+                    CheckInputDeadline(start_time, samples);
                     continue;
                 }
             }
@@ -239,11 +259,14 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
+            auto& data = input_buffers_.feed;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
-                if (ReadAudioData(data, 16000, samples)) {
+                if (ReadAudioData(data, 16000, samples, input_buffers_)) {
+                    // Both processors copy the samples, so the buffer comes back for the next read
+                    int64_t start_time = esp_timer_get_time();
                     audio_processor_->Feed(std::move(data));
+                    CheckInputDeadline(start_time, samples);
                     continue;
                 }
             }
@@ -256,9 +279,25 @@ void AudioService::AudioInputTask() {
     ESP_LOGW(TAG, "Audio input task stopped");
 }
 
+bool AudioService::HandOverWakeWordAudio() {
+    std::vector<int16_t> pcm;
+    if (!wake_word_ || !wake_word_->GetAudioSinceWakeWord(pcm, OPUS_FRAME_DURATION_MS * 16000 / 1000)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Hand over %u ms of audio since the wake word", pcm.size() / 16);
+    if (!pcm.empty()) {
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(pcm));
+    }
+    return true;
+}
+
 void AudioService::AudioOutputTask() {
     while (true) {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+        if (audio_playback_queue_.empty() && !audio_decode_queue_.empty()) {
+            // The packets are here but the decoder did not keep up with playback
+            PowerGovernor::GetInstance().ReportDeadlineMiss(kPowerRequestAudioCodec);
+        }
         audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
         if (service_stopped_) {
             break;
@@ -293,16 +332,29 @@ void AudioService::AudioOutputTask() {
 }
 
 void AudioService::OpusCodecTask() {
+    auto& governor = PowerGovernor::GetInstance();
+    bool power_requested = false;
+    auto has_work = [this]() {
+        return service_stopped_ ||
+            (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
+            (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
+    };
+
     while (true) {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
+        /* Only keep the CPU at full speed while there is something to encode or decode */
+        if (power_requested && !has_work()) {
+            governor.Release(kPowerRequestAudioCodec);
+            power_requested = false;
+        }
+        audio_queue_cv_.wait(lock, has_work);
         if (service_stopped_) {
             break;
         }
+        if (!power_requested) {
+            governor.Acquire(kPowerRequestAudioCodec);
+            power_requested = true;
+        }
 
         /* Decode the audio from decode queue */
         if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
@@ -342,32 +394,51 @@ void AudioService::OpusCodecTask() {
             audio_queue_cv_.notify_all();
             lock.unlock();
 
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
-            }
+            // A task holds one frame, except the audio handed over from the
+            // wake word which is encoded frame by frame here
+            const size_t frame_samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            size_t frames = task->pcm.size() > frame_samples ? task->pcm.size() / frame_samples : 1;
+            for (size_t i = 0; i < frames; i++) {
+                auto packet = std::make_unique<AudioStreamPacket>();
+                packet->frame_duration = OPUS_FRAME_DURATION_MS;
+                packet->sample_rate = 16000;
+                packet->timestamp = i == 0 ? task->timestamp : 0;
+                std::vector<int16_t> pcm;
+                if (frames == 1) {
+                    pcm = std::move(task->pcm);
+                } else {
+                    pcm = pcm_frame_pool_.Acquire();
+                    std::copy(task->pcm.begin() + i * frame_samples, task->pcm.begin() + (i + 1) * frame_samples, pcm.begin());
+                }
+                // Encode() leaves the samples in pcm, the frame goes back to the processor
+                bool encoded = opus_encoder_->Encode(std::move(pcm), packet->payload);
+                pcm_frame_pool_.Release(std::move(pcm));
+                if (!encoded) {
+                    ESP_LOGE(TAG, "Failed to encode audio");
+                    continue;
+                }
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
+                if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+                    {
+                        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+                        audio_send_queue_.push_back(std::move(packet));
+                    }
+                    if (callbacks_.on_send_queue_available) {
+                        callbacks_.on_send_queue_available();
+                    }
+                } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
                     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
+                    audio_testing_queue_.push_back(std::move(packet));
                 }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
-                }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
+                debug_statistics_.encode_count++;
             }
-            debug_statistics_.encode_count++;
             lock.lock();
         }
     }
 
+    if (power_requested) {
+        governor.Release(kPowerRequestAudioCodec);
+    }
     ESP_LOGW(TAG, "Opus codec task stopped");
 }
 
@@ -472,13 +543,14 @@ void AudioService::EnableWakeWordDetection(bool enable) {
         wake_word_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     }
+    UpdateInputPowerRequest();
 }
 
 void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_, &pcm_frame_pool_);
             audio_processor_initialized_ = true;
         }
 
@@ -491,6 +563,7 @@ void AudioService::EnableVoiceProcessing(bool enable) {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     }
+    UpdateInputPowerRequest();
 }
 
 void AudioService::EnableAudioTesting(bool enable) {
@@ -504,12 +577,38 @@ void AudioService::EnableAudioTesting(bool enable) {
         audio_decode_queue_ = std::move(audio_testing_queue_);
         audio_queue_cv_.notify_all();
     }
+    UpdateInputPowerRequest();
+}
+
+// The input task runs at full speed whenever any consumer of the microphone is enabled
+void AudioService::UpdateInputPowerRequest() {
+    std::lock_guard<std::mutex> lock(input_power_mutex_);
+    bool running = xEventGroupGetBits(event_group_) &
+        (AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_AUDIO_TESTING_RUNNING);
+    if (input_power_requested_ == running) {
+        return;
+    }
+    input_power_requested_ = running;
+    if (running) {
+        PowerGovernor::GetInstance().Acquire(kPowerRequestAudioInput);
+    } else {
+        PowerGovernor::GetInstance().Release(kPowerRequestAudioInput);
+    }
+}
+
+// Feeding has to finish well within the duration of the chunk, otherwise the
+// input task falls behind the I2S DMA and drops audio
+void AudioService::CheckInputDeadline(int64_t start_time, int samples) {
+    int64_t elapsed_us = esp_timer_get_time() - start_time;
+    if (elapsed_us > (int64_t)samples * 1000000 / 16000 / 2) {
+        PowerGovernor::GetInstance().ReportDeadlineMiss(kPowerRequestAudioInput);
+    }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_, &pcm_frame_pool_);
         audio_processor_initialized_ = true;
     }
 
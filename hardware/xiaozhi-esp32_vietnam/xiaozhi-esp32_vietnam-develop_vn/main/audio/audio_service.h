@@ -6,6 +6,7 @@
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -19,6 +20,7 @@
 
 #include "audio_codec.h"
 #include "audio_processor.h"
+#include "pcm_frame_pool.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
@@ -146,17 +148,39 @@ private:
     bool voice_detected_ = false;
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
+    // Guards the flag together with the governor call, the enable functions
+    // run on both the main task and the esp_timer task
+    std::mutex input_power_mutex_;
+    bool input_power_requested_ = false;
+
+    // Buffers reused by the audio input task, so once they have grown to the
+    // feed size reading and resampling the input does not touch the heap
+    struct InputBuffers {
+        std::vector<int16_t> feed;
+        std::vector<int16_t> raw;
+        std::vector<int16_t> mic;
+        std::vector<int16_t> reference;
+        std::vector<int16_t> resampled_mic;
+        std::vector<int16_t> resampled_reference;
+    };
+    InputBuffers input_buffers_;
+    // Output frames of the audio processor, returned after encoding
+    PcmFramePool pcm_frame_pool_{MAX_ENCODE_TASKS_IN_QUEUE + 2, OPUS_FRAME_DURATION_MS * 16000 / 1000};
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
 
+    bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples, InputBuffers& buffers);
+    bool HandOverWakeWordAudio();
     void AudioInputTask();
     void AudioOutputTask();
     void OpusCodecTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
+    void UpdateInputPowerRequest();
+    void CheckInputDeadline(int64_t start_time, int samples);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#ifndef _PCM_FRAME_POOL_H_
+#define _PCM_FRAME_POOL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fixed set of frame buffers that go from the audio processor through the
+// encode queue to the Opus encoder and back. Buffers are allocated the first
+// time they are needed, after that the 16 kHz input path reuses them.
+class PcmFramePool {
+public:
+    // frames is the most buffers in flight at once: the one being filled,
+    // the ones waiting in the encode queue and the one being encoded
+    PcmFramePool(size_t frames, size_t frame_samples) : frames_(frames), frame_samples_(frame_samples) {
+        free_.reserve(frames);
+    }
+
+    PcmFramePool(const PcmFramePool&) = delete;
+    PcmFramePool& operator=(const PcmFramePool&) = delete;
+
+    size_t frame_samples() const { return frame_samples_; }
+
+    // Returns a buffer of frame_samples() samples. If more than `frames`
+    // buffers are in flight a new one is allocated and counted as a miss.
+    std::vector<int16_t> Acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            std::vector<int16_t> buffer = std::move(free_.back());
+            free_.pop_back();
+            return buffer;
+        }
+        if (allocated_ < frames_) {
+            allocated_++;
+        } else {
+            misses_++;
+        }
+        return std::vector<int16_t>(frame_samples_);
+    }
+
+    // Takes a frame back once its samples have been consumed. Buffers of
+    // another size (like the audio handed over from the wake word) and
+    // buffers beyond the pool size are left to the caller to free.
+    void Release(std::vector<int16_t>&& buffer) {
+        if (buffer.size() != frame_samples_) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < frames_) {
+            free_.push_back(std::move(buffer));
+        }
+    }
+
+    size_t allocated() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocated_;
+    }
+
+    size_t misses() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return misses_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::vector<int16_t>> free_;
+    size_t frames_;
+    size_t frame_samples_;
+    size_t allocated_ = 0;
+    size_t misses_ = 0;
+};
+
+// Cuts a stream of samples into frames taken from a PcmFramePool
+class PcmFrameAssembler {
+public:
+    // Drops any partial frame and takes the following frames from pool
+    void Reset(PcmFramePool* pool) {
+        pool_ = pool;
+        frame_.clear();
+        samples_ = 0;
+    }
+
+    // Appends `samples` samples taken every `stride` values of `data` and
+    // hands each completed frame to on_frame. The next frame is only taken
+    // from the pool when samples arrive for it, so a frame blocked in
+    // on_frame is the last one this assembler holds.
+    template <typename OnFrame>
+    void Append(const int16_t* data, size_t samples, size_t stride, OnFrame&& on_frame) {
+        while (samples > 0) {
+            if (frame_.empty()) {
+                frame_ = pool_->Acquire();
+                samples_ = 0;
+            }
+            size_t count = std::min(samples, frame_.size() - samples_);
+            int16_t* dst = frame_.data() + samples_;
+            if (stride == 1) {
+                std::copy(data, data + count, dst);
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    dst[i] = data[i * stride];
+                }
+            }
+            data += count * stride;
+            samples -= count;
+            samples_ += count;
+
+            if (samples_ == frame_.size()) {
+                on_frame(std::move(frame_));
+                frame_.clear();
+                samples_ = 0;
+            }
+        }
+    }
+
+private:
+    PcmFramePool* pool_ = nullptr;
+    std::vector<int16_t> frame_;
+    size_t samples_ = 0;
+};
+
+#endif // _PCM_FRAME_POOL_H_
@@ -0,0 +1,134 @@
+#ifndef _PCM_RING_H_
+#define _PCM_RING_H_
+
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+
+// Fixed ring of 16-bit mono samples with one writer and any number of
+// readers. The writer never waits: when the ring is full the oldest audio
+// is overwritten. Positions count the samples written since the ring was
+// created, so a reader can ask for any range and find out whether it is
+// still (or already) in the ring without taking a lock.
+//
+// If the buffer cannot be allocated the ring stays usable but holds nothing:
+// positions still advance and every Read fails as if the audio was lapped.
+class PcmRing {
+public:
+    // capacity must be a power of two
+    explicit PcmRing(size_t capacity) : capacity_(capacity) {
+        assert((capacity & (capacity - 1)) == 0);
+        buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (buffer_ == nullptr) {
+            buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_8BIT);
+        }
+    }
+
+    ~PcmRing() {
+        heap_caps_free(buffer_);
+    }
+
+    PcmRing(const PcmRing&) = delete;
+    PcmRing& operator=(const PcmRing&) = delete;
+
+    bool valid() const { return buffer_ != nullptr; }
+
+    size_t capacity() const { return capacity_; }
+
+    uint32_t write_position() const {
+        return write_position_.load(std::memory_order_acquire);
+    }
+
+    // Oldest position still held by the ring
+    uint32_t oldest_position() const {
+        uint32_t position = write_position();
+        return position > capacity_ ? position - capacity_ : 0;
+    }
+
+    // Appends `samples` samples taken every `stride` values of `data`, so the
+    // first channel of interleaved audio can be stored directly
+    void Write(const int16_t* data, size_t samples, size_t stride = 1) {
+        uint32_t position = write_position_.load(std::memory_order_relaxed);
+        if (buffer_ == nullptr) {
+            write_position_.store(position + samples, std::memory_order_release);
+            return;
+        }
+        // Announce the range about to be overwritten before touching it
+        claim_position_.store(position + samples, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        while (samples > 0) {
+            size_t offset = position & (capacity_ - 1);
+            size_t count = std::min(samples, capacity_ - offset);
+            int16_t* dst = buffer_ + offset;
+            if (stride == 1) {
+                std::copy(data, data + count, dst);
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    dst[i] = data[i * stride];
+                }
+            }
+            data += count * stride;
+            samples -= count;
+            position += count;
+        }
+        write_position_.store(position, std::memory_order_release);
+    }
+
+    // Copies [position, position + samples) into dst. Returns false when part
+    // of the range has not been written yet or was overwritten while copying.
+    bool Read(uint32_t position, int16_t* dst, size_t samples) const {
+        uint32_t end = write_position();
+        if (buffer_ == nullptr || samples > (uint32_t)(end - position) || (uint32_t)(end - position) > capacity_) {
+            return false;
+        }
+        uint32_t current = position;
+        size_t remaining = samples;
+        while (remaining > 0) {
+            size_t offset = current & (capacity_ - 1);
+            size_t count = std::min(remaining, capacity_ - offset);
+            std::copy(buffer_ + offset, buffer_ + offset + count, dst);
+            dst += count;
+            remaining -= count;
+            current += count;
+        }
+        // The writer may have lapped the start of the range during the copy
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (uint32_t)(claim_position_.load(std::memory_order_relaxed) - position) <= capacity_;
+    }
+
+    // Reads everything written since `position` into pcm, in whole frames
+    // ending at the write position. The start is rounded back to a frame
+    // boundary, so up to one frame before `position` is included rather than
+    // part of the first frame dropped. Frames no longer in the ring are
+    // skipped and counted in the returned number of dropped samples. pcm is
+    // left empty if the writer lapped the range during the copy.
+    size_t ReadSince(uint32_t position, size_t frame_samples, std::vector<int16_t>& pcm) const {
+        uint32_t end = write_position();
+        size_t frames = ((uint32_t)(end - position) + frame_samples - 1) / frame_samples;
+        size_t max_frames = (uint32_t)(end - oldest_position()) / frame_samples;
+        size_t dropped = 0;
+        if (frames > max_frames) {
+            dropped = (frames - max_frames) * frame_samples;
+            frames = max_frames;
+        }
+
+        pcm.resize(frames * frame_samples);
+        if (!Read(end - pcm.size(), pcm.data(), pcm.size())) {
+            pcm.clear();
+        }
+        return dropped;
+    }
+
+private:
+    int16_t* buffer_ = nullptr;
+    size_t capacity_;
+    std::atomic<uint32_t> write_position_{0};
+    std::atomic<uint32_t> claim_position_{0};
+};
+
+#endif // _PCM_RING_H_
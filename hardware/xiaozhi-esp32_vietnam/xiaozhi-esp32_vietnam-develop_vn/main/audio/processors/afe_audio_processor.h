@@ -18,7 +18,8 @@ public:
     AfeAudioProcessor();
     ~AfeAudioProcessor();
 
-    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list,
+                    PcmFramePool* frame_pool) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
@@ -37,7 +38,8 @@ private:
     AudioCodec* codec_ = nullptr;
     int frame_samples_ = 0;
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    // Frame being filled from the AFE output, handed over once it is full
+    PcmFrameAssembler output_frames_;
 
     void AudioProcessorTask();
 };
@@ -3,9 +3,11 @@
 
 #define TAG "NoAudioProcessor"
 
-void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
+void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list,
+                                  PcmFramePool* frame_pool) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    output_frames_.Reset(frame_pool);
 }
 
 void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
@@ -13,16 +15,11 @@ void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
         return;
     }
 
-    if (codec_->input_channels() == 2) {
-        // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
-        }
-        output_callback_(std::move(mono_data));
-    } else {
-        output_callback_(std::move(data));
-    }
+    // The caller reuses data as its feed buffer, so the output is copied
+    // into pool frames owned by the encode queue and data keeps its storage.
+    // If input channels is 2, we need to fetch the left channel data
+    size_t stride = codec_->input_channels() == 2 ? 2 : 1;
+    output_frames_.Append(data.data(), data.size() / stride, stride, output_callback_);
 }
 
 void NoAudioProcessor::Start() {
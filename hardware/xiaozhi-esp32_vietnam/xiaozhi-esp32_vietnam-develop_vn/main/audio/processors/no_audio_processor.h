@@ -12,7 +12,8 @@ public:
     NoAudioProcessor() = default;
     ~NoAudioProcessor() = default;
 
-    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list,
+                    PcmFramePool* frame_pool) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
@@ -28,6 +29,7 @@ private:
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     bool is_running_ = false;
+    PcmFrameAssembler output_frames_;
 };
 
 #endif 
\ No newline at end of file
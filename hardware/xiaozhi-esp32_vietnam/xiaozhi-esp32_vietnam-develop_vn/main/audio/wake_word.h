@@ -20,6 +20,9 @@ public:
     virtual size_t GetFeedSize() = 0;
     virtual void EncodeWakeWordData() = 0;
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
+    // Takes the mic audio captured between the last detection and now, as a
+    // whole number of frames. Returns false when there is none to hand over.
+    virtual bool GetAudioSinceWakeWord(std::vector<int16_t>& pcm, size_t frame_samples) { return false; }
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
 };
 
@@ -2,21 +2,32 @@
 #include "audio_service.h"
 
 #include <esp_log.h>
+#include <algorithm>
 #include <sstream>
 
 #define DETECTION_RUNNING_EVENT 1
 
+// 65536 samples is about 4 seconds at 16 kHz, enough for the time it takes
+// to open the audio channel and start listening after the wake word
+#define WAKE_WORD_RING_SAMPLES 65536
+// Keep about 2 seconds of encoded audio before the wake word
+#define WAKE_WORD_OPUS_PACKETS (2000 / OPUS_FRAME_DURATION_MS)
+#define WAKE_WORD_ENCODE_STACK_SIZE (4096 * 7)
+
 #define TAG "AfeWakeWord"
 
 AfeWakeWord::AfeWakeWord()
     : afe_data_(nullptr),
-      wake_word_pcm_(),
       wake_word_opus_() {
 
     event_group_ = xEventGroupCreate();
 }
 
 AfeWakeWord::~AfeWakeWord() {
+    if (wake_word_encode_task_ != nullptr) {
+        vTaskDelete(wake_word_encode_task_);
+    }
+
     if (afe_data_ != nullptr) {
         afe_iface_->destroy(afe_data_);
     }
@@ -80,6 +91,12 @@ bool AfeWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
     
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
+    pcm_ring_ = std::make_unique<PcmRing>(WAKE_WORD_RING_SAMPLES);
+    if (!pcm_ring_->valid()) {
+        // 唤醒词照常检测，只是不再上传唤醒词音频
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for the wake word audio ring", (unsigned)(WAKE_WORD_RING_SAMPLES * sizeof(int16_t)));
+    }
+    opus_ring_.resize(WAKE_WORD_OPUS_PACKETS);
 
     xTaskCreate([](void* arg) {
         auto this_ = (AfeWakeWord*)arg;
@@ -87,6 +104,17 @@ bool AfeWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
         vTaskDelete(NULL);
     }, "audio_detection", 1024 * 3, this, 3, nullptr);
 
+    // Opus needs a large stack, keep it in PSRAM
+    wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(WAKE_WORD_ENCODE_STACK_SIZE, MALLOC_CAP_SPIRAM);
+    assert(wake_word_encode_task_stack_ != nullptr);
+    wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    assert(wake_word_encode_task_buffer_ != nullptr);
+    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (AfeWakeWord*)arg;
+        this_->WakeWordEncodeTask();
+        vTaskDelete(NULL);
+    }, "encode_wake_word", WAKE_WORD_ENCODE_STACK_SIZE, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
+
     return true;
 }
 
@@ -95,6 +123,15 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
 }
 
 void AfeWakeWord::Start() {
+    wake_audio_pending_ = false;
+    {
+        // Packets from before the last conversation are not part of the next wake word
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        opus_ring_count_ = 0;
+        wake_stream_open_ = false;
+        wake_stream_done_ = false;
+        encoder_resync_ = true;
+    }
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
 
@@ -109,7 +146,18 @@ void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
     if (afe_data_ == nullptr) {
         return;
     }
-    afe_iface_->feed(afe_data_, data.data());
+    // The first channel is the mic, any others are mics or the reference
+    int channels = codec_->input_channels();
+    pcm_ring_->Write(data.data(), data.size() / channels, channels);
+
+    if (wake_word_encode_task_ != nullptr) {
+        xTaskNotifyGive(wake_word_encode_task_);
+    }
+
+    // After a detection the audio only goes to the ring until listening takes over
+    if (!wake_audio_pending_) {
+        afe_iface_->feed(afe_data_, data.data());
+    }
 }
 
 size_t AfeWakeWord::GetFeedSize() {
@@ -133,10 +181,10 @@ void AfeWakeWord::AudioDetectionTask() {
             continue;;
         }
 
-        // Store the wake word data for voice recognition, like who is speaking
-        StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
-
         if (res->wakeup_state == WAKENET_DETECTED) {
+            // Audio before this point is the wake word, audio after it belongs to the listening stream
+            wake_position_ = pcm_ring_->write_position();
+            wake_audio_pending_ = true;
             Stop();
             last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
 
@@ -147,54 +195,120 @@ void AfeWakeWord::AudioDetectionTask() {
     }
 }
 
-void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
+void AfeWakeWord::WakeWordEncodeTask() {
+    const size_t frame_samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+    auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    // 0 is the fastest. The task encodes for as long as the wake word listens,
+    // so the per-frame time logged in EncodeWakeWordData is its CPU cost
+    encoder->SetComplexity(0);
+
+    // One frame buffer for the life of the task, Encode() only reads it
+    // through the rvalue parameter so it keeps its storage between frames
+    std::vector<int16_t> pcm(frame_samples);
+    std::vector<uint8_t> opus;
+    uint32_t position = 0;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true) {
+            uint32_t end = pcm_ring_->write_position();
+            if (encoder_resync_.exchange(false)) {
+                position = end;
+            }
+            // Stop at the first frame that starts after the wake word, the
+            // rest is handed to the listening stream
+            if (wake_audio_pending_ && (int32_t)(position - wake_position_) >= 0) {
+                FinishWakeWordStream();
+                break;
+            }
+            if (end - position < frame_samples) {
+                break;
+            }
+            if (end - position > pcm_ring_->capacity()) {
+                position = end - frame_samples;
+            }
+
+            if (pcm.size() != frame_samples) {
+                // Only if an encoder version took the buffer over
+                pcm.resize(frame_samples);
+            }
+            if (!pcm_ring_->Read(position, pcm.data(), frame_samples)) {
+                position = end;
+                continue;
+            }
+            position += frame_samples;
+
+            auto start_time = esp_timer_get_time();
+            if (!encoder->Encode(std::move(pcm), opus)) {
+                continue;
+            }
+            StoreWakeWordPacket(opus, esp_timer_get_time() - start_time);
+        }
     }
 }
 
-void AfeWakeWord::EncodeWakeWordData() {
-    const size_t stack_size = 4096 * 7;
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
-        assert(wake_word_encode_task_stack_ != nullptr);
+void AfeWakeWord::StoreWakeWordPacket(std::vector<uint8_t>& opus, int64_t encode_time_us) {
+    std::lock_guard<std::mutex> lock(wake_word_mutex_);
+    if (encoder_resync_) {
+        return;
+    }
+    encode_frames_++;
+    encode_time_us_ += encode_time_us;
+    if (wake_stream_open_) {
+        wake_word_opus_.push_back(opus);
+        wake_word_cv_.notify_all();
     }
-    if (wake_word_encode_task_buffer_ == nullptr) {
-        wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
-        assert(wake_word_encode_task_buffer_ != nullptr);
+    // Swap so the slot keeps its buffer and the next encode reuses the old one
+    size_t index = (opus_ring_head_ + opus_ring_count_) % opus_ring_.size();
+    if (opus_ring_count_ == opus_ring_.size()) {
+        opus_ring_head_ = (opus_ring_head_ + 1) % opus_ring_.size();
+    } else {
+        opus_ring_count_++;
     }
+    opus_ring_[index].swap(opus);
+}
 
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (AfeWakeWord*)arg;
-        {
-            auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            int packets = 0;
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
-                packets++;
-            }
-            this_->wake_word_pcm_.clear();
+void AfeWakeWord::FinishWakeWordStream() {
+    std::lock_guard<std::mutex> lock(wake_word_mutex_);
+    if (wake_stream_done_) {
+        return;
+    }
+    wake_stream_done_ = true;
+    if (wake_stream_open_) {
+        wake_stream_open_ = false;
+        wake_word_opus_.push_back(std::vector<uint8_t>());
+        wake_word_cv_.notify_all();
+    }
+}
 
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
+void AfeWakeWord::EncodeWakeWordData() {
+    // Invoked without a detection (like from a button), the wake word ends now
+    if (!wake_audio_pending_) {
+        wake_position_ = pcm_ring_->write_position();
+        wake_audio_pending_ = true;
+    }
 
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        wake_word_opus_.clear();
+        for (size_t i = 0; i < opus_ring_count_; i++) {
+            wake_word_opus_.push_back(opus_ring_[(opus_ring_head_ + i) % opus_ring_.size()]);
         }
-        vTaskDelete(NULL);
-    }, "encode_wake_word", stack_size, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
+        if (wake_stream_done_) {
+            wake_word_opus_.push_back(std::vector<uint8_t>());
+        } else {
+            wake_stream_open_ = true;
+        }
+        wake_word_cv_.notify_all();
+
+        if (encode_frames_ > 0) {
+            ESP_LOGI(TAG, "Wake word opus: %u packets ready, encoding takes %ld us per %d ms frame",
+                wake_word_opus_.size(), (long)(encode_time_us_ / encode_frames_), OPUS_FRAME_DURATION_MS);
+        }
+    }
+
+    // Let the encoder finish the frames up to the wake word
+    xTaskNotifyGive(wake_word_encode_task_);
 }
 
 bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
@@ -206,3 +320,17 @@ bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
     wake_word_opus_.pop_front();
     return !opus.empty();
 }
+
+bool AfeWakeWord::GetAudioSinceWakeWord(std::vector<int16_t>& pcm, size_t frame_samples) {
+    if (!wake_audio_pending_.exchange(false)) {
+        return false;
+    }
+
+    // Start on a whole number of frames back from now. That reaches a little
+    // into the wake word rather than dropping the first part of a frame.
+    size_t dropped = pcm_ring_->ReadSince(wake_position_, frame_samples, pcm);
+    if (dropped > 0) {
+        ESP_LOGW(TAG, "Dropped %u ms of audio since the wake word", (unsigned)(dropped / 16));
+    }
+    return true;
+}
@@ -9,14 +9,19 @@
 #include <esp_nsn_models.h>
 #include <model_path.h>
 
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <string>
 #include <vector>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
 
+#include <opus_encoder.h>
+
 #include "audio_codec.h"
+#include "pcm_ring.h"
 #include "wake_word.h"
 
 class AfeWakeWord : public WakeWord {
@@ -32,6 +37,7 @@ public:
     size_t GetFeedSize();
     void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
+    bool GetAudioSinceWakeWord(std::vector<int16_t>& pcm, size_t frame_samples);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
@@ -48,13 +54,30 @@ private:
     TaskHandle_t wake_word_encode_task_ = nullptr;
     StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
     StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
+    // Mic audio of the last few seconds, kept through the detection so the
+    // speech right after the wake word can be handed to the listening stream
+    std::unique_ptr<PcmRing> pcm_ring_;
+    std::atomic<uint32_t> wake_position_{0};      // ring position where the wake word was detected
+    std::atomic<bool> wake_audio_pending_{false};
+    std::atomic<bool> encoder_resync_{true};
+
+    // The ring audio is encoded as it arrives into a rolling set of the last
+    // packets, so the wake word is ready to send as soon as it is detected
+    std::vector<std::vector<uint8_t>> opus_ring_;
+    size_t opus_ring_head_ = 0;
+    size_t opus_ring_count_ = 0;
+    bool wake_stream_open_ = false;     // packets go to wake_word_opus_ as they are encoded
+    bool wake_stream_done_ = false;     // all packets up to the wake word have been encoded
+    uint32_t encode_frames_ = 0;
+    int64_t encode_time_us_ = 0;
     std::deque<std::vector<uint8_t>> wake_word_opus_;
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
 
-    void StoreWakeWordData(const int16_t* data, size_t size);
     void AudioDetectionTask();
+    void WakeWordEncodeTask();
+    void StoreWakeWordPacket(std::vector<uint8_t>& opus, int64_t encode_time_us);
+    void FinishWakeWordStream();
 };
 
 #endif
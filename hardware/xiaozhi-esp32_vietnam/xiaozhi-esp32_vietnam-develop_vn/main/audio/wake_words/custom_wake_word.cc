@@ -46,6 +46,7 @@ void CustomWakeWord::ParseWakenetModelConfig() {
         return;
     }
     cJSON* root = cJSON_ParseWithLength(static_cast<char*>(ptr), size);
+    assets.ReleaseAssetData("index.json");
     if (root == nullptr) {
         ESP_LOGE(TAG, "Failed to parse index.json");
         return;
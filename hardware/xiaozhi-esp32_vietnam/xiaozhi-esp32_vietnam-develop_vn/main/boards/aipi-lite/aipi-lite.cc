@@ -19,6 +19,7 @@
 #include "mcp_server.h"
 #include "power_manager.h"
 #include "power_save_timer.h"
+#include "settings.h"
 #include "system_reset.h"
 #include "wifi_board.h"
 
@@ -164,6 +165,7 @@ class AIPILite : public WifiBoard {
                 !(power_manager_->IsCharging() &&
                   power_manager_->GetBatteryLevel() < 100)) {
                 ESP_LOGI(TAG, "Power button long pressed, shutting down");
+                Settings::Flush();
                 esp_lcd_panel_disp_on_off(panel_, false);  // 关闭显示
                 rtc_gpio_set_level(POWER_CONTROL_PIN, 0);
                 rtc_gpio_hold_dis(POWER_CONTROL_PIN);
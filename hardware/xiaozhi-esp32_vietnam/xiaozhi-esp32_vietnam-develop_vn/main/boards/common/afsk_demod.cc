@@ -1,6 +1,7 @@
 #include "afsk_demod.h"
 #include <cstring>
 #include <algorithm>
+#include <limits>
 #include "esp_log.h"
 #include "display.h"
 
@@ -18,11 +19,12 @@ namespace audio_wifi_config
                                         size_t input_channels
                                     )
     {
-        const int kInputSampleRate = 16000;                                    // Input sampling rate
-        const float kDownsampleStep = static_cast<float>(kInputSampleRate) / static_cast<float>(kAudioSampleRate); // Downsampling step
         std::vector<int16_t> audio_data;
-        AudioSignalProcessor signal_processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate, kWindowSize);
-        AudioDataBuffer data_buffer;
+        std::vector<SlicedBit> sliced_bits;
+        AudioSignalProcessor signal_processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate,
+                                              kWindowSize, kSlicerPhases);
+        // One data buffer per bit clock alignment, whichever decodes a valid transmission first wins
+        std::vector<AudioDataBuffer> data_buffers(kSlicerPhases);
 
         while (true)
         {
@@ -33,71 +35,61 @@ namespace audio_wifi_config
                 continue;
             }
             
-            if (!app->GetAudioService().ReadAudioData(audio_data, 16000, 480)) { // 16kHz, 480 samples corresponds to 30ms data
+            if (!app->GetAudioService().ReadAudioData(audio_data, kAudioSampleRate, 480)) { // 16kHz, 480 samples corresponds to 30ms data
                 // 读取音频失败，短暂延迟后重试
                 ESP_LOGI(kLogTag, "Failed to read audio data, retrying.");
                 vTaskDelay(pdMS_TO_TICKS(10));
                 continue;
             }
 
-            if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
+            // 双声道输入只取第一个声道
+            sliced_bits.clear();
+            signal_processor.ProcessAudioSamples(audio_data.data(), audio_data.size() / input_channels,
+                                                 input_channels, sliced_bits);
+
+            std::optional<std::string> decoded_text;
+            for (const auto &bit : sliced_bits) {
+                auto &data_buffer = data_buffers[bit.phase];
+                if (data_buffer.ProcessProbability(bit.mark_probability, 0.5f)) {
+                    // A checksum that passes on an alignment straddling the bits is usually two errors cancelling out
+                    if (signal_processor.GetPhaseQuality(bit.phase) >= kMinPhaseQuality) {
+                        decoded_text = std::move(data_buffer.decoded_text);
+                        break;
+                    }
+                    ESP_LOGD(kLogTag, "Dropping transmission decoded at phase %zu", bit.phase);
+                    data_buffer.decoded_text.reset();
                 }
-                audio_data = std::move(mono_data);
             }
-            
-            // Downsample the audio data
-            std::vector<float> downsampled_data;
-            size_t last_index = 0;
-
-            if (kDownsampleStep > 1.0f) {
-                downsampled_data.reserve(audio_data.size() / static_cast<size_t>(kDownsampleStep));
-                for (size_t i = 0; i < audio_data.size(); ++i) {
-                    size_t sample_index = static_cast<size_t>(i / kDownsampleStep);
-                    if ((sample_index + 1) > last_index) {
-                        downsampled_data.push_back(static_cast<float>(audio_data[i]));
-                        last_index = sample_index + 1;
-                    }
+
+            // If complete data was received, extract WiFi credentials
+            if (decoded_text.has_value()) {
+                // The other alignments are decoding the same transmission, start over
+                for (auto &data_buffer : data_buffers) {
+                    data_buffer.Reset();
                 }
-            } else {
-                downsampled_data.reserve(audio_data.size());
-                for (int16_t sample : audio_data) {
-                    downsampled_data.push_back(static_cast<float>(sample));
+                signal_processor.Reset();
+
+                ESP_LOGI(kLogTag, "Received text data: %s", decoded_text->c_str());
+                
+                // Split SSID and password by newline character
+                std::string wifi_ssid, wifi_password;
+                size_t newline_position = decoded_text->find('\n');
+                if (newline_position != std::string::npos) {
+                    wifi_ssid = decoded_text->substr(0, newline_position);
+                    wifi_password = decoded_text->substr(newline_position + 1);
+                    std::string wifi_ssid_display = "Kết nối thành công WiFi \"" + wifi_ssid + "\"";
+                    display->SetChatMessage("system", wifi_ssid_display.c_str());
+                    ESP_LOGI(kLogTag, "WiFi SSID: %s, Password: %s", wifi_ssid.c_str(), wifi_password.c_str());
+                } else {
+                    ESP_LOGE(kLogTag, "Invalid data format, no newline character found");
+                    continue;
                 }
-            }
-            
-            // Process audio samples to get probability data
-            auto probabilities = signal_processor.ProcessAudioSamples(downsampled_data);
-            
-            // Feed probability data to the data buffer
-            if (data_buffer.ProcessProbabilityData(probabilities, 0.5f)) {
-                // If complete data was received, extract WiFi credentials
-                if (data_buffer.decoded_text.has_value()) {
-                    ESP_LOGI(kLogTag, "Received text data: %s", data_buffer.decoded_text->c_str());
-                    
-                    // Split SSID and password by newline character
-                    std::string wifi_ssid, wifi_password;
-                    size_t newline_position = data_buffer.decoded_text->find('\n');
-                    if (newline_position != std::string::npos) {
-                        wifi_ssid = data_buffer.decoded_text->substr(0, newline_position);
-                        wifi_password = data_buffer.decoded_text->substr(newline_position + 1);
-                        std::string wifi_ssid_display = "Kết nối thành công WiFi \"" + wifi_ssid + "\"";
-                        display->SetChatMessage("system", wifi_ssid_display.c_str());
-                        ESP_LOGI(kLogTag, "WiFi SSID: %s, Password: %s", wifi_ssid.c_str(), wifi_password.c_str());
-                    } else {
-                        ESP_LOGE(kLogTag, "Invalid data format, no newline character found");
-                        continue;
-                    }
-                    
-                    if (wifi_ap->ConnectToWifi(wifi_ssid, wifi_password)) {
-                        wifi_ap->Save(wifi_ssid, wifi_password);  // Save WiFi credentials
-                        esp_restart();                            // Restart device to apply new WiFi configuration
-                    } else {
-                        ESP_LOGE(kLogTag, "Failed to connect to WiFi with received credentials");
-                    }
-                    data_buffer.decoded_text.reset();  // Clear processed data
+                
+                if (wifi_ap->ConnectToWifi(wifi_ssid, wifi_password)) {
+                    wifi_ap->Save(wifi_ssid, wifi_password);  // Save WiFi credentials
+                    esp_restart();                            // Restart device to apply new WiFi configuration
+                } else {
+                    ESP_LOGE(kLogTag, "Failed to connect to WiFi with received credentials");
                 }
             }
             vTaskDelay(pdMS_TO_TICKS(1));  // 1ms delay
@@ -113,110 +105,189 @@ namespace audio_wifi_config
     const std::vector<uint8_t> kDefaultEndTransmissionPattern = {
         0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0};
 
-    // FrequencyDetector implementation
-    FrequencyDetector::FrequencyDetector(float frequency, size_t window_size)
-        : frequency_(frequency), window_size_(window_size) {
-        frequency_bin_ = std::floor(frequency_ * static_cast<float>(window_size_));
-        angular_frequency_ = 2.0f * M_PI * frequency_;
-        cos_coefficient_ = std::cos(angular_frequency_);
-        sin_coefficient_ = std::sin(angular_frequency_);
-        filter_coefficient_ = 2.0f * cos_coefficient_;
-
-        // Initialize state buffer
-        state_buffer_.push_back(0.0f);
-        state_buffer_.push_back(0.0f);
+    // GoertzelBank implementation
+    GoertzelBank::GoertzelBank(float mark_frequency, float space_frequency, size_t window_size, size_t phases)
+        : phases_(phases), hop_size_(window_size / phases),
+          states_(phases * 4, 0) {
+        const float frequencies[2] = {mark_frequency, space_frequency};
+        for (int i = 0; i < 2; ++i) {
+            coefficients_[i] = static_cast<int32_t>(std::lround(
+                2.0 * std::cos(2.0 * M_PI * frequencies[i]) * (1 << kCoefficientBits)));
+        }
     }
 
-    void FrequencyDetector::Reset() {
-        state_buffer_.clear();
-        state_buffer_.push_back(0.0f);
-        state_buffer_.push_back(0.0f);
+    void GoertzelBank::Reset() {
+        std::fill(states_.begin(), states_.end(), 0);
+        hop_samples_ = 0;
+        next_window_ = 0;
+        hops_ = 0;
     }
 
-    void FrequencyDetector::ProcessSample(float sample) {
-        if (state_buffer_.size() < 2) {
-            return;
-        }
-
-        float s_minus_2 = state_buffer_.front();  // S[-2]
-        state_buffer_.pop_front();
-        float s_minus_1 = state_buffer_.front();  // S[-1]
-        state_buffer_.pop_front();
-
-        float s_current = sample + filter_coefficient_ * s_minus_1 - s_minus_2;
+    void GoertzelBank::ProcessBlock(const int16_t *samples, size_t count, size_t stride,
+                                    std::vector<TonePower> &output) {
+        while (count > 0) {
+            // Run every filter over the samples up to the next hop, one filter at a time
+            // so its state stays in registers
+            size_t run = std::min(count, hop_size_ - hop_samples_);
+            for (size_t window = 0; window < phases_; ++window) {
+                for (int tone = 0; tone < 2; ++tone) {
+                    int32_t *state = &states_[window * 4 + tone * 2];
+                    int32_t s_minus_1 = state[0];
+                    int32_t s_minus_2 = state[1];
+                    const int64_t coefficient = coefficients_[tone];
+                    const int16_t *input = samples;
+                    for (size_t i = 0; i < run; ++i, input += stride) {
+                        int32_t s_current = *input + static_cast<int32_t>((coefficient * s_minus_1) >> kCoefficientBits) - s_minus_2;
+                        s_minus_2 = s_minus_1;
+                        s_minus_1 = s_current;
+                    }
+                    state[0] = s_minus_1;
+                    state[1] = s_minus_2;
+                }
+            }
+            samples += run * stride;
+            count -= run;
+            hop_samples_ += run;
+            if (hop_samples_ < hop_size_) {
+                break;
+            }
 
-        state_buffer_.push_back(s_minus_1);  // Put S[-1] back
-        state_buffer_.push_back(s_current);  // Add new S[0]
+            // The oldest window now holds exactly window_size_ samples
+            hop_samples_ = 0;
+            int32_t *state = &states_[next_window_ * 4];
+            if (++hops_ >= phases_) {
+                float magnitudes[2];
+                for (int tone = 0; tone < 2; ++tone) {
+                    int64_t s_minus_1 = state[tone * 2];
+                    int64_t s_minus_2 = state[tone * 2 + 1];
+                    // |X|^2 = S[-1]^2 + S[-2]^2 - 2cos(w) * S[-1] * S[-2]
+                    int64_t power = s_minus_1 * s_minus_1 + s_minus_2 * s_minus_2 -
+                                    ((coefficients_[tone] * s_minus_1) >> kCoefficientBits) * s_minus_2;
+                    magnitudes[tone] = std::sqrt(static_cast<float>(std::max<int64_t>(power, 0)));
+                }
+                output.push_back({magnitudes[0], magnitudes[1]});
+            }
+            std::fill(state, state + 4, 0);
+            next_window_ = (next_window_ + 1) % phases_;
+        }
     }
 
-    float FrequencyDetector::GetAmplitude() const {
-        if (state_buffer_.size() < 2) {
-            return 0.0f;
+    // SlidingDft implementation
+    SlidingDft::SlidingDft(float mark_frequency, float space_frequency, size_t window_size, size_t phases)
+        : window_size_(window_size), hop_size_(window_size / phases),
+          twiddles_(window_size * 4), products_(window_size * 4, 0) {
+        const float frequencies[2] = {mark_frequency, space_frequency};
+        for (int tone = 0; tone < 2; ++tone) {
+            float bin = frequencies[tone] * static_cast<float>(window_size_);
+            if (std::fabs(bin - std::round(bin)) > 0.01f) {
+                ESP_LOGW(kLogTag, "Frequency %.4f is not on a bin of a %zu-sample window", frequencies[tone], window_size_);
+            }
+            long k = std::lround(bin);
+            for (size_t n = 0; n < window_size_; ++n) {
+                double angle = 2.0 * M_PI * static_cast<double>((k * n) % window_size_) / static_cast<double>(window_size_);
+                twiddles_[n * 4 + tone * 2] = static_cast<int16_t>(std::lround(std::cos(angle) * (1 << kTwiddleBits)));
+                twiddles_[n * 4 + tone * 2 + 1] = static_cast<int16_t>(std::lround(std::sin(angle) * (1 << kTwiddleBits)));
+            }
         }
+    }
+
+    void SlidingDft::Reset() {
+        std::fill(products_.begin(), products_.end(), 0);
+        std::fill(std::begin(sums_), std::end(sums_), 0);
+        position_ = 0;
+        hop_samples_ = 0;
+        filled_ = false;
+    }
 
-        float s_minus_1 = state_buffer_[1];                      // S[-1]
-        float s_minus_2 = state_buffer_[0];                      // S[-2]
-        float real_part = cos_coefficient_ * s_minus_1 - s_minus_2;  // Real part
-        float imaginary_part = sin_coefficient_ * s_minus_1;         // Imaginary part
+    void SlidingDft::ProcessBlock(const int16_t *samples, size_t count, size_t stride,
+                                  std::vector<TonePower> &output) {
+        for (size_t i = 0; i < count; ++i, samples += stride) {
+            const int32_t sample = *samples;
+            const int16_t *twiddle = &twiddles_[position_ * 4];
+            int32_t *product = &products_[position_ * 4];
+            // The product stored for this position is exactly the one subtracted
+            // a window later, so rounding never accumulates in the sums
+            for (int j = 0; j < 4; ++j) {
+                int32_t value = (sample * twiddle[j]) >> kTwiddleBits;
+                sums_[j] += value - product[j];
+                product[j] = value;
+            }
 
-        return std::sqrt(real_part * real_part + imaginary_part * imaginary_part) / 
-               (static_cast<float>(window_size_) / 2.0f);
+            if (++position_ == window_size_) {
+                position_ = 0;
+                filled_ = true;
+            }
+            if (++hop_samples_ == hop_size_) {
+                hop_samples_ = 0;
+                if (filled_) {
+                    float magnitudes[2];
+                    for (int tone = 0; tone < 2; ++tone) {
+                        int64_t real_part = sums_[tone * 2];
+                        int64_t imaginary_part = sums_[tone * 2 + 1];
+                        magnitudes[tone] = std::sqrt(static_cast<float>(real_part * real_part + imaginary_part * imaginary_part));
+                    }
+                    output.push_back({magnitudes[0], magnitudes[1]});
+                }
+            }
+        }
     }
 
     // AudioSignalProcessor implementation
     AudioSignalProcessor::AudioSignalProcessor(size_t sample_rate, size_t mark_frequency, size_t space_frequency,
-                                             size_t bit_rate, size_t window_size)
-        : input_buffer_size_(window_size), output_sample_count_(0) {
+                                             size_t bit_rate, size_t window_size, size_t phases)
+        : phases_(phases), hop_count_(0), phase_contrast_(phases, 0.0f) {
         if (sample_rate % bit_rate != 0) {
             // On ESP32 we can continue execution, but log the error
             ESP_LOGW(kLogTag, "Sample rate %zu is not divisible by bit rate %zu", sample_rate, bit_rate);
         }
+        if (sample_rate / bit_rate != window_size) {
+            ESP_LOGW(kLogTag, "Window size %zu does not match the bit length, bits will be smeared", window_size);
+        }
+        if (window_size % phases != 0) {
+            ESP_LOGW(kLogTag, "Window size %zu is not divisible by %zu phases", window_size, phases);
+        }
 
         float normalized_mark_freq = static_cast<float>(mark_frequency) / static_cast<float>(sample_rate);
         float normalized_space_freq = static_cast<float>(space_frequency) / static_cast<float>(sample_rate);
 
-        mark_detector_ = std::make_unique<FrequencyDetector>(normalized_mark_freq, window_size);
-        space_detector_ = std::make_unique<FrequencyDetector>(normalized_space_freq, window_size);
-
-        samples_per_bit_ = sample_rate / bit_rate;  // Number of samples per bit
+#if CONFIG_ACOUSTIC_WIFI_SLIDING_DFT
+        detector_ = std::make_unique<SlidingDft>(normalized_mark_freq, normalized_space_freq, window_size, phases);
+#else
+        detector_ = std::make_unique<GoertzelBank>(normalized_mark_freq, normalized_space_freq, window_size, phases);
+#endif
     }
 
-    std::vector<float> AudioSignalProcessor::ProcessAudioSamples(const std::vector<float> &samples) {
-        std::vector<float> result;
-
-        for (float sample : samples) {
-            if (input_buffer_.size() < input_buffer_size_) {
-                input_buffer_.push_back(sample);  // Just add, don't process yet
-            } else {
-                // Input buffer is full, process the data
-                input_buffer_.pop_front();   // Remove oldest sample
-                input_buffer_.push_back(sample);  // Add new sample
-                output_sample_count_++;
-
-                if (output_sample_count_ >= samples_per_bit_) {
-                    // Process all samples in the window using Goertzel algorithm
-                    for (float window_sample : input_buffer_) {
-                        mark_detector_->ProcessSample(window_sample);
-                        space_detector_->ProcessSample(window_sample);
-                    }
-
-                    float mark_amplitude = mark_detector_->GetAmplitude();   // Mark amplitude
-                    float space_amplitude = space_detector_->GetAmplitude(); // Space amplitude
-
-                    // Avoid division by zero
-                    float mark_probability = mark_amplitude / 
-                                           (space_amplitude + mark_amplitude + std::numeric_limits<float>::epsilon());
-                    result.push_back(mark_probability);
+    void AudioSignalProcessor::Reset() {
+        detector_->Reset();
+        hop_count_ = 0;
+        std::fill(phase_contrast_.begin(), phase_contrast_.end(), 0.0f);
+    }
 
-                    // Reset detector windows
-                    mark_detector_->Reset();
-                    space_detector_->Reset();
-                    output_sample_count_ = 0;  // Reset output counter
-                }
-            }
+    void AudioSignalProcessor::ProcessAudioSamples(const int16_t *samples, size_t count, size_t stride,
+                                                   std::vector<SlicedBit> &bits) {
+        tone_powers_.clear();
+        detector_->ProcessBlock(samples, count, stride, tone_powers_);
+
+        for (const auto &power : tone_powers_) {
+            // Avoid division by zero
+            float mark_probability = power.mark /
+                                   (power.space + power.mark + std::numeric_limits<float>::epsilon());
+            size_t phase = hop_count_ % phases_;
+            bits.push_back({phase, mark_probability});
+            hop_count_++;
+
+            // Averaged over about 16 bits
+            float contrast = std::fabs(2.0f * mark_probability - 1.0f);
+            phase_contrast_[phase] += (contrast - phase_contrast_[phase]) / 16.0f;
         }
+    }
 
-        return result;
+    float AudioSignalProcessor::GetPhaseQuality(size_t phase) const {
+        float best_contrast = *std::max_element(phase_contrast_.begin(), phase_contrast_.end());
+        if (best_contrast <= 0.0f) {
+            return 0.0f;
+        }
+        return phase_contrast_[phase] / best_contrast;
     }
 
     // AudioDataBuffer implementation
@@ -229,6 +300,7 @@ namespace audio_wifi_config
         max_bit_buffer_size_ = 776;  // Preset bit buffer size, 776 bits = (32 + 1 + 63 + 1) * 8 = 776
 
         bit_buffer_.reserve(max_bit_buffer_size_);
+        confidence_buffer_.reserve(max_bit_buffer_size_);
     }
 
     AudioDataBuffer::AudioDataBuffer(size_t max_byte_size, const std::vector<uint8_t> &start_identifier,
@@ -241,6 +313,7 @@ namespace audio_wifi_config
         max_bit_buffer_size_ = max_byte_size * 8;  // Bit buffer size in bytes
 
         bit_buffer_.reserve(max_bit_buffer_size_);
+        confidence_buffer_.reserve(max_bit_buffer_size_);
     }
 
     uint8_t AudioDataBuffer::CalculateChecksum(const std::string &text) {
@@ -254,101 +327,195 @@ namespace audio_wifi_config
     void AudioDataBuffer::ClearBuffers() {
         identifier_buffer_.clear();
         bit_buffer_.clear();
+        confidence_buffer_.clear();
+    }
+
+    void AudioDataBuffer::Reset() {
+        ClearBuffers();
+        current_state_ = DataReceptionState::kInactive;
+        decoded_text.reset();
     }
 
     bool AudioDataBuffer::ProcessProbabilityData(const std::vector<float> &probabilities, float threshold) {
         for (float probability : probabilities) {
-            uint8_t bit = (probability > threshold) ? 1 : 0;
+            if (ProcessProbability(probability, threshold)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool AudioDataBuffer::ProcessProbability(float probability, float threshold) {
+        uint8_t bit = (probability > threshold) ? 1 : 0;
 
-            if (identifier_buffer_.size() >= identifier_buffer_size_) {
-                identifier_buffer_.pop_front();  // Maintain buffer size
+        if (identifier_buffer_.size() >= identifier_buffer_size_) {
+            identifier_buffer_.pop_front();  // Maintain buffer size
+        }
+        identifier_buffer_.push_back(bit);
+
+        auto identifier_matches = [this](const std::vector<uint8_t> &identifier) {
+            return identifier_buffer_.size() >= identifier.size() &&
+                   std::equal(identifier.begin(), identifier.end(), identifier_buffer_.end() - identifier.size());
+        };
+
+        // Process received bit based on state machine
+        switch (current_state_) {
+        case DataReceptionState::kInactive:
+            if (identifier_buffer_.size() >= start_of_transmission_.size()) {
+                current_state_ = DataReceptionState::kWaiting;  // Enter waiting state
+                ESP_LOGD(kLogTag, "Entering Waiting state");
             }
-            identifier_buffer_.push_back(bit);
-
-            // Process received bit based on state machine
-            switch (current_state_) {
-            case DataReceptionState::kInactive:
-                if (identifier_buffer_.size() >= start_of_transmission_.size()) {
-                    current_state_ = DataReceptionState::kWaiting;  // Enter waiting state
-                    ESP_LOGI(kLogTag, "Entering Waiting state");
+            break;
+
+        case DataReceptionState::kWaiting:
+            // Waiting state, possibly waiting for transmission end
+            if (identifier_matches(start_of_transmission_)) {
+                ClearBuffers();                                // Clear buffers
+                current_state_ = DataReceptionState::kReceiving;  // Enter receiving state
+                ESP_LOGD(kLogTag, "Entering Receiving state");
+            }
+            break;
+
+        case DataReceptionState::kReceiving: {
+            bit_buffer_.push_back(bit);
+            float confidence = std::min(std::fabs(probability - threshold) * 2.0f, 1.0f);
+            confidence_buffer_.push_back(static_cast<uint8_t>(confidence * 255.0f));
+
+            // The sender transmits whole bytes, an end identifier off the byte
+            // boundary is payload that happens to look like it
+            if (bit_buffer_.size() % 8 == 0 && identifier_matches(end_of_transmission_)) {
+                current_state_ = DataReceptionState::kInactive;  // Enter inactive state
+
+                std::string result;
+                if (!DecodeTransmission(bit_buffer_, result) && !CorrectSingleBitError(result)) {
+                    ClearBuffers();
+                    return false;
                 }
-                break;
 
-            case DataReceptionState::kWaiting:
-                // Waiting state, possibly waiting for transmission end
-                if (identifier_buffer_.size() >= start_of_transmission_.size()) {
-                    std::vector<uint8_t> identifier_snapshot(identifier_buffer_.begin(), identifier_buffer_.end());
-                    if (identifier_snapshot == start_of_transmission_)
-                    {
-                        ClearBuffers();                                // Clear buffers
-                        current_state_ = DataReceptionState::kReceiving;  // Enter receiving state
-                        ESP_LOGI(kLogTag, "Entering Receiving state");
-                    }
-                }
-                break;
+                ClearBuffers();
+                decoded_text = result;
+                return true;  // Return success
+            } else if (bit_buffer_.size() >= max_bit_buffer_size_) {
+                // If not end identifier and bit buffer is full, reset
+                ClearBuffers();
+                ESP_LOGD(kLogTag, "Buffer overflow, clearing buffer");
+                current_state_ = DataReceptionState::kInactive;  // Reset state machine
+            }
+            break;
+        }
+        }
 
-            case DataReceptionState::kReceiving:
-                bit_buffer_.push_back(bit);
-                if (identifier_buffer_.size() >= end_of_transmission_.size()) {
-                    std::vector<uint8_t> identifier_snapshot(identifier_buffer_.begin(), identifier_buffer_.end());
-                    if (identifier_snapshot == end_of_transmission_) {
-                        current_state_ = DataReceptionState::kInactive;  // Enter inactive state
-
-                        // Convert bits to bytes
-                        std::vector<uint8_t> bytes = ConvertBitsToBytes(bit_buffer_);
-
-                        uint8_t received_checksum = 0;
-                        size_t minimum_length = 0;
-
-                        if (enable_checksum_validation_) {
-                            // If checksum is required, last byte is checksum
-                            minimum_length = 1 + start_of_transmission_.size() / 8;
-                            if (bytes.size() >= minimum_length)
-                            {
-                                received_checksum = bytes[bytes.size() - start_of_transmission_.size() / 8 - 1];
-                            }
-                        } else {
-                            minimum_length = start_of_transmission_.size() / 8;
-                        }
-
-                        if (bytes.size() < minimum_length) {
-                            ClearBuffers();
-                            ESP_LOGW(kLogTag, "Data too short, clearing buffer");
-                            return false;  // Data too short, return failure
-                        }
-
-                        // Extract text data (remove trailing identifier part)
-                        std::vector<uint8_t> text_bytes(
-                            bytes.begin(), bytes.begin() + bytes.size() - minimum_length);
-
-                        std::string result(text_bytes.begin(), text_bytes.end());
-
-                        // Validate checksum if required
-                        if (enable_checksum_validation_) {
-                            uint8_t calculated_checksum = CalculateChecksum(result);
-                            if (calculated_checksum != received_checksum) {
-                                // Checksum mismatch
-                                ESP_LOGW(kLogTag, "Checksum mismatch: expected %d, got %d", 
-                                        received_checksum, calculated_checksum);
-                                ClearBuffers();
-                                return false;
-                            }
-                        }
-
-                        ClearBuffers();
-                        decoded_text = result;
-                        return true;  // Return success
-                    } else if (bit_buffer_.size() >= max_bit_buffer_size_) {
-                        // If not end identifier and bit buffer is full, reset
-                        ClearBuffers();
-                        ESP_LOGW(kLogTag, "Buffer overflow, clearing buffer");
-                        current_state_ = DataReceptionState::kInactive;  // Reset state machine
-                    }
+        return false;
+    }
+
+    bool AudioDataBuffer::DecodeTransmission(const std::vector<uint8_t> &bits, std::string &text) const {
+        // Convert bits to bytes
+        std::vector<uint8_t> bytes = ConvertBitsToBytes(bits);
+
+        uint8_t received_checksum = 0;
+        size_t minimum_length = 0;
+
+        if (enable_checksum_validation_) {
+            // If checksum is required, last byte is checksum
+            minimum_length = 1 + start_of_transmission_.size() / 8;
+            if (bytes.size() >= minimum_length)
+            {
+                received_checksum = bytes[bytes.size() - start_of_transmission_.size() / 8 - 1];
+            }
+        } else {
+            minimum_length = start_of_transmission_.size() / 8;
+        }
+
+        if (bytes.size() < minimum_length) {
+            ESP_LOGD(kLogTag, "Data too short");
+            return false;  // Data too short, return failure
+        }
+
+        // Extract text data (remove trailing identifier part)
+        text.assign(bytes.begin(), bytes.begin() + bytes.size() - minimum_length);
+
+        // Validate checksum if required
+        if (enable_checksum_validation_) {
+            uint8_t calculated_checksum = CalculateChecksum(text);
+            if (calculated_checksum != received_checksum) {
+                // Checksum mismatch, expected on the alignments that straddle bits
+                ESP_LOGD(kLogTag, "Checksum mismatch: expected %d, got %d",
+                        received_checksum, calculated_checksum);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The sum checksum passes one in 256 corrupted transmissions, so a corrected
+    // one must also look like credentials: one newline between SSID and
+    // password, no other control characters and well-formed UTF-8
+    static bool IsCredentialText(const std::string &text) {
+        size_t newlines = 0;
+        size_t continuation_bytes = 0;
+        for (char character : text) {
+            uint8_t value = static_cast<uint8_t>(character);
+            if (continuation_bytes > 0) {
+                if ((value & 0xC0) != 0x80) {
+                    return false;
+                }
+                continuation_bytes--;
+            } else if (value == '\n') {
+                newlines++;
+            } else if (value < 0x20 || value == 0x7F) {
+                return false;
+            } else if (value >= 0x80) {
+                if ((value & 0xE0) == 0xC0 && value >= 0xC2) {
+                    continuation_bytes = 1;
+                } else if ((value & 0xF0) == 0xE0) {
+                    continuation_bytes = 2;
+                } else if ((value & 0xF8) == 0xF0 && value <= 0xF4) {
+                    continuation_bytes = 3;
+                } else {
+                    return false;
                 }
-                break;
             }
         }
+        return newlines == 1 && continuation_bytes == 0;
+    }
+
+    bool AudioDataBuffer::CorrectSingleBitError(std::string &text) const {
+        // Only try the weakest bits, every extra candidate is another chance to
+        // "fix" a transmission with several errors into a wrong one
+        const size_t kMaxCandidates = 2;
+        const uint8_t kMaxConfidence = 32;  // Mark probability within 0.5 +- 0.0625
+
+        if (!enable_checksum_validation_) {
+            return false;
+        }
+        size_t identifier_bits = end_of_transmission_.size();
+        if (bit_buffer_.size() < identifier_bits + 8) {
+            return false;
+        }
+        // Payload and checksum bits, the end identifier already matched
+        size_t data_bits = bit_buffer_.size() - identifier_bits;
 
+        std::vector<size_t> candidates(data_bits);
+        for (size_t i = 0; i < data_bits; ++i) {
+            candidates[i] = i;
+        }
+        size_t candidate_count = std::min(kMaxCandidates, data_bits);
+        std::partial_sort(candidates.begin(), candidates.begin() + candidate_count, candidates.end(),
+                          [this](size_t a, size_t b) { return confidence_buffer_[a] < confidence_buffer_[b]; });
+
+        std::vector<uint8_t> bits = bit_buffer_;
+        for (size_t i = 0; i < candidate_count; ++i) {
+            size_t index = candidates[i];
+            if (confidence_buffer_[index] > kMaxConfidence) {
+                break;
+            }
+            bits[index] ^= 1;
+            if (DecodeTransmission(bits, text) && IsCredentialText(text)) {
+                ESP_LOGI(kLogTag, "Corrected bit %zu of %zu", index, data_bits);
+                return true;
+            }
+            bits[index] ^= 1;
+        }
         return false;
     }
 
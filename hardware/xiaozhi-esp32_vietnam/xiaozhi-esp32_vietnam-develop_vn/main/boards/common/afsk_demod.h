@@ -10,11 +10,15 @@
 #include "application.h"
 
 // Audio signal processing constants for WiFi configuration via audio
-const size_t kAudioSampleRate = 6400;
+// The detectors run at the input rate: with one bit per window both tones fall
+// on exact DFT bins (15 and 18), so no decimation is needed
+const size_t kAudioSampleRate = 16000;
 const size_t kMarkFrequency = 1800;
 const size_t kSpaceFrequency = 1500;
 const size_t kBitRate = 100;
-const size_t kWindowSize = 64;
+const size_t kWindowSize = kAudioSampleRate / kBitRate;  // One bit, the matched filter of a tone
+const size_t kSlicerPhases = 4;                          // Bit clock offsets decoded in parallel
+const float kMinPhaseQuality = 0.9f;                     // Transmissions from smeared alignments are dropped
 
 namespace audio_wifi_config
 {
@@ -23,60 +27,138 @@ namespace audio_wifi_config
                                          size_t input_channels = 1);
 
     /**
-     * Goertzel algorithm implementation for single frequency detection
-     * Used to detect specific audio frequencies in the AFSK demodulation process
+     * Mark and space magnitudes of one analysis window
      */
-    class FrequencyDetector
+    struct TonePower
     {
-    private:
-        float frequency_;              // Target frequency (normalized, i.e., f / fs)
-        size_t window_size_;           // Window size for analysis
-        float frequency_bin_;          // Frequency bin
-        float angular_frequency_;      // Angular frequency
-        float cos_coefficient_;        // cos(w)
-        float sin_coefficient_;        // sin(w)
-        float filter_coefficient_;     // 2 * cos(w)
-        std::deque<float> state_buffer_;  // Circular buffer for storing S[-1] and S[-2]
+        float mark;
+        float space;
+    };
 
+    /**
+     * Detects the mark and space tones over a sliding window of window_size
+     * samples and reports both magnitudes every window_size / phases samples,
+     * i.e. for `phases` evenly spaced window alignments
+     */
+    class ToneDetector
+    {
     public:
+        virtual ~ToneDetector() = default;
+
         /**
-         * Constructor
-         * @param frequency Normalized frequency (f / fs)
-         * @param window_size Window size for analysis
+         * Reset the detector state
          */
-        FrequencyDetector(float frequency, size_t window_size);
+        virtual void Reset() = 0;
 
         /**
-         * Reset the detector state
+         * Process a block of samples
+         * @param samples Input samples, one every `stride` values (first channel of interleaved audio)
+         * @param count Number of samples
+         * @param stride Distance between two samples
+         * @param output One TonePower is appended per completed window
          */
-        void Reset();
+        virtual void ProcessBlock(const int16_t *samples, size_t count, size_t stride,
+                                  std::vector<TonePower> &output) = 0;
+    };
+
+    /**
+     * Fixed-point Goertzel filter bank. Every alignment has its own pair of
+     * Goertzel filters kept in a circular array; the filter whose window
+     * completes at a hop is read out and restarted.
+     */
+    class GoertzelBank : public ToneDetector
+    {
+    private:
+        static const int kCoefficientBits = 14;
 
+        size_t phases_;                // Number of staggered windows
+        size_t hop_size_;              // Samples between two outputs
+        int32_t coefficients_[2];      // 2 * cos(w) of mark and space, Q14
+        std::vector<int32_t> states_;  // S[-1] and S[-2] of each tone for each window, 4 per window
+        size_t hop_samples_ = 0;       // Samples since the last hop
+        size_t next_window_ = 0;       // Window completed at the next hop
+        size_t hops_ = 0;              // Hops since reset, outputs start once every window is full
+
+    public:
         /**
-         * Process one audio sample
-         * @param sample Input audio sample
+         * Constructor
+         * @param mark_frequency Normalized mark frequency (f / fs)
+         * @param space_frequency Normalized space frequency (f / fs)
+         * @param window_size Window size for analysis
+         * @param phases Number of window alignments, must divide window_size
          */
-        void ProcessSample(float sample);
+        GoertzelBank(float mark_frequency, float space_frequency, size_t window_size, size_t phases);
+
+        void Reset() override;
+        void ProcessBlock(const int16_t *samples, size_t count, size_t stride,
+                          std::vector<TonePower> &output) override;
+    };
 
+    /**
+     * Sliding DFT on the mark and space bins. Each sample is multiplied by
+     * the bin's twiddle factor once and kept in a circular array, the window
+     * sums add the new product and drop the one leaving the window. All in
+     * integers, so the sums never drift and a window costs the same whatever
+     * the number of alignments. The tones must fall on bins (f * window_size
+     * is an integer).
+     */
+    class SlidingDft : public ToneDetector
+    {
+    private:
+        static const int kTwiddleBits = 14;
+
+        size_t window_size_;
+        size_t hop_size_;
+        std::vector<int16_t> twiddles_;  // cos and sin of each tone for each window position, 4 per position
+        std::vector<int32_t> products_;  // Products still in the window, 4 per position
+        int32_t sums_[4] = {};           // Real and imaginary sums of mark and space
+        size_t position_ = 0;            // Position of the next sample in the window
+        size_t hop_samples_ = 0;
+        bool filled_ = false;            // A whole window has been seen
+
+    public:
         /**
-         * Calculate current amplitude
-         * @return Amplitude value
+         * Constructor
+         * @param mark_frequency Normalized mark frequency (f / fs)
+         * @param space_frequency Normalized space frequency (f / fs)
+         * @param window_size Window size for analysis
+         * @param phases Number of window alignments, must divide window_size
          */
-        float GetAmplitude() const;
+        SlidingDft(float mark_frequency, float space_frequency, size_t window_size, size_t phases);
+
+        void Reset() override;
+        void ProcessBlock(const int16_t *samples, size_t count, size_t stride,
+                          std::vector<TonePower> &output) override;
+    };
+
+    /**
+     * Mark probability of one bit as seen from one bit clock alignment
+     */
+    struct SlicedBit
+    {
+        size_t phase;            // Alignment the bit belongs to
+        float mark_probability;  // 0.0 (space) to 1.0 (mark)
     };
 
     /**
      * Audio signal processor for Mark/Space frequency pair detection
      * Processes audio signals to extract digital data using AFSK demodulation
+     *
+     * The sender's bit clock is unknown, so the bits are sliced at `phases`
+     * alignments in parallel. Each window integrates exactly one bit (the
+     * matched filter of a tone), the alignment closest to the sender's clock
+     * sees clean bits and the others see bits smeared with their neighbours.
+     * Smeared bits fail in pairs that the sum checksum can miss, so the
+     * processor also tracks how clean each alignment's bits are.
      */
     class AudioSignalProcessor
     {
     private:
-        std::deque<float> input_buffer_;             // Input sample buffer
-        size_t input_buffer_size_;                   // Input buffer size = window size
-        size_t output_sample_count_;                 // Output sample counter
-        size_t samples_per_bit_;                     // Samples per bit threshold
-        std::unique_ptr<FrequencyDetector> mark_detector_;   // Mark frequency detector
-        std::unique_ptr<FrequencyDetector> space_detector_;  // Space frequency detector
+        size_t phases_;                          // Number of bit clock alignments
+        size_t hop_count_;                       // Windows completed, the phase of the next one is hop_count_ % phases_
+        std::unique_ptr<ToneDetector> detector_; // Mark and space detector
+        std::vector<TonePower> tone_powers_;     // Reused output of the detector
+        std::vector<float> phase_contrast_;      // Smoothed |2p - 1| of the bits of each alignment
 
     public:
         /**
@@ -86,16 +168,32 @@ namespace audio_wifi_config
          * @param space_frequency Space frequency for digital '0'
          * @param bit_rate Data transmission bit rate
          * @param window_size Analysis window size
+         * @param phases Number of bit clock alignments sliced in parallel
          */
         AudioSignalProcessor(size_t sample_rate, size_t mark_frequency, size_t space_frequency,
-                           size_t bit_rate, size_t window_size);
+                           size_t bit_rate, size_t window_size, size_t phases = 1);
+
+        /**
+         * Reset the detector and the bit clock
+         */
+        void Reset();
 
         /**
          * Process input audio samples
-         * @param samples Input audio sample vector
-         * @return Vector of Mark probability values (0.0 to 1.0)
+         * @param samples Input samples, one every `stride` values
+         * @param count Number of samples
+         * @param stride Distance between two samples (the number of input channels)
+         * @param bits One SlicedBit is appended per bit per alignment
+         */
+        void ProcessAudioSamples(const int16_t *samples, size_t count, size_t stride,
+                                 std::vector<SlicedBit> &bits);
+
+        /**
+         * Contrast of an alignment relative to the best one
+         * @param phase Alignment
+         * @return 1.0 for the alignment with the cleanest bits, less for the others
          */
-        std::vector<float> ProcessAudioSamples(const std::vector<float> &samples);
+        float GetPhaseQuality(size_t phase) const;
     };
 
     /**
@@ -119,6 +217,7 @@ namespace audio_wifi_config
         std::deque<uint8_t> identifier_buffer_;  // Buffer for start/end identifier detection
         size_t identifier_buffer_size_;          // Identifier buffer size
         std::vector<uint8_t> bit_buffer_;        // Buffer for storing bit stream
+        std::vector<uint8_t> confidence_buffer_; // Confidence of each bit in bit_buffer_, 0 (coin toss) to 255
         size_t max_bit_buffer_size_;             // Maximum bit buffer size
         const std::vector<uint8_t> start_of_transmission_;  // Start-of-transmission identifier
         const std::vector<uint8_t> end_of_transmission_;    // End-of-transmission identifier
@@ -150,6 +249,19 @@ namespace audio_wifi_config
          */
         bool ProcessProbabilityData(const std::vector<float> &probabilities, float threshold = 0.5f);
 
+        /**
+         * Process the probability of a single bit
+         * @param probability Mark probability
+         * @param threshold Decision threshold for bit detection
+         * @return true if this bit completed a transmission that was successfully decoded
+         */
+        bool ProcessProbability(float probability, float threshold = 0.5f);
+
+        /**
+         * Drop any partial transmission and wait for the next start identifier
+         */
+        void Reset();
+
         /**
          * Calculate checksum for ASCII text
          * @param text Input text string
@@ -158,6 +270,23 @@ namespace audio_wifi_config
         static uint8_t CalculateChecksum(const std::string &text);
 
     private:
+        /**
+         * Decode a complete transmission (payload, checksum and end identifier)
+         * @param bits Received bits
+         * @param text Decoded text
+         * @return true if the transmission is long enough and the checksum matches
+         */
+        bool DecodeTransmission(const std::vector<uint8_t> &bits, std::string &text) const;
+
+        /**
+         * Retry a transmission with a checksum mismatch with one of its least
+         * confident bits flipped. The sum checksum catches every single bit
+         * error, so a single weak bit is the likely culprit.
+         * @param text Decoded text
+         * @return true if one flip produced a valid transmission of printable text
+         */
+        bool CorrectSingleBitError(std::string &text) const;
+
         /**
          * Convert bit vector to byte vector
          * @param bits Input bit vector
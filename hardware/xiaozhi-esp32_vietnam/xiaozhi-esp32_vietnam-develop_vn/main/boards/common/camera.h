@@ -3,9 +3,26 @@
 
 #include <string>
 
+// 上传给视觉服务器的图像参数，由 MCP initialize 的 vision 能力下发
+struct ExplainImageOptions {
+    int max_size = 0;   // 长边最大像素，0 表示保持原尺寸
+    int quality = 80;   // JPEG 质量 1-100
+};
+
+// 感兴趣区域，按画面宽高的百分比
+struct ImageRegion {
+    int x = 0;
+    int y = 0;
+    int width = 100;
+    int height = 100;
+};
+
 class Camera {
 public:
     virtual void SetExplainUrl(const std::string& url, const std::string& token) = 0;
+    // 不支持缩放或裁剪的摄像头（如直接输出 JPEG 的模组）忽略这些设置
+    virtual void SetExplainImageOptions(const ExplainImageOptions& options) {}
+    virtual void SetExplainRegion(const ImageRegion& region) {}
     virtual bool Capture() = 0;
     virtual bool SetHMirror(bool enabled) = 0;
     virtual bool SetVFlip(bool enabled) = 0;
@@ -0,0 +1,125 @@
+#ifndef _CAMERA_IMAGE_OPS_H_
+#define _CAMERA_IMAGE_OPS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "linux/videodev2.h"
+
+// Pixel kernels of Esp32Camera that only touch memory, kept out of
+// esp32_camera.cc so the host tests can check them against reference code
+
+// 16 位字节交换，每次处理一个 32 位字
+// src 和 dst 需 4 字节对齐（相机缓冲区按 128 字节对齐），len 为奇数时最后一个字节不处理
+inline void SwapBytes16(const uint8_t* src, uint8_t* dst, size_t len) {
+    auto src32 = (const uint32_t*)src;
+    auto dst32 = (uint32_t*)dst;
+    size_t words = len / 4;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t v = src32[i];
+        dst32[i] = ((v & 0x00FF00FF) << 8) | ((v >> 8) & 0x00FF00FF);
+    }
+    if (len & 2) {
+        auto src16 = (const uint16_t*)(src32 + words);
+        auto dst16 = (uint16_t*)(dst32 + words);
+        *dst16 = __builtin_bswap16(*src16);
+    }
+}
+
+// 旋转 90°（顺时针）或 270°，同时完成 16 位字节交换，只遍历一次
+// 按目标行顺序写入，PSRAM 写回保持连续
+inline void RotateSwapImage(const uint8_t* src, uint8_t* dst, int src_w, int src_h, int bpp, bool clockwise) {
+    const int dst_w = src_h;
+    const int dst_h = src_w;
+    if (bpp == 2) {
+        auto src16 = (const uint16_t*)src;
+        auto dst16 = (uint16_t*)dst;
+        for (int dy = 0; dy < dst_h; dy++) {
+            // 顺时针: dst(dx, dy) = src(dy, src_h - 1 - dx)，逆时针: dst(dx, dy) = src(src_w - 1 - dy, dx)
+            int sx = clockwise ? dy : src_w - 1 - dy;
+            for (int dx = 0; dx < dst_w; dx++) {
+                int sy = clockwise ? src_h - 1 - dx : dx;
+                *dst16++ = __builtin_bswap16(src16[(size_t)sy * src_w + sx]);
+            }
+        }
+        return;
+    }
+    // 其它像素宽度：字节交换作用于整个缓冲区的 16 位字，即源字节下标异或 1
+    // （src_w * src_h * bpp 需为偶数，传感器分辨率都满足）
+    for (int dy = 0; dy < dst_h; dy++) {
+        int sx = clockwise ? dy : src_w - 1 - dy;
+        for (int dx = 0; dx < dst_w; dx++) {
+            int sy = clockwise ? src_h - 1 - dx : dx;
+            size_t offset = ((size_t)sy * src_w + sx) * bpp;
+            for (int b = 0; b < bpp; b++) {
+                *dst++ = src[(offset + b) ^ 1];
+            }
+        }
+    }
+}
+
+// 裁剪 (cx, cy, cw, ch) 区域并用 box 滤波缩小到 ow x oh（每个输出像素取其覆盖源区域的平均值）
+// kFormat 为 V4L2_PIX_FMT_RGB565/RGB24/YUYV/GREY。每个源像素只读取一次；
+// YUYV 的色度按像素所在的 YUYV 对取样后同样求平均
+template <uint32_t kFormat>
+inline void CropAndScaleImage(const uint8_t* src, int src_w, int cx, int cy, int cw, int ch, uint8_t* dst, int ow,
+                              int oh) {
+    std::vector<int> xb(ow + 1);
+    for (int i = 0; i <= ow; i++) {
+        xb[i] = cx + i * cw / ow;
+    }
+
+    for (int oy = 0; oy < oh; oy++) {
+        int y0 = cy + oy * ch / oh;
+        int y1 = cy + (oy + 1) * ch / oh;
+        for (int ox = 0; ox < ow; ox++) {
+            int x0 = xb[ox];
+            int x1 = xb[ox + 1];
+            uint32_t count = (uint32_t)(x1 - x0) * (y1 - y0);
+            uint32_t sum[3] = {0, 0, 0};
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    if constexpr (kFormat == V4L2_PIX_FMT_RGB565) {
+                        uint16_t p = ((const uint16_t*)src)[(size_t)y * src_w + x];
+                        sum[0] += p >> 11;
+                        sum[1] += (p >> 5) & 0x3F;
+                        sum[2] += p & 0x1F;
+                    } else if constexpr (kFormat == V4L2_PIX_FMT_RGB24) {
+                        const uint8_t* p = src + ((size_t)y * src_w + x) * 3;
+                        sum[0] += p[0];
+                        sum[1] += p[1];
+                        sum[2] += p[2];
+                    } else if constexpr (kFormat == V4L2_PIX_FMT_YUYV) {
+                        const uint8_t* row = src + (size_t)y * src_w * 2;
+                        sum[0] += row[x * 2];
+                        sum[1] += row[(x & ~1) * 2 + 1];
+                        sum[2] += row[(x & ~1) * 2 + 3];
+                    } else {
+                        sum[0] += src[(size_t)y * src_w + x];
+                    }
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                sum[c] = (sum[c] + count / 2) / count;
+            }
+            if constexpr (kFormat == V4L2_PIX_FMT_RGB565) {
+                ((uint16_t*)dst)[(size_t)oy * ow + ox] = (uint16_t)((sum[0] << 11) | (sum[1] << 5) | sum[2]);
+            } else if constexpr (kFormat == V4L2_PIX_FMT_RGB24) {
+                uint8_t* p = dst + ((size_t)oy * ow + ox) * 3;
+                p[0] = sum[0];
+                p[1] = sum[1];
+                p[2] = sum[2];
+            } else if constexpr (kFormat == V4L2_PIX_FMT_YUYV) {
+                // 偶数像素写 Y U，奇数像素写 Y V
+                uint8_t* p = dst + ((size_t)oy * ow + ox) * 2;
+                p[0] = sum[0];
+                p[1] = (ox & 1) ? sum[2] : sum[1];
+            } else {
+                dst[(size_t)oy * ow + ox] = sum[0];
+            }
+        }
+    }
+}
+
+#endif // _CAMERA_IMAGE_OPS_H_
@@ -5,11 +5,13 @@
 #include <sys/param.h>
 #include <unistd.h>
 #include "board.h"
+#include "camera_image_ops.h"
 #include "display.h"
 #include "esp_imgfx_color_convert.h"
 #include "esp_video_device.h"
 #include "esp_video_init.h"
 #include "jpg/image_to_jpeg.h"
+#include "jpeg_chunk_pipe.h"
 #include "linux/videodev2.h"
 #include "lvgl_display.h"
 #include "mcp_server.h"
@@ -45,6 +47,8 @@
 #include <errno.h>
 #include <esp_heap_caps.h>
 #include <esp_log.h>
+#include <esp_pthread.h>
+#include <esp_timer.h>
 #include <cstdio>
 #include <cstring>
 
@@ -369,6 +373,9 @@ Esp32Camera::~Esp32Camera() {
         close(video_fd_);
         video_fd_ = -1;
     }
+    frame_scratch_.Free();
+    convert_scratch_.Free();
+    chunk_pool_.Free();
     sensor_format_ = 0;
     esp_video_deinit();
 }
@@ -378,346 +385,453 @@ void Esp32Camera::SetExplainUrl(const std::string& url, const std::string& token
     explain_token_ = token;
 }
 
-bool Esp32Camera::Capture() {
-    if (encoder_thread_.joinable()) {
-        encoder_thread_.join();
+uint8_t* Esp32Camera::ScratchBuffer::Reserve(size_t len) {
+    if (data != nullptr && size >= len) {
+        return data;
     }
+    Free();
+    // 按 128 字节对齐，满足 PPA/DMA 对 cache line 的要求
+    size_t aligned_len = (len + 127) & ~(size_t)127;
+    data = (uint8_t*)heap_caps_aligned_alloc(128, aligned_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (data != nullptr) {
+        size = aligned_len;
+    }
+    return data;
+}
 
-    if (!streaming_on_ || video_fd_ < 0) {
-        return false;
+void Esp32Camera::ScratchBuffer::Free() {
+    if (data != nullptr) {
+        heap_caps_free(data);
+        data = nullptr;
     }
+    size = 0;
+}
 
-    for (int i = 0; i < 3; i++) {
-        struct v4l2_buffer buf = {};
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
-            ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
-            return false;
-        }
-        if (i == 2) {
-            // 保存帧副本到PSRAM
-            if (frame_.data) {
-                heap_caps_free(frame_.data);
-                frame_.data = nullptr;
-                frame_.format = 0;
-            }
-            frame_.len = buf.bytesused;
-            frame_.data = (uint8_t*)heap_caps_malloc(frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-            if (!frame_.data) {
-                ESP_LOGE(TAG, "alloc frame copy failed");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
+void Esp32Camera::ReleaseFrame() {
+    if (held_buffer_ < 0) {
+        return;
+    }
+    struct v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = held_buffer_;
+    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_QBUF failed");
+    }
+    held_buffer_ = -1;
+    frame_.data = nullptr;
+    frame_.len = 0;
+}
+
+void Esp32Camera::NotePsramUsage() {
+    size_t free_size = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    if (free_size < psram_min_free_) {
+        psram_min_free_ = free_size;
+    }
+}
+
+/**
+ * 将刚取出的 V4L2 缓冲区作为 frame_：
+ * - 不需要变换时直接引用 mmap 缓冲区（零拷贝），编码上传后由 ReleaseFrame() 归还驱动
+ * - 需要字节交换或旋转时一次遍历写入复用的 frame_scratch_，缓冲区可立即归还
+ */
+bool Esp32Camera::ProcessFrame(uint32_t index, size_t bytesused) {
+    const MmapBuffer& mmap_buffer = mmap_buffers_[index];
+    uint8_t* src = (uint8_t*)mmap_buffer.start;
+    size_t len = MIN(mmap_buffer.length, bytesused);
 
 #ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
-            ESP_LOGW(TAG, "mmap_buffers_[buf.index].length = %d, sensor_width = %d, sensor_height = %d",
-                     mmap_buffers_[buf.index].length, sensor_width_, sensor_height_);
+    ESP_LOGW(TAG, "mmap_buffers_[buf.index].length = %d, sensor_width = %d, sensor_height = %d",
+             mmap_buffer.length, sensor_width_, sensor_height_);
 #else
-            ESP_LOGW(TAG, "mmap_buffers_[buf.index].length = %d, frame.width = %d, frame.height = %d",
-                     mmap_buffers_[buf.index].length, frame_.width, frame_.height);
+    ESP_LOGW(TAG, "mmap_buffers_[buf.index].length = %d, frame.width = %d, frame.height = %d",
+             mmap_buffer.length, frame_.width, frame_.height);
 #endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
-            ESP_LOG_BUFFER_HEXDUMP(TAG, mmap_buffers_[buf.index].start, MIN(mmap_buffers_[buf.index].length, 256),
-                                   ESP_LOG_DEBUG);
-
-            switch (sensor_format_) {
-                case V4L2_PIX_FMT_RGB565:
-                case V4L2_PIX_FMT_RGB24:
-                case V4L2_PIX_FMT_YUYV:
-                case V4L2_PIX_FMT_YUV420:
-                case V4L2_PIX_FMT_GREY:
-#ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
-                {
-                    auto src16 = (uint16_t*)mmap_buffers_[buf.index].start;
-                    auto dst16 = (uint16_t*)frame_.data;
-                    size_t count = (size_t)mmap_buffers_[buf.index].length / 2;
-                    for (size_t i = 0; i < count; i++) {
-                        dst16[i] = __builtin_bswap16(src16[i]);
-                    }
-                }
-#else
-                    memcpy(frame_.data, mmap_buffers_[buf.index].start,
-                           MIN(mmap_buffers_[buf.index].length, frame_.len));
-#endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
-                    frame_.format = sensor_format_;
-                    break;
-                case V4L2_PIX_FMT_YUV422P: {
-                    // 这个格式是 422 YUYV，不是 planer
-                    frame_.format = V4L2_PIX_FMT_YUYV;
+    ESP_LOG_BUFFER_HEXDUMP(TAG, src, MIN(mmap_buffer.length, 256), ESP_LOG_DEBUG);
+
 #ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
-                    {
-                        auto src16 = (uint16_t*)mmap_buffers_[buf.index].start;
-                        auto dst16 = (uint16_t*)frame_.data;
-                        size_t count = (size_t)mmap_buffers_[buf.index].length / 2;
-                        for (size_t i = 0; i < count; i++) {
-                            dst16[i] = __builtin_bswap16(src16[i]);
-                        }
-                    }
+    bool swap_bytes = true;
 #else
-                    memcpy(frame_.data, mmap_buffers_[buf.index].start,
-                           MIN(mmap_buffers_[buf.index].length, frame_.len));
+    bool swap_bytes = false;
 #endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
-                    break;
-                }
-                case V4L2_PIX_FMT_RGB565X: {
-                    // 大端序的 RGB565 需要转换为小端序
-                    // 目前 esp_video 的大小端都会返回格式为 RGB565，不会返回格式为 RGB565X，此 case 用于未来版本兼容
-                    auto src16 = (uint16_t*)mmap_buffers_[buf.index].start;
-                    auto dst16 = (uint16_t*)frame_.data;
-                    size_t pixel_count = (size_t)frame_.width * (size_t)frame_.height;
-                    for (size_t i = 0; i < pixel_count; i++) {
-                        dst16[i] = __builtin_bswap16(src16[i]);
-                    }
-                    frame_.format = V4L2_PIX_FMT_RGB565;
-                    break;
-                }
-                default:
-                    ESP_LOGE(TAG, "unsupported sensor format: 0x%08x", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
+
+    switch (sensor_format_) {
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_YUV420:
+        case V4L2_PIX_FMT_GREY:
+            frame_.format = sensor_format_;
+            break;
+        case V4L2_PIX_FMT_YUV422P:
+            // 这个格式是 422 YUYV，不是 planer
+            frame_.format = V4L2_PIX_FMT_YUYV;
+            break;
+        case V4L2_PIX_FMT_RGB565X:
+            // 大端序的 RGB565 需要转换为小端序
+            // 目前 esp_video 的大小端都会返回格式为 RGB565，不会返回格式为 RGB565X，此 case 用于未来版本兼容
+            frame_.format = V4L2_PIX_FMT_RGB565;
+            swap_bytes = true;
+            break;
+        default:
+            ESP_LOGE(TAG, "unsupported sensor format: 0x%08x", sensor_format_);
+            return false;
+    }
+
+#ifndef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+    if (!swap_bytes) {
+        frame_.data = src;
+        frame_.len = len;
+        held_buffer_ = index;
+        return true;
+    }
+    uint8_t* dst = frame_scratch_.Reserve(len);
+    if (dst == nullptr) {
+        ESP_LOGE(TAG, "alloc frame buffer failed");
+        return false;
+    }
+    SwapBytes16(src, dst, len);
+    frame_.data = dst;
+    frame_.len = len;
+    return true;
+#elif !defined(CONFIG_SOC_PPA_SUPPORTED)
+    int bpp;
+    esp_imgfx_pixel_fmt_t pixel_fmt;
+    switch (frame_.format) {
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_YUYV:
+            bpp = 2;
+            pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
+            break;
+        case V4L2_PIX_FMT_GREY:
+            bpp = 1;
+            pixel_fmt = ESP_IMGFX_PIXEL_FMT_Y;
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            bpp = 3;
+            pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888;
+            break;
+        default:
+            ESP_LOGE(TAG, "unsupported sensor format: 0x%08x", sensor_format_);
+            return false;
+    }
+    size_t frame_len = (size_t)sensor_width_ * sensor_height_ * bpp;
+    if (len < frame_len) {
+        ESP_LOGE(TAG, "short frame: %u < %u", (unsigned)len, (unsigned)frame_len);
+        return false;
+    }
+    uint8_t* dst = frame_scratch_.Reserve(frame_len);
+    if (dst == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
+        return false;
+    }
+
+    if (swap_bytes) {
+        RotateSwapImage(src, dst, sensor_width_, sensor_height_, bpp, IMAGE_ROTATION_ANGLE == 90);
+    } else {
+        // 直接从 mmap 缓冲区旋转到输出，不再经过中间副本
+        esp_imgfx_rotate_cfg_t rotate_cfg = {
+            .in_res =
+                {
+                    .width = static_cast<int16_t>(sensor_width_),
+                    .height = static_cast<int16_t>(sensor_height_),
+                },
+            .degree = IMAGE_ROTATION_ANGLE,
+        };
+        rotate_cfg.in_pixel_fmt = pixel_fmt;
+        esp_imgfx_rotate_handle_t rotate_handle = nullptr;
+        esp_imgfx_err_t imgfx_err = esp_imgfx_rotate_open(&rotate_cfg, &rotate_handle);
+        if (imgfx_err != ESP_IMGFX_ERR_OK || rotate_handle == nullptr) {
+            ESP_LOGE(TAG, "esp_imgfx_rotate_create failed");
+            return false;
+        }
+        esp_imgfx_data_t rotate_input_data = {
+            .data = src,
+            .data_len = static_cast<uint32_t>(frame_len),
+        };
+        esp_imgfx_data_t rotate_output_data = {
+            .data = dst,
+            .data_len = static_cast<uint32_t>(frame_len),
+        };
+        imgfx_err = esp_imgfx_rotate_process(rotate_handle, &rotate_input_data, &rotate_output_data);
+        esp_imgfx_rotate_close(rotate_handle);
+        if (imgfx_err != ESP_IMGFX_ERR_OK) {
+            ESP_LOGE(TAG, "esp_imgfx_rotate_process failed");
+            return false;
+        }
+    }
+    frame_.data = dst;
+    frame_.len = frame_len;
+    return true;
+#else   // CONFIG_SOC_PPA_SUPPORTED
+    // PPA 输出固定为 RGB565，输出缓冲区也兼作字节交换的中间缓冲
+    size_t out_len = (size_t)frame_.width * frame_.height * 2;
+    uint8_t* dst = frame_scratch_.Reserve(MAX(out_len, len));
+    if (dst == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
+        return false;
+    }
+
+    uint8_t* rotate_src = src;
+    ppa_srm_color_mode_t ppa_color_mode;
+    bool ppa_byte_swap = false;
+    switch (frame_.format) {
+        case V4L2_PIX_FMT_RGB565:
+            // 由 PPA 在读取时完成字节交换
+            ppa_color_mode = PPA_SRM_COLOR_MODE_RGB565;
+            ppa_byte_swap = swap_bytes;
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            ppa_color_mode = PPA_SRM_COLOR_MODE_RGB888;
+            if (swap_bytes) {
+                rotate_src = convert_scratch_.Reserve(len);
+                if (rotate_src == nullptr) {
+                    ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
                     return false;
+                }
+                SwapBytes16(src, rotate_src, len);
             }
-
-#ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
-#ifndef CONFIG_SOC_PPA_SUPPORTED
-            uint8_t* rotate_dst =
-                (uint8_t*)heap_caps_aligned_alloc(64, frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-            if (rotate_dst == nullptr) {
+            break;
+        case V4L2_PIX_FMT_YUYV: {
+            ESP_LOGW(TAG, "YUYV format is not supported for PPA rotation, using software conversion to RGB888");
+            const uint8_t* yuyv = src;
+            if (swap_bytes) {
+                SwapBytes16(src, dst, len);
+                yuyv = dst;
+            }
+            size_t rgb_len = (size_t)frame_.width * frame_.height * 3;
+            rotate_src = convert_scratch_.Reserve(rgb_len);
+            if (rotate_src == nullptr) {
                 ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
                 return false;
             }
-            uint8_t* rotate_src = (uint8_t*)frame_.data;
-
-            esp_imgfx_rotate_cfg_t rotate_cfg = {
-                .in_res =
-                    {
-                        .width = static_cast<int16_t>(sensor_width_),
-                        .height = static_cast<int16_t>(sensor_height_),
-                    },
-                .degree = IMAGE_ROTATION_ANGLE,
+            esp_imgfx_color_convert_cfg_t convert_cfg = {
+                .in_res = {.width = static_cast<int16_t>(sensor_width_),
+                           .height = static_cast<int16_t>(sensor_height_)},
+                .in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
+                .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888,
             };
-            switch (frame_.format) {
-                case V4L2_PIX_FMT_RGB565:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
-                    break;
-                case V4L2_PIX_FMT_YUYV:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
-                    break;
-                case V4L2_PIX_FMT_GREY:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_Y;
-                    break;
-                case V4L2_PIX_FMT_RGB24:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888;
-                    break;
-                default:
-                    ESP_LOGE(TAG, "unsupported sensor format: 0x%08x", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
-                    return false;
-            }
-            esp_imgfx_rotate_handle_t rotate_handle = nullptr;
-            esp_imgfx_err_t imgfx_err = esp_imgfx_rotate_open(&rotate_cfg, &rotate_handle);
-            if (imgfx_err != ESP_IMGFX_ERR_OK || rotate_handle == nullptr) {
-                ESP_LOGE(TAG, "esp_imgfx_rotate_create failed");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+            esp_imgfx_color_convert_handle_t convert_handle = nullptr;
+            esp_imgfx_err_t err = esp_imgfx_color_convert_open(&convert_cfg, &convert_handle);
+            if (err != ESP_IMGFX_ERR_OK || convert_handle == nullptr) {
+                ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
                 return false;
             }
-
-            esp_imgfx_data_t rotate_input_data = {
-                .data = rotate_src,
-                .data_len = frame_.len,
+            esp_imgfx_data_t convert_input_data = {
+                .data = const_cast<uint8_t*>(yuyv),
+                .data_len = static_cast<uint32_t>(len),
             };
-            esp_imgfx_data_t rotate_output_data = {
-                .data = rotate_dst,
-                .data_len = frame_.len,
+            esp_imgfx_data_t convert_output_data = {
+                .data = rotate_src,
+                .data_len = static_cast<uint32_t>(rgb_len),
             };
-
-            imgfx_err = esp_imgfx_rotate_process(rotate_handle, &rotate_input_data, &rotate_output_data);
-            if (imgfx_err != ESP_IMGFX_ERR_OK) {
-                ESP_LOGE(TAG, "esp_imgfx_rotate_process failed");
-                heap_caps_free(rotate_dst);
-                rotate_dst = nullptr;
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                esp_imgfx_rotate_close(rotate_handle);
-                rotate_handle = nullptr;
+            err = esp_imgfx_color_convert_process(convert_handle, &convert_input_data, &convert_output_data);
+            esp_imgfx_color_convert_close(convert_handle);
+            if (err != ESP_IMGFX_ERR_OK) {
+                ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
                 return false;
             }
+            ppa_color_mode = PPA_SRM_COLOR_MODE_RGB888;
+            break;
+        }
+        default:
+            ESP_LOGE(TAG, "unsupported sensor format for PPA rotation: 0x%08x", sensor_format_);
+            return false;
+    }
 
-            frame_.data = rotate_dst;
+    ppa_client_handle_t ppa_client = nullptr;
+    ppa_client_config_t client_cfg = {
+        .oper_type = PPA_OPERATION_SRM,
+        .max_pending_trans_num = 1,
+    };
+    esp_err_t err = ppa_register_client(&client_cfg, &ppa_client);
+    if (err != ESP_OK || ppa_client == nullptr) {
+        ESP_LOGE(TAG, "ppa_register_client failed: %d", (int)err);
+        return false;
+    }
 
-            heap_caps_free(rotate_src);
-            rotate_src = nullptr;
+    ppa_srm_rotation_angle_t ppa_angle = IMAGE_ROTATION_ANGLE;
+
+    ppa_srm_oper_config_t srm_cfg = {};
+    srm_cfg.in.buffer = (void*)rotate_src;
+    srm_cfg.in.pic_w = sensor_width_;
+    srm_cfg.in.pic_h = sensor_height_;
+    srm_cfg.in.block_w = sensor_width_;
+    srm_cfg.in.block_h = sensor_height_;
+    srm_cfg.in.block_offset_x = 0;
+    srm_cfg.in.block_offset_y = 0;
+    srm_cfg.in.srm_cm = ppa_color_mode;
+
+    srm_cfg.out.buffer = (void*)dst;
+    srm_cfg.out.buffer_size = frame_scratch_.size;
+    srm_cfg.out.pic_w = frame_.width;
+    srm_cfg.out.pic_h = frame_.height;
+    srm_cfg.out.block_offset_x = 0;
+    srm_cfg.out.block_offset_y = 0;
+    srm_cfg.out.srm_cm = PPA_SRM_COLOR_MODE_RGB565;
+
+    // 等比例缩放 1.0
+    srm_cfg.scale_x = 1.0f;
+    srm_cfg.scale_y = 1.0f;
+    srm_cfg.rotation_angle = ppa_angle;
+    srm_cfg.byte_swap = ppa_byte_swap;
+    srm_cfg.mode = PPA_TRANS_MODE_BLOCKING;
+    srm_cfg.user_data = nullptr;
+
+    err = ppa_do_scale_rotate_mirror(ppa_client, &srm_cfg);
+    (void)ppa_unregister_client(ppa_client);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ppa_do_scale_rotate_mirror failed: %d", (int)err);
+        return false;
+    }
 
-            esp_imgfx_rotate_close(rotate_handle);
-            rotate_handle = nullptr;
-#else   // CONFIG_SOC_PPA_SUPPORTED
-            uint8_t* rotate_src = nullptr;
-
-            ppa_srm_color_mode_t ppa_color_mode;
-            switch (frame_.format) {
-                case V4L2_PIX_FMT_RGB565:
-                    rotate_src = (uint8_t*)frame_.data;
-                    ppa_color_mode = PPA_SRM_COLOR_MODE_RGB565;
-                    break;
-                case V4L2_PIX_FMT_RGB24:
-                    rotate_src = (uint8_t*)frame_.data;
-                    ppa_color_mode = PPA_SRM_COLOR_MODE_RGB888;
-                    break;
-                case V4L2_PIX_FMT_YUYV: {
-                    ESP_LOGW(TAG, "YUYV format is not supported for PPA rotation, using software conversion to RGB888");
-                    rotate_src = (uint8_t*)heap_caps_malloc(frame_.width * frame_.height * 3,
-                                                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-                    if (rotate_src == nullptr) {
-                        ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
-                        return false;
-                    }
-                    esp_imgfx_color_convert_cfg_t convert_cfg = {
-                        .in_res = {.width = static_cast<int16_t>(frame_.width),
-                                   .height = static_cast<int16_t>(frame_.height)},
-                        .in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
-                        .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888,
-                    };
-                    esp_imgfx_color_convert_handle_t convert_handle = nullptr;
-                    esp_imgfx_err_t err = esp_imgfx_color_convert_open(&convert_cfg, &convert_handle);
-                    if (err != ESP_IMGFX_ERR_OK || convert_handle == nullptr) {
-                        ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
-                        heap_caps_free(rotate_src);
-                        rotate_src = nullptr;
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
-                        return false;
-                    }
-                    esp_imgfx_data_t convert_input_data = {
-                        .data = frame_.data,
-                        .data_len = frame_.len,
-                    };
-                    esp_imgfx_data_t convert_output_data = {
-                        .data = rotate_src,
-                        .data_len = static_cast<uint32_t>(frame_.width * frame_.height * 3),
-                    };
-                    err = esp_imgfx_color_convert_process(convert_handle, &convert_input_data, &convert_output_data);
-                    if (err != ESP_IMGFX_ERR_OK) {
-                        ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
-                        heap_caps_free(rotate_src);
-                        rotate_src = nullptr;
-                        esp_imgfx_color_convert_close(convert_handle);
-                        convert_handle = nullptr;
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
-                        return false;
-                    }
-                    esp_imgfx_color_convert_close(convert_handle);
-                    convert_handle = nullptr;
-                    ppa_color_mode = PPA_SRM_COLOR_MODE_RGB888;
-                    heap_caps_free(frame_.data);
-                    frame_.data = rotate_src;
-                    frame_.len = frame_.width * frame_.height * 3;
-                    break;
-                }
-                default:
-                    ESP_LOGE(TAG, "unsupported sensor format for PPA rotation: 0x%08x", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
-                    return false;
-            }
+    frame_.data = dst;
+    frame_.len = out_len;
+    frame_.format = V4L2_PIX_FMT_RGB565;
+    return true;
+#endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+}
 
-            uint8_t* rotate_dst = (uint8_t*)heap_caps_malloc(
-                frame_.width * frame_.height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT | MALLOC_CAP_CACHE_ALIGNED);
-            if (rotate_dst == nullptr) {
-                ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
+void Esp32Camera::SetExplainImageOptions(const ExplainImageOptions& options) {
+    explain_options_ = options;
+    if (explain_options_.quality < 1 || explain_options_.quality > 100) {
+        explain_options_.quality = 80;
+    }
+    ESP_LOGI(TAG, "Explain image options: max_size=%d, quality=%d", explain_options_.max_size,
+             explain_options_.quality);
+}
 
-            ppa_client_handle_t ppa_client = nullptr;
-            ppa_client_config_t client_cfg = {
-                .oper_type = PPA_OPERATION_SRM,
-                .max_pending_trans_num = 1,
-            };
-            esp_err_t err = ppa_register_client(&client_cfg, &ppa_client);
-            if (err != ESP_OK || ppa_client == nullptr) {
-                ESP_LOGE(TAG, "ppa_register_client failed: %d", (int)err);
-                heap_caps_free(rotate_dst);
-                rotate_dst = nullptr;
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
+void Esp32Camera::SetExplainRegion(const ImageRegion& region) {
+    explain_region_ = region;
+}
 
-            ppa_srm_rotation_angle_t ppa_angle = IMAGE_ROTATION_ANGLE;
-
-            ppa_srm_oper_config_t srm_cfg = {};
-            srm_cfg.in.buffer = (void*)rotate_src;
-            srm_cfg.in.pic_w = sensor_width_;
-            srm_cfg.in.pic_h = sensor_height_;
-            srm_cfg.in.block_w = sensor_width_;
-            srm_cfg.in.block_h = sensor_height_;
-            srm_cfg.in.block_offset_x = 0;
-            srm_cfg.in.block_offset_y = 0;
-            srm_cfg.in.srm_cm = ppa_color_mode;
-
-            srm_cfg.out.buffer = (void*)rotate_dst;
-            srm_cfg.out.buffer_size = frame_.len;
-            srm_cfg.out.pic_w = frame_.width;
-            srm_cfg.out.pic_h = frame_.height;
-            srm_cfg.out.block_offset_x = 0;
-            srm_cfg.out.block_offset_y = 0;
-            srm_cfg.out.srm_cm = PPA_SRM_COLOR_MODE_RGB565;
-
-            // 等比例缩放 1.0
-            srm_cfg.scale_x = 1.0f;
-            srm_cfg.scale_y = 1.0f;
-            srm_cfg.rotation_angle = ppa_angle;
-            srm_cfg.mode = PPA_TRANS_MODE_BLOCKING;
-            srm_cfg.user_data = nullptr;
-
-            err = ppa_do_scale_rotate_mirror(ppa_client, &srm_cfg);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "ppa_do_scale_rotate_mirror failed: %d", (int)err);
-                heap_caps_free(rotate_dst);
-                rotate_dst = nullptr;
-                (void)ppa_unregister_client(ppa_client);
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
+/**
+ * 按感兴趣区域和服务器要求的最大尺寸准备要编码的图像。
+ * 不需要裁剪缩放时直接使用 frame_；否则输出到 convert_scratch_，宽高对齐到 16，
+ * 以便 JPEG 编码器按块流式输出。
+ */
+bool Esp32Camera::PrepareExplainImage(FrameBuffer& image) {
+    image = frame_;
+
+    const ImageRegion& r = explain_region_;
+    int rx = MIN(MAX(r.x, 0), 90);
+    int ry = MIN(MAX(r.y, 0), 90);
+    int rw = MIN(MAX(r.width, 10), 100 - rx);
+    int rh = MIN(MAX(r.height, 10), 100 - ry);
+    bool crop = rx != 0 || ry != 0 || rw != 100 || rh != 100;
+    int cx = frame_.width * rx / 100;
+    int cy = frame_.height * ry / 100;
+    int cw = frame_.width * rw / 100;
+    int ch = frame_.height * rh / 100;
+
+    int long_side = MAX(cw, ch);
+    bool scale = explain_options_.max_size > 0 && long_side > explain_options_.max_size;
+    if (!crop && !scale) {
+        return true;
+    }
 
-            (void)ppa_unregister_client(ppa_client);
+    switch (frame_.format) {
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_GREY:
+            break;
+        default:
+            ESP_LOGW(TAG, "crop/scale not supported for format 0x%08lx, sending full frame", frame_.format);
+            return true;
+    }
 
-            frame_.data = rotate_dst;
-            frame_.len = frame_.width * frame_.height * 2;
-            frame_.format = V4L2_PIX_FMT_RGB565;
-            heap_caps_free(rotate_src);
-            rotate_src = nullptr;
-#endif  // CONFIG_SOC_PPA_SUPPORTED
-#endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+    int ow = cw;
+    int oh = ch;
+    if (scale) {
+        ow = cw * explain_options_.max_size / long_side;
+        oh = ch * explain_options_.max_size / long_side;
+    }
+    ow = MIN(MAX(ow & ~15, 16), cw & ~1);
+    oh = MIN(MAX(oh & ~15, 16), ch);
+    if (ow <= 0 || oh <= 0) {
+        return true;
+    }
+
+    int bpp = frame_.format == V4L2_PIX_FMT_RGB24 ? 3 : frame_.format == V4L2_PIX_FMT_GREY ? 1 : 2;
+    size_t len = (size_t)ow * oh * bpp;
+    uint8_t* dst = convert_scratch_.Reserve(len);
+    if (dst == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate memory for scaled image");
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    switch (frame_.format) {
+        case V4L2_PIX_FMT_RGB565:
+            CropAndScaleImage<V4L2_PIX_FMT_RGB565>(frame_.data, frame_.width, cx, cy, cw, ch, dst, ow, oh);
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            CropAndScaleImage<V4L2_PIX_FMT_RGB24>(frame_.data, frame_.width, cx, cy, cw, ch, dst, ow, oh);
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            CropAndScaleImage<V4L2_PIX_FMT_YUYV>(frame_.data, frame_.width, cx, cy, cw, ch, dst, ow, oh);
+            break;
+        default:
+            CropAndScaleImage<V4L2_PIX_FMT_GREY>(frame_.data, frame_.width, cx, cy, cw, ch, dst, ow, oh);
+            break;
+    }
+    ESP_LOGI(TAG, "Explain image %dx%d crop (%d,%d %dx%d) -> %dx%d in %d ms", frame_.width, frame_.height, cx, cy,
+             cw, ch, ow, oh, (int)((esp_timer_get_time() - start) / 1000));
+
+    image.data = dst;
+    image.len = len;
+    image.width = ow;
+    image.height = oh;
+    return true;
+}
+
+bool Esp32Camera::Capture() {
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
+    // 上一帧若仍占用 V4L2 缓冲区，先归还给驱动
+    ReleaseFrame();
+
+    if (!streaming_on_ || video_fd_ < 0) {
+        return false;
+    }
+
+    capture_start_us_ = esp_timer_get_time();
+    psram_free_at_capture_ = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    psram_min_free_ = psram_free_at_capture_;
+
+    // 丢弃前两帧，使用第三帧
+    struct v4l2_buffer buf = {};
+    for (int i = 0; i < 3; i++) {
+        buf = {};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
+            ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
+            return false;
         }
+        if (i < 2 && ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
+            ESP_LOGE(TAG, "VIDIOC_QBUF failed");
+        }
+    }
 
+    frame_.data = nullptr;
+    frame_.len = 0;
+    bool ok = ProcessFrame(buf.index, buf.bytesused);
+    if (held_buffer_ != (int)buf.index) {
+        // 帧已写入 scratch 或处理失败，缓冲区立即归还
         if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
             ESP_LOGE(TAG, "VIDIOC_QBUF failed");
         }
     }
+    if (!ok) {
+        frame_.data = nullptr;
+        frame_.len = 0;
+        return false;
+    }
+    NotePsramUsage();
+    capture_end_us_ = esp_timer_get_time();
 
     // 显示预览图片
     auto display = dynamic_cast<LvglDisplay*>(Board::GetInstance().GetDisplay());
@@ -845,9 +959,9 @@ bool Esp32Camera::SetVFlip(bool enabled) {
  * 问题对图像进行AI分析并返回结果。
  *
  * 实现特点：
- * - 使用独立线程编码JPEG，与主线程分离
+ * - 使用独立线程编码JPEG，与主线程分离；多核芯片上编码线程固定在核心 1，与上传并行
  * - 采用分块传输编码(chunked transfer encoding)优化内存使用
- * - 通过队列机制实现编码线程和发送线程的数据同步
+ * - 编码器每输出一个 MCU 行块就写入预分配的块池，上传线程边编码边发送
  * - 支持设备ID、客户端ID和认证令牌的HTTP头部配置
  *
  * @param question 要向AI提出的关于图像的问题，将作为表单字段发送
@@ -864,30 +978,61 @@ std::string Esp32Camera::Explain(const std::string& question) {
     if (explain_url_.empty()) {
         throw std::runtime_error("Image explain URL or token is not set");
     }
+    if (frame_.data == nullptr) {
+        throw std::runtime_error("No captured image to explain");
+    }
+    size_t frame_len = frame_.len;
 
-    // 创建局部的 JPEG 队列, 40 entries is about to store 512 * 40 = 20480 bytes of JPEG data
-    QueueHandle_t jpeg_queue = xQueueCreate(40, sizeof(JpegChunk));
-    if (jpeg_queue == nullptr) {
+    int64_t explain_start_us = esp_timer_get_time();
+    uint8_t* chunk_pool = chunk_pool_.Reserve(JPEG_CHUNK_SIZE * JPEG_CHUNK_COUNT);
+    if (chunk_pool == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate JPEG chunk pool");
+        throw std::runtime_error("Failed to allocate JPEG chunk pool");
+    }
+    JpegChunkPipe pipe(chunk_pool);
+    if (!pipe.valid()) {
         ESP_LOGE(TAG, "Failed to create JPEG queue");
         throw std::runtime_error("Failed to create JPEG queue");
     }
 
     // We spawn a thread to encode the image to JPEG using optimized encoder (cost about 500ms and 8KB SRAM)
-    encoder_thread_ = std::thread([this, jpeg_queue]() {
-        uint16_t w = frame_.width ? frame_.width : 320;
-        uint16_t h = frame_.height ? frame_.height : 240;
-        v4l2_pix_fmt_t enc_fmt = frame_.format;
-        image_to_jpeg_cb(
-            frame_.data, frame_.len, w, h, enc_fmt, 80,
-            [](void* arg, size_t index, const void* data, size_t len) -> size_t {
-                auto jpeg_queue = (QueueHandle_t)arg;
-                JpegChunk chunk = {.data = (uint8_t*)heap_caps_aligned_alloc(16, len, MALLOC_CAP_SPIRAM), .len = len};
-                memcpy(chunk.data, data, len);
-                xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
-                return len;
-            },
-            jpeg_queue);
+#if !CONFIG_FREERTOS_UNICORE
+    // 音频输入固定在核心 0，编码放到核心 1，上传在当前线程与编码并行
+    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+    cfg.pin_to_core = 1;
+    cfg.thread_name = "jpeg_encoder";
+    esp_pthread_set_cfg(&cfg);
+#endif
+    int64_t encode_done_us = 0;
+    FrameBuffer image;
+    encoder_thread_ = std::thread([this, &pipe, &encode_done_us, &image]() {
+        // 裁剪缩放在编码线程中完成，与 HTTP 连接建立并行
+        if (!PrepareExplainImage(image)) {
+            encode_done_us = esp_timer_get_time();
+            pipe.Finish();
+            return;
+        }
+        uint16_t w = image.width ? image.width : 320;
+        uint16_t h = image.height ? image.height : 240;
+        v4l2_pix_fmt_t enc_fmt = image.format;
+        if (!image_to_jpeg_cb(
+                image.data, image.len, w, h, enc_fmt, explain_options_.quality,
+                [](void* arg, size_t index, const void* data, size_t len) -> size_t {
+                    if (data != nullptr) {
+                        static_cast<JpegChunkPipe*>(arg)->Write((const uint8_t*)data, len);
+                    }
+                    return len;
+                },
+                &pipe)) {
+            ESP_LOGE(TAG, "Failed to encode image to JPEG");
+        }
+        encode_done_us = esp_timer_get_time();
+        pipe.Finish();
     });
+#if !CONFIG_FREERTOS_UNICORE
+    cfg = esp_pthread_get_default_config();
+    esp_pthread_set_cfg(&cfg);
+#endif
 
     auto network = Board::GetInstance().GetNetwork();
     auto http = network->CreateHttp(3);
@@ -904,17 +1049,13 @@ std::string Esp32Camera::Explain(const std::string& question) {
     http->SetHeader("Transfer-Encoding", "chunked");
     if (!http->Open("POST", explain_url_)) {
         ESP_LOGE(TAG, "Failed to connect to explain URL");
-        // Clear the queue
-        encoder_thread_.join();
+        // 丢弃编码输出，让编码线程能够结束
         JpegChunk chunk;
-        while (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) == pdPASS) {
-            if (chunk.data != nullptr) {
-                heap_caps_free(chunk.data);
-            } else {
-                break;
-            }
+        while (pipe.Read(chunk)) {
+            pipe.Recycle(chunk);
         }
-        vQueueDelete(jpeg_queue);
+        encoder_thread_.join();
+        ReleaseFrame();
         throw std::runtime_error("Failed to connect to explain URL");
     }
 
@@ -939,23 +1080,20 @@ std::string Esp32Camera::Explain(const std::string& question) {
 
     // 第三块：JPEG数据
     size_t total_sent = 0;
-    while (true) {
-        JpegChunk chunk;
-        if (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) != pdPASS) {
-            ESP_LOGE(TAG, "Failed to receive JPEG chunk");
-            break;
-        }
-        if (chunk.data == nullptr) {
-            break;  // The last chunk
+    int64_t first_chunk_us = 0;
+    JpegChunk chunk;
+    while (pipe.Read(chunk)) {
+        if (first_chunk_us == 0) {
+            first_chunk_us = esp_timer_get_time();
         }
         http->Write((const char*)chunk.data, chunk.len);
         total_sent += chunk.len;
-        heap_caps_free(chunk.data);
+        pipe.Recycle(chunk);
     }
-    // Wait for the encoder thread to finish
+    NotePsramUsage();
+    // Wait for the encoder thread to finish, then give the frame buffer back to the driver
     encoder_thread_.join();
-    // 清理队列
-    vQueueDelete(jpeg_queue);
+    ReleaseFrame();
 
     {
         // 第四块：multipart尾部
@@ -965,6 +1103,7 @@ std::string Esp32Camera::Explain(const std::string& question) {
     }
     // 结束块
     http->Write("", 0);
+    int64_t upload_done_us = esp_timer_get_time();
 
     if (http->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "Failed to upload photo, status code: %d", http->GetStatusCode());
@@ -973,10 +1112,24 @@ std::string Esp32Camera::Explain(const std::string& question) {
 
     std::string result = http->ReadAll();
     http->Close();
+    int64_t response_us = esp_timer_get_time();
 
     // Get remain task stack size
     size_t remain_stack_size = uxTaskGetStackHighWaterMark(nullptr);
-    ESP_LOGI(TAG, "Explain image size=%d bytes, compressed size=%d, remain stack size=%d, question=%s\n%s",
-             (int)frame_.len, (int)total_sent, (int)remain_stack_size, question.c_str(), result.c_str());
+    ESP_LOGI(TAG,
+             "Explain image size=%d bytes, encoded %dx%d q=%d, compressed size=%d, remain stack size=%d, "
+             "question=%s\n%s",
+             (int)frame_len, image.width, image.height, explain_options_.quality, (int)total_sent,
+             (int)remain_stack_size, question.c_str(), result.c_str());
+    // 各阶段耗时：拍照从 Capture 开始计，其余从 Explain 开始计
+    auto ms = [](int64_t us) { return (int)(us / 1000); };
+    ESP_LOGI(TAG,
+             "Explain timings: capture=%dms first_chunk=%dms encode=%dms upload=%dms response=%dms total=%dms, "
+             "encoder stalled %lu times (%dms), uploader waited %dms, peak PSRAM usage: %u bytes",
+             ms(capture_end_us_ - capture_start_us_), ms(first_chunk_us ? first_chunk_us - explain_start_us : 0),
+             ms(encode_done_us - explain_start_us), ms(upload_done_us - explain_start_us),
+             ms(response_us - explain_start_us), ms(response_us - capture_start_us_), pipe.encoder_stalls(),
+             ms(pipe.encoder_stall_us()), ms(pipe.reader_wait_us()),
+             (unsigned)(psram_free_at_capture_ - psram_min_free_));
     return result;
 }
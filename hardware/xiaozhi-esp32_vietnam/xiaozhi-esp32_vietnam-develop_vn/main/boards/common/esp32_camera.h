@@ -14,11 +14,6 @@
 #include "jpg/image_to_jpeg.h"
 #include "esp_video_init.h"
 
-struct JpegChunk {
-    uint8_t* data;
-    size_t len;
-};
-
 class Esp32Camera : public Camera {
 private:
     struct FrameBuffer {
@@ -39,13 +34,41 @@ private:
     std::vector<MmapBuffer> mmap_buffers_;
     std::string explain_url_;
     std::string explain_token_;
+    ExplainImageOptions explain_options_;
+    ImageRegion explain_region_;
     std::thread encoder_thread_;
 
+    // 复用的对齐缓冲区，避免每次拍照都重新申请整帧内存
+    struct ScratchBuffer {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        uint8_t* Reserve(size_t len);
+        void Free();
+    };
+    ScratchBuffer frame_scratch_;    // 需要字节交换或旋转时的输出帧
+    ScratchBuffer convert_scratch_;  // PPA 旋转前的颜色转换或字节交换，以及 Explain 前的裁剪缩放
+    ScratchBuffer chunk_pool_;       // Explain 上传用的 JPEG 块池
+    // 直接作为 frame_ 使用的 V4L2 缓冲区，编码上传完成后才归还驱动
+    int held_buffer_ = -1;
+
+    // 拍照到上传完成的耗时与 PSRAM 峰值占用
+    int64_t capture_start_us_ = 0;
+    int64_t capture_end_us_ = 0;
+    size_t psram_free_at_capture_ = 0;
+    size_t psram_min_free_ = 0;
+
+    bool ProcessFrame(uint32_t index, size_t bytesused);
+    bool PrepareExplainImage(FrameBuffer& image);
+    void ReleaseFrame();
+    void NotePsramUsage();
+
 public:
     Esp32Camera(const esp_video_init_config_t& config);
     ~Esp32Camera();
 
     virtual void SetExplainUrl(const std::string& url, const std::string& token);
+    virtual void SetExplainImageOptions(const ExplainImageOptions& options) override;
+    virtual void SetExplainRegion(const ImageRegion& region) override;
     virtual bool Capture();
     // 翻转控制函数
     virtual bool SetHMirror(bool enabled) override;
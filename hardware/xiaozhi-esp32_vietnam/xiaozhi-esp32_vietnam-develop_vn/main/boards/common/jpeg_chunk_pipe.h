@@ -0,0 +1,118 @@
+#ifndef _JPEG_CHUNK_PIPE_H_
+#define _JPEG_CHUNK_PIPE_H_
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#include <sys/param.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+struct JpegChunk {
+    uint8_t* data;
+    size_t len;
+};
+
+// 编码线程与上传线程之间的预分配 JPEG 块池：编码回调把数据写入空闲块，块满后交给上传线程，
+// 发送完再放回空闲队列。空闲块用完时编码线程阻塞等待（背压），不再逐块申请内存
+#define JPEG_CHUNK_SIZE 4096
+#define JPEG_CHUNK_COUNT 8
+
+class JpegChunkPipe {
+public:
+    explicit JpegChunkPipe(uint8_t* pool) {
+        free_chunks_ = xQueueCreate(JPEG_CHUNK_COUNT, sizeof(uint8_t*));
+        // 多留一个位置给结束标记，写入就绪队列永远不会阻塞
+        ready_chunks_ = xQueueCreate(JPEG_CHUNK_COUNT + 1, sizeof(JpegChunk));
+        if (free_chunks_ == nullptr || ready_chunks_ == nullptr) {
+            return;
+        }
+        for (int i = 0; i < JPEG_CHUNK_COUNT; i++) {
+            uint8_t* chunk = pool + i * JPEG_CHUNK_SIZE;
+            xQueueSend(free_chunks_, &chunk, 0);
+        }
+    }
+
+    ~JpegChunkPipe() {
+        if (free_chunks_ != nullptr) {
+            vQueueDelete(free_chunks_);
+        }
+        if (ready_chunks_ != nullptr) {
+            vQueueDelete(ready_chunks_);
+        }
+    }
+
+    bool valid() const { return free_chunks_ != nullptr && ready_chunks_ != nullptr; }
+
+    // 编码线程调用
+    void Write(const uint8_t* data, size_t len) {
+        while (len > 0) {
+            if (current_.data == nullptr) {
+                if (xQueueReceive(free_chunks_, &current_.data, 0) != pdPASS) {
+                    int64_t start = esp_timer_get_time();
+                    xQueueReceive(free_chunks_, &current_.data, portMAX_DELAY);
+                    encoder_stalls_++;
+                    encoder_stall_us_ += esp_timer_get_time() - start;
+                }
+                current_.len = 0;
+            }
+            size_t n = MIN(len, JPEG_CHUNK_SIZE - current_.len);
+            memcpy(current_.data + current_.len, data, n);
+            current_.len += n;
+            data += n;
+            len -= n;
+            if (current_.len == JPEG_CHUNK_SIZE) {
+                Flush();
+            }
+        }
+    }
+
+    // 编码结束（无论成功与否）后调用，发出剩余数据和结束标记
+    void Finish() {
+        Flush();
+        JpegChunk end = {.data = nullptr, .len = 0};
+        xQueueSend(ready_chunks_, &end, portMAX_DELAY);
+    }
+
+    // 上传线程调用，返回 false 表示没有更多数据
+    bool Read(JpegChunk& chunk) {
+        if (xQueueReceive(ready_chunks_, &chunk, 0) != pdPASS) {
+            int64_t start = esp_timer_get_time();
+            xQueueReceive(ready_chunks_, &chunk, portMAX_DELAY);
+            reader_wait_us_ += esp_timer_get_time() - start;
+        }
+        return chunk.data != nullptr;
+    }
+
+    void Recycle(const JpegChunk& chunk) {
+        xQueueSend(free_chunks_, &chunk.data, 0);
+    }
+
+    uint32_t encoder_stalls() const { return encoder_stalls_; }
+    int64_t encoder_stall_us() const { return encoder_stall_us_; }
+    int64_t reader_wait_us() const { return reader_wait_us_; }
+
+private:
+    QueueHandle_t free_chunks_ = nullptr;
+    QueueHandle_t ready_chunks_ = nullptr;
+    JpegChunk current_ = {.data = nullptr, .len = 0};
+    uint32_t encoder_stalls_ = 0;
+    int64_t encoder_stall_us_ = 0;
+    int64_t reader_wait_us_ = 0;
+
+    void Flush() {
+        if (current_.data == nullptr) {
+            return;
+        }
+        if (current_.len > 0) {
+            xQueueSend(ready_chunks_, &current_, portMAX_DELAY);
+        } else {
+            Recycle(current_);
+        }
+        current_ = {.data = nullptr, .len = 0};
+    }
+};
+
+#endif // _JPEG_CHUNK_PIPE_H_
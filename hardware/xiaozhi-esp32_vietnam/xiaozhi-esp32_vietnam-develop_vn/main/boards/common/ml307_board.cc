@@ -2,6 +2,7 @@
 
 #include "application.h"
 #include "display.h"
+#include "json_writer.h"
 #include "assets/lang_config.h"
 
 #include <esp_log.h>
@@ -135,63 +136,63 @@ std::string Ml307Board::GetDeviceStatusJson() {
      * }
      */
     auto& board = Board::GetInstance();
-    auto root = cJSON_CreateObject();
+    std::string result;
+    result.reserve(256);
+    JsonWriter json(result);
+    json.BeginObject();
 
     // Audio speaker
-    auto audio_speaker = cJSON_CreateObject();
+    json.Key("audio_speaker").BeginObject();
     auto audio_codec = board.GetAudioCodec();
     if (audio_codec) {
-        cJSON_AddNumberToObject(audio_speaker, "volume", audio_codec->output_volume());
+        json.Field("volume", audio_codec->output_volume());
     }
-    cJSON_AddItemToObject(root, "audio_speaker", audio_speaker);
+    json.EndObject();
 
     // Screen brightness
     auto backlight = board.GetBacklight();
-    auto screen = cJSON_CreateObject();
+    json.Key("screen").BeginObject();
     if (backlight) {
-        cJSON_AddNumberToObject(screen, "brightness", backlight->brightness());
+        json.Field("brightness", (int)backlight->brightness());
     }
     auto display = board.GetDisplay();
     if (display && display->height() > 64) { // For LCD display only
         auto theme = display->GetTheme();
         if (theme != nullptr) {
-            cJSON_AddStringToObject(screen, "theme", theme->name().c_str());
+            json.Field("theme", theme->name());
         }
     }
-    cJSON_AddItemToObject(root, "screen", screen);
+    json.EndObject();
 
     // Battery
     int battery_level = 0;
     bool charging = false;
     bool discharging = false;
     if (board.GetBatteryLevel(battery_level, charging, discharging)) {
-        cJSON* battery = cJSON_CreateObject();
-        cJSON_AddNumberToObject(battery, "level", battery_level);
-        cJSON_AddBoolToObject(battery, "charging", charging);
-        cJSON_AddItemToObject(root, "battery", battery);
+        json.Key("battery").BeginObject()
+            .Field("level", battery_level)
+            .Field("charging", charging)
+            .EndObject();
     }
 
     // Network
-    auto network = cJSON_CreateObject();
-    cJSON_AddStringToObject(network, "type", "cellular");
-    cJSON_AddStringToObject(network, "carrier", modem_->GetCarrierName().c_str());
+    json.Key("network").BeginObject();
+    json.Field("type", "cellular");
+    json.Field("carrier", modem_->GetCarrierName());
     int csq = modem_->GetCsq();
     if (csq == -1) {
-        cJSON_AddStringToObject(network, "signal", "unknown");
+        json.Field("signal", "unknown");
     } else if (csq >= 0 && csq <= 14) {
-        cJSON_AddStringToObject(network, "signal", "very weak");
+        json.Field("signal", "very weak");
     } else if (csq >= 15 && csq <= 19) {
-        cJSON_AddStringToObject(network, "signal", "weak");
+        json.Field("signal", "weak");
     } else if (csq >= 20 && csq <= 24) {
-        cJSON_AddStringToObject(network, "signal", "medium");
+        json.Field("signal", "medium");
     } else if (csq >= 25 && csq <= 31) {
-        cJSON_AddStringToObject(network, "signal", "strong");
+        json.Field("signal", "strong");
     }
-    cJSON_AddItemToObject(root, "network", network);
+    json.EndObject();
 
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string json(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
-    return json;
+    json.EndObject();
+    return result;
 }
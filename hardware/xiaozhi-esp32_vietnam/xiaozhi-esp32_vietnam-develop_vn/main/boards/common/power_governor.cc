@@ -0,0 +1,109 @@
+#include "power_governor.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "PowerGovernor"
+
+PowerGovernor::EspPmBackend::EspPmBackend() {
+    auto ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "governor_max", &locks_[kPowerLevelMax]);
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGI(TAG, "Power management not supported");
+        return;
+    }
+    ESP_ERROR_CHECK(ret);
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "governor_awake", &locks_[kPowerLevelAwake]));
+}
+
+void PowerGovernor::EspPmBackend::Acquire(PowerLevel level) {
+    if (locks_[level] != nullptr) {
+        esp_pm_lock_acquire(locks_[level]);
+    }
+}
+
+void PowerGovernor::EspPmBackend::Release(PowerLevel level) {
+    if (locks_[level] != nullptr) {
+        esp_pm_lock_release(locks_[level]);
+    }
+}
+
+PowerGovernor::PowerGovernor() : policy_([]() { return esp_timer_get_time(); }, &backend_) {
+}
+
+void PowerGovernor::Acquire(PowerRequest request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_.Acquire(request);
+}
+
+void PowerGovernor::Release(PowerRequest request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!policy_.Release(request)) {
+        ESP_LOGW(TAG, "Release without acquire: %s", PowerPolicy::RequestName(request));
+    }
+}
+
+void PowerGovernor::ReportDeadlineMiss(PowerRequest request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_.ReportDeadlineMiss(request);
+}
+
+void PowerGovernor::Configure(int max_freq_mhz, int min_freq_mhz, bool light_sleep) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_freq_mhz_ = max_freq_mhz;
+    min_freq_mhz_ = min_freq_mhz;
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = max_freq_mhz,
+        .min_freq_mhz = min_freq_mhz,
+        .light_sleep_enable = light_sleep,
+    };
+    auto ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(ret));
+        return;
+    }
+    // Animations stop holding the chip awake once light sleep is allowed
+    policy_.SetLightSleep(light_sleep);
+    ESP_LOGI(TAG, "CPU %d-%d MHz, light sleep %s", min_freq_mhz, max_freq_mhz, light_sleep ? "on" : "off");
+}
+
+PowerGovernor::Stats PowerGovernor::TakeStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_.TakeStats();
+}
+
+void PowerGovernor::PrintStats() {
+    int max_freq_mhz, min_freq_mhz;
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats = policy_.TakeStats();
+        max_freq_mhz = max_freq_mhz_;
+        min_freq_mhz = min_freq_mhz_;
+    }
+    int64_t total_us = 0;
+    for (int i = 0; i < kPowerLevelCount; i++) {
+        total_us += stats.residency_us[i];
+    }
+    if (total_us <= 0) {
+        return;
+    }
+
+    uint32_t misses = 0;
+    for (int i = 0; i < kPowerRequestCount; i++) {
+        misses += stats.deadline_misses[i];
+    }
+    ESP_LOGI(TAG, "Residency: max %d MHz %ld%%, awake %ld%%, idle %d MHz %ld%% (light sleep %ld%%), "
+        "CPU ~%.1f mA, deadline misses %lu",
+        max_freq_mhz, (long)(stats.residency_us[kPowerLevelMax] * 100 / total_us),
+        (long)(stats.residency_us[kPowerLevelAwake] * 100 / total_us),
+        min_freq_mhz, (long)(stats.residency_us[kPowerLevelIdle] * 100 / total_us),
+        (long)(stats.light_sleep_us * 100 / total_us),
+        PowerPolicy::EstimateCurrentMa(stats, max_freq_mhz, min_freq_mhz), misses);
+    for (int i = 0; i < kPowerRequestCount; i++) {
+        if (stats.deadline_misses[i] > 0) {
+            ESP_LOGW(TAG, "Deadline misses of %s: %lu", PowerPolicy::RequestName(static_cast<PowerRequest>(i)),
+                stats.deadline_misses[i]);
+        }
+    }
+}
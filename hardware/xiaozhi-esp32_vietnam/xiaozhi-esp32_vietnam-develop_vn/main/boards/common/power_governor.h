@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+#include <esp_pm.h>
+
+#include "power_policy.h"
+
+// Collects the power requests of the subsystems and holds the esp_pm lock of
+// the lowest level that satisfies all of them, so the CPU only runs at full
+// speed while audio or music are actually being processed. The level choice
+// and the accounting live in PowerPolicy, this class adds the locking, the
+// esp_pm backend and the frequency range from Configure(). Without
+// CONFIG_PM_ENABLE there are no locks and only the statistics are kept.
+class PowerGovernor {
+public:
+    using Stats = PowerPolicy::Stats;
+
+    static PowerGovernor& GetInstance() {
+        static PowerGovernor instance;
+        return instance;
+    }
+
+    PowerGovernor(const PowerGovernor&) = delete;
+    PowerGovernor& operator=(const PowerGovernor&) = delete;
+
+    // Requests are counted, every Acquire needs a matching Release
+    void Acquire(PowerRequest request);
+    void Release(PowerRequest request);
+    // Called when a request's work did not finish in time
+    void ReportDeadlineMiss(PowerRequest request);
+    // Sets the range the levels map to, max_freq_mhz is used for kPowerLevelMax
+    // and min_freq_mhz for the other levels
+    void Configure(int max_freq_mhz, int min_freq_mhz, bool light_sleep);
+
+    // Returns the counters since the last call
+    Stats TakeStats();
+    void PrintStats();
+
+private:
+    class EspPmBackend : public PowerLockBackend {
+    public:
+        EspPmBackend();
+        void Acquire(PowerLevel level) override;
+        void Release(PowerLevel level) override;
+
+    private:
+        esp_pm_lock_handle_t locks_[kPowerLevelCount] = {};
+    };
+
+    PowerGovernor();
+
+    std::mutex mutex_;
+    EspPmBackend backend_;
+    PowerPolicy policy_;
+    int max_freq_mhz_ = 0;
+    int min_freq_mhz_ = 0;
+};
+
+// Holds a power request for the lifetime of a scope
+class PowerRequestGuard {
+public:
+    explicit PowerRequestGuard(PowerRequest request) : request_(request) {
+        PowerGovernor::GetInstance().Acquire(request_);
+    }
+    ~PowerRequestGuard() {
+        PowerGovernor::GetInstance().Release(request_);
+    }
+
+    PowerRequestGuard(const PowerRequestGuard&) = delete;
+    PowerRequestGuard& operator=(const PowerRequestGuard&) = delete;
+
+private:
+    PowerRequest request_;
+};
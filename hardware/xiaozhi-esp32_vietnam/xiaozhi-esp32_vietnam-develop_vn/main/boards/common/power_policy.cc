@@ -0,0 +1,132 @@
+#include "power_policy.h"
+
+#include <utility>
+
+// What each request needs to meet its deadlines. Audio and music are
+// processed in real time and need the full CPU. Animations only need the
+// display task to keep running, and waiting for the network only needs the
+// radio to stay up, so both let the CPU scale down.
+static const PowerLevel kRequestLevels[kPowerRequestCount] = {
+    kPowerLevelMax,     // kPowerRequestAudioInput
+    kPowerLevelMax,     // kPowerRequestAudioCodec
+    kPowerLevelMax,     // kPowerRequestMusicDecode
+    kPowerLevelAwake,   // kPowerRequestDisplayAnimation
+    kPowerLevelAwake,   // kPowerRequestNetwork
+};
+
+// Requests dropped while the light sleep profile is on
+static const bool kDroppedInLightSleep[kPowerRequestCount] = {
+    false,  // kPowerRequestAudioInput
+    false,  // kPowerRequestAudioCodec
+    false,  // kPowerRequestMusicDecode
+    true,   // kPowerRequestDisplayAnimation
+    false,  // kPowerRequestNetwork
+};
+
+static const char* const kRequestNames[kPowerRequestCount] = {
+    "input", "codec", "music", "animation", "network",
+};
+
+PowerPolicy::PowerPolicy(Clock clock, PowerLockBackend* backend)
+    : clock_(std::move(clock)), backend_(backend) {
+    level_since_us_ = clock_();
+}
+
+PowerLevel PowerPolicy::RequiredLevel(PowerRequest request, bool light_sleep) {
+    if (light_sleep && kDroppedInLightSleep[request]) {
+        return kPowerLevelIdle;
+    }
+    return kRequestLevels[request];
+}
+
+const char* PowerPolicy::RequestName(PowerRequest request) {
+    return kRequestNames[request];
+}
+
+void PowerPolicy::Acquire(PowerRequest request) {
+    if (counts_[request]++ == 0) {
+        UpdateLevel();
+    }
+}
+
+bool PowerPolicy::Release(PowerRequest request) {
+    if (counts_[request] == 0) {
+        return false;
+    }
+    if (--counts_[request] == 0) {
+        UpdateLevel();
+    }
+    return true;
+}
+
+void PowerPolicy::ReportDeadlineMiss(PowerRequest request) {
+    stats_.deadline_misses[request]++;
+}
+
+void PowerPolicy::SetLightSleep(bool light_sleep) {
+    if (light_sleep == light_sleep_) {
+        return;
+    }
+    AccountLevel();
+    light_sleep_ = light_sleep;
+    UpdateLevel();
+}
+
+void PowerPolicy::AccountLevel() {
+    int64_t now = clock_();
+    stats_.residency_us[level_] += now - level_since_us_;
+    if (level_ == kPowerLevelIdle && light_sleep_) {
+        stats_.light_sleep_us += now - level_since_us_;
+    }
+    level_since_us_ = now;
+}
+
+void PowerPolicy::UpdateLevel() {
+    PowerLevel level = kPowerLevelIdle;
+    for (int i = 0; i < kPowerRequestCount; i++) {
+        PowerLevel required = RequiredLevel(static_cast<PowerRequest>(i), light_sleep_);
+        if (counts_[i] > 0 && required > level) {
+            level = required;
+        }
+    }
+    if (level == level_) {
+        return;
+    }
+
+    AccountLevel();
+    // Take the new lock before dropping the old one so the clock never dips in between
+    if (backend_ != nullptr) {
+        if (level != kPowerLevelIdle) {
+            backend_->Acquire(level);
+        }
+        if (level_ != kPowerLevelIdle) {
+            backend_->Release(level_);
+        }
+    }
+    level_ = level;
+}
+
+PowerPolicy::Stats PowerPolicy::TakeStats() {
+    AccountLevel();
+    Stats stats = stats_;
+    stats_ = Stats();
+    return stats;
+}
+
+float PowerPolicy::EstimateCurrentMa(const Stats& stats, int max_freq_mhz, int min_freq_mhz,
+                                     const PowerCurrentModel& model) {
+    int64_t total_us = 0;
+    for (int i = 0; i < kPowerLevelCount; i++) {
+        total_us += stats.residency_us[i];
+    }
+    if (total_us <= 0) {
+        return 0;
+    }
+    // Idle with light sleep allowed is counted as asleep, the wakeups for
+    // DTIM beacons and timers are not modeled
+    double charge = stats.residency_us[kPowerLevelMax] * (double)model.ActiveMa(max_freq_mhz)
+        + stats.residency_us[kPowerLevelAwake] * (double)model.ActiveMa(min_freq_mhz)
+        + (stats.residency_us[kPowerLevelIdle] - stats.light_sleep_us) * (double)model.ActiveMa(min_freq_mhz)
+        + stats.light_sleep_us * (double)model.light_sleep_ma;
+    return static_cast<float>(charge / total_us);
+}
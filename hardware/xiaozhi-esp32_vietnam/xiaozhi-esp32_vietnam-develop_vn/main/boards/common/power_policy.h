@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// Work that needs the chip kept up while it runs
+enum PowerRequest {
+    kPowerRequestAudioInput,        // AFE wake word, voice processing or audio testing
+    kPowerRequestAudioCodec,        // Opus encode / decode
+    kPowerRequestMusicDecode,       // MP3 decode for music playback
+    kPowerRequestDisplayAnimation,  // LVGL animations like GIF emojis
+    kPowerRequestNetwork,           // Audio channel open, waiting for server packets
+    kPowerRequestCount,
+};
+
+enum PowerLevel {
+    kPowerLevelIdle,    // Minimum frequency, light sleep if the profile allows it
+    kPowerLevelAwake,   // No light sleep, the CPU still scales down
+    kPowerLevelMax,     // CPU at the maximum frequency
+    kPowerLevelCount,
+};
+
+// Holds the lock of a level, esp_pm locks on the device, a recorder in the host tests
+class PowerLockBackend {
+public:
+    virtual ~PowerLockBackend() = default;
+    virtual void Acquire(PowerLevel level) = 0;
+    virtual void Release(PowerLevel level) = 0;
+};
+
+// Rough CPU current per state for comparing policies, radio excluded.
+// Defaults are ESP32-S3 datasheet typical figures.
+struct PowerCurrentModel {
+    float base_ma = 8.0f;           // Active current at 0 MHz, extrapolated
+    float ma_per_mhz = 0.2f;        // 240 MHz ~ 56 mA, 80 MHz ~ 24 mA, 40 MHz ~ 16 mA
+    float light_sleep_ma = 0.24f;
+
+    float ActiveMa(int freq_mhz) const { return base_ma + ma_per_mhz * freq_mhz; }
+};
+
+// Picks the lowest level that satisfies all active requests and accounts the
+// time spent in each level. Pure logic: time comes from the injected clock and
+// levels are applied through the backend. Not thread safe, PowerGovernor
+// serializes the calls.
+class PowerPolicy {
+public:
+    using Clock = std::function<int64_t()>;     // Microseconds
+
+    struct Stats {
+        int64_t residency_us[kPowerLevelCount];
+        int64_t light_sleep_us;     // Part of the idle residency with light sleep allowed
+        uint32_t deadline_misses[kPowerRequestCount];
+    };
+
+    PowerPolicy(Clock clock, PowerLockBackend* backend);
+
+    // Requests are counted, every Acquire needs a matching Release.
+    // Release returns false if the request was not held.
+    void Acquire(PowerRequest request);
+    bool Release(PowerRequest request);
+    void ReportDeadlineMiss(PowerRequest request);
+    // The light sleep profile of PowerSaveTimer. Requests that only keep the
+    // device looking alive (animations) are ignored while it is on, so they
+    // cannot keep the chip out of light sleep.
+    void SetLightSleep(bool light_sleep);
+
+    PowerLevel level() const { return level_; }
+    bool light_sleep() const { return light_sleep_; }
+    // Returns the counters since the last call
+    Stats TakeStats();
+
+    static PowerLevel RequiredLevel(PowerRequest request, bool light_sleep);
+    static const char* RequestName(PowerRequest request);
+    // Average CPU current over the stats period
+    static float EstimateCurrentMa(const Stats& stats, int max_freq_mhz, int min_freq_mhz,
+                                   const PowerCurrentModel& model = PowerCurrentModel());
+
+private:
+    Clock clock_;
+    PowerLockBackend* backend_;
+    int counts_[kPowerRequestCount] = {};
+    PowerLevel level_ = kPowerLevelIdle;
+    bool light_sleep_ = false;
+    int64_t level_since_us_ = 0;
+    Stats stats_ = {};
+
+    void UpdateLevel();
+    void AccountLevel();
+};
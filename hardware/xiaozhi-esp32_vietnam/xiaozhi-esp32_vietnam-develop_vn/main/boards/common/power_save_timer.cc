@@ -1,11 +1,14 @@
 #include "power_save_timer.h"
 #include "application.h"
 #include "settings.h"
+#include "power_governor.h"
 
 #include <esp_log.h>
 
 #define TAG "PowerSaveTimer"
 
+// Lowest CPU frequency while awake, the APB clock stays at 80 MHz from here up
+static constexpr int kAwakeMinFreqMhz = 80;
 
 PowerSaveTimer::PowerSaveTimer(int cpu_max_freq, int seconds_to_sleep, int seconds_to_shutdown)
     : cpu_max_freq_(cpu_max_freq), seconds_to_sleep_(seconds_to_sleep), seconds_to_shutdown_(seconds_to_shutdown) {
@@ -20,6 +23,11 @@ PowerSaveTimer::PowerSaveTimer(int cpu_max_freq, int seconds_to_sleep, int secon
         .skip_unhandled_events = true,
     };
     ESP_ERROR_CHECK(esp_timer_create(&timer_args, &power_save_timer_));
+
+    if (cpu_max_freq_ != -1) {
+        // 空闲时降频，音频和音乐需要时由 PowerGovernor 升到最高频率
+        PowerGovernor::GetInstance().Configure(cpu_max_freq_, kAwakeMinFreqMhz, false);
+    }
 }
 
 PowerSaveTimer::~PowerSaveTimer() {
@@ -89,16 +97,13 @@ void PowerSaveTimer::PowerSaveCheck() {
                     codec->EnableInput(false);
                 }
 
-                esp_pm_config_t pm_config = {
-                    .max_freq_mhz = cpu_max_freq_,
-                    .min_freq_mhz = 40,
-                    .light_sleep_enable = true,
-                };
-                esp_pm_configure(&pm_config);
+                PowerGovernor::GetInstance().Configure(cpu_max_freq_, 40, true);
             }
         }
     }
     if (seconds_to_shutdown_ != -1 && ticks_ >= seconds_to_shutdown_ && on_shutdown_request_) {
+        // 关机不经过 esp_restart，先把还没写入的设置写回 flash
+        Settings::Flush();
         on_shutdown_request_();
     }
 }
@@ -110,12 +115,7 @@ void PowerSaveTimer::WakeUp() {
         in_sleep_mode_ = false;
 
         if (cpu_max_freq_ != -1) {
-            esp_pm_config_t pm_config = {
-                .max_freq_mhz = cpu_max_freq_,
-                .min_freq_mhz = cpu_max_freq_,
-                .light_sleep_enable = false,
-            };
-            esp_pm_configure(&pm_config);
+            PowerGovernor::GetInstance().Configure(cpu_max_freq_, kAwakeMinFreqMhz, false);
 
             // Enable wake word detection
             auto& app = Application::GetInstance();
@@ -1,4 +1,5 @@
 #include "system_reset.h"
+#include "settings.h"
 
 #include <esp_log.h>
 #include <nvs_flash.h>
@@ -68,5 +69,6 @@ void SystemReset::RestartInSeconds(int seconds) {
         ESP_LOGI(TAG, "Resetting in %d seconds", i);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
+    Settings::Flush();
     esp_restart();
 }
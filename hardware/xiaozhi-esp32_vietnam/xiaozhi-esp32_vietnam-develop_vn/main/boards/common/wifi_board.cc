@@ -1,6 +1,7 @@
 #include "wifi_board.h"
 
 #include "display.h"
+#include "json_writer.h"
 #include "application.h"
 #include "system_info.h"
 #include "settings.h"
@@ -172,6 +173,7 @@ void WifiBoard::ResetWifiConfiguration() {
         settings.SetInt("force_ap", 1);
     }
     GetDisplay()->ShowNotification(Lang::Strings::ENTERING_WIFI_CONFIG_MODE);
+    Settings::Flush();
     vTaskDelay(pdMS_TO_TICKS(1000));
     // Reboot the device
     esp_restart();
@@ -205,68 +207,66 @@ std::string WifiBoard::GetDeviceStatusJson() {
      * }
      */
     auto& board = Board::GetInstance();
-    auto root = cJSON_CreateObject();
+    std::string result;
+    result.reserve(256);
+    JsonWriter json(result);
+    json.BeginObject();
 
     // Audio speaker
-    auto audio_speaker = cJSON_CreateObject();
+    json.Key("audio_speaker").BeginObject();
     auto audio_codec = board.GetAudioCodec();
     if (audio_codec) {
-        cJSON_AddNumberToObject(audio_speaker, "volume", audio_codec->output_volume());
+        json.Field("volume", audio_codec->output_volume());
     }
-    cJSON_AddItemToObject(root, "audio_speaker", audio_speaker);
+    json.EndObject();
 
     // Screen brightness
     auto backlight = board.GetBacklight();
-    auto screen = cJSON_CreateObject();
+    json.Key("screen").BeginObject();
     if (backlight) {
-        cJSON_AddNumberToObject(screen, "brightness", backlight->brightness());
+        json.Field("brightness", (int)backlight->brightness());
     }
     auto display = board.GetDisplay();
     if (display && display->height() > 64) { // For LCD display only
         auto theme = display->GetTheme();
         if (theme != nullptr) {
-            cJSON_AddStringToObject(screen, "theme", theme->name().c_str());
+            json.Field("theme", theme->name());
         }
     }
-    cJSON_AddItemToObject(root, "screen", screen);
+    json.EndObject();
 
     // Battery
     int battery_level = 0;
     bool charging = false;
     bool discharging = false;
     if (board.GetBatteryLevel(battery_level, charging, discharging)) {
-        cJSON* battery = cJSON_CreateObject();
-        cJSON_AddNumberToObject(battery, "level", battery_level);
-        cJSON_AddBoolToObject(battery, "charging", charging);
-        cJSON_AddItemToObject(root, "battery", battery);
+        json.Key("battery").BeginObject()
+            .Field("level", battery_level)
+            .Field("charging", charging)
+            .EndObject();
     }
 
     // Network
-    auto network = cJSON_CreateObject();
+    json.Key("network").BeginObject();
     auto& wifi_station = WifiStation::GetInstance();
-    cJSON_AddStringToObject(network, "type", "wifi");
-    cJSON_AddStringToObject(network, "ssid", wifi_station.GetSsid().c_str());
+    json.Field("type", "wifi");
+    json.Field("ssid", wifi_station.GetSsid());
     int rssi = wifi_station.GetRssi();
     if (rssi >= -60) {
-        cJSON_AddStringToObject(network, "signal", "strong");
+        json.Field("signal", "strong");
     } else if (rssi >= -70) {
-        cJSON_AddStringToObject(network, "signal", "medium");
+        json.Field("signal", "medium");
     } else {
-        cJSON_AddStringToObject(network, "signal", "weak");
+        json.Field("signal", "weak");
     }
-    cJSON_AddItemToObject(root, "network", network);
+    json.EndObject();
 
     // Chip
     float esp32temp = 0.0f;
     if (board.GetTemperature(esp32temp)) {
-        auto chip = cJSON_CreateObject();
-        cJSON_AddNumberToObject(chip, "temperature", esp32temp);
-        cJSON_AddItemToObject(root, "chip", chip);
+        json.Key("chip").BeginObject().Key("temperature").Number(esp32temp).EndObject();
     }
 
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string json(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
-    return json;
+    json.EndObject();
+    return result;
 }
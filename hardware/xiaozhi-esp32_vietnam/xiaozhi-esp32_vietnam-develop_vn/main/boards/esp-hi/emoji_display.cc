@@ -88,6 +88,11 @@ void EmojiPlayer::StartPlayer(const std::string& asset_name, bool repeat, int fp
         }
 
         anim_player_set_src_data(player_handle_, src_data, src_len);
+        // A compressed animation may be evicted once the player moved on
+        if (!current_asset_.empty() && current_asset_ != filename) {
+            assets.ReleaseAssetData(current_asset_);
+        }
+        current_asset_ = filename;
         anim_player_get_segment(player_handle_, &start, &end);
         if(asset_name == "wake"){
             start = 7;
@@ -28,6 +28,8 @@ private:
     static void OnFlush(anim_player_handle_t handle, int x_start, int y_start, int x_end, int y_end, const void *color_data);
 
     anim_player_handle_t player_handle_;
+    // Asset the player reads from, released when the next one replaces it
+    std::string current_asset_;
 };
 
 class EmojiWidget : public Display {
@@ -7,6 +7,7 @@
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#include "settings.h"
 #include <math.h>
 
 
@@ -161,6 +162,7 @@ public:
     }
 
     void PowerOff(void) {
+        Settings::Flush();
         if (bat_power_pin_ != GPIO_NUM_NC) {
             gpio_set_level(bat_power_pin_, 0);
         }
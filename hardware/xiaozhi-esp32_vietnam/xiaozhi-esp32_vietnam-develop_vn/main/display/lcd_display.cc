@@ -290,7 +290,13 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         .panel_handle = panel_,
         .control_handle = nullptr,
         .buffer_size = static_cast<uint32_t>(width_ * 20),
+#if CONFIG_LCD_DOUBLE_BUFFER
+        // Render into one DMA buffer while the other is still being sent over SPI,
+        // the panel IO transfer-done callback signals flush ready
+        .double_buffer = true,
+#else
         .double_buffer = false,
+#endif
         .trans_size = 0,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
@@ -1135,6 +1141,11 @@ void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     if (chat_message_label_ == nullptr) {
         return;
     }
+    // Lyrics and status text are often re-sent unchanged, skip the re-measure and re-wrap
+    const char* current = lv_label_get_text(chat_message_label_);
+    if (content != nullptr && current != nullptr && strcmp(current, content) == 0) {
+        return;
+    }
     lv_label_set_text(chat_message_label_, content);
 }
 #endif
@@ -1172,7 +1183,20 @@ void LcdDisplay::SetEmotion(const char* emotion) {
         if (gif_controller_->IsLoaded()) {
             // Set up frame update callback
             gif_controller_->SetFrameCallback([this]() {
-                lv_image_set_src(emoji_image_, gif_controller_->image_dsc());
+                // Only redraw the part of the image touched by the new frame
+                lv_area_t dirty;
+                if (!gif_controller_->GetDirtyArea(dirty)) {
+                    return;
+                }
+                lv_image_cache_drop(gif_controller_->image_dsc());
+                if (lv_image_get_scale(emoji_image_) != LV_SCALE_NONE) {
+                    lv_obj_invalidate(emoji_image_);
+                    return;
+                }
+                lv_area_t coords;
+                lv_obj_get_content_coords(emoji_image_, &coords);
+                lv_area_move(&dirty, coords.x1, coords.y1);
+                lv_obj_invalidate_area(emoji_image_, &dirty);
             });
             
             // Set initial frame and start animation
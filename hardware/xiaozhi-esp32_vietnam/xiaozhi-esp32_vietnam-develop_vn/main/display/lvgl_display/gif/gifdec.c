@@ -10,23 +10,10 @@
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
 
-typedef struct Entry {
-    uint16_t length;
-    uint16_t prefix;
-    uint8_t  suffix;
-} Entry;
-
-typedef struct Table {
-    int bulk;
-    int nentries;
-    Entry * entries;
-} Table;
-
-#if LV_GIF_CACHE_DECODE_DATA
+/* The LZW code table lives in the gd_GIF allocation and is reused by every frame */
 #define LZW_MAXBITS                 12
 #define LZW_TABLE_SIZE              (1 << LZW_MAXBITS)
 #define LZW_CACHE_SIZE              (LZW_TABLE_SIZE * 4)
-#endif
 
 static gd_GIF  * gif_open(gd_GIF * gif);
 static bool f_gif_open(gd_GIF * gif, const void * path, bool is_file);
@@ -116,19 +103,11 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
         ESP_LOGW(TAG, "Zero size image");
         goto fail;
     }
-#if LV_GIF_CACHE_DECODE_DATA
     if(0 == (INT_MAX - sizeof(gd_GIF) - LZW_CACHE_SIZE) / width / height / 5){
         ESP_LOGW(TAG, "Image dimensions are too large");
         goto fail;
     } 
     gif = lv_malloc(sizeof(gd_GIF) + 5 * width * height + LZW_CACHE_SIZE);
-#else
-    if(0 == (INT_MAX - sizeof(gd_GIF)) / width / height / 5){
-        ESP_LOGW(TAG, "Image dimensions are too large");
-        goto fail;
-    } 
-    gif = lv_malloc(sizeof(gd_GIF) + 5 * width * height);
-#endif
     if(!gif) goto fail;
     memcpy(gif, gif_base, sizeof(gd_GIF));
     gif->width  = width;
@@ -145,9 +124,7 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
         memset(gif->frame, gif->bgindex, gif->width * gif->height);
     }
     bgcolor = &gif->palette->colors[gif->bgindex * 3];
-    #if LV_GIF_CACHE_DECODE_DATA
     gif->lzw_cache = gif->frame + width * height;
-    #endif
 
 #ifdef GIFDEC_FILL_BG
     GIFDEC_FILL_BG(gif->canvas, gif->width * gif->height, 1, gif->width * gif->height, bgcolor, 0x00);
@@ -299,6 +276,18 @@ read_ext(gd_GIF * gif)
     }
 }
 
+static inline uint8_t
+read_byte(gd_GIF * gif)
+{
+    uint8_t byte;
+
+    if(!gif->is_file) {
+        return (uint8_t) gif->data[gif->f_rw_p++];
+    }
+    f_gif_read(gif, &byte, 1);
+    return byte;
+}
+
 static uint16_t
 get_key(gd_GIF *gif, int key_size, uint8_t *sub_len, uint8_t *shift, uint8_t *byte)
 {
@@ -313,10 +302,10 @@ get_key(gd_GIF *gif, int key_size, uint8_t *sub_len, uint8_t *shift, uint8_t *by
         if (rpad == 0) {
             /* Update byte. */
             if (*sub_len == 0) {
-                f_gif_read(gif, sub_len, 1); /* Must be nonzero! */
+                *sub_len = read_byte(gif); /* Must be nonzero! */
                 if (*sub_len == 0) return 0x1000;
             }
-            f_gif_read(gif, byte, 1);
+            *byte = read_byte(gif);
             (*sub_len)--;
         }
         frag_size = MIN(key_size - bits_read, 8 - rpad);
@@ -328,7 +317,6 @@ get_key(gd_GIF *gif, int key_size, uint8_t *sub_len, uint8_t *shift, uint8_t *by
     return key;
 }
 
-#if LV_GIF_CACHE_DECODE_DATA
 /* Decompress image pixels.
  * Return 0 on success or -1 on out-of-memory (w.r.t. LZW code table) or parse error. */
 static int
@@ -477,152 +465,6 @@ read_image_data(gd_GIF *gif, int interlace)
     f_gif_seek(gif, end, LV_FS_SEEK_SET);
     return ret;
 }
-#else
-static Table *
-new_table(int key_size)
-{
-    int key;
-    int init_bulk = MAX(1 << (key_size + 1), 0x100);
-    Table * table = lv_malloc(sizeof(*table) + sizeof(Entry) * init_bulk);
-    if(table) {
-        table->bulk = init_bulk;
-        table->nentries = (1 << key_size) + 2;
-        table->entries = (Entry *) &table[1];
-        for(key = 0; key < (1 << key_size); key++)
-            table->entries[key] = (Entry) {
-            1, 0xFFF, key
-        };
-    }
-    return table;
-}
-
-/* Add table entry. Return value:
- *  0 on success
- *  +1 if key size must be incremented after this addition
- *  -1 if could not realloc table */
-static int
-add_entry(Table ** tablep, uint16_t length, uint16_t prefix, uint8_t suffix)
-{
-    Table * table = *tablep;
-    if(table->nentries == table->bulk) {
-        table->bulk *= 2;
-        table = lv_realloc(table, sizeof(*table) + sizeof(Entry) * table->bulk);
-        if(!table) return -1;
-        table->entries = (Entry *) &table[1];
-        *tablep = table;
-    }
-    table->entries[table->nentries] = (Entry) {
-        length, prefix, suffix
-    };
-    table->nentries++;
-    if((table->nentries & (table->nentries - 1)) == 0)
-        return 1;
-    return 0;
-}
-
-/* Compute output index of y-th input line, in frame of height h. */
-static int
-interlaced_line_index(int h, int y)
-{
-    int p; /* number of lines in current pass */
-
-    p = (h - 1) / 8 + 1;
-    if(y < p)  /* pass 1 */
-        return y * 8;
-    y -= p;
-    p = (h - 5) / 8 + 1;
-    if(y < p)  /* pass 2 */
-        return y * 8 + 4;
-    y -= p;
-    p = (h - 3) / 4 + 1;
-    if(y < p)  /* pass 3 */
-        return y * 4 + 2;
-    y -= p;
-    /* pass 4 */
-    return y * 2 + 1;
-}
-
-/* Decompress image pixels.
- * Return 0 on success or -1 on out-of-memory (w.r.t. LZW code table) or parse error. */
-static int
-read_image_data(gd_GIF * gif, int interlace)
-{
-    uint8_t sub_len, shift, byte;
-    int init_key_size, key_size, table_is_full = 0;
-    int frm_off, frm_size, str_len = 0, i, p, x, y;
-    uint16_t key, clear, stop;
-    int ret;
-    Table * table;
-    Entry entry = {0};
-    size_t start, end;
-
-    f_gif_read(gif, &byte, 1);
-    key_size = (int) byte;
-    start = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
-    discard_sub_blocks(gif);
-    end = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
-    f_gif_seek(gif, start, LV_FS_SEEK_SET);
-    clear = 1 << key_size;
-    stop = clear + 1;
-    table = new_table(key_size);
-    key_size++;
-    init_key_size = key_size;
-    sub_len = shift = 0;
-    key = get_key(gif, key_size, &sub_len, &shift, &byte); /* clear code */
-    frm_off = 0;
-    ret = 0;
-    frm_size = gif->fw * gif->fh;
-    while(frm_off < frm_size) {
-        if(key == clear) {
-            key_size = init_key_size;
-            table->nentries = (1 << (key_size - 1)) + 2;
-            table_is_full = 0;
-        }
-        else if(!table_is_full) {
-            ret = add_entry(&table, str_len + 1, key, entry.suffix);
-            if(ret == -1) {
-                lv_free(table);
-                return -1;
-            }
-            if(table->nentries == 0x1000) {
-                ret = 0;
-                table_is_full = 1;
-            }
-        }
-        key = get_key(gif, key_size, &sub_len, &shift, &byte);
-        if(key == clear) continue;
-        if(key == stop || key == 0x1000) break;
-        if(ret == 1) key_size++;
-        entry = table->entries[key];
-        str_len = entry.length;
-	if(frm_off + str_len > frm_size){
-		ESP_LOGW(TAG, "LZW table token overflows the frame buffer");
-		lv_free(table);
-		return -1;
-	}
-        for(i = 0; i < str_len; i++) {
-            p = frm_off + entry.length - 1;
-            x = p % gif->fw;
-            y = p / gif->fw;
-            if(interlace)
-                y = interlaced_line_index((int) gif->fh, y);
-            gif->frame[(gif->fy + y) * gif->width + gif->fx + x] = entry.suffix;
-            if(entry.prefix == 0xFFF)
-                break;
-            else
-                entry = table->entries[entry.prefix];
-        }
-        frm_off += str_len;
-        if(key < table->nentries - 1 && !table_is_full)
-            table->entries[table->nentries - 1].suffix = entry.suffix;
-    }
-    lv_free(table);
-    if(key == stop) f_gif_read(gif, &sub_len, 1);  /* Must be zero! */
-    f_gif_seek(gif, end, LV_FS_SEEK_SET);
-    return 0;
-}
-
-#endif
 
 /* Read image.
  * Return 0 on success or -1 on out-of-memory (w.r.t. LZW code table) or parse error. */
@@ -716,8 +558,10 @@ dispose(gd_GIF * gif)
         case 3: /* Restore to previous, i.e., don't update canvas.*/
             break;
         default:
-            /* Add frame non-transparent pixels to canvas. */
-            render_frame_rect(gif, gif->canvas);
+            /* Add frame non-transparent pixels to canvas, unless gd_render_frame already did. */
+            if(!gif->canvas_ready) {
+                render_frame_rect(gif, gif->canvas);
+            }
     }
 }
 
@@ -726,12 +570,17 @@ int
 gd_get_frame(gd_GIF * gif)
 {
     char sep;
+    uint16_t px = gif->fx, py = gif->fy, pw = gif->fw, ph = gif->fh;
+    /* Restoring the background or late compositing rewrites the previous frame rect */
+    bool prev_dirty = gif->gce.disposal == 2 || (gif->gce.disposal != 3 && !gif->canvas_ready);
 
     dispose(gif);
+    gif->looped = 0;
     f_gif_read(gif, &sep, 1);
     while(sep != ',') {
         if(sep == ';') {
             f_gif_seek(gif, gif->anim_start, LV_FS_SEEK_SET);
+            gif->looped = 1;
             if(gif->loop_count == 1 || gif->loop_count < 0) {
                 return 0;
             }
@@ -746,6 +595,20 @@ gd_get_frame(gd_GIF * gif)
     }
     if(read_image(gif) == -1)
         return -1;
+    gif->canvas_ready = 0;
+
+    gif->dx = gif->fx;
+    gif->dy = gif->fy;
+    gif->dw = gif->fw;
+    gif->dh = gif->fh;
+    if(prev_dirty && pw > 0 && ph > 0) {
+        uint16_t x2 = MAX(gif->fx + gif->fw, px + pw);
+        uint16_t y2 = MAX(gif->fy + gif->fh, py + ph);
+        gif->dx = MIN(gif->fx, px);
+        gif->dy = MIN(gif->fy, py);
+        gif->dw = x2 - gif->dx;
+        gif->dh = y2 - gif->dy;
+    }
     return 1;
 }
 
@@ -753,6 +616,9 @@ void
 gd_render_frame(gd_GIF * gif, uint8_t * buffer)
 {
     render_frame_rect(gif, buffer);
+    if(buffer == gif->canvas) {
+        gif->canvas_ready = 1;
+    }
 }
 
 void
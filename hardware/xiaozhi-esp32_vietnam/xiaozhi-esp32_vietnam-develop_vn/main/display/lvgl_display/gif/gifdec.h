@@ -46,9 +46,13 @@ typedef struct _gd_GIF {
     uint16_t fx, fy, fw, fh;
     uint8_t bgindex;
     uint8_t * canvas, * frame;
-#if LV_GIF_CACHE_DECODE_DATA
-    uint8_t *lzw_cache;
-#endif
+    uint8_t * lzw_cache;
+    /* Canvas area touched by the last gd_get_frame (disposal + new frame rect) */
+    uint16_t dx, dy, dw, dh;
+    /* Current frame has already been composited onto the canvas */
+    uint8_t canvas_ready;
+    /* Set by gd_get_frame when it wrapped around to the first frame */
+    uint8_t looped;
 } gd_GIF;
 
 gd_GIF * gd_open_gif_file(const char * fname);
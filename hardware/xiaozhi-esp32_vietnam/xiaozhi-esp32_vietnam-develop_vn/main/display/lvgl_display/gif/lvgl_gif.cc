@@ -1,9 +1,14 @@
 #include "lvgl_gif.h"
+#include "power_governor.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <cstring>
 
 #define TAG "LvglGif"
 
+// Upper bound of PSRAM used to keep the decoded frames of one looping GIF
+#define GIF_FRAME_CACHE_MAX_BYTES (1024 * 1024)
+
 LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
     : gif_(nullptr), timer_(nullptr), last_call_(0), playing_(false), loaded_(false) {
     if (!img_dsc || !img_dsc->data) {
@@ -32,6 +37,11 @@ LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
     if (gif_->canvas) {
         gd_render_frame(gif_, gif_->canvas);
     }
+    lv_area_set(&dirty_area_, 0, 0, gif_->width - 1, gif_->height - 1);
+
+#if CONFIG_SPIRAM
+    frame_cache_enabled_ = img_dsc_.data_size <= GIF_FRAME_CACHE_MAX_BYTES;
+#endif
 
     loaded_ = true;
     ESP_LOGD(TAG, "GIF loaded from image descriptor: %dx%d", gif_->width, gif_->height);
@@ -65,7 +75,7 @@ void LvglGif::Start() {
     }
 
     if (timer_) {
-        playing_ = true;
+        SetPlaying(true);
         last_call_ = lv_tick_get();
         lv_timer_resume(timer_);
         lv_timer_reset(timer_);
@@ -79,7 +89,7 @@ void LvglGif::Start() {
 
 void LvglGif::Pause() {
     if (timer_) {
-        playing_ = false;
+        SetPlaying(false);
         lv_timer_pause(timer_);
         ESP_LOGD(TAG, "GIF animation paused");
     }
@@ -92,7 +102,7 @@ void LvglGif::Resume() {
     }
 
     if (timer_) {
-        playing_ = true;
+        SetPlaying(true);
         lv_timer_resume(timer_);
         ESP_LOGD(TAG, "GIF animation resumed");
     }
@@ -100,11 +110,14 @@ void LvglGif::Resume() {
 
 void LvglGif::Stop() {
     if (timer_) {
-        playing_ = false;
+        SetPlaying(false);
         lv_timer_pause(timer_);
     }
 
-    if (gif_) {
+    if (frame_cache_complete_) {
+        // Next frame replays the first cached one
+        frame_cache_index_ = frame_cache_.size() - 1;
+    } else if (gif_) {
         gd_rewind(gif_);
         NextFrame();
         ESP_LOGD(TAG, "GIF animation stopped and rewound");
@@ -152,33 +165,63 @@ void LvglGif::SetFrameCallback(std::function<void()> callback) {
     frame_callback_ = callback;
 }
 
+bool LvglGif::GetDirtyArea(lv_area_t& area) const {
+    if (!loaded_ || lv_area_get_size(&dirty_area_) == 0) {
+        return false;
+    }
+    area = dirty_area_;
+    return true;
+}
+
 void LvglGif::NextFrame() {
     if (!loaded_ || !gif_ || !playing_) {
         return;
     }
 
     // Check if enough time has passed for the next frame
+    uint32_t delay = frame_cache_complete_ ? frame_cache_[frame_cache_index_].delay : gif_->gce.delay;
     uint32_t elapsed = lv_tick_elaps(last_call_);
-    if (elapsed < gif_->gce.delay * 10) {
+    if (elapsed < delay * 10) {
         return;
     }
 
     last_call_ = lv_tick_get();
 
+    // Replay from the frame cache, no decoding needed
+    if (frame_cache_complete_) {
+        frame_cache_index_ = (frame_cache_index_ + 1) % frame_cache_.size();
+        const auto& frame = frame_cache_[frame_cache_index_];
+        img_dsc_.data = frame.data;
+        dirty_area_ = frame.dirty;
+        if (frame_callback_) {
+            frame_callback_();
+        }
+        return;
+    }
+
     // Get next frame
     int has_next = gd_get_frame(gif_);
     if (has_next == 0) {
         // Animation finished, pause timer
-        playing_ = false;
+        SetPlaying(false);
         if (timer_) {
             lv_timer_pause(timer_);
         }
+        ClearFrameCache();
         ESP_LOGD(TAG, "GIF animation completed");
+    } else if (has_next < 0) {
+        ClearFrameCache();
     }
 
     // Render current frame
     if (gif_->canvas) {
-        gd_render_frame(gif_, gif_->canvas);
+        if (has_next > 0) {
+            gd_render_frame(gif_, gif_->canvas);
+            lv_area_set(&dirty_area_, gif_->dx, gif_->dy, gif_->dx + gif_->dw - 1, gif_->dy + gif_->dh - 1);
+            CacheFrame();
+        } else {
+            lv_area_set(&dirty_area_, 0, 0, -1, -1);
+        }
         
         // Call frame callback if set
         if (frame_callback_) {
@@ -187,6 +230,68 @@ void LvglGif::NextFrame() {
     }
 }
 
+void LvglGif::CacheFrame() {
+    if (!frame_cache_enabled_) {
+        return;
+    }
+
+    if (gif_->looped) {
+        // Only endless loops are worth replaying from memory
+        if (gif_->loop_count != 0 || frame_cache_.empty()) {
+            ClearFrameCache();
+            return;
+        }
+        frame_cache_complete_ = true;
+        frame_cache_index_ = 0;
+        img_dsc_.data = frame_cache_[0].data;
+        lv_area_set(&dirty_area_, 0, 0, gif_->width - 1, gif_->height - 1);
+        frame_cache_[0].dirty = dirty_area_;
+        ESP_LOGI(TAG, "GIF frames cached: %u frames, %u bytes", (unsigned)frame_cache_.size(), (unsigned)frame_cache_bytes_);
+        return;
+    }
+
+    if (frame_cache_bytes_ + img_dsc_.data_size > GIF_FRAME_CACHE_MAX_BYTES) {
+        ClearFrameCache();
+        return;
+    }
+
+    auto data = (uint8_t*)heap_caps_malloc(img_dsc_.data_size, MALLOC_CAP_SPIRAM);
+    if (data == nullptr) {
+        ClearFrameCache();
+        return;
+    }
+    memcpy(data, gif_->canvas, img_dsc_.data_size);
+    frame_cache_.push_back({data, gif_->gce.delay, dirty_area_});
+    frame_cache_bytes_ += img_dsc_.data_size;
+}
+
+void LvglGif::ClearFrameCache() {
+    for (auto& frame : frame_cache_) {
+        heap_caps_free(frame.data);
+    }
+    frame_cache_.clear();
+    frame_cache_bytes_ = 0;
+    frame_cache_index_ = 0;
+    frame_cache_enabled_ = false;
+    if (frame_cache_complete_) {
+        frame_cache_complete_ = false;
+        img_dsc_.data = gif_ != nullptr ? gif_->canvas : nullptr;
+    }
+}
+
+// The CPU is kept at full speed while frames are being decoded
+void LvglGif::SetPlaying(bool playing) {
+    if (playing == playing_) {
+        return;
+    }
+    playing_ = playing;
+    if (playing) {
+        PowerGovernor::GetInstance().Acquire(kPowerRequestDisplayAnimation);
+    } else {
+        PowerGovernor::GetInstance().Release(kPowerRequestDisplayAnimation);
+    }
+}
+
 void LvglGif::Cleanup() {
     // Stop and delete timer
     if (timer_) {
@@ -194,13 +299,15 @@ void LvglGif::Cleanup() {
         timer_ = nullptr;
     }
 
+    ClearFrameCache();
+
     // Close GIF decoder
     if (gif_) {
         gd_close_gif(gif_);
         gif_ = nullptr;
     }
 
-    playing_ = false;
+    SetPlaying(false);
     loaded_ = false;
     
     // Clear image descriptor
@@ -5,6 +5,7 @@
 #include <lvgl.h>
 #include <memory>
 #include <functional>
+#include <vector>
 
 /**
  * C++ implementation of LVGL GIF widget
@@ -69,6 +70,12 @@ public:
      */
     void SetFrameCallback(std::function<void()> callback);
 
+    /**
+     * Get the image area changed by the last frame, in image coordinates
+     * Returns false if nothing changed
+     */
+    bool GetDirtyArea(lv_area_t& area) const;
+
 private:
     // GIF decoder instance
     gd_GIF* gif_;
@@ -88,6 +95,36 @@ private:
     
     // Frame update callback
     std::function<void()> frame_callback_;
+
+    // Image area changed by the last frame
+    lv_area_t dirty_area_;
+
+    // Fully decoded frames of an endless loop, replayed once the first pass is cached
+    struct CachedFrame {
+        uint8_t* data;
+        uint16_t delay;
+        lv_area_t dirty;
+    };
+    std::vector<CachedFrame> frame_cache_;
+    size_t frame_cache_bytes_ = 0;
+    size_t frame_cache_index_ = 0;
+    bool frame_cache_enabled_ = false;
+    bool frame_cache_complete_ = false;
+
+    /**
+     * Store the current canvas in the frame cache, or switch to cached playback on loop
+     */
+    void CacheFrame();
+
+    /**
+     * Free all cached frames and stop caching
+     */
+    void ClearFrameCache();
+
+    /**
+     * Update the playing state and the power request that goes with it
+     */
+    void SetPlaying(bool playing);
     
     /**
      * Update to next frame
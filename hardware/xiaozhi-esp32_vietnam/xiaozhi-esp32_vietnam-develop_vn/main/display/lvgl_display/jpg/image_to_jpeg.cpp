@@ -6,6 +6,7 @@
 
 #include "esp_jpeg_common.h"
 #include "esp_jpeg_enc.h"
+#include "esp_timer.h"
 #if CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
 #include "driver/jpeg_encode.h"
 #endif
@@ -32,107 +33,111 @@ static __always_inline uint8_t expand_6_to_8(uint8_t v) {
     return (uint8_t)((v << 2) | (v >> 4));
 }
 
-static uint8_t* convert_input_to_encoder_buf(const uint8_t* src, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
-                                             jpeg_pixel_format_t* out_fmt, int* out_size) {
-    // 直接支持的格式：GRAY、RGB888、YCbYCr(YUYV)
-    if (format == V4L2_PIX_FMT_GREY) {
-        int sz = (int)width * (int)height;
-        uint8_t* buf = (uint8_t*)jpeg_calloc_align(sz, 16);
-        if (!buf)
-            return NULL;
-        memcpy(buf, src, sz);
-        if (out_fmt)
-            *out_fmt = JPEG_PIXEL_FORMAT_GRAY;
-        if (out_size)
-            *out_size = sz;
-        return buf;
+// 交换每个 16 位的两个字节；dst 需 4 字节对齐，src 对齐时每次处理一个 32 位字
+static void swap_bytes16(const uint8_t* src, uint8_t* dst, size_t len) {
+    size_t i = 0;
+    if (((uintptr_t)src & 3) == 0) {
+        const uint32_t* s = (const uint32_t*)src;
+        uint32_t* d = (uint32_t*)dst;
+        for (; i + 4 <= len; i += 4) {
+            uint32_t v = *s++;
+            *d++ = ((v & 0x00FF00FF) << 8) | ((v >> 8) & 0x00FF00FF);
+        }
+    }
+    for (; i + 2 <= len; i += 2) {
+        dst[i] = src[i + 1];
+        dst[i + 1] = src[i];
     }
+}
 
-    // V4L2 YUYV (Y Cb Y Cr) 可直接作为 JPEG_PIXEL_FORMAT_YCbYCr 输入
-    if (format == V4L2_PIX_FMT_YUYV) {
-        int sz = (int)width * (int)height * 2;
-        uint8_t* buf = (uint8_t*)jpeg_calloc_align(sz, 16);
-        if (!buf)
-            return NULL;
-        memcpy(buf, src, sz);
-        if (out_fmt)
+// 输入格式对应的编码器格式与每像素字节数
+static void get_encoder_input_format(v4l2_pix_fmt_t format, jpeg_pixel_format_t* out_fmt, int* out_bpp) {
+    switch (format) {
+        // 直接支持的格式：GRAY、YCbYCr(YUYV)
+        case V4L2_PIX_FMT_GREY:
+            *out_fmt = JPEG_PIXEL_FORMAT_GRAY;
+            *out_bpp = 1;
+            break;
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_YUV422P:
             *out_fmt = JPEG_PIXEL_FORMAT_YCbYCr;
-        if (out_size)
-            *out_size = sz;
-        return buf;
+            *out_bpp = 2;
+            break;
+        // 其余格式转换为 RGB888
+        default:
+            *out_fmt = JPEG_PIXEL_FORMAT_RGB888;
+            *out_bpp = 3;
+            break;
+    }
+}
+
+// 输入已是编码器格式，可以直接送入编码器
+static bool is_encoder_native_format(v4l2_pix_fmt_t format) {
+    return format == V4L2_PIX_FMT_GREY || format == V4L2_PIX_FMT_YUYV || format == V4L2_PIX_FMT_RGB24;
+}
+
+// 输入到编码器格式的转换器，按固定行数（一个编码块或整幅）转换
+typedef struct {
+    v4l2_pix_fmt_t format;
+    uint16_t width;
+    uint16_t height;
+    int rows;
+} input_converter_t;
+
+static void input_converter_init(input_converter_t* conv, v4l2_pix_fmt_t format, uint16_t width, uint16_t height,
+                                 int rows) {
+    conv->format = format;
+    conv->width = width;
+    conv->height = height;
+    conv->rows = rows;
+}
+
+// 将第 y0 行开始的 conv->rows 行转换为编码器输入格式，写入 dst（16 字节对齐）
+static void convert_rows_to_encoder_buf(input_converter_t* conv, const uint8_t* src, int y0, uint8_t* dst) {
+    const uint16_t width = conv->width;
+    const int rows = conv->rows;
+    const v4l2_pix_fmt_t format = conv->format;
+    jpeg_pixel_format_t enc_fmt;
+    int bpp;
+    get_encoder_input_format(format, &enc_fmt, &bpp);
+    (void)enc_fmt;
+
+    if (is_encoder_native_format(format)) {
+        memcpy(dst, src + (size_t)y0 * width * bpp, (size_t)rows * width * bpp);
+        return;
     }
 
-    // V4L2 UYVY (Cb Y Cr Y) -> 重排为 YUYV 再作为 YCbYCr 输入
+    // V4L2 UYVY (Cb Y Cr Y) -> 重排为 YUYV 再作为 YCbYCr 输入，即每个 16 位交换字节
     if (format == V4L2_PIX_FMT_UYVY) {
-        int sz = (int)width * (int)height * 2;
-        const uint8_t* s = src;
-        uint8_t* buf = (uint8_t*)jpeg_calloc_align(sz, 16);
-        if (!buf)
-            return NULL;
-        uint8_t* d = buf;
-        for (int i = 0; i < sz; i += 4) {
-            // src: Cb, Y0, Cr, Y1 -> dst: Y0, Cb, Y1, Cr
-            d[0] = s[1];
-            d[1] = s[0];
-            d[2] = s[3];
-            d[3] = s[2];
-            s += 4;
-            d += 4;
-        }
-        if (out_fmt)
-            *out_fmt = JPEG_PIXEL_FORMAT_YCbYCr;
-        if (out_size)
-            *out_size = sz;
-        return buf;
+        swap_bytes16(src + (size_t)y0 * width * 2, dst, (size_t)width * rows * 2);
+        return;
     }
 
     // V4L2 YUV422P (YUV422 Planar) -> 重排为 YUYV (YCbYCr)
     if (format == V4L2_PIX_FMT_YUV422P) {
-        int sz = (int)width * (int)height * 2;
         const uint8_t* y_plane = src;
-        const uint8_t* u_plane = y_plane + (int)width * (int)height;
-        const uint8_t* v_plane = u_plane + ((int)width / 2) * (int)height;
-        uint8_t* buf = (uint8_t*)jpeg_calloc_align(sz, 16);
-        if (!buf)
-            return NULL;
-        uint8_t* dst = buf;
-        for (int y = 0; y < height; y++) {
+        const uint8_t* u_plane = y_plane + (int)width * (int)conv->height;
+        const uint8_t* v_plane = u_plane + ((int)width / 2) * (int)conv->height;
+        uint32_t* d = (uint32_t*)dst;
+        for (int y = y0; y < y0 + rows; y++) {
             const uint8_t* y_row = y_plane + y * (int)width;
             const uint8_t* u_row = u_plane + y * ((int)width / 2);
             const uint8_t* v_row = v_plane + y * ((int)width / 2);
             for (int x = 0; x < width; x += 2) {
-                uint8_t y0 = y_row[x + 0];
-                uint8_t y1 = y_row[x + 1];
-                uint8_t cb = u_row[x / 2];
-                uint8_t cr = v_row[x / 2];
-                dst[0] = y0;
-                dst[1] = cb;
-                dst[2] = y1;
-                dst[3] = cr;
-                dst += 4;
+                // 小端序：Y0 Cb Y1 Cr
+                *d++ = (uint32_t)y_row[x] | ((uint32_t)u_row[x / 2] << 8) | ((uint32_t)y_row[x + 1] << 16) |
+                       ((uint32_t)v_row[x / 2] << 24);
             }
         }
-        if (out_fmt)
-            *out_fmt = JPEG_PIXEL_FORMAT_YCbYCr;
-        if (out_size)
-            *out_size = sz;
-        return buf;
+        return;
     }
 
-    // 其余格式转换为 RGB888
-    int rgb_size = (int)width * (int)height * 3;
-    uint8_t* rgb = (uint8_t*)jpeg_calloc_align(rgb_size, 16);
-    if (!rgb)
-        return NULL;
-
-    if (format == V4L2_PIX_FMT_RGB24) {
-        // V4L2_RGB24 即 RGB888
-        memcpy(rgb, src, rgb_size);
-    } else if (format == V4L2_PIX_FMT_RGB565) {
-        // RGB565 小端，需要转换为 RGB888
-        const uint8_t* p = src;
-        uint8_t* d = rgb;
-        int pixels = (int)width * (int)height;
+    if (format == V4L2_PIX_FMT_RGB565) {
+        const uint8_t* p = src + (size_t)y0 * width * 2;
+        int pixels = (int)width * rows;
+        // RGB565 小端，需要转换为 RGB888（位复制扩展，0x1F/0x3F 对应 0xFF）
+        uint8_t* d = dst;
         for (int i = 0; i < pixels; i++) {
             uint8_t lo = p[0];  // 低字节（LSB）
             uint8_t hi = p[1];  // 高字节（MSB）
@@ -147,16 +152,30 @@ static uint8_t* convert_input_to_encoder_buf(const uint8_t* src, uint16_t width,
             d[2] = expand_5_to_8(b5);
             d += 3;
         }
-    } else {
-        // 其他未覆盖格式，清零
-        memset(rgb, 0, rgb_size);
+        return;
     }
 
+    // 其他未覆盖格式，清零
+    memset(dst, 0, (size_t)width * rows * 3);
+}
+
+static uint8_t* convert_input_to_encoder_buf(const uint8_t* src, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
+                                             jpeg_pixel_format_t* out_fmt, int* out_size) {
+    jpeg_pixel_format_t enc_fmt;
+    int bpp;
+    get_encoder_input_format(format, &enc_fmt, &bpp);
+    int sz = (int)width * (int)height * bpp;
+    uint8_t* buf = (uint8_t*)jpeg_calloc_align(sz, 16);
+    if (!buf)
+        return NULL;
+    input_converter_t conv;
+    input_converter_init(&conv, format, width, height, height);
+    convert_rows_to_encoder_buf(&conv, src, 0, buf);
     if (out_fmt)
-        *out_fmt = JPEG_PIXEL_FORMAT_RGB888;
+        *out_fmt = enc_fmt;
     if (out_size)
-        *out_size = rgb_size;
-    return rgb;
+        *out_size = sz;
+    return buf;
 }
 
 #if CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
@@ -225,18 +244,15 @@ static uint8_t* convert_input_to_hw_encoder_buf(const uint8_t* src, uint16_t wid
     if (format == V4L2_PIX_FMT_YUYV) {
         // 硬件需要 | Y1 V Y0 U | 的“大端”格式，因此需要 bswap16
         int sz = (int)width * (int)height * 2;
-        uint16_t* buf = (uint16_t*)malloc_psram(sz);
+        uint8_t* buf = (uint8_t*)malloc_psram(sz);
         if (!buf)
             return NULL;
-        const uint16_t* bsrc = (const uint16_t*)src;
-        for (int i = 0; i < sz / 2; i++) {
-            buf[i] = __builtin_bswap16(bsrc[i]);
-        }
+        swap_bytes16(src, buf, sz);
         if (out_fmt)
             *out_fmt = JPEG_ENCODE_IN_FORMAT_YUV422;
         if (out_size)
             *out_size = sz;
-        return (uint8_t*)buf;
+        return buf;
     }
 
     return NULL;
@@ -314,6 +330,86 @@ static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t wid
 }
 #endif // CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
 
+// 按块编码：每编码完一个 MCU 行块立即通过回调输出，下游（如上传）可以与编码并行，
+// 也不再需要整幅的格式转换缓冲区和整幅的输出缓冲区。
+// 返回 -1 表示图像尺寸不适合按块编码，调用者应改用整幅编码
+static int encode_blocks_with_esp_new_jpeg(jpeg_enc_handle_t h, const uint8_t* src, uint16_t width, uint16_t height,
+                                           v4l2_pix_fmt_t format, jpg_out_cb cb, void* cb_arg) {
+    jpeg_pixel_format_t enc_fmt;
+    int bpp;
+    get_encoder_input_format(format, &enc_fmt, &bpp);
+    (void)enc_fmt;
+
+    int block_size = jpeg_enc_get_block_size(h);
+    int row_size = (int)width * bpp;
+    if (block_size <= 0 || block_size % row_size != 0 || height % (block_size / row_size) != 0) {
+        return -1;
+    }
+    int block_rows = block_size / row_size;
+
+    // 已是编码器格式且对齐时直接从源图读取，否则逐块转换到 inbuf
+    bool direct = is_encoder_native_format(format) && ((uintptr_t)src % 16) == 0 && (block_size % 16) == 0;
+    uint8_t* inbuf = NULL;
+    if (!direct) {
+        inbuf = (uint8_t*)jpeg_calloc_align(block_size, 16);
+        if (!inbuf) {
+            ESP_LOGE(TAG, "alloc block input failed");
+            return 0;
+        }
+    }
+    // 单个块的压缩输出不会超过原始块大小，另加文件头的余量
+    int out_cap = block_size + 4096;
+    uint8_t* outbuf = (uint8_t*)malloc_psram(out_cap);
+    if (!outbuf) {
+        if (inbuf)
+            jpeg_free_align(inbuf);
+        ESP_LOGE(TAG, "alloc block output failed");
+        return 0;
+    }
+
+    input_converter_t conv;
+    input_converter_init(&conv, format, width, height, block_rows);
+
+    size_t index = 0;
+    size_t total = 0;
+    int64_t convert_us = 0;
+    int64_t encode_us = 0;
+    int ok = 1;
+    for (int y = 0; y < height; y += block_rows) {
+        int64_t t0 = esp_timer_get_time();
+        const uint8_t* block = src + (size_t)y * row_size;
+        if (!direct) {
+            convert_rows_to_encoder_buf(&conv, src, y, inbuf);
+            block = inbuf;
+        }
+        int64_t t1 = esp_timer_get_time();
+        int out_len = 0;
+        jpeg_error_t ret = jpeg_enc_process_with_block(h, block, block_size, outbuf, out_cap, &out_len);
+        convert_us += t1 - t0;
+        encode_us += esp_timer_get_time() - t1;
+        if (ret != JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "jpeg_enc_process_with_block failed: %d", (int)ret);
+            ok = 0;
+            break;
+        }
+        if (out_len > 0) {
+            cb(cb_arg, index++, outbuf, (size_t)out_len);
+            total += out_len;
+        }
+    }
+    if (ok) {
+        cb(cb_arg, index, NULL, 0);  // 结束信号
+        // 回调（例如等待上传）的耗时不计入
+        ESP_LOGD(TAG, "encoded %dx%d fmt=0x%08lx: convert %d ms, encode %d ms, %u bytes", width, height,
+                 (unsigned long)format, (int)(convert_us / 1000), (int)(encode_us / 1000), (unsigned)total);
+    }
+
+    free(outbuf);
+    if (inbuf)
+        jpeg_free_align(inbuf);
+    return ok;
+}
+
 static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_t width, uint16_t height,
                                      v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len,
                                      jpg_out_cb cb, void* cb_arg) {
@@ -323,12 +419,8 @@ static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_
         quality = 100;
 
     jpeg_pixel_format_t enc_src_type = JPEG_PIXEL_FORMAT_RGB888;
-    int enc_in_size = 0;
-    uint8_t* enc_in = convert_input_to_encoder_buf(src, width, height, format, &enc_src_type, &enc_in_size);
-    if (!enc_in) {
-        ESP_LOGE(TAG, "alloc/convert input failed");
-        return false;
-    }
+    int bpp = 0;
+    get_encoder_input_format(format, &enc_src_type, &bpp);
 
     jpeg_enc_config_t cfg = DEFAULT_JPEG_ENC_CONFIG();
     cfg.width = width;
@@ -342,11 +434,28 @@ static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_
     jpeg_enc_handle_t h = NULL;
     jpeg_error_t ret = jpeg_enc_open(&cfg, &h);
     if (ret != JPEG_ERR_OK) {
-        jpeg_free_align(enc_in);
         ESP_LOGE(TAG, "jpeg_enc_open failed: %d", (int)ret);
         return false;
     }
 
+    if (cb) {
+        int block_ret = encode_blocks_with_esp_new_jpeg(h, src, width, height, format, cb, cb_arg);
+        if (block_ret >= 0) {
+            jpeg_enc_close(h);
+            return block_ret == 1;
+        }
+        // 高度不是块的整数倍，改用整幅编码（同一个句柄尚未处理任何数据）
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    int enc_in_size = 0;
+    uint8_t* enc_in = convert_input_to_encoder_buf(src, width, height, format, NULL, &enc_in_size);
+    if (!enc_in) {
+        jpeg_enc_close(h);
+        ESP_LOGE(TAG, "alloc/convert input failed");
+        return false;
+    }
+
     // 估算输出缓冲区：宽高的 1.5 倍 + 64KB
     size_t out_cap = (size_t)width * (size_t)height * 3 / 2 + 64 * 1024;
     if (out_cap < 128 * 1024)
@@ -359,10 +468,14 @@ static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_
         return false;
     }
 
+    int64_t convert_done_us = esp_timer_get_time();
     int out_len = 0;
     ret = jpeg_enc_process(h, enc_in, enc_in_size, outbuf, (int)out_cap, &out_len);
     jpeg_enc_close(h);
     jpeg_free_align(enc_in);
+    ESP_LOGD(TAG, "encoded %dx%d fmt=0x%08lx: convert %d ms, encode %d ms, %d bytes", width, height,
+             (unsigned long)format, (int)((convert_done_us - start_us) / 1000),
+             (int)((esp_timer_get_time() - convert_done_us) / 1000), out_len);
 
     if (ret != JPEG_ERR_OK) {
         free(outbuf);
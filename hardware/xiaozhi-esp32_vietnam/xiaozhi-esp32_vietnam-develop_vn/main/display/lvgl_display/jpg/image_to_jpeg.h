@@ -47,7 +47,9 @@ bool image_to_jpeg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height
  * 使用回调函数处理JPEG输出数据，适合流式传输或分块处理：
  * - 节省约8KB的SRAM使用（静态变量改为堆分配）
  * - 支持流式输出，无需预分配大缓冲区
- * - 通过回调函数逐块处理JPEG数据
+ * - 通过回调函数逐块处理JPEG数据：软件编码器每编码完一个 MCU 行块就回调一次，
+ *   回调在编码线程中执行，可以把数据交给其它线程与编码并行处理
+ * - 编码结束时以 data=NULL, len=0 回调一次；编码失败时不会有结束回调
  * 
  * @param src       源图像数据
  * @param src_len   源图像数据长度
@@ -1,5 +1,7 @@
 #include "lvgl_font.h"
 #include <cbin_font.h>
+#include <esp_heap_caps.h>
+#include <cstring>
 
 
 LvglCBinFont::LvglCBinFont(void* data) {
@@ -10,4 +12,85 @@ LvglCBinFont::~LvglCBinFont() {
     if (font_ != nullptr) {
         cbin_font_delete(font_);
     }
-}
\ No newline at end of file
+}
+
+LvglCachedFont::LvglCachedFont(std::shared_ptr<LvglFont> base, size_t capacity_bytes)
+    : base_(base), capacity_bytes_(capacity_bytes) {
+    // Share glyph metrics, fallback and font data with the base font, only the
+    // bitmap callback goes through the cache
+    proxy_.font = *base_->font();
+    proxy_.font.get_glyph_bitmap = GetGlyphBitmap;
+    proxy_.owner = this;
+}
+
+LvglCachedFont::~LvglCachedFont() {
+    for (auto& entry : lru_) {
+        heap_caps_free(entry.data);
+    }
+}
+
+const void* LvglCachedFont::GetGlyphBitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf) {
+    auto self = reinterpret_cast<const ProxyFont*>(g_dsc->resolved_font)->owner;
+    return self->Lookup(g_dsc, draw_buf);
+}
+
+const void* LvglCachedFont::Lookup(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf) {
+    // Only plain alpha bitmaps rendered into the caller's draw buffer are cacheable
+    bool cacheable = draw_buf != nullptr && g_dsc->format > LV_FONT_GLYPH_FORMAT_NONE &&
+        g_dsc->format <= LV_FONT_GLYPH_FORMAT_A8;
+    uint32_t glyph_index = g_dsc->gid.index;
+
+    if (cacheable) {
+        auto it = index_.find(glyph_index);
+        if (it != index_.end()) {
+            auto& entry = *it->second;
+            if (entry.stride == draw_buf->header.stride && entry.size <= draw_buf->data_size) {
+                memcpy(draw_buf->data, entry.data, entry.size);
+                lru_.splice(lru_.begin(), lru_, it->second);
+                return draw_buf;
+            }
+        }
+    }
+
+    const lv_font_t* base_font = base_->font();
+    g_dsc->resolved_font = base_font;
+    const void* result = base_font->get_glyph_bitmap(g_dsc, draw_buf);
+    g_dsc->resolved_font = &proxy_.font;
+
+    if (cacheable && result == draw_buf) {
+        Insert(glyph_index, draw_buf);
+    }
+    return result;
+}
+
+void LvglCachedFont::Insert(uint32_t glyph_index, const lv_draw_buf_t* draw_buf) {
+    uint32_t size = draw_buf->header.stride * draw_buf->header.h;
+    if (size == 0 || size > capacity_bytes_ / 8) {
+        return;
+    }
+
+    auto it = index_.find(glyph_index);
+    if (it != index_.end()) {
+        used_bytes_ -= it->second->size;
+        heap_caps_free(it->second->data);
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    while (used_bytes_ + size > capacity_bytes_ && !lru_.empty()) {
+        auto& victim = lru_.back();
+        used_bytes_ -= victim.size;
+        heap_caps_free(victim.data);
+        index_.erase(victim.glyph_index);
+        lru_.pop_back();
+    }
+
+    auto data = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM));
+    if (data == nullptr) {
+        return;
+    }
+    memcpy(data, draw_buf->data, size);
+    lru_.push_front({glyph_index, draw_buf->header.stride, size, data});
+    index_[glyph_index] = lru_.begin();
+    used_bytes_ += size;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <lvgl.h>
+#include <memory>
+#include <list>
+#include <unordered_map>
 
 
 class LvglFont {
@@ -29,3 +32,40 @@ public:
 private:
     lv_font_t* font_;
 };
+
+
+// Glyph bitmap cache in front of another font. cbin fonts rasterize (and
+// decompress) every glyph on every redraw, which is costly for Vietnamese text
+// where most letters carry one or two diacritics. The proxy keeps an LRU of
+// rendered A1..A8 bitmaps in PSRAM, keyed by glyph id, one cache per font.
+class LvglCachedFont : public LvglFont {
+public:
+    LvglCachedFont(std::shared_ptr<LvglFont> base, size_t capacity_bytes);
+    virtual ~LvglCachedFont();
+    virtual const lv_font_t* font() const override { return &proxy_.font; }
+
+private:
+    struct Entry {
+        uint32_t glyph_index;
+        uint32_t stride;
+        uint32_t size;
+        uint8_t* data;
+    };
+
+    // The base font may use user_data itself, so the owner rides next to the copy
+    struct ProxyFont {
+        lv_font_t font;
+        LvglCachedFont* owner;
+    };
+
+    std::shared_ptr<LvglFont> base_;
+    ProxyFont proxy_;
+    size_t capacity_bytes_;
+    size_t used_bytes_ = 0;
+    std::list<Entry> lru_;
+    std::unordered_map<uint32_t, std::list<Entry>::iterator> index_;
+
+    static const void* GetGlyphBitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf);
+    const void* Lookup(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf);
+    void Insert(uint32_t glyph_index, const lv_draw_buf_t* draw_buf);
+};
@@ -34,6 +34,18 @@ LvglCBinImage::~LvglCBinImage() {
     }
 }
 
+LvglMappedImage::LvglMappedImage(const void* data, size_t size) {
+    bzero(&image_dsc_, sizeof(image_dsc_));
+    memcpy(&image_dsc_.header, data, sizeof(lv_image_header_t));
+    image_dsc_.data = static_cast<const uint8_t*>(data) + sizeof(lv_image_header_t);
+    image_dsc_.data_size = size - sizeof(lv_image_header_t);
+}
+
+bool LvglMappedImage::IsMappedImage(const void* data, size_t size) {
+    auto ptr = static_cast<const uint8_t*>(data);
+    return size > sizeof(lv_image_header_t) && ptr[0] == LV_IMAGE_HEADER_MAGIC;
+}
+
 LvglAllocatedImage::LvglAllocatedImage(void* data, size_t size) {
     bzero(&image_dsc_, sizeof(image_dsc_));
     image_dsc_.data_size = size;
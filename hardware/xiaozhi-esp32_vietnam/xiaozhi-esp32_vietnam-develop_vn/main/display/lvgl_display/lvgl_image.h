@@ -32,6 +32,18 @@ private:
     lv_img_dsc_t* image_dsc_ = nullptr;
 };
 
+// LVGL v9 binary image (header + pixels) used in place, e.g. from the mmapped assets partition
+class LvglMappedImage : public LvglImage {
+public:
+    LvglMappedImage(const void* data, size_t size);
+    virtual const lv_img_dsc_t* image_dsc() const override { return &image_dsc_; }
+
+    static bool IsMappedImage(const void* data, size_t size);
+
+private:
+    lv_img_dsc_t image_dsc_;
+};
+
 class LvglSourceImage : public LvglImage {
 public:
     LvglSourceImage(const lv_img_dsc_t* image_dsc) : image_dsc_(image_dsc) {}
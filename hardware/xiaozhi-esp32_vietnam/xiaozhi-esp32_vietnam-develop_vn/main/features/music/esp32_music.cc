@@ -6,6 +6,7 @@
 #include "protocols/protocol.h"
 #include "display/display.h"
 #include "settings.h"
+#include "power_governor.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -786,6 +787,7 @@ void Esp32Music::DownloadAudioStream(const std::string& music_url) {
 // Stream audio data
 void Esp32Music::PlayAudioStream() {
     ESP_LOGI(TAG, "Starting audio stream playback");
+    PowerRequestGuard power_request(kPowerRequestMusicDecode);
     
     // Initialize time tracking variables
     current_play_time_ms_ = 0;
@@ -5,6 +5,7 @@
 #include "application.h"
 #include "protocols/protocol.h"
 #include "display/display.h"
+#include "power_governor.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -460,6 +461,7 @@ void Esp32Radio::DownloadRadioStream(const std::string& radio_url) {
 
 void Esp32Radio::PlayRadioStream() {
     ESP_LOGI(TAG, "Starting VOV radio stream playback with AAC decoder");
+    PowerRequestGuard power_request(kPowerRequestMusicDecode);
     
     auto codec = Board::GetInstance().GetAudioCodec();
     if (!codec) {
@@ -4,6 +4,7 @@
 #include "audio_codec.h"
 #include "application.h"
 #include "sd_card.h"
+#include "power_governor.h"
 #include <sys/stat.h>
 #include <dirent.h>
 #include <cstring>
@@ -1640,6 +1641,7 @@ void Esp32SdMusic::playbackThreadFunc()
 
 bool Esp32SdMusic::decodeAndPlayFile(const TrackInfo& track)
 {
+    PowerRequestGuard power_request(kPowerRequestMusicDecode);
     SdAudioFormat fmt = DetectAudioFormat(track.path);
 
     auto display = Board::GetInstance().GetDisplay();
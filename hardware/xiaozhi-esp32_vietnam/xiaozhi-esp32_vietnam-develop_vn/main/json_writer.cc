@@ -0,0 +1,74 @@
+#include "json_writer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+JsonWriter& JsonWriter::Int(int64_t value) {
+    Separator();
+    char digits[21];
+    int length = 0;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do {
+        digits[length++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        buffer_ += '-';
+    }
+    while (length > 0) {
+        buffer_ += digits[--length];
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::Number(double value) {
+    // Same output as cJSON_PrintUnformatted
+    if (!std::isfinite(value)) {
+        return Null();
+    }
+    // Range check before the cast, converting an out of range double to int64_t is undefined
+    if (std::fabs(value) < 1e15 && value == std::trunc(value)) {
+        return Int(static_cast<int64_t>(value));
+    }
+    Separator();
+    char text[26];
+    int length = snprintf(text, sizeof(text), "%1.15g", value);
+    if (strtod(text, nullptr) != value) {
+        length = snprintf(text, sizeof(text), "%1.17g", value);
+    }
+    buffer_.append(text, length);
+    return *this;
+}
+
+void JsonWriter::AppendEscaped(const char* value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    buffer_ += '"';
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        // Copy the clean run in one go, then the escape sequence
+        buffer_.append(value + start, i - start);
+        start = i + 1;
+        buffer_ += '\\';
+        switch (c) {
+            case '"': buffer_ += '"'; break;
+            case '\\': buffer_ += '\\'; break;
+            case '\b': buffer_ += 'b'; break;
+            case '\f': buffer_ += 'f'; break;
+            case '\n': buffer_ += 'n'; break;
+            case '\r': buffer_ += 'r'; break;
+            case '\t': buffer_ += 't'; break;
+            default:
+                buffer_ += "u00";
+                buffer_ += hex[c >> 4];
+                buffer_ += hex[c & 0xF];
+                break;
+        }
+    }
+    buffer_.append(value + start, length - start);
+    buffer_ += '"';
+}
@@ -0,0 +1,71 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+// Streaming JSON writer that appends compact JSON to a caller owned buffer.
+// Nothing is allocated besides growing the buffer, so reserving the expected
+// size up front builds a message with a single allocation. Strings are always escaped.
+//
+//   std::string buffer;
+//   JsonWriter json(buffer);
+//   json.BeginObject().Field("type", "listen").Field("state", "stop").EndObject();
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& buffer) : buffer_(buffer) {}
+
+    JsonWriter& BeginObject() { Separator(); buffer_ += '{'; first_ = true; return *this; }
+    JsonWriter& EndObject() { buffer_ += '}'; first_ = false; return *this; }
+    JsonWriter& BeginArray() { Separator(); buffer_ += '['; first_ = true; return *this; }
+    JsonWriter& EndArray() { buffer_ += ']'; first_ = false; return *this; }
+
+    JsonWriter& Key(const char* key) {
+        Separator();
+        AppendEscaped(key, strlen(key));
+        buffer_ += ':';
+        after_key_ = true;
+        return *this;
+    }
+
+    JsonWriter& String(const char* value, size_t length) {
+        Separator();
+        AppendEscaped(value, length);
+        return *this;
+    }
+    JsonWriter& String(const char* value) { return String(value, strlen(value)); }
+    JsonWriter& String(const std::string& value) { return String(value.data(), value.size()); }
+    JsonWriter& Int(int64_t value);
+    JsonWriter& Number(double value);
+    JsonWriter& Bool(bool value) { Separator(); buffer_ += value ? "true" : "false"; return *this; }
+    JsonWriter& Null() { Separator(); buffer_ += "null"; return *this; }
+    // Already serialized JSON, such as a cached fragment or a nested payload
+    JsonWriter& Raw(const std::string& json) { Separator(); buffer_ += json; return *this; }
+
+    JsonWriter& Field(const char* key, const char* value) { return Key(key).String(value); }
+    JsonWriter& Field(const char* key, const std::string& value) { return Key(key).String(value); }
+    JsonWriter& Field(const char* key, int value) { return Key(key).Int(value); }
+    JsonWriter& Field(const char* key, bool value) { return Key(key).Bool(value); }
+
+    std::string& buffer() { return buffer_; }
+
+private:
+    std::string& buffer_;
+    bool first_ = true;
+    bool after_key_ = false;
+
+    // Comma between members, none right after a key or at the start of a container
+    void Separator() {
+        if (after_key_) {
+            after_key_ = false;
+        } else if (!first_) {
+            buffer_ += ',';
+        }
+        first_ = false;
+    }
+
+    void AppendEscaped(const char* value, size_t length);
+};
+
+#endif // JSON_WRITER_H
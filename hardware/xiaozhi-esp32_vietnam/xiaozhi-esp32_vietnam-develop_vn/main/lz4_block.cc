@@ -0,0 +1,73 @@
+#include "lz4_block.h"
+
+#include <cstring>
+
+bool Lz4Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_size;
+
+    // Even an empty block has the token of its last sequence
+    if (src_size == 0) {
+        return false;
+    }
+
+    auto read_length = [&](size_t& length) -> bool {
+        uint8_t byte;
+        do {
+            if (ip >= iend) {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(literal_length)) {
+            return false;
+        }
+        if (literal_length > (size_t)(iend - ip) || literal_length > (size_t)(oend - op)) {
+            return false;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // The last sequence has literals only
+        if (ip >= iend) {
+            break;
+        }
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return false;
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(match_length)) {
+            return false;
+        }
+        match_length += 4;
+        if (match_length > (size_t)(oend - op)) {
+            return false;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            // Overlapping match repeats the last offset bytes
+            while (match_length--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == oend;
+}
@@ -0,0 +1,14 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Decodes one LZ4 block (raw block format, no frame header) as written by
+// lz4_compress_block in scripts/build_default_assets.py. Every read and write
+// is bounds-checked, so a corrupt or truncated block fails instead of running
+// off either buffer. Returns true only if the block decodes to exactly
+// dst_size bytes.
+bool Lz4Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+#endif // LZ4_BLOCK_H
@@ -0,0 +1,90 @@
+#include "main_task_queue.h"
+
+#include <chrono>
+
+MainTaskQueue::MainTaskQueue(size_t capacity) : slots_(capacity) {
+}
+
+void MainTaskQueue::Push(SmallTask task, const void* origin) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!task.is_inline()) {
+        stats_.heap_tasks++;
+    }
+    // Once something spilled, later tasks queue behind it to keep the order
+    if (overflow_.empty() && count_ < slots_.size()) {
+        Slot& slot = slots_[(head_ + count_) % slots_.size()];
+        slot.task = std::move(task);
+        slot.origin = origin;
+        count_++;
+    } else {
+        overflow_.push_back(Slot{std::move(task), origin});
+        stats_.overflows++;
+    }
+
+    size_t depth = count_ + overflow_.size();
+    if (depth > stats_.high_water) {
+        stats_.high_water = depth;
+    }
+}
+
+bool MainTaskQueue::PopLocked(Slot& slot) {
+    if (count_ > 0) {
+        Slot& head = slots_[head_];
+        slot.task = std::move(head.task);
+        slot.origin = head.origin;
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+        return true;
+    }
+    if (!overflow_.empty()) {
+        slot.task = std::move(overflow_.front().task);
+        slot.origin = overflow_.front().origin;
+        overflow_.pop_front();
+        return true;
+    }
+    return false;
+}
+
+bool MainTaskQueue::RunPending() {
+    size_t pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending = count_ + overflow_.size();
+    }
+
+    // Tasks scheduled while these run wait for the next round, so a task that
+    // keeps rescheduling itself cannot hold off the other main loop events
+    Slot slot;
+    while (pending-- > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!PopLocked(slot)) {
+                return false;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        slot.task();
+        slot.task.Reset();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.tasks++;
+        stats_.total_us += elapsed;
+        if (elapsed > stats_.max_us) {
+            stats_.max_us = elapsed;
+            stats_.max_origin = slot.origin;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_ + overflow_.size() > 0;
+}
+
+MainTaskQueue::Stats MainTaskQueue::TakeStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats_ = Stats();
+    stats_.high_water = stats.high_water;
+    return stats;
+}
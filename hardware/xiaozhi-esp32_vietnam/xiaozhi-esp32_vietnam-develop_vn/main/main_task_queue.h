@@ -0,0 +1,57 @@
+#ifndef _MAIN_TASK_QUEUE_H_
+#define _MAIN_TASK_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "small_task.h"
+
+// Task queue of the main event loop: any number of producers, the main loop
+// as the only consumer. Tasks live in a fixed ring allocated once. When the
+// ring is full, tasks spill into an overflow list instead of being dropped or
+// blocking the caller (the main loop schedules work for itself too); the
+// spill allocates and is counted, and order is kept until the list drains.
+//
+// Each task remembers the address it was scheduled from, so the slowest task
+// can be traced back to its call site.
+class MainTaskQueue {
+public:
+    struct Stats {
+        size_t high_water = 0;          // deepest the queue has been
+        uint32_t tasks = 0;
+        uint32_t overflows = 0;         // tasks that did not fit in the ring
+        uint32_t heap_tasks = 0;        // tasks whose captures were too large to store inline
+        uint64_t total_us = 0;
+        uint32_t max_us = 0;
+        const void* max_origin = nullptr;
+    };
+
+    explicit MainTaskQueue(size_t capacity);
+
+    void Push(SmallTask task, const void* origin);
+    // Runs the tasks queued before the call, returns true if more are waiting
+    bool RunPending();
+    // Returns the counters since the last call, the high water mark is kept
+    Stats TakeStats();
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    struct Slot {
+        SmallTask task;
+        const void* origin = nullptr;
+    };
+
+    std::mutex mutex_;
+    std::vector<Slot> slots_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    std::deque<Slot> overflow_;
+    Stats stats_;
+
+    bool PopLocked(Slot& slot);
+};
+
+#endif // _MAIN_TASK_QUEUE_H_
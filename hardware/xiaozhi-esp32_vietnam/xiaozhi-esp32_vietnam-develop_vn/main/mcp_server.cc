@@ -10,6 +10,9 @@
 #include <cstring>
 #include <esp_pthread.h>
 #include <qrcode.h>
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include "application.h"
 #include "display.h"
@@ -26,7 +29,41 @@
 
 #define TAG "MCP"
 
-McpServer::McpServer() {
+#define MCP_BACKGROUND_WORKERS  2
+#define MCP_WORKER_QUEUE_DEPTH  4
+// Below the main event loop, a slow tool must not delay uplink audio
+#define MCP_WORKER_PRIORITY     2
+
+McpServer::McpServer() : executor_({
+        .run_on_main = [](McpToolExecutor::Task task) {
+            Application::GetInstance().Schedule(std::move(task));
+        },
+        // Workers finish on their own threads, the protocol is only used from the main loop
+        .send = [](std::string payload) {
+            auto& app = Application::GetInstance();
+            app.Schedule([&app, payload = std::move(payload)]() {
+                app.SendMcpMessage(payload);
+            });
+        },
+        .spawn = [](const char* name, size_t stack_size, McpToolExecutor::Task body) {
+            // The config belongs to the calling task, put back whatever it had before
+            esp_pthread_cfg_t previous;
+            bool had_config = esp_pthread_get_cfg(&previous) == ESP_OK;
+
+            esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+            cfg.stack_size = stack_size;
+            cfg.prio = MCP_WORKER_PRIORITY;
+            cfg.thread_name = name;
+            esp_pthread_set_cfg(&cfg);
+            std::thread thread(std::move(body));
+
+            if (!had_config) {
+                previous = esp_pthread_get_default_config();
+            }
+            esp_pthread_set_cfg(&previous);
+            return thread;
+        },
+    }, MCP_BACKGROUND_WORKERS, MCP_WORKER_QUEUE_DEPTH, CONFIG_MCP_BACKGROUND_STACK_SIZE, CONFIG_MCP_IO_STACK_SIZE) {
 }
 
 McpServer::~McpServer() {
@@ -43,6 +80,8 @@ void McpServer::AddCommonTools() {
 
     // Backup the original tools list and restore it after adding the common tools.
     auto original_tools = std::move(tools_);
+    tools_.clear();
+    tool_index_.clear();
     auto& board = Board::GetInstance();
 
     // Do not add custom tools here.
@@ -183,25 +222,40 @@ void McpServer::AddCommonTools() {
 
     auto camera = board.GetCamera();
     if (camera) {
+        // 相机只有一份帧缓冲和解释区域，后台线程里的多次拍照必须逐个执行
+        static std::mutex camera_mutex;
         AddTool("self.camera.take_photo",
             "Take a photo and explain it. Use this tool after the user asks you to see something.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
+            "  `crop_x`, `crop_y`, `crop_width`, `crop_height`: Optional region of the photo to look at, "
+            "in percent of the photo width and height. Defaults to the whole photo.\n"
             "Return:\n"
             "  A JSON object that provides the photo information.",
             PropertyList({
-                Property("question", kPropertyTypeString)
+                Property("question", kPropertyTypeString),
+                Property("crop_x", kPropertyTypeInteger, 0, 0, 90),
+                Property("crop_y", kPropertyTypeInteger, 0, 0, 90),
+                Property("crop_width", kPropertyTypeInteger, 100, 10, 100),
+                Property("crop_height", kPropertyTypeInteger, 100, 10, 100)
             }),
             [camera](const PropertyList& properties) -> ReturnValue {
                 // Lower the priority to do the camera capture
                 TaskPriorityReset priority_reset(1);
+                std::lock_guard<std::mutex> lock(camera_mutex);
 
                 if (!camera->Capture()) {
                     throw std::runtime_error("Failed to capture photo");
                 }
+                ImageRegion region;
+                region.x = properties["crop_x"].value<int>();
+                region.y = properties["crop_y"].value<int>();
+                region.width = properties["crop_width"].value<int>();
+                region.height = properties["crop_height"].value<int>();
+                camera->SetExplainRegion(region);
                 auto question = properties["question"].value<std::string>();
                 return camera->Explain(question);
-            });
+            }, kMcpToolBackground);
     }
 #endif
 
@@ -235,7 +289,7 @@ void McpServer::AddCommonTools() {
                      auto download_result = music->GetDownloadResult();
                      ESP_LOGI(TAG, "Music details result: %s", download_result.c_str());
                      return "{\"success\": true, \"message\": \"Music started playing\"}";
-                 });
+                 }, kMcpToolIo);
 
          AddTool("self.music.set_display_mode",
                  "Set the display mode for music playback. You can choose to display spectrum or lyrics, for example when user says 'show spectrum' or 'display spectrum', 'show lyrics' or 'display lyrics', set the corresponding display mode.\n"
@@ -295,7 +349,7 @@ void McpServer::AddCommonTools() {
                         return "{\"success\": false, \"message\": \"Failed to find or play radio station: " + station_name + "\"}";
                     }
                     return "{\"success\": true, \"message\": \"Radio station " + station_name + " started playing\"}";
-                });
+                }, kMcpToolIo);
 
         AddTool("self.radio.play_url",
                 "Play a radio stream from a custom URL. Use this tool when user provides a specific radio stream URL.\n"
@@ -318,7 +372,7 @@ void McpServer::AddCommonTools() {
                         return "{\"success\": false, \"message\": \"Failed to play radio stream from URL: " + url + "\"}";
                     }
                     return "{\"success\": true, \"message\": \"Radio stream started playing\"}";
-                });
+                }, kMcpToolIo);
 
         AddTool("self.radio.stop",
                 "Stop the currently playing radio stream.\n"
@@ -331,7 +385,7 @@ void McpServer::AddCommonTools() {
                         return "{\"success\": false, \"message\": \"Failed to stop radio\"}";
                     }
                     return "{\"success\": true, \"message\": \"Radio stopped\"}";
-                });
+                }, kMcpToolIo);
 
         AddTool("self.radio.get_stations",
                 "Get the list of available radio stations.\n"
@@ -340,16 +394,15 @@ void McpServer::AddCommonTools() {
                 PropertyList(),
                 [radio](const PropertyList &properties) -> ReturnValue {
                     auto stations = radio->GetStationList();
-                    std::string result = "{\"success\": true, \"stations\": [";
-                    for (size_t i = 0; i < stations.size(); ++i) {
-                        result += "\"" + stations[i] + "\"";
-                        if (i < stations.size() - 1) {
-                            result += ", ";
-                        }
+                    std::string result;
+                    JsonWriter json(result);
+                    json.BeginObject().Field("success", true).Key("stations").BeginArray();
+                    for (const auto& station : stations) {
+                        json.String(station);
                     }
-                    result += "]}";
+                    json.EndArray().EndObject();
                     return result;
-                });
+                }, kMcpToolIo);
 
         AddTool("self.radio.set_display_mode",
                 "Set the display mode for radio playback. You can choose to display spectrum or station info.\n"
@@ -384,7 +437,7 @@ void McpServer::AddCommonTools() {
                     {
                         return "{\"success\": false, \"message\": \"Invalid display mode, please use 'spectrum' or 'info'\"}";
                     }
-                });
+                }, kMcpToolIo);
     }
 
 #ifdef CONFIG_SD_CARD_ENABLE
@@ -454,7 +507,8 @@ void McpServer::AddCommonTools() {
 
                 // Hành vi mới, chỉ để an toàn
                 return "{\"success\":false,\"message\":\"Unknown playback action\"}";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 2) SHUFFLE / REPEAT MODE ==================
@@ -501,7 +555,8 @@ void McpServer::AddCommonTools() {
                 }
 
                 return "Unknown mode action";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 3) TRUY CẬP BÀI HÁT ==================
@@ -607,7 +662,8 @@ void McpServer::AddCommonTools() {
                 }
 
                 return "Unknown track action";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 4) THƯ MỤC ==================
@@ -658,7 +714,8 @@ void McpServer::AddCommonTools() {
                 }
 
                 return "{\"success\": false, \"message\": \"Unknown directory action\"}";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 5) TÌM KIẾM / PLAY THEO TÊN ==================
@@ -733,7 +790,8 @@ void McpServer::AddCommonTools() {
                 }
 
                 return "{\"success\": false, \"message\": \"Unknown search action\"}";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 6) ĐẾM / PHÂN TRANG ==================
@@ -834,7 +892,8 @@ void McpServer::AddCommonTools() {
                 }
 
                 return "{\"success\": false, \"message\": \"Unknown library action\"}";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 7) NẠP LẠI DANH SÁCH NHẠC (QUÉT LẠI SD THEO YÊU CẦU) ==================
@@ -857,7 +916,8 @@ void McpServer::AddCommonTools() {
                     return "{\"success\": false, \"message\": \"Failed to rescan SD card or no supported audio files found\"}";
                 }
                 return "{\"success\": true, \"message\": \"SD playlist reloaded from SD card\"}";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 7) GỢI Ý BÀI HÁT ==================
@@ -927,7 +987,8 @@ void McpServer::AddCommonTools() {
 
                 // Không action hợp lệ → mảng rỗng
                 return arr;
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 8) PROGRESS ==================
@@ -972,7 +1033,8 @@ void McpServer::AddCommonTools() {
                 cJSON_AddStringToObject(o, "track_name", sd_music->getCurrentTrack().c_str());
                 cJSON_AddStringToObject(o, "track_path", sd_music->getCurrentTrackPath().c_str());
                 return o;
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 9) THỂ LOẠI (GENRE PLAYLIST) ==================
@@ -1070,7 +1132,8 @@ void McpServer::AddCommonTools() {
                 }
 
                 return "{\"success\": false, \"message\": \"Unknown genre action\"}";
-            }
+            },
+            kMcpToolIo
         );
 
         // ================== 10) LIỆT KÊ GENRE SẴN CÓ ==================
@@ -1095,13 +1158,16 @@ void McpServer::AddCommonTools() {
                     cJSON_AddItemToArray(arr, cJSON_CreateString(g.c_str()));
                 }
                 return arr;
-            }
+            },
+            kMcpToolIo
         );
     }
 #endif // CONFIG_EXAMPLE_SD_MUSIC
     
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+    RebuildToolIndex();
+    tools_list_.Invalidate();
 }
 
 void McpServer::AddUserOnlyTools() {
@@ -1114,6 +1180,13 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.get_tool_stats",
+        "Get the call count and latency histogram of every tool that has been called",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return GetToolStatsJson();
+        });
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -1220,7 +1293,7 @@ void McpServer::AddUserOnlyTools() {
                 http->Close();
                 ESP_LOGI(TAG, "Snapshot screen result: %s", result.c_str());
                 return true;
-            });
+            }, kMcpToolIo);
         
         AddUserOnlyTool("self.screen.preview_image", "Preview an image on the screen",
             PropertyList({
@@ -1260,7 +1333,7 @@ void McpServer::AddUserOnlyTools() {
                 auto image = std::make_unique<LvglAllocatedImage>(data, content_length);
                 display->SetPreviewImage(std::move(image));
                 return true;
-            });
+            }, kMcpToolIo);
 #endif // CONFIG_LV_USE_SNAPSHOT
     }
 #endif // HAVE_LVGL
@@ -1283,22 +1356,42 @@ void McpServer::AddUserOnlyTools() {
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (tool_index_.find(tool->name()) != tool_index_.end()) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s%s", tool->name().c_str(), tool->user_only() ? " [user]" : "");
+    tool_index_.emplace(tool->name(), tools_.size());
     tools_.push_back(tool);
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+void McpServer::RebuildToolIndex() {
+    tool_index_.clear();
+    tool_index_.reserve(tools_.size());
+    for (size_t i = 0; i < tools_.size(); i++) {
+        // emplace keeps the first tool of a name, the one DoToolCall used to find
+        tool_index_.emplace(tools_[i]->name(), i);
+    }
 }
 
-void McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
+McpTool* McpServer::FindTool(const std::string& name) const {
+    auto it = tool_index_.find(name);
+    return it != tool_index_.end() ? tools_[it->second] : nullptr;
+}
+
+void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+    McpToolExecution execution) {
+    auto tool = new McpTool(name, description, properties, callback);
+    tool->set_execution(execution);
+    AddTool(tool);
+}
+
+void McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+    McpToolExecution execution) {
     auto tool = new McpTool(name, description, properties, callback);
     tool->set_user_only(true);
+    tool->set_execution(execution);
     AddTool(tool);
 }
 
@@ -1328,6 +1421,23 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
                 camera->SetExplainUrl(url_str, token_str);
             }
         }
+
+        // 服务器可以要求缩小上传的图像并调整 JPEG 质量，以减少上传时间
+        auto max_size = cJSON_GetObjectItem(vision, "max_size");
+        auto quality = cJSON_GetObjectItem(vision, "quality");
+        if (cJSON_IsNumber(max_size) || cJSON_IsNumber(quality)) {
+            auto camera = Board::GetInstance().GetCamera();
+            if (camera) {
+                ExplainImageOptions options;
+                if (cJSON_IsNumber(max_size)) {
+                    options.max_size = max_size->valueint;
+                }
+                if (cJSON_IsNumber(quality)) {
+                    options.quality = quality->valueint;
+                }
+                camera->SetExplainImageOptions(options);
+            }
+        }
     }
 }
 
@@ -1373,9 +1483,16 @@ void McpServer::ParseMessage(const cJSON* json) {
             }
         }
         auto app_desc = esp_app_get_description();
-        std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
-        message += app_desc->version;
-        message += "\"}}";
+        std::string message;
+        JsonWriter writer(message);
+        writer.BeginObject()
+            .Field("protocolVersion", "2024-11-05")
+            .Key("capabilities").BeginObject().Key("tools").BeginObject().EndObject().EndObject()
+            .Key("serverInfo").BeginObject()
+                .Field("name", BOARD_NAME)
+                .Field("version", app_desc->version)
+            .EndObject()
+            .EndObject();
         ReplyResult(id_int, message);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
@@ -1416,92 +1533,85 @@ void McpServer::ParseMessage(const cJSON* json) {
     }
 }
 
+std::string McpServer::ResultPayload(int id, const std::string& result) {
+    std::string payload;
+    payload.reserve(result.size() + 48);
+    JsonWriter json(payload);
+    json.BeginObject()
+        .Field("jsonrpc", "2.0")
+        .Field("id", id)
+        .Key("result").Raw(result)
+        .EndObject();
+    return payload;
+}
+
+std::string McpServer::ErrorPayload(int id, const std::string& message) {
+    std::string payload;
+    payload.reserve(message.size() + 64);
+    JsonWriter json(payload);
+    json.BeginObject()
+        .Field("jsonrpc", "2.0")
+        .Field("id", id)
+        .Key("error").BeginObject().Field("message", message).EndObject()
+        .EndObject();
+    return payload;
+}
+
+// Replies go through the executor so they stay behind tool calls still running
 void McpServer::ReplyResult(int id, const std::string& result) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id) + ",\"result\":";
-    payload += result;
-    payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+    executor_.Reply(ResultPayload(id, result));
 }
 
 void McpServer::ReplyError(int id, const std::string& message) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id);
-    payload += ",\"error\":{\"message\":\"";
-    payload += message;
-    payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+    executor_.Reply(ErrorPayload(id, message));
 }
 
-void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
-        }
-
-        if (!list_user_only_tools && (*it)->user_only()) {
-            ++it;
+cJSON* McpServer::GetToolStatsJson() {
+    cJSON* json = cJSON_CreateArray();
+    for (auto tool : tools_) {
+        auto& latency = tool->latency();
+        uint32_t calls = latency.total_count();
+        if (calls == 0) {
             continue;
         }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
-            break;
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", tool->name().c_str());
+        cJSON_AddNumberToObject(item, "calls", calls);
+        cJSON_AddNumberToObject(item, "avg_ms", latency.total_ms() / calls);
+        cJSON_AddNumberToObject(item, "max_ms", latency.max_ms());
+        if (tool->stack_free() != UINT32_MAX) {
+            cJSON_AddNumberToObject(item, "stack_free", tool->stack_free());
         }
-        
-        json += tool_json;
-        ++it;
-    }
-    
-    if (json.back() == ',') {
-        json.pop_back();
-    }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
-        return;
+        cJSON* histogram = cJSON_CreateObject();
+        for (int i = 0; i < McpLatencyHistogram::kBucketCount; i++) {
+            cJSON_AddNumberToObject(histogram, McpLatencyHistogram::bucket_name(i), latency.count(i));
+        }
+        cJSON_AddItemToObject(item, "histogram", histogram);
+        cJSON_AddItemToArray(json, item);
     }
+    return json;
+}
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
+    std::string result;
+    std::string error;
+    if (!tools_list_.Get(cursor, list_user_only_tools, result, error)) {
+        ESP_LOGE(TAG, "tools/list: %s", error.c_str());
+        ReplyError(id, error);
+        return;
     }
-    
-    ReplyResult(id, json);
+    ReplyResult(id, result);
 }
 
 void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+    McpTool* tool = FindTool(tool_name);
+    if (tool == nullptr) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
         ReplyError(id, "Unknown tool: " + tool_name);
         return;
     }
 
-    PropertyList arguments = (*tool_iter)->properties();
+    PropertyList arguments = tool->properties();
     try {
         for (auto& argument : arguments) {
             bool found = false;
@@ -1531,14 +1641,27 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
         return;
     }
 
-    // Use main thread to call the tool
-    auto& app = Application::GetInstance();
-    app.Schedule([this, id, tool_iter, arguments = std::move(arguments)]() {
+    // Main thread tools run in the main loop as before, slow ones on the worker pool
+    auto job = [id, tool, arguments = std::move(arguments)]() -> std::string {
+        std::string payload;
         try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
+            payload = ResultPayload(id, tool->Call(arguments));
         } catch (const std::exception& e) {
             ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
+            payload = ErrorPayload(id, e.what());
+        }
+        // 记录工作线程剩余的栈空间，用于调整 CONFIG_MCP_*_STACK_SIZE
+        if (tool->execution() != kMcpToolMainThread) {
+            uint32_t stack_free = uxTaskGetStackHighWaterMark(nullptr);
+            if (stack_free < tool->stack_free()) {
+                ESP_LOGI(TAG, "tools/call: %s left %lu bytes of worker stack", tool->name().c_str(), stack_free);
+            }
+            tool->RecordStackFree(stack_free);
         }
-    });
+        return payload;
+    };
+    if (!executor_.Submit(tool->execution(), std::move(job), &tool->latency())) {
+        ESP_LOGW(TAG, "tools/call: %s rejected, worker queue is full", tool_name.c_str());
+        ReplyError(id, "Device is busy, try again later");
+    }
 }
@@ -4,15 +4,23 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
 #include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <mbedtls/base64.h>
 
 #include <cJSON.h>
 
+#include "json_writer.h"
+#include "mcp_tool_executor.h"
+#include "mcp_tools_list.h"
+
 class ImageContent {
 private:
     std::string encoded_data_;
@@ -34,14 +42,14 @@ public:
     }
 
     std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "type", "image");
-        cJSON_AddStringToObject(json, "mimeType", mime_type_.c_str());
-        cJSON_AddStringToObject(json, "data", encoded_data_.c_str());
-        char* json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
+        std::string result;
+        result.reserve(encoded_data_.size() + mime_type_.size() + 48);
+        JsonWriter json(result);
+        json.BeginObject()
+            .Field("type", "image")
+            .Field("mimeType", mime_type_)
+            .Field("data", encoded_data_)
+            .EndObject();
         return result;
     }
 };
@@ -120,37 +128,37 @@ public:
         value_ = value;
     }
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
+    void Write(JsonWriter& json) const {
+        json.BeginObject();
         if (type_ == kPropertyTypeBoolean) {
-            cJSON_AddStringToObject(json, "type", "boolean");
+            json.Field("type", "boolean");
             if (has_default_value_) {
-                cJSON_AddBoolToObject(json, "default", value<bool>());
+                json.Field("default", value<bool>());
             }
         } else if (type_ == kPropertyTypeInteger) {
-            cJSON_AddStringToObject(json, "type", "integer");
+            json.Field("type", "integer");
             if (has_default_value_) {
-                cJSON_AddNumberToObject(json, "default", value<int>());
+                json.Field("default", value<int>());
             }
             if (min_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "minimum", min_value_.value());
+                json.Field("minimum", min_value_.value());
             }
             if (max_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "maximum", max_value_.value());
+                json.Field("maximum", max_value_.value());
             }
         } else if (type_ == kPropertyTypeString) {
-            cJSON_AddStringToObject(json, "type", "string");
+            json.Field("type", "string");
             if (has_default_value_) {
-                cJSON_AddStringToObject(json, "default", value<std::string>().c_str());
+                json.Field("default", value<std::string>());
             }
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
+        json.EndObject();
+    }
+
+    std::string to_json() const {
+        std::string result;
+        JsonWriter json(result);
+        Write(json);
         return result;
     }
 };
@@ -188,19 +196,19 @@ public:
         return required;
     }
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
+    void Write(JsonWriter& json) const {
+        json.BeginObject();
         for (const auto& property : properties_) {
-            cJSON *prop_json = cJSON_Parse(property.to_json().c_str());
-            cJSON_AddItemToObject(json, property.name().c_str(), prop_json);
+            json.Key(property.name().c_str());
+            property.Write(json);
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
+        json.EndObject();
+    }
+
+    std::string to_json() const {
+        std::string result;
+        JsonWriter json(result);
+        Write(json);
         return result;
     }
 };
@@ -212,6 +220,11 @@ private:
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
     bool user_only_ = false;
+    McpToolExecution execution_ = kMcpToolMainThread;
+    McpLatencyHistogram latency_;
+    // Smallest free stack in bytes seen after running on a worker, UINT32_MAX if never
+    std::atomic<uint32_t> stack_free_{UINT32_MAX};
+    mutable std::string json_;
 
 public:
     McpTool(const std::string& name, 
@@ -223,91 +236,96 @@ public:
         properties_(properties), 
         callback_(callback) {}
 
-    void set_user_only(bool user_only) { user_only_ = user_only; }
+    void set_user_only(bool user_only) { user_only_ = user_only; json_.clear(); }
+    void set_execution(McpToolExecution execution) { execution_ = execution; }
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
     inline bool user_only() const { return user_only_; }
+    inline McpToolExecution execution() const { return execution_; }
+    inline McpLatencyHistogram& latency() { return latency_; }
+    inline uint32_t stack_free() const { return stack_free_.load(std::memory_order_relaxed); }
+    void RecordStackFree(uint32_t bytes) {
+        uint32_t current = stack_free_.load(std::memory_order_relaxed);
+        while (bytes < current && !stack_free_.compare_exchange_weak(current, bytes, std::memory_order_relaxed)) {
+        }
+    }
+
+    // 工具注册后描述不再变化，缓存 to_json() 的结果供 tools/list 复用
+    const std::string& cached_json() const {
+        if (json_.empty()) {
+            json_ = to_json();
+        }
+        return json_;
+    }
 
     std::string to_json() const {
         std::vector<std::string> required = properties_.GetRequired();
-        
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "name", name_.c_str());
-        cJSON_AddStringToObject(json, "description", description_.c_str());
-        
-        cJSON *input_schema = cJSON_CreateObject();
-        cJSON_AddStringToObject(input_schema, "type", "object");
-        
-        cJSON *properties = cJSON_Parse(properties_.to_json().c_str());
-        cJSON_AddItemToObject(input_schema, "properties", properties);
-        
+
+        std::string result;
+        JsonWriter json(result);
+        json.BeginObject()
+            .Field("name", name_)
+            .Field("description", description_);
+
+        json.Key("inputSchema").BeginObject().Field("type", "object");
+        json.Key("properties");
+        properties_.Write(json);
         if (!required.empty()) {
-            cJSON *required_array = cJSON_CreateArray();
+            json.Key("required").BeginArray();
             for (const auto& property : required) {
-                cJSON_AddItemToArray(required_array, cJSON_CreateString(property.c_str()));
+                json.String(property);
             }
-            cJSON_AddItemToObject(input_schema, "required", required_array);
+            json.EndArray();
         }
-        
-        cJSON_AddItemToObject(json, "inputSchema", input_schema);
+        json.EndObject();
 
         // Add audience annotation if the tool is user only (invisible to AI)
         if (user_only_) {
-            cJSON *annotations = cJSON_CreateObject();
-            cJSON *audience = cJSON_CreateArray();
-            cJSON_AddItemToArray(audience, cJSON_CreateString("user"));
-            cJSON_AddItemToObject(annotations, "audience", audience);
-            cJSON_AddItemToObject(json, "annotations", annotations);
+            json.Key("annotations").BeginObject()
+                .Key("audience").BeginArray().String("user").EndArray()
+                .EndObject();
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
+        json.EndObject();
         return result;
     }
 
     std::string Call(const PropertyList& properties) {
         ReturnValue return_value = callback_(properties);
         // Return result
-        cJSON* result = cJSON_CreateObject();
-        cJSON* content = cJSON_CreateArray();
+        std::string result;
+        JsonWriter json(result);
+        json.BeginObject().Key("content").BeginArray().BeginObject();
 
         if (std::holds_alternative<ImageContent*>(return_value)) {
             auto image_content = std::get<ImageContent*>(return_value);
-            cJSON* image = cJSON_CreateObject();
-            cJSON_AddStringToObject(image, "type", "image");
-            cJSON_AddStringToObject(image, "image", image_content->to_json().c_str());
-            cJSON_AddItemToArray(content, image);
+            json.Field("type", "image");
+            json.Field("image", image_content->to_json());
             delete image_content;
         } else {
-            cJSON* text = cJSON_CreateObject();
-            cJSON_AddStringToObject(text, "type", "text");
+            json.Field("type", "text");
+            json.Key("text");
             if (std::holds_alternative<std::string>(return_value)) {
-                cJSON_AddStringToObject(text, "text", std::get<std::string>(return_value).c_str());
+                json.String(std::get<std::string>(return_value));
             } else if (std::holds_alternative<bool>(return_value)) {
-                cJSON_AddStringToObject(text, "text", std::get<bool>(return_value) ? "true" : "false");
+                json.String(std::get<bool>(return_value) ? "true" : "false");
             } else if (std::holds_alternative<int>(return_value)) {
-                cJSON_AddStringToObject(text, "text", std::to_string(std::get<int>(return_value)).c_str());
+                char text[12];
+                snprintf(text, sizeof(text), "%d", std::get<int>(return_value));
+                json.String(text);
             } else if (std::holds_alternative<cJSON*>(return_value)) {
-                cJSON* json = std::get<cJSON*>(return_value);
-                char* json_str = cJSON_PrintUnformatted(json);
-                cJSON_AddStringToObject(text, "text", json_str);
+                // Tools that build a cJSON tree still have it printed once
+                cJSON* tree = std::get<cJSON*>(return_value);
+                char* json_str = cJSON_PrintUnformatted(tree);
+                json.String(json_str);
                 cJSON_free(json_str);
-                cJSON_Delete(json);
+                cJSON_Delete(tree);
             }
-            cJSON_AddItemToArray(content, text);
         }
-        cJSON_AddItemToObject(result, "content", content);
-        cJSON_AddBoolToObject(result, "isError", false);
-
-        auto json_str = cJSON_PrintUnformatted(result);
-        std::string result_str(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(result);
-        return result_str;
+        json.EndObject().EndArray();
+        json.Field("isError", false);
+        json.EndObject();
+        return result;
     }
 };
 
@@ -321,8 +339,10 @@ public:
     void AddCommonTools();
     void AddUserOnlyTools();
     void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
-    void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+        McpToolExecution execution = kMcpToolMainThread);
+    void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+        McpToolExecution execution = kMcpToolMainThread);
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
 
@@ -330,15 +350,24 @@ private:
     McpServer();
     ~McpServer();
 
+    void RebuildToolIndex();
+    McpTool* FindTool(const std::string& name) const;
+
     void ParseCapabilities(const cJSON* capabilities);
 
+    static std::string ResultPayload(int id, const std::string& result);
+    static std::string ErrorPayload(int id, const std::string& message);
     void ReplyResult(int id, const std::string& result);
     void ReplyError(int id, const std::string& message);
+    cJSON* GetToolStatsJson();
 
     void GetToolsList(int id, const std::string& cursor, bool list_user_only_tools);
     void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments);
 
     std::vector<McpTool*> tools_;
+    std::unordered_map<std::string, size_t> tool_index_;   // name -> position in tools_
+    McpToolsList tools_list_{tools_, tool_index_};
+    McpToolExecutor executor_;
 };
 
 #endif // MCP_SERVER_H
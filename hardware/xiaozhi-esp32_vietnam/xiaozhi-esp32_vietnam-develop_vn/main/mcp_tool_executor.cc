@@ -0,0 +1,123 @@
+#include "mcp_tool_executor.h"
+
+#include <chrono>
+
+static const uint32_t kBucketLimitsUs[McpLatencyHistogram::kBucketCount - 1] = {
+    10 * 1000, 50 * 1000, 200 * 1000, 1000 * 1000, 5000 * 1000
+};
+
+void McpLatencyHistogram::Record(uint32_t latency_us) {
+    int bucket = 0;
+    while (bucket < kBucketCount - 1 && latency_us >= kBucketLimitsUs[bucket]) {
+        bucket++;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    total_ms_.fetch_add(latency_us / 1000, std::memory_order_relaxed);
+
+    uint32_t max_us = max_us_.load(std::memory_order_relaxed);
+    while (latency_us > max_us && !max_us_.compare_exchange_weak(max_us, latency_us, std::memory_order_relaxed)) {
+    }
+}
+
+uint32_t McpLatencyHistogram::total_count() const {
+    uint32_t total = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        total += count(i);
+    }
+    return total;
+}
+
+const char* McpLatencyHistogram::bucket_name(int bucket) {
+    static const char* names[kBucketCount] = { "<10ms", "<50ms", "<200ms", "<1s", "<5s", ">=5s" };
+    return names[bucket];
+}
+
+McpToolExecutor::McpToolExecutor(Callbacks callbacks, size_t background_workers, size_t queue_depth,
+                                 size_t background_stack_size, size_t io_stack_size)
+    : callbacks_(std::move(callbacks)),
+      queue_depth_(queue_depth),
+      background_pool_{"mcp_bg", background_workers, background_stack_size},
+      io_pool_{"mcp_io", 1, io_stack_size} {
+    if (!callbacks_.spawn) {
+        callbacks_.spawn = [](const char* name, size_t stack_size, Task body) {
+            return std::thread(std::move(body));
+        };
+    }
+}
+
+McpToolExecutor::~McpToolExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    for (auto pool : { &background_pool_, &io_pool_ }) {
+        pool->cv.notify_all();
+        for (auto& thread : pool->threads) {
+            thread.join();
+        }
+    }
+}
+
+void McpToolExecutor::Reply(std::string payload) {
+    callbacks_.send(std::move(payload));
+}
+
+bool McpToolExecutor::Submit(McpToolExecution execution, Job job, McpLatencyHistogram* latency) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Pool* pool = nullptr;
+    if (execution != kMcpToolMainThread) {
+        pool = execution == kMcpToolIo ? &io_pool_ : &background_pool_;
+        if (stopping_ || pool->queue.size() >= queue_depth_) {
+            return false;
+        }
+    }
+
+    Task task = [this, job = std::move(job), latency]() {
+        Run(job, latency);
+    };
+
+    if (pool == nullptr) {
+        lock.unlock();
+        callbacks_.run_on_main(std::move(task));
+        return true;
+    }
+
+    pool->queue.push_back(std::move(task));
+    // Workers are started on demand, a board that never calls a slow tool pays no stack for them
+    if (pool->idle == 0 && pool->threads.size() < pool->max_workers) {
+        pool->threads.push_back(callbacks_.spawn(pool->name, pool->stack_size, [this, pool]() {
+            WorkerLoop(pool);
+        }));
+    } else {
+        pool->cv.notify_one();
+    }
+    return true;
+}
+
+void McpToolExecutor::Run(const Job& job, McpLatencyHistogram* latency) {
+    auto start = std::chrono::steady_clock::now();
+    std::string payload = job();
+    if (latency != nullptr) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        latency->Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+    callbacks_.send(std::move(payload));
+}
+
+void McpToolExecutor::WorkerLoop(Pool* pool) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        pool->idle++;
+        pool->cv.wait(lock, [this, pool]() { return stopping_ || !pool->queue.empty(); });
+        pool->idle--;
+        if (stopping_) {
+            return;
+        }
+
+        Task task = std::move(pool->queue.front());
+        pool->queue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef _MCP_TOOL_EXECUTOR_H
+#define _MCP_TOOL_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where a tool's callback runs
+enum McpToolExecution {
+    kMcpToolMainThread,     // Application main loop, for tools touching chat/device state
+    kMcpToolBackground,     // Shared worker pool, for slow CPU work such as camera capture
+    kMcpToolIo,             // Single I/O worker, for HTTP and SD card, runs these tools one at a time
+};
+
+// Call latency buckets: <10ms, <50ms, <200ms, <1s, <5s, >=5s
+class McpLatencyHistogram {
+public:
+    static constexpr int kBucketCount = 6;
+
+    void Record(uint32_t latency_us);
+
+    uint32_t count(int bucket) const { return buckets_[bucket].load(std::memory_order_relaxed); }
+    uint32_t total_count() const;
+    uint32_t max_ms() const { return max_us_.load(std::memory_order_relaxed) / 1000; }
+    uint32_t total_ms() const { return total_ms_.load(std::memory_order_relaxed); }
+    static const char* bucket_name(int bucket);
+
+private:
+    std::atomic<uint32_t> buckets_[kBucketCount] = {};
+    std::atomic<uint32_t> max_us_{0};
+    std::atomic<uint32_t> total_ms_{0};
+};
+
+// Runs MCP tool calls on the main loop or on a bounded worker pool. Each reply
+// is sent as soon as its call finishes, JSON-RPC matches replies by id, so a
+// slow tool never holds back the replies of fast ones. Calls on the I/O worker
+// still run, and therefore reply, one at a time in submission order.
+// Only depends on the C++ standard library so it can be exercised with fake tools.
+class McpToolExecutor {
+public:
+    using Task = std::function<void()>;
+    // Runs the tool and returns the complete JSON-RPC reply, must not throw
+    using Job = std::function<std::string()>;
+
+    struct Callbacks {
+        std::function<void(Task)> run_on_main;
+        std::function<void(std::string)> send;
+        // Creates a worker thread, lets the platform set name, stack and priority
+        std::function<std::thread(const char* name, size_t stack_size, Task body)> spawn;
+    };
+
+    McpToolExecutor(Callbacks callbacks, size_t background_workers = 2, size_t queue_depth = 4,
+                    size_t background_stack_size = 8192, size_t io_stack_size = 8192);
+    ~McpToolExecutor();
+
+    // Returns false without running the job if the worker queue is full
+    bool Submit(McpToolExecution execution, Job job, McpLatencyHistogram* latency = nullptr);
+    // Reply that needs no tool call, sent right away
+    void Reply(std::string payload);
+
+private:
+    struct Pool {
+        const char* name;
+        size_t max_workers;
+        size_t stack_size;
+        size_t idle = 0;
+        std::deque<Task> queue;
+        std::vector<std::thread> threads;
+        std::condition_variable cv;
+    };
+
+    Callbacks callbacks_;
+    size_t queue_depth_;
+    std::mutex mutex_;
+    bool stopping_ = false;
+    Pool background_pool_;
+    Pool io_pool_;
+
+    void Run(const Job& job, McpLatencyHistogram* latency);
+    void WorkerLoop(Pool* pool);
+};
+
+#endif // _MCP_TOOL_EXECUTOR_H
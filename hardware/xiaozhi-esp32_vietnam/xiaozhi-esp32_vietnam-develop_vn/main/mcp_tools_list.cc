@@ -0,0 +1,109 @@
+#include "mcp_tools_list.h"
+#include "mcp_server.h"
+
+#include <esp_log.h>
+
+#define TAG "MCP"
+
+McpToolsList::Page McpToolsList::BuildPage(size_t start, bool list_user_only_tools, size_t& next) const {
+    Page page;
+    std::string& json = page.json;
+    json.reserve(max_payload_size_);
+    JsonWriter writer(json);
+    writer.BeginObject().Key("tools").BeginArray();
+
+    size_t added = 0;
+    size_t i = start;
+    for (; i < tools_.size(); i++) {
+        const McpTool* tool = tools_[i];
+        if (!list_user_only_tools && tool->user_only()) {
+            continue;
+        }
+
+        // 添加tool前检查大小：每个tool都按带一个逗号计算，和原来逐个拼接时分页位置一致
+        const std::string& tool_json = tool->cached_json();
+        if (json.length() + (added > 0 ? 1 : 0) + tool_json.length() + 1 + 30 > max_payload_size_) {
+            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
+            page.next_cursor = tool->name();
+            break;
+        }
+
+        writer.Raw(tool_json);
+        added++;
+    }
+    next = i;
+
+    if (added == 0 && !tools_.empty()) {
+        // 如果没有添加任何tool，返回错误
+        json.clear();
+        return page;
+    }
+
+    writer.EndArray();
+    if (!page.next_cursor.empty()) {
+        writer.Field("nextCursor", page.next_cursor);
+    }
+    writer.EndObject();
+    return page;
+}
+
+void McpToolsList::BuildPages(bool list_user_only_tools) {
+    auto& pages = pages_[list_user_only_tools ? 1 : 0];
+    pages.clear();
+    pages_tools_[list_user_only_tools ? 1 : 0] = tools_.size();
+
+    size_t start = 0;
+    std::string cursor;
+    while (true) {
+        size_t next = 0;
+        Page page = BuildPage(start, list_user_only_tools, next);
+        page.cursor = cursor;
+        bool last = page.json.empty() || page.next_cursor.empty();
+        cursor = page.next_cursor;
+        pages.push_back(std::move(page));
+        if (last) {
+            break;
+        }
+        start = next;
+    }
+    ESP_LOGI(TAG, "tools/list: %u tools in %u pages%s", tools_.size(), pages.size(),
+        list_user_only_tools ? " (with user only tools)" : "");
+}
+
+bool McpToolsList::Get(const std::string& cursor, bool list_user_only_tools, std::string& result,
+                       std::string& error) {
+    auto& pages = pages_[list_user_only_tools ? 1 : 0];
+    // Tools are only ever appended, so a changed count means the pages are stale
+    if (pages.empty() || pages_tools_[list_user_only_tools ? 1 : 0] != tools_.size()) {
+        BuildPages(list_user_only_tools);
+    }
+
+    const Page* page = nullptr;
+    for (const auto& p : pages) {
+        if (p.cursor == cursor) {
+            page = &p;
+            break;
+        }
+    }
+
+    // A cursor that is not a page boundary still starts the list at that tool
+    Page custom_page;
+    if (page == nullptr) {
+        auto it = tool_index_.find(cursor);
+        size_t next = 0;
+        custom_page = BuildPage(it != tool_index_.end() ? it->second : tools_.size(), list_user_only_tools, next);
+        page = &custom_page;
+    }
+
+    if (page->json.empty()) {
+        error = "Failed to add tool " + page->next_cursor + " because of payload size limit";
+        return false;
+    }
+    result = page->json;
+    return true;
+}
+
+void McpToolsList::Invalidate() {
+    pages_[0].clear();
+    pages_[1].clear();
+}
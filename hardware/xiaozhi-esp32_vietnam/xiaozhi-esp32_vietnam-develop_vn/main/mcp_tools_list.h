@@ -0,0 +1,48 @@
+#ifndef _MCP_TOOLS_LIST_H
+#define _MCP_TOOLS_LIST_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class McpTool;
+
+// tools/list results split into pages that fit one message. The pages are
+// built on the first request and reused until a tool is added, or until
+// Invalidate() after the list was reordered.
+class McpToolsList {
+public:
+    static constexpr size_t kMaxPayloadSize = 8000;
+
+    // tools and tool_index belong to the server and are read on every request
+    McpToolsList(const std::vector<McpTool*>& tools, const std::unordered_map<std::string, size_t>& tool_index,
+                 size_t max_payload_size = kMaxPayloadSize)
+        : tools_(tools), tool_index_(tool_index), max_payload_size_(max_payload_size) {}
+
+    // Returns the page starting at cursor in result, or false with the message
+    // for the error reply when the tool at the cursor does not fit in a page
+    bool Get(const std::string& cursor, bool list_user_only_tools, std::string& result, std::string& error);
+    void Invalidate();
+
+    size_t page_count(bool list_user_only_tools) const { return pages_[list_user_only_tools ? 1 : 0].size(); }
+
+private:
+    // A precomputed tools/list result, selected by the cursor of its first tool
+    struct Page {
+        std::string cursor;
+        std::string json;           // empty if the tool at next_cursor does not fit in a page
+        std::string next_cursor;
+    };
+
+    Page BuildPage(size_t start, bool list_user_only_tools, size_t& next) const;
+    void BuildPages(bool list_user_only_tools);
+
+    const std::vector<McpTool*>& tools_;
+    const std::unordered_map<std::string, size_t>& tool_index_;
+    size_t max_payload_size_;
+    std::vector<Page> pages_[2];    // without / with user only tools
+    size_t pages_tools_[2] = {};    // tools_.size() when the pages were built
+};
+
+#endif // _MCP_TOOLS_LIST_H
@@ -1,4 +1,6 @@
 #include "ota.h"
+#include "ota_delta.h"
+#include "ota_writer.h"
 #include "system_info.h"
 #include "http_client.h"
 #include "settings.h"
@@ -11,6 +13,9 @@
 #include <esp_app_format.h>
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
 #ifdef SOC_HMAC_SUPPORTED
 #include <esp_hmac.h>
 #endif
@@ -22,6 +27,20 @@
 
 #define TAG "Ota"
 
+#if CONFIG_SPIRAM
+#define OTA_CHUNK_SIZE (32 * 1024)
+#define OTA_CHUNK_COUNT 4
+#else
+#define OTA_CHUNK_SIZE (8 * 1024)
+#define OTA_CHUNK_COUNT 2
+#endif
+
+// Network reads are staged here before they are copied or patched into chunks
+#define OTA_READ_SIZE (4 * 1024)
+
+// Reconnect attempts after a dropped firmware stream, with 1s, 2s, 4s... backoff
+#define OTA_MAX_RETRIES 5
+
 Ota::Ota() {
 #ifdef ESP_EFUSE_BLOCK_USR_DATA
     // Read Serial Number from efuse user_data
@@ -234,7 +253,7 @@ bool Ota::CheckVersion(std::string& url) {
     data = http->ReadAll();
     http->Close();
 
-    // Response: { "firmware": { "version": "1.0.0", "url": "http://", "force": 0 } }
+    // Response: { "firmware": { "version": "1.0.0", "url": "http://", "force": 0, "sha256": "<optional hex>", "delta_url": "<optional>" } }
     // Parse the JSON response and check if the version is newer
     // If it is, set has_new_version_ to true and store the new version and URL
     if (url != CONFIG_OTA_URL) {
@@ -354,6 +373,16 @@ bool Ota::CheckVersion(std::string& url) {
             firmware_size_ = size->valueint;
             ESP_LOGI(TAG, "Firmware size from server: %d bytes", firmware_size_);
         }
+        cJSON *delta_url = cJSON_GetObjectItem(firmware, "delta_url");
+        firmware_delta_url_.clear();
+        if (cJSON_IsString(delta_url)) {
+            firmware_delta_url_ = delta_url->valuestring;
+        }
+        cJSON *sha256 = cJSON_GetObjectItem(firmware, "sha256");
+        firmware_sha256_.clear();
+        if (cJSON_IsString(sha256) && strlen(sha256->valuestring) == 64) {
+            firmware_sha256_ = sha256->valuestring;
+        }
 
         if (cJSON_IsString(version) && cJSON_IsString(url)) {
             // Check if the version is newer, for example, 0.1.0 is newer than 0.0.1
@@ -407,9 +436,44 @@ void Ota::MarkCurrentVersionValid() {
     }
 }
 
+std::unique_ptr<Http> Ota::OpenFirmwareStream(const std::string& url, size_t offset) {
+    auto network = Board::GetInstance().GetNetwork();
+    auto http = network->CreateHttp(0);
+    auto user_agent = SystemInfo::GetUserAgent();
+    http->SetHeader("User-Agent", user_agent);
+    http->SetHeader("Content-Type", "*/*");
+    if (offset > 0) {
+        http->SetHeader("Range", "bytes=" + std::to_string(offset) + "-");
+    }
+    if (!http->Open("GET", url)) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection");
+        return nullptr;
+    }
+
+    int expected_status = offset > 0 ? 206 : 200;
+    if (http->GetStatusCode() != expected_status) {
+        // A 200 for a Range request means the server sends the whole image again,
+        // which cannot be appended to the partially written partition
+        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
+        http->Close();
+        return nullptr;
+    }
+    return http;
+}
+
+static void LogNewAppInfo(const uint8_t* data, size_t length) {
+    const size_t desc_offset = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
+    if (length < desc_offset + sizeof(esp_app_desc_t)) {
+        return;
+    }
+    esp_app_desc_t new_app_info;
+    memcpy(&new_app_info, data + desc_offset, sizeof(esp_app_desc_t));
+    auto current_version = esp_app_get_description()->version;
+    ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
+}
+
 bool Ota::Upgrade(const std::string& firmware_url) {
     ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
-    esp_ota_handle_t update_handle = 0;
     auto update_partition = esp_ota_get_next_update_partition(NULL);
     if (update_partition == NULL) {
         ESP_LOGE(TAG, "Failed to get update partition");
@@ -417,29 +481,20 @@ bool Ota::Upgrade(const std::string& firmware_url) {
     }
 
     ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
-    bool image_header_checked = false;
-    std::string image_header;
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    auto user_agent = SystemInfo::GetUserAgent();
-    http->SetHeader("User-Agent", user_agent);
-    http->SetHeader("Content-Type", "*/*");
-    if (!http->Open("GET", firmware_url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
-    }
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
+    auto http = OpenFirmwareStream(firmware_url, 0);
+    if (!http) {
         return false;
     }
 
     size_t content_length = http->GetBodyLength();
+    // A dropped connection can only be told apart from the end of the image if the size is known
+    bool length_known = content_length > 0;
     if (content_length == 0) {
         ESP_LOGE(TAG, "Failed to get content length");
-        if (firmware_size_ > 0) {
+        if (firmware_size_ > 0 && firmware_url == firmware_url_) {
             content_length = firmware_size_;
+            length_known = true;
         } else {
             esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL);
             const esp_partition_t *partition = esp_partition_get(it);
@@ -449,62 +504,109 @@ bool Ota::Upgrade(const std::string& firmware_url) {
     }
     ESP_LOGI(TAG, "Firmware size: %u bytes", content_length);
 
-    char buffer[512];
+    // The HTTP reader fills chunks while a writer task programs them into the partition
+    OtaWriter writer(OTA_CHUNK_SIZE, OTA_CHUNK_COUNT);
+    writer.on_first_chunk = LogNewAppInfo;
+    if (writer.Begin(update_partition) != ESP_OK) {
+        return false;
+    }
+    auto emit = [&writer](const uint8_t* data, size_t length) {
+        return writer.Write(data, length);
+    };
+
+    // A delta patch is rebuilt against the running image before it reaches the writer
+    std::unique_ptr<OtaDelta> delta;
+    auto read_buffer = static_cast<uint8_t*>(OtaWriter::AllocateBuffer(OTA_READ_SIZE));
+    bool read_failed = read_buffer == nullptr;
+    int retries = 0;
     size_t total_read = 0, recent_read = 0;
     auto last_calc_time = esp_timer_get_time();
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
+    while (!read_failed) {
+        int ret = http->Read(reinterpret_cast<char*>(read_buffer), OTA_READ_SIZE);
+        if (ret > 0) {
+            if (total_read == 0 && OtaDelta::IsDelta(read_buffer, ret)) {
+                ESP_LOGI(TAG, "Applying delta update against partition %s", esp_ota_get_running_partition()->label);
+                delta = std::make_unique<OtaDelta>(esp_ota_get_running_partition(), emit);
+            }
+            total_read += ret;
+            recent_read += ret;
+            retries = 0;
+            bool consumed = delta ? delta->Feed(read_buffer, ret) : emit(read_buffer, ret);
+            if (!consumed) {
+                read_failed = true;
+            }
+        } else if (ret == 0 && (!length_known || total_read >= content_length)) {
+            break;
+        } else {
+            // Connection dropped, continue from the current position with a Range request
+            ESP_LOGW(TAG, "Firmware stream interrupted at %u/%u: %s", total_read, content_length, esp_err_to_name(ret));
+            http->Close();
+            http.reset();
+            while (!http && retries < OTA_MAX_RETRIES) {
+                retries++;
+                vTaskDelay(pdMS_TO_TICKS(1000 << (retries - 1)));
+                ESP_LOGI(TAG, "Resuming firmware download at %u (retry %d)", total_read, retries);
+                http = OpenFirmwareStream(firmware_url, total_read);
+            }
+            if (!http) {
+                ESP_LOGE(TAG, "Failed to read HTTP data after %d retries", retries);
+                read_failed = true;
+                break;
+            }
+            continue;
         }
 
         // Calculate speed and progress every second
-        recent_read += ret;
-        total_read += ret;
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
+        if (esp_timer_get_time() - last_calc_time >= 1000000) {
             size_t progress = total_read * 100 / content_length;
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, content_length, recent_read);
+            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s, stall: network %lldms, flash %lldms",
+                progress, total_read, content_length, recent_read, writer.writer_stall_us() / 1000,
+                writer.reader_stall_us() / 1000);
             if (upgrade_callback_) {
                 upgrade_callback_(progress, recent_read);
             }
             last_calc_time = esp_timer_get_time();
             recent_read = 0;
         }
+    }
+    if (http) {
+        http->Close();
+    }
+    heap_caps_free(read_buffer);
 
-        if (ret == 0) {
-            break;
+    if (delta && !read_failed && !delta->finished()) {
+        ESP_LOGE(TAG, "Delta patch ended early");
+        read_failed = true;
+    }
+    if (!read_failed) {
+        ESP_LOGI(TAG, "Progress: 100%% (%u/%u), stall: network %lldms, flash %lldms",
+            total_read, content_length, writer.writer_stall_us() / 1000, writer.reader_stall_us() / 1000);
+        if (upgrade_callback_) {
+            upgrade_callback_(100, recent_read);
         }
+    }
+    uint8_t sha256[32];
+    esp_err_t write_error = writer.Finish(!read_failed, sha256);
+    if (read_failed || write_error != ESP_OK) {
+        writer.Abort();
+        return false;
+    }
 
-        if (!image_header_checked) {
-            image_header.append(buffer, ret);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-                
-                auto current_version = esp_app_get_description()->version;
-                ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
-
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
-                    return false;
-                }
-
-                image_header_checked = true;
-                std::string().swap(image_header);
-            }
+    // The expected hash is of the final image, so it covers delta updates as well
+    if ((firmware_url == firmware_url_ || firmware_url == firmware_delta_url_) && !firmware_sha256_.empty()) {
+        char hex[65];
+        for (int i = 0; i < 32; i++) {
+            snprintf(hex + i * 2, 3, "%02x", sha256[i]);
         }
-        auto err = esp_ota_write(update_handle, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
-            esp_ota_abort(update_handle);
+        if (strcasecmp(hex, firmware_sha256_.c_str()) != 0) {
+            ESP_LOGE(TAG, "Firmware SHA-256 mismatch, expected %s, got %s", firmware_sha256_.c_str(), hex);
+            writer.Abort();
             return false;
         }
+        ESP_LOGI(TAG, "Firmware SHA-256 verified");
     }
-    http->Close();
 
-    esp_err_t err = esp_ota_end(update_handle);
+    esp_err_t err = writer.End();
     if (err != ESP_OK) {
         if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
             ESP_LOGE(TAG, "Image validation failed, image is corrupted");
@@ -525,12 +627,18 @@ bool Ota::Upgrade(const std::string& firmware_url) {
 }
 
 bool Ota::StartUpgrade(std::function<void(int progress, size_t speed)> callback) {
-    upgrade_callback_ = callback;
-    return Upgrade(firmware_url_);
+    return StartUpgradeFromUrl(firmware_url_, callback);
 }
 
 bool Ota::StartUpgradeFromUrl(const std::string& url, std::function<void(int progress, size_t speed)> callback) {
     upgrade_callback_ = callback;
+    // The delta only applies on top of the running image, fall back to the full image if it does not
+    if (url == firmware_url_ && !firmware_delta_url_.empty()) {
+        if (Upgrade(firmware_delta_url_)) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Delta upgrade failed, downloading the full image");
+    }
     return Upgrade(url);
 }
 
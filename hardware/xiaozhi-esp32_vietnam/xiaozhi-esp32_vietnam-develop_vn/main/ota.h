@@ -44,6 +44,8 @@ private:
     std::string current_version_;
     std::string firmware_version_;
     std::string firmware_url_;
+    std::string firmware_sha256_;
+    std::string firmware_delta_url_;
     std::string activation_challenge_;
     std::string serial_number_;
     int firmware_size_ = 0;
@@ -55,6 +57,7 @@ private:
     bool IsNewVersionAvailable(const std::string& currentVersion, const std::string& newVersion);
     std::string GetActivationPayload();
     std::unique_ptr<Http> SetupHttp();
+    std::unique_ptr<Http> OpenFirmwareStream(const std::string& url, size_t offset);
 };
 
 #endif // _OTA_H
@@ -0,0 +1,264 @@
+#include "ota_delta.h"
+
+#include <esp_log.h>
+#include <mbedtls/sha256.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "OtaDelta"
+
+#define OP_END  0x00
+#define OP_COPY 0x01
+#define OP_ADD  0x02
+#define OP_DATA 0x03
+
+static uint32_t ReadLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OtaDelta::OtaDelta(const esp_partition_t* base, Output output)
+    : base_(base), output_(output) {
+}
+
+bool OtaDelta::IsDelta(const uint8_t* data, size_t length) {
+    return length >= 4 && memcmp(data, kMagic, 4) == 0;
+}
+
+bool OtaDelta::Fail(const char* reason) {
+    ESP_LOGE(TAG, "Delta patch failed at output offset %u: %s", output_size_, reason);
+    state_ = State::kError;
+    return false;
+}
+
+bool OtaDelta::ParseHeader() {
+    if (!IsDelta(header_, sizeof(header_))) {
+        return Fail("bad magic");
+    }
+    base_size_ = ReadLe32(header_ + 4);
+    target_size_ = ReadLe32(header_ + 40);
+    if (base_size_ > base_->size) {
+        return Fail("base image is larger than the running partition");
+    }
+    ESP_LOGI(TAG, "Delta patch: base %u bytes, target %u bytes", base_size_, target_size_);
+    if (!VerifyBase()) {
+        return Fail("patch was made for a different base image");
+    }
+    state_ = State::kOpcode;
+    return true;
+}
+
+bool OtaDelta::VerifyBase() {
+    mbedtls_sha256_context sha256;
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    bool ok = true;
+    for (size_t offset = 0; offset < base_size_; offset += sizeof(buffer_)) {
+        size_t n = std::min(sizeof(buffer_), base_size_ - offset);
+        if (esp_partition_read(base_, offset, buffer_, n) != ESP_OK) {
+            ok = false;
+            break;
+        }
+        mbedtls_sha256_update(&sha256, buffer_, n);
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha256, digest);
+    mbedtls_sha256_free(&sha256);
+    return ok && memcmp(digest, header_ + 8, sizeof(digest)) == 0;
+}
+
+bool OtaDelta::ReadVarint(uint8_t byte) {
+    if (varint_shift_ > 28) {
+        Fail("varint overflow");
+        return false;
+    }
+    varint_ |= (uint32_t)(byte & 0x7F) << varint_shift_;
+    varint_shift_ += 7;
+    if (byte & 0x80) {
+        return false;
+    }
+    varint_shift_ = 0;
+    return true;
+}
+
+bool OtaDelta::Emit(const uint8_t* data, size_t length) {
+    if (output_size_ + length > target_size_) {
+        return Fail("output exceeds target size");
+    }
+    if (!output_(data, length)) {
+        return Fail("output rejected");
+    }
+    output_size_ += length;
+    return true;
+}
+
+bool OtaDelta::CopyBase(size_t length) {
+    if (src_offset_ + length > base_size_) {
+        return Fail("copy beyond base image");
+    }
+    while (length > 0) {
+        size_t n = std::min(length, sizeof(buffer_));
+        if (esp_partition_read(base_, src_offset_, buffer_, n) != ESP_OK) {
+            return Fail("failed to read base image");
+        }
+        if (!Emit(buffer_, n)) {
+            return false;
+        }
+        src_offset_ += n;
+        length -= n;
+    }
+    return true;
+}
+
+void OtaDelta::FinishOp() {
+    state_ = State::kOpcode;
+}
+
+bool OtaDelta::Feed(const uint8_t* data, size_t length) {
+    size_t pos = 0;
+    while (pos < length) {
+        if (state_ == State::kError) {
+            return false;
+        }
+
+        // Varint arguments may be split across network reads
+        uint32_t value = 0;
+        if (state_ != State::kHeader && state_ != State::kOpcode && state_ != State::kAddLiteral &&
+            state_ != State::kData && state_ != State::kDone) {
+            if (!ReadVarint(data[pos++])) {
+                continue;
+            }
+            value = varint_;
+            varint_ = 0;
+        }
+
+        switch (state_) {
+        case State::kHeader: {
+            size_t n = std::min(length - pos, sizeof(header_) - header_size_);
+            memcpy(header_ + header_size_, data + pos, n);
+            header_size_ += n;
+            pos += n;
+            if (header_size_ == sizeof(header_) && !ParseHeader()) {
+                return false;
+            }
+            break;
+        }
+        case State::kOpcode:
+            switch (data[pos++]) {
+            case OP_END:
+                state_ = State::kDone;
+                break;
+            case OP_COPY:
+                state_ = State::kCopyOffset;
+                break;
+            case OP_ADD:
+                state_ = State::kAddOffset;
+                break;
+            case OP_DATA:
+                state_ = State::kDataLength;
+                break;
+            default:
+                return Fail("unknown opcode");
+            }
+            break;
+        case State::kCopyOffset:
+            src_offset_ = value;
+            state_ = State::kCopyLength;
+            break;
+        case State::kCopyLength:
+            if (!CopyBase(value)) {
+                return false;
+            }
+            FinishOp();
+            break;
+        case State::kAddOffset:
+            src_offset_ = value;
+            state_ = State::kAddLength;
+            break;
+        case State::kAddLength:
+            if (src_offset_ + value > base_size_) {
+                return Fail("add beyond base image");
+            }
+            remaining_ = value;
+            if (remaining_ == 0) {
+                FinishOp();
+            } else {
+                state_ = State::kAddZeroRun;
+            }
+            break;
+        case State::kAddZeroRun:
+            // Unchanged bytes are copied straight from the base
+            if (value > remaining_) {
+                return Fail("bad zero run");
+            }
+            if (!CopyBase(value)) {
+                return false;
+            }
+            remaining_ -= value;
+            state_ = State::kAddLiteralCount;
+            break;
+        case State::kAddLiteralCount:
+            if (value > remaining_) {
+                return Fail("bad literal run");
+            }
+            run_remaining_ = value;
+            if (run_remaining_ > 0) {
+                state_ = State::kAddLiteral;
+            } else if (remaining_ == 0) {
+                FinishOp();
+            } else {
+                state_ = State::kAddZeroRun;
+            }
+            break;
+        case State::kAddLiteral: {
+            size_t n = std::min({length - pos, run_remaining_, sizeof(buffer_)});
+            if (esp_partition_read(base_, src_offset_, buffer_, n) != ESP_OK) {
+                return Fail("failed to read base image");
+            }
+            for (size_t i = 0; i < n; i++) {
+                buffer_[i] += data[pos + i];
+            }
+            if (!Emit(buffer_, n)) {
+                return false;
+            }
+            pos += n;
+            src_offset_ += n;
+            run_remaining_ -= n;
+            remaining_ -= n;
+            if (run_remaining_ == 0) {
+                if (remaining_ == 0) {
+                    FinishOp();
+                } else {
+                    state_ = State::kAddZeroRun;
+                }
+            }
+            break;
+        }
+        case State::kDataLength:
+            remaining_ = value;
+            if (remaining_ == 0) {
+                FinishOp();
+            } else {
+                state_ = State::kData;
+            }
+            break;
+        case State::kData: {
+            size_t n = std::min(length - pos, remaining_);
+            if (!Emit(data + pos, n)) {
+                return false;
+            }
+            pos += n;
+            remaining_ -= n;
+            if (remaining_ == 0) {
+                FinishOp();
+            }
+            break;
+        }
+        case State::kDone:
+            return Fail("trailing data after end of patch");
+        case State::kError:
+            return false;
+        }
+    }
+    return state_ != State::kError;
+}
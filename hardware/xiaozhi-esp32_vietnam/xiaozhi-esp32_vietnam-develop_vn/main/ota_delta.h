@@ -0,0 +1,74 @@
+#ifndef _OTA_DELTA_H
+#define _OTA_DELTA_H
+
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include <esp_partition.h>
+
+// Streaming decoder for delta patches made by scripts/firmware_delta.py.
+// The patch is fed in arbitrary pieces as it arrives from the network, and the
+// reconstructed image is passed to the output callback in order. Only a small
+// read buffer is kept, base bytes are read from the running partition on demand.
+class OtaDelta {
+public:
+    static constexpr const char* kMagic = "XZD1";
+
+    using Output = std::function<bool(const uint8_t* data, size_t length)>;
+
+    OtaDelta(const esp_partition_t* base, Output output);
+
+    static bool IsDelta(const uint8_t* data, size_t length);
+
+    // Returns false if the patch is malformed, made for another base image, or output fails
+    bool Feed(const uint8_t* data, size_t length);
+    bool finished() const { return state_ == State::kDone && output_size_ == target_size_; }
+    size_t target_size() const { return target_size_; }
+
+private:
+    enum class State {
+        kHeader,
+        kOpcode,
+        kCopyOffset,
+        kCopyLength,
+        kAddOffset,
+        kAddLength,
+        kAddZeroRun,
+        kAddLiteralCount,
+        kAddLiteral,
+        kDataLength,
+        kData,
+        kDone,
+        kError,
+    };
+
+    const esp_partition_t* base_;
+    Output output_;
+    State state_ = State::kHeader;
+
+    uint8_t header_[44];
+    size_t header_size_ = 0;
+    size_t base_size_ = 0;
+    size_t target_size_ = 0;
+    size_t output_size_ = 0;
+
+    uint32_t varint_ = 0;
+    int varint_shift_ = 0;
+
+    size_t src_offset_ = 0;
+    size_t remaining_ = 0;      // bytes left in the current COPY/ADD/DATA op
+    size_t run_remaining_ = 0;  // bytes left in the current ADD literal run
+
+    uint8_t buffer_[512];
+
+    bool ReadVarint(uint8_t byte);
+    bool ParseHeader();
+    bool VerifyBase();
+    bool CopyBase(size_t length);
+    bool Emit(const uint8_t* data, size_t length);
+    bool Fail(const char* reason);
+    void FinishOp();
+};
+
+#endif // _OTA_DELTA_H
@@ -12,6 +12,7 @@
 #include "assets/lang_config.h"
 #include "board.h"
 #include "display.h"
+#include "settings.h"
 
 namespace ota {
 namespace {
@@ -499,6 +500,7 @@ Content-Type: application/octet-stream
   httpd_resp_sendstr(req, "{\"success\": true}");
 
   // Delay and reboot.
+  Settings::Flush();
   vTaskDelay(pdMS_TO_TICKS(2000));
   esp_restart();
 
@@ -904,6 +906,7 @@ esp_err_t OtaServer::HandleAssetsUpload(httpd_req_t* req) {
   httpd_resp_sendstr(req, "{\"success\": true}");
 
   // Re-initialize and apply assets.
+  Settings::Flush();
   vTaskDelay(pdMS_TO_TICKS(1000));
   esp_restart();
 
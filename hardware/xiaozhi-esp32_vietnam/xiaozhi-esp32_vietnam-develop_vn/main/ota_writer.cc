@@ -0,0 +1,180 @@
+#include "ota_writer.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "OtaWriter"
+
+OtaWriter::OtaWriter(size_t chunk_size, size_t chunk_count)
+    : chunk_size_(chunk_size), chunk_count_(chunk_count) {
+    mbedtls_sha256_init(&sha256_);
+    mbedtls_sha256_starts(&sha256_, 0);
+}
+
+OtaWriter::~OtaWriter() {
+    if (task_running_) {
+        Finish(false, nullptr);
+    }
+    if (handle_open_) {
+        Abort();
+    }
+    if (chunks_ != nullptr) {
+        for (size_t i = 0; i < chunk_count_; i++) {
+            heap_caps_free(chunks_[i].data);
+        }
+        delete[] chunks_;
+    }
+    if (free_queue_ != nullptr) {
+        vQueueDelete(free_queue_);
+    }
+    if (full_queue_ != nullptr) {
+        vQueueDelete(full_queue_);
+    }
+    if (done_ != nullptr) {
+        vSemaphoreDelete(done_);
+    }
+    mbedtls_sha256_free(&sha256_);
+}
+
+void* OtaWriter::AllocateBuffer(size_t size) {
+#if CONFIG_SPIRAM
+    void* buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buffer != nullptr) {
+        return buffer;
+    }
+#endif
+    return heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+esp_err_t OtaWriter::Begin(const esp_partition_t* partition) {
+    free_queue_ = xQueueCreate(chunk_count_, sizeof(Chunk*));
+    // One more slot for the end marker
+    full_queue_ = xQueueCreate(chunk_count_ + 1, sizeof(Chunk*));
+    done_ = xSemaphoreCreateBinary();
+    chunks_ = new Chunk[chunk_count_]();
+    for (size_t i = 0; i < chunk_count_; i++) {
+        chunks_[i].data = static_cast<uint8_t*>(AllocateBuffer(chunk_size_));
+        if (chunks_[i].data == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate OTA buffer");
+            return ESP_ERR_NO_MEM;
+        }
+        Chunk* chunk = &chunks_[i];
+        xQueueSend(free_queue_, &chunk, 0);
+    }
+
+    // Sequential writes erase each sector just ahead of the write pointer
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to begin OTA: %s", esp_err_to_name(err));
+        return err;
+    }
+    handle_open_ = true;
+
+    if (xTaskCreate(WriterTask, "ota_writer", 4096, this, uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create OTA writer task");
+        Abort();
+        return ESP_ERR_NO_MEM;
+    }
+    task_running_ = true;
+    return ESP_OK;
+}
+
+void OtaWriter::WriterTask(void* arg) {
+    auto self = static_cast<OtaWriter*>(arg);
+    while (true) {
+        Chunk* chunk = nullptr;
+        auto wait_start = esp_timer_get_time();
+        xQueueReceive(self->full_queue_, &chunk, portMAX_DELAY);
+        self->writer_stall_us_ += esp_timer_get_time() - wait_start;
+        // nullptr marks the end of the stream
+        if (chunk == nullptr) {
+            break;
+        }
+        // After a failed write the chunks only go back to the free queue, so Write never blocks for good
+        if (self->error_ == ESP_OK) {
+            mbedtls_sha256_update(&self->sha256_, chunk->data, chunk->length);
+            esp_err_t err = esp_ota_write(self->handle_, chunk->data, chunk->length);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
+                self->error_ = err;
+            }
+        }
+        xQueueSend(self->free_queue_, &chunk, portMAX_DELAY);
+    }
+    xSemaphoreGive(self->done_);
+    vTaskDelete(NULL);
+}
+
+void OtaWriter::SendChunk() {
+    if (first_chunk_) {
+        if (on_first_chunk) {
+            on_first_chunk(chunk_->data, chunk_->length);
+        }
+        first_chunk_ = false;
+    }
+    xQueueSend(full_queue_, &chunk_, portMAX_DELAY);
+    chunk_ = nullptr;
+}
+
+bool OtaWriter::Write(const uint8_t* data, size_t length) {
+    // Fill whole chunks so the writer always programs full sectors
+    while (length > 0 && error_ == ESP_OK) {
+        if (chunk_ == nullptr) {
+            // Waiting here means flash writes are slower than the network
+            auto wait_start = esp_timer_get_time();
+            xQueueReceive(free_queue_, &chunk_, portMAX_DELAY);
+            reader_stall_us_ += esp_timer_get_time() - wait_start;
+            chunk_->length = 0;
+        }
+        size_t n = std::min(length, chunk_size_ - chunk_->length);
+        memcpy(chunk_->data + chunk_->length, data, n);
+        chunk_->length += n;
+        data += n;
+        length -= n;
+        if (chunk_->length == chunk_size_) {
+            SendChunk();
+        }
+    }
+    return error_ == ESP_OK;
+}
+
+esp_err_t OtaWriter::Finish(bool flush, uint8_t sha256[32]) {
+    if (!task_running_) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (chunk_ != nullptr) {
+        if (chunk_->length > 0 && flush) {
+            SendChunk();
+        } else {
+            xQueueSend(free_queue_, &chunk_, portMAX_DELAY);
+            chunk_ = nullptr;
+        }
+    }
+
+    Chunk* end_marker = nullptr;
+    xQueueSend(full_queue_, &end_marker, portMAX_DELAY);
+    xSemaphoreTake(done_, portMAX_DELAY);
+    task_running_ = false;
+
+    if (sha256 != nullptr) {
+        mbedtls_sha256_finish(&sha256_, sha256);
+    }
+    return error_;
+}
+
+esp_err_t OtaWriter::End() {
+    handle_open_ = false;
+    return esp_ota_end(handle_);
+}
+
+void OtaWriter::Abort() {
+    if (handle_open_) {
+        esp_ota_abort(handle_);
+        handle_open_ = false;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef _OTA_WRITER_H
+#define _OTA_WRITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <esp_err.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+
+// Writes a firmware image into an OTA partition. The caller fills large chunks
+// while a writer task programs them into flash, so network receive and flash
+// erase/write overlap. The chunks go back and forth between a free and a full
+// queue, nothing is allocated after Begin.
+class OtaWriter {
+public:
+    OtaWriter(size_t chunk_size, size_t chunk_count);
+    ~OtaWriter();
+
+    OtaWriter(const OtaWriter&) = delete;
+    OtaWriter& operator=(const OtaWriter&) = delete;
+
+    // Allocates the chunks, opens the partition and starts the writer task
+    esp_err_t Begin(const esp_partition_t* partition);
+    // Copies data into chunks and hands each full one to the writer task, blocks
+    // while all chunks are waiting for flash. Returns false once a write failed.
+    bool Write(const uint8_t* data, size_t length);
+    // Hands over the last partial chunk if flush is set, waits for the writer
+    // task and returns the first write error. sha256 gets the hash of every
+    // byte passed to esp_ota_write.
+    esp_err_t Finish(bool flush, uint8_t sha256[32]);
+    // esp_ota_end or esp_ota_abort, after Finish
+    esp_err_t End();
+    void Abort();
+
+    // Called with the first full chunk, before it is written
+    std::function<void(const uint8_t* data, size_t length)> on_first_chunk;
+
+    // Time the writer task waited for the network, and Write waited for flash
+    int64_t writer_stall_us() const { return writer_stall_us_; }
+    int64_t reader_stall_us() const { return reader_stall_us_; }
+
+    // PSRAM if there is any, internal RAM otherwise
+    static void* AllocateBuffer(size_t size);
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t length;
+    };
+
+    static void WriterTask(void* arg);
+    void SendChunk();
+
+    size_t chunk_size_;
+    size_t chunk_count_;
+    Chunk* chunks_ = nullptr;
+    Chunk* chunk_ = nullptr;        // Being filled by Write
+    bool first_chunk_ = true;
+
+    esp_ota_handle_t handle_ = 0;
+    bool handle_open_ = false;
+    bool task_running_ = false;
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t full_queue_ = nullptr;
+    SemaphoreHandle_t done_ = nullptr;
+    mbedtls_sha256_context sha256_;
+    std::atomic<esp_err_t> error_{ESP_OK};
+    std::atomic<int64_t> writer_stall_us_{0};
+    int64_t reader_stall_us_ = 0;
+};
+
+#endif // _OTA_WRITER_H
@@ -0,0 +1,94 @@
+#include "partition_writer.h"
+
+#include <esp_rom_crc.h>
+#include <algorithm>
+#include <vector>
+
+static size_t AlignUp(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+void PartitionWriter::Begin(const State& state) {
+    state_ = state;
+    committed_ = state;
+    // 断点所在扇区已经写过，只擦除后面的扇区
+    erased_end_ = AlignUp(state.offset, flash_.sector_size());
+    erased_sectors_ = 0;
+}
+
+void PartitionWriter::Rollback() {
+    size_t sector_size = flash_.sector_size();
+    size_t aligned = committed_.offset / sector_size * sector_size;
+    if (aligned != committed_.offset && committed_.offset != committed_.content_length) {
+        // 旧固件留下的非对齐断点，回退到扇区起点，重写时整个扇区重新擦除
+        committed_.crc = CalculateCrc(flash_, 0, aligned, 0);
+        committed_.offset = aligned;
+    }
+    state_ = committed_;
+    erased_end_ = AlignUp(committed_.offset, sector_size);
+}
+
+esp_err_t PartitionWriter::Write(const void* data, size_t size, bool& committed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t sector_size = flash_.sector_size();
+    committed = false;
+
+    while (size > 0) {
+        size_t sector_end = (state_.offset / sector_size + 1) * sector_size;
+        if (state_.offset >= erased_end_) {
+            if (sector_end > flash_.size()) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            esp_err_t err = flash_.Erase(sector_end - sector_size, sector_size);
+            if (err != ESP_OK) {
+                return err;
+            }
+            erased_end_ = sector_end;
+            erased_sectors_++;
+        }
+
+        size_t chunk = std::min(size, sector_end - state_.offset);
+        esp_err_t err = flash_.Write(state_.offset, bytes, chunk);
+        if (err != ESP_OK) {
+            return err;
+        }
+        state_.offset += chunk;
+        state_.crc = esp_rom_crc32_le(state_.crc, bytes, chunk);
+        bytes += chunk;
+        size -= chunk;
+
+        bool block_done = state_.offset == sector_end && state_.offset - committed_.offset >= block_size_;
+        if (block_done || state_.offset == state_.content_length) {
+            err = Commit();
+            if (err != ESP_OK) {
+                return err;
+            }
+            committed = true;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t PartitionWriter::Commit() {
+    uint32_t flash_crc = CalculateCrc(flash_, committed_.offset, state_.offset - committed_.offset, committed_.crc);
+    if (flash_crc != state_.crc) {
+        Rollback();
+        return ESP_ERR_INVALID_CRC;
+    }
+    committed_ = state_;
+    return ESP_OK;
+}
+
+uint32_t PartitionWriter::CalculateCrc(FlashRegion& flash, size_t offset, size_t length, uint32_t crc) {
+    std::vector<uint8_t> buffer(4096);
+    while (length > 0) {
+        size_t chunk = std::min(length, buffer.size());
+        if (flash.Read(offset, buffer.data(), chunk) != ESP_OK) {
+            return ~crc;
+        }
+        crc = esp_rom_crc32_le(crc, buffer.data(), chunk);
+        offset += chunk;
+        length -= chunk;
+    }
+    return crc;
+}
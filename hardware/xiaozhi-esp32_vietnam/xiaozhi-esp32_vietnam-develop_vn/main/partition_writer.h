@@ -0,0 +1,63 @@
+#ifndef PARTITION_WRITER_H
+#define PARTITION_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_err.h>
+
+// Raw flash access used by PartitionWriter, backed by an esp_partition_t on the
+// device and by an in-memory NOR flash model in the host tests.
+class FlashRegion {
+public:
+    virtual ~FlashRegion() = default;
+    virtual size_t size() const = 0;
+    virtual size_t sector_size() const = 0;
+    virtual esp_err_t Erase(size_t offset, size_t size) = 0;
+    virtual esp_err_t Write(size_t offset, const void* data, size_t size) = 0;
+    virtual esp_err_t Read(size_t offset, void* data, size_t size) = 0;
+};
+
+// Writes a resumable download sequentially into a flash region.
+//
+// Sectors are erased right before the first byte lands in them. Checkpoints are
+// only committed on sector boundaries (or at the end of the content), after the
+// written range has been read back and matched against the running CRC, so a
+// resume always starts on a fresh sector and never erases committed bytes.
+class PartitionWriter {
+public:
+    struct State {
+        size_t offset = 0;
+        size_t content_length = 0;
+        uint32_t crc = 0;
+    };
+
+    PartitionWriter(FlashRegion& flash, size_t block_size) : flash_(flash), block_size_(block_size) {}
+
+    // Starts writing at state.offset. Checkpoints written by older firmware may
+    // be unaligned, the sector holding them is kept and only later sectors are erased.
+    void Begin(const State& state);
+    // Appends data, committed is set when a new checkpoint has been verified.
+    // ESP_ERR_INVALID_CRC means the read back failed and the writer rolled back.
+    esp_err_t Write(const void* data, size_t size, bool& committed);
+    // Drops everything after the last committed checkpoint
+    void Rollback();
+
+    const State& state() const { return state_; }
+    const State& committed() const { return committed_; }
+    size_t erased_sectors() const { return erased_sectors_; }
+
+    // CRC32 of a flash range chained onto crc, ~crc if the range cannot be read
+    static uint32_t CalculateCrc(FlashRegion& flash, size_t offset, size_t length, uint32_t crc);
+
+private:
+    esp_err_t Commit();
+
+    FlashRegion& flash_;
+    size_t block_size_;
+    State state_;
+    State committed_;
+    size_t erased_end_ = 0;
+    size_t erased_sectors_ = 0;
+};
+
+#endif // PARTITION_WRITER_H
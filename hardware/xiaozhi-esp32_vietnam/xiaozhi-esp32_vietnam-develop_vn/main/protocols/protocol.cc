@@ -1,4 +1,5 @@
 #include "protocol.h"
+#include "json_writer.h"
 
 #include <esp_log.h>
 
@@ -40,41 +41,70 @@ void Protocol::SetError(const std::string& message) {
 }
 
 void Protocol::SendAbortSpeaking(AbortReason reason) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
+    std::string message;
+    message.reserve(96);
+    JsonWriter json(message);
+    json.BeginObject().Field("session_id", session_id_).Field("type", "abort");
     if (reason == kAbortReasonWakeWordDetected) {
-        message += ",\"reason\":\"wake_word_detected\"";
+        json.Field("reason", "wake_word_detected");
     }
-    message += "}";
+    json.EndObject();
     SendText(message);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
-    std::string json = "{\"session_id\":\"" + session_id_ + 
-                      "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    std::string message;
+    message.reserve(96 + wake_word.size());
+    JsonWriter json(message);
+    json.BeginObject()
+        .Field("session_id", session_id_)
+        .Field("type", "listen")
+        .Field("state", "detect")
+        .Field("text", wake_word)
+        .EndObject();
+    SendText(message);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
-    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    std::string message;
+    message.reserve(112);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Field("session_id", session_id_)
+        .Field("type", "listen")
+        .Field("state", "start");
     if (mode == kListeningModeRealtime) {
-        message += ",\"mode\":\"realtime\"";
+        json.Field("mode", "realtime");
     } else if (mode == kListeningModeAutoStop) {
-        message += ",\"mode\":\"auto\"";
+        json.Field("mode", "auto");
     } else {
-        message += ",\"mode\":\"manual\"";
+        json.Field("mode", "manual");
     }
-    message += "}";
+    json.EndObject();
     SendText(message);
 }
 
 void Protocol::SendStopListening() {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
+    std::string message;
+    message.reserve(96);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Field("session_id", session_id_)
+        .Field("type", "listen")
+        .Field("state", "stop")
+        .EndObject();
     SendText(message);
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
+    std::string message;
+    message.reserve(payload.size() + 96);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Field("session_id", session_id_)
+        .Field("type", "mcp")
+        .Key("payload").Raw(payload)
+        .EndObject();
     SendText(message);
 }
 
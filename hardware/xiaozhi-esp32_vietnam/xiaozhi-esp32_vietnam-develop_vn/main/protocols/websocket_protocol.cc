@@ -3,6 +3,7 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "json_writer.h"
 
 #include <cstring>
 #include <cJSON.h>
@@ -201,26 +202,26 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
 std::string WebsocketProtocol::GetHelloMessage() {
     // keys: message type, version, audio_params (format, sample_rate, channels)
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", version_);
-    cJSON* features = cJSON_CreateObject();
+    std::string message;
+    message.reserve(192);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Field("type", "hello")
+        .Field("version", version_);
+    json.Key("features").BeginObject();
 #if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+    json.Field("aec", true);
 #endif
-    cJSON_AddBoolToObject(features, "mcp", true);
-    cJSON_AddItemToObject(root, "features", features);
-    cJSON_AddStringToObject(root, "transport", "websocket");
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string message(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
+    json.Field("mcp", true);
+    json.EndObject();
+    json.Field("transport", "websocket");
+    json.Key("audio_params").BeginObject()
+        .Field("format", "opus")
+        .Field("sample_rate", 16000)
+        .Field("channels", 1)
+        .Field("frame_duration", OPUS_FRAME_DURATION_MS)
+        .EndObject();
+    json.EndObject();
     return message;
 }
 
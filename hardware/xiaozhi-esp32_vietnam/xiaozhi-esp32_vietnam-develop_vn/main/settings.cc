@@ -1,88 +1,402 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #define TAG "Settings"
 
-Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
+// 最后一次修改后等待这么久再写入 flash，期间的修改合并成一次写入
+#define SETTINGS_COMMIT_DELAY_US (1000 * 1000)
+// 持续修改时（比如一直在调音量）最多推迟这么久
+#define SETTINGS_COMMIT_MAX_DELAY_US (5000 * 1000)
+// 写 flash 的任务，优先级低于音频和主循环，不占用共享的 esp_timer 任务
+#define SETTINGS_COMMIT_TASK_STACK_SIZE 4096
+#define SETTINGS_COMMIT_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+
+enum class SettingsType : uint8_t {
+    kString,
+    kInt,
+    kBool,
+};
+
+struct SettingsNamespace {
+    struct Entry {
+        SettingsType type = SettingsType::kString;
+        bool present = false;   // false: NVS 中没有这个键，或者已被擦除
+        bool dirty = false;     // 还没有写回 NVS
+        std::string str;
+        int32_t num = 0;
+    };
+
+    std::string name;
+    std::mutex mutex;
+    nvs_handle_t handle = 0;
+    bool cached = true;         // false: 其他组件也直接写这个命名空间，读取总是回到 NVS
+    bool writable = false;
+    bool missing = false;       // 只读打开失败，命名空间还不存在
+    bool has_dirty = false;
+    std::map<std::string, Entry> entries;
+
+    bool OpenLocked(bool write);
+    Entry& LoadLocked(const std::string& key, SettingsType type);
+};
+
+bool SettingsNamespace::OpenLocked(bool write) {
+    if (handle != 0 && (writable || !write)) {
+        return true;
+    }
+    if (!write && missing && cached) {
+        return false;
+    }
+    if (handle != 0) {
+        nvs_close(handle);
+        handle = 0;
+    }
+
+    esp_err_t err = nvs_open(name.c_str(), write ? NVS_READWRITE : NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        handle = 0;
+        if (write) {
+            ESP_LOGE(TAG, "Failed to open namespace %s: %s", name.c_str(), esp_err_to_name(err));
+        } else {
+            missing = true;
+        }
+        return false;
+    }
+    writable = write;
+    missing = false;
+    return true;
 }
 
-Settings::~Settings() {
-    if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
+// Returns the cached entry, reading it from NVS on the first access. A missing
+// key is cached too, so repeated lookups of unset keys stay off the flash.
+SettingsNamespace::Entry& SettingsNamespace::LoadLocked(const std::string& key, SettingsType type) {
+    auto it = entries.find(key);
+    if (it != entries.end() && (it->second.dirty || (cached && it->second.type == type))) {
+        return it->second;
+    }
+
+    Entry entry;
+    entry.type = type;
+    if (OpenLocked(false)) {
+        switch (type) {
+            case SettingsType::kString: {
+                size_t length = 0;
+                if (nvs_get_str(handle, key.c_str(), nullptr, &length) == ESP_OK) {
+                    entry.str.resize(length);
+                    if (nvs_get_str(handle, key.c_str(), entry.str.data(), &length) == ESP_OK) {
+                        while (!entry.str.empty() && entry.str.back() == '\0') {
+                            entry.str.pop_back();
+                        }
+                        entry.present = true;
+                    } else {
+                        entry.str.clear();
+                    }
+                }
+                break;
+            }
+            case SettingsType::kInt:
+                entry.present = nvs_get_i32(handle, key.c_str(), &entry.num) == ESP_OK;
+                break;
+            case SettingsType::kBool: {
+                uint8_t value;
+                if (nvs_get_u8(handle, key.c_str(), &value) == ESP_OK) {
+                    entry.num = value != 0;
+                    entry.present = true;
+                }
+                break;
+            }
         }
-        nvs_close(nvs_handle_);
     }
+
+    Entry& slot = entries[key];
+    slot = std::move(entry);
+    return slot;
 }
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
+class SettingsStore {
+public:
+    static SettingsStore& GetInstance() {
+        static SettingsStore instance;
+        return instance;
     }
 
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+    SettingsNamespace* GetNamespace(const std::string& ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& shard = namespaces_[ns];
+        if (!shard) {
+            shard = std::make_unique<SettingsNamespace>();
+            shard->name = ns;
+            // esp-wifi-connect 的 SsidManager 直接用 NVS 读写 "wifi"，缓存会过期
+            shard->cached = ns != "wifi";
+        }
+        return shard.get();
+    }
+
+    // Stores a new value (or an erase when entry.present is false). Returns
+    // without touching anything when the value did not change.
+    void Store(SettingsNamespace* shard, const std::string& key, SettingsNamespace::Entry entry) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            if (entry.present) {
+                auto& current = shard->LoadLocked(key, entry.type);
+                if (current.present && current.type == entry.type && current.num == entry.num && current.str == entry.str) {
+                    return;
+                }
+            } else {
+                // A clean miss only says the key is not stored with that type,
+                // so only a pending erase can be skipped
+                auto it = shard->entries.find(key);
+                if (it != shard->entries.end() && it->second.dirty && !it->second.present) {
+                    return;
+                }
+            }
+            auto& current = shard->entries[key];
+            current = std::move(entry);
+            current.dirty = true;
+            shard->has_dirty = true;
+        }
+        ScheduleCommit();
+        Notify(shard->name, key);
+    }
+
+    void EraseAll(SettingsNamespace* shard) {
+        {
+            std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->entries.clear();
+            shard->has_dirty = false;
+            if (shard->OpenLocked(true)) {
+                esp_err_t err = nvs_erase_all(shard->handle);
+                if (err == ESP_OK) {
+                    err = nvs_commit(shard->handle);
+                }
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to erase namespace %s: %s", shard->name.c_str(), esp_err_to_name(err));
+                }
+            }
+        }
+        Notify(shard->name, "");
+    }
+
+    void AddChangeListener(Settings::ChangeCallback callback) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners_.push_back(std::move(callback));
+    }
+
+    void Flush() {
+        std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+        std::vector<SettingsNamespace*> shards;
+        uint32_t changes;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& [name, shard] : namespaces_) {
+                shards.push_back(shard.get());
+            }
+            changes = pending_changes_;
+            pending_changes_ = 0;
+            first_pending_us_ = 0;
+        }
+        if (changes == 0) {
+            return;
+        }
+
+        int written = 0;
+        for (auto shard : shards) {
+            // 先在锁内取出待写的条目，写 flash 时不阻塞其他任务读取设置
+            std::vector<std::pair<std::string, SettingsNamespace::Entry>> pending;
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                if (!shard->has_dirty) {
+                    continue;
+                }
+                if (!shard->OpenLocked(true)) {
+                    continue;
+                }
+                for (auto& [key, entry] : shard->entries) {
+                    if (entry.dirty) {
+                        pending.emplace_back(key, entry);
+                        entry.dirty = false;
+                    }
+                }
+                shard->has_dirty = false;
+            }
+
+            for (auto& [key, entry] : pending) {
+                esp_err_t err;
+                if (!entry.present) {
+                    err = nvs_erase_key(shard->handle, key.c_str());
+                    if (err == ESP_ERR_NVS_NOT_FOUND) {
+                        err = ESP_OK;
+                    }
+                } else if (entry.type == SettingsType::kString) {
+                    err = nvs_set_str(shard->handle, key.c_str(), entry.str.c_str());
+                } else if (entry.type == SettingsType::kInt) {
+                    err = nvs_set_i32(shard->handle, key.c_str(), entry.num);
+                } else {
+                    err = nvs_set_u8(shard->handle, key.c_str(), entry.num ? 1 : 0);
+                }
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to write %s.%s: %s", shard->name.c_str(), key.c_str(), esp_err_to_name(err));
+                    continue;
+                }
+                written++;
+            }
+
+            esp_err_t err = nvs_commit(shard->handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to commit namespace %s: %s", shard->name.c_str(), esp_err_to_name(err));
+            }
+        }
+        ESP_LOGI(TAG, "Committed %d settings for %lu changes", written, (unsigned long)changes);
     }
 
-    std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+private:
+    std::mutex mutex_;          // namespaces_, listeners_ 和提交计时
+    std::mutex flush_mutex_;    // 同一时间只有一个任务写 flash
+    std::map<std::string, std::unique_ptr<SettingsNamespace>> namespaces_;
+    std::vector<Settings::ChangeCallback> listeners_;
+    esp_timer_handle_t commit_timer_ = nullptr;
+    TaskHandle_t commit_task_ = nullptr;
+    int64_t first_pending_us_ = 0;
+    uint32_t pending_changes_ = 0;
+
+    SettingsStore() {
+        auto ret = xTaskCreate([](void* arg) {
+            auto store = static_cast<SettingsStore*>(arg);
+            while (true) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                store->Flush();
+            }
+        }, "settings_commit", SETTINGS_COMMIT_TASK_STACK_SIZE, this, SETTINGS_COMMIT_TASK_PRIORITY, &commit_task_);
+        if (ret != pdPASS) {
+            commit_task_ = nullptr;
+            ESP_LOGW(TAG, "Failed to create the commit task, committing on the timer task");
+        }
+
+        // 计时器只负责唤醒提交任务，NVS 写入和擦除不在 esp_timer 任务里执行
+        esp_timer_create_args_t commit_timer_args = {
+            .callback = [](void* arg) {
+                auto store = static_cast<SettingsStore*>(arg);
+                if (store->commit_task_ != nullptr) {
+                    xTaskNotifyGive(store->commit_task_);
+                } else {
+                    store->Flush();
+                }
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "settings_commit",
+            .skip_unhandled_events = true
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&commit_timer_args, &commit_timer_));
+
+        // esp_restart() 之前把还没写入的设置写回 flash
+        esp_register_shutdown_handler([]() {
+            SettingsStore::GetInstance().Flush();
+        });
     }
-    return value;
+
+    void ScheduleCommit() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_changes_++;
+        int64_t now = esp_timer_get_time();
+        if (first_pending_us_ == 0) {
+            first_pending_us_ = now;
+        }
+        if (esp_timer_is_active(commit_timer_)) {
+            // Keep the running deadline once the oldest change has waited long enough
+            if (now + SETTINGS_COMMIT_DELAY_US - first_pending_us_ > SETTINGS_COMMIT_MAX_DELAY_US) {
+                return;
+            }
+            esp_timer_stop(commit_timer_);
+        }
+        esp_timer_start_once(commit_timer_, SETTINGS_COMMIT_DELAY_US);
+    }
+
+    void Notify(const std::string& ns, const std::string& key) {
+        std::vector<Settings::ChangeCallback> listeners;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            listeners = listeners_;
+        }
+        for (auto& listener : listeners) {
+            listener(ns, key);
+        }
+    }
+};
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+    shard_ = SettingsStore::GetInstance().GetNamespace(ns);
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    std::lock_guard<std::mutex> lock(shard_->mutex);
+    auto& entry = shard_->LoadLocked(key, SettingsType::kString);
+    if (!entry.present || entry.type != SettingsType::kString) {
+        return default_value;
+    }
+    return entry.str;
 }
 
 void Settings::SetString(const std::string& key, const std::string& value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
+        SettingsNamespace::Entry entry;
+        entry.type = SettingsType::kString;
+        entry.present = true;
+        entry.str = value;
+        SettingsStore::GetInstance().Store(shard_, key, std::move(entry));
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
 
 int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
-    int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
+    std::lock_guard<std::mutex> lock(shard_->mutex);
+    auto& entry = shard_->LoadLocked(key, SettingsType::kInt);
+    if (!entry.present || entry.type != SettingsType::kInt) {
         return default_value;
     }
-    return value;
+    return entry.num;
 }
 
 void Settings::SetInt(const std::string& key, int32_t value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
+        SettingsNamespace::Entry entry;
+        entry.type = SettingsType::kInt;
+        entry.present = true;
+        entry.num = value;
+        SettingsStore::GetInstance().Store(shard_, key, std::move(entry));
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
 
 bool Settings::GetBool(const std::string& key, bool default_value) {
-    if (nvs_handle_ == 0) {
+    std::lock_guard<std::mutex> lock(shard_->mutex);
+    auto& entry = shard_->LoadLocked(key, SettingsType::kBool);
+    if (!entry.present || entry.type != SettingsType::kBool) {
         return default_value;
     }
-
-    uint8_t value;
-    if (nvs_get_u8(nvs_handle_, key.c_str(), &value) != ESP_OK) {
-        return default_value;
-    }
-    return value != 0;
+    return entry.num != 0;
 }
 
 void Settings::SetBool(const std::string& key, bool value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_u8(nvs_handle_, key.c_str(), value ? 1 : 0));
-        dirty_ = true;
+        SettingsNamespace::Entry entry;
+        entry.type = SettingsType::kBool;
+        entry.present = true;
+        entry.num = value ? 1 : 0;
+        SettingsStore::GetInstance().Store(shard_, key, std::move(entry));
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -90,10 +404,9 @@ void Settings::SetBool(const std::string& key, bool value) {
 
 void Settings::EraseKey(const std::string& key) {
     if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
+        SettingsNamespace::Entry entry;
+        entry.present = false;
+        SettingsStore::GetInstance().Store(shard_, key, std::move(entry));
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -101,8 +414,16 @@ void Settings::EraseKey(const std::string& key) {
 
 void Settings::EraseAll() {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
+        SettingsStore::GetInstance().EraseAll(shard_);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
+
+void Settings::Flush() {
+    SettingsStore::GetInstance().Flush();
+}
+
+void Settings::AddChangeListener(ChangeCallback callback) {
+    SettingsStore::GetInstance().AddChangeListener(std::move(callback));
+}
@@ -2,12 +2,22 @@
 #define SETTINGS_H
 
 #include <string>
+#include <functional>
 #include <nvs_flash.h>
 
+struct SettingsNamespace;
+
+// Settings are cached per namespace for the whole process. Reads hit NVS only
+// the first time a key is seen; writes update the cache and are written back
+// by a debounced commit on a low priority task, so a burst of changes (like
+// turning the volume knob) costs a single flash write per key. Pending writes
+// are also flushed on esp_restart(); power off and deep sleep paths call Flush().
+// The "wifi" namespace is also written by esp-wifi-connect, so its reads are not cached.
 class Settings {
 public:
+    using ChangeCallback = std::function<void(const std::string& ns, const std::string& key)>;
+
     Settings(const std::string& ns, bool read_write = false);
-    ~Settings();
 
     std::string GetString(const std::string& key, const std::string& default_value = "");
     void SetString(const std::string& key, const std::string& value);
@@ -18,11 +28,15 @@ public:
     void EraseKey(const std::string& key);
     void EraseAll();
 
+    // Writes all pending changes to NVS now
+    static void Flush();
+    // Called after a key changes value or is erased (empty key for EraseAll)
+    static void AddChangeListener(ChangeCallback callback);
+
 private:
     std::string ns_;
-    nvs_handle_t nvs_handle_ = 0;
+    SettingsNamespace* shard_ = nullptr;
     bool read_write_ = false;
-    bool dirty_ = false;
 };
 
 #endif
@@ -0,0 +1,103 @@
+#ifndef _SMALL_TASK_H_
+#define _SMALL_TASK_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable for main loop work. Callables up to kInlineSize
+// bytes (a few pointers plus a std::string) are stored inside the task, so
+// scheduling them does not touch the heap; larger ones fall back to new.
+class SmallTask {
+public:
+    static constexpr size_t kInlineSize = 40;
+
+    SmallTask() = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SmallTask>>>
+    SmallTask(F&& callable) {
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible_v<Fn>) {
+            new (storage_) Fn(std::forward<F>(callable));
+            ops_ = &kInlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(callable));
+            ops_ = &kHeapOps<Fn>;
+        }
+    }
+
+    SmallTask(SmallTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    SmallTask& operator=(SmallTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    SmallTask(const SmallTask&) = delete;
+    SmallTask& operator=(const SmallTask&) = delete;
+
+    ~SmallTask() {
+        Reset();
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+    bool is_inline() const { return ops_ != nullptr && !ops_->heap; }
+
+    void operator()() {
+        ops_->invoke(storage_);
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);     // move into dst and destroy src
+        void (*destroy)(void* storage);
+        bool heap;
+    };
+
+    template<typename Fn>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<Fn*>(storage))(); },
+        [](void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* storage) { static_cast<Fn*>(storage)->~Fn(); },
+        false,
+    };
+
+    template<typename Fn>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<Fn**>(storage))(); },
+        [](void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+        [](void* storage) { delete *static_cast<Fn**>(storage); },
+        true,
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+
+    void MoveFrom(SmallTask& other) {
+        if (other.ops_ != nullptr) {
+            other.ops_->move(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+};
+
+#endif // _SMALL_TASK_H_
@@ -17,6 +17,7 @@ import shutil
 import sys
 import json
 import struct
+import zlib
 from datetime import datetime
 
 
@@ -215,7 +216,122 @@ def process_text_font(text_font_file, assets_dir):
     return None
 
 
-def process_emoji_collection(emoji_collection_dir, assets_dir):
+# =============================================================================
+# Native emoji conversion (PNG -> LVGL v9 binary image)
+# =============================================================================
+
+LV_IMAGE_HEADER_MAGIC = 0x19
+LV_COLOR_FORMAT_RGB565A8 = 0x14
+
+
+def decode_png_rgba(png_path):
+    """
+    Decode a non-interlaced 8-bit PNG (gray, RGB, palette, gray+alpha or RGBA)
+    Returns (width, height, rgba_bytes) or None if the PNG is not supported
+    """
+    with open(png_path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        return None
+
+    pos = 8
+    width = height = bit_depth = color_type = interlace = 0
+    palette = b''
+    transparency = b''
+    idat = bytearray()
+    while pos < len(data):
+        length, chunk_type = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if chunk_type == b'IHDR':
+            width, height, bit_depth, color_type, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif chunk_type == b'PLTE':
+            palette = chunk
+        elif chunk_type == b'tRNS':
+            transparency = chunk
+        elif chunk_type == b'IDAT':
+            idat.extend(chunk)
+        elif chunk_type == b'IEND':
+            break
+
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(color_type)
+    if bit_depth != 8 or interlace != 0 or channels is None:
+        return None
+
+    raw = zlib.decompress(bytes(idat))
+    stride = width * channels
+    pixels = bytearray(height * stride)
+    prev = bytearray(stride)
+    offset = 0
+    for y in range(height):
+        filter_type = raw[offset]
+        line = bytearray(raw[offset + 1:offset + 1 + stride])
+        offset += 1 + stride
+        for x in range(stride):
+            a = line[x - channels] if x >= channels else 0
+            b = prev[x]
+            c = prev[x - channels] if x >= channels else 0
+            if filter_type == 1:
+                line[x] = (line[x] + a) & 0xFF
+            elif filter_type == 2:
+                line[x] = (line[x] + b) & 0xFF
+            elif filter_type == 3:
+                line[x] = (line[x] + ((a + b) >> 1)) & 0xFF
+            elif filter_type == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                predictor = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[x] = (line[x] + predictor) & 0xFF
+        pixels[y * stride:(y + 1) * stride] = line
+        prev = line
+
+    rgba = bytearray(width * height * 4)
+    for i in range(width * height):
+        px = pixels[i * channels:(i + 1) * channels]
+        if color_type == 0:
+            r = g = b = px[0]
+            alpha = 255
+        elif color_type == 2:
+            r, g, b = px
+            alpha = 255
+        elif color_type == 3:
+            index = px[0]
+            r, g, b = palette[index * 3:index * 3 + 3]
+            alpha = transparency[index] if index < len(transparency) else 255
+        elif color_type == 4:
+            r = g = b = px[0]
+            alpha = px[1]
+        else:
+            r, g, b, alpha = px
+        rgba[i * 4:i * 4 + 4] = bytes((r, g, b, alpha))
+    return width, height, rgba
+
+
+def convert_png_to_rgb565a8(png_path, bin_path):
+    """
+    Convert a PNG to an LVGL v9 RGB565A8 binary image, which the firmware
+    draws straight from the mmapped assets partition without decoding
+    """
+    decoded = decode_png_rgba(png_path)
+    if decoded is None:
+        return False
+
+    width, height, rgba = decoded
+    color_plane = bytearray()
+    alpha_plane = bytearray()
+    for i in range(width * height):
+        r, g, b, alpha = rgba[i * 4:i * 4 + 4]
+        color_plane += struct.pack('<H', ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3))
+        alpha_plane.append(alpha)
+
+    header = struct.pack('<BBHHHHH', LV_IMAGE_HEADER_MAGIC, LV_COLOR_FORMAT_RGB565A8, 0,
+                         width, height, width * 2, 0)
+    with open(bin_path, 'wb') as f:
+        f.write(header + color_plane + alpha_plane)
+    return True
+
+
+def process_emoji_collection(emoji_collection_dir, assets_dir, native_format=False):
     """Process emoji_collection parameter"""
     if not emoji_collection_dir:
         return []
@@ -226,13 +342,25 @@ def process_emoji_collection(emoji_collection_dir, assets_dir):
     for root, dirs, files in os.walk(emoji_collection_dir):
         for file in files:
             if file.lower().endswith(('.png', '.gif')):
-                # Copy file
                 src_file = os.path.join(root, file)
+                # Get filename without extension
+                filename_without_ext = os.path.splitext(file)[0]
+
+                # Static PNGs can be stored in the panel pixel format, GIFs stay animated
+                if native_format and file.lower().endswith('.png'):
+                    bin_file = filename_without_ext + '.bin'
+                    if convert_png_to_rgb565a8(src_file, os.path.join(assets_dir, bin_file)):
+                        print(f"Converted: {src_file} -> {bin_file} (RGB565A8)")
+                        emoji_list.append({
+                            "name": filename_without_ext,
+                            "file": bin_file
+                        })
+                        continue
+                    print(f"Warning: Unsupported PNG layout, keeping {file} as PNG")
+
+                # Copy file
                 dst_file = os.path.join(assets_dir, file)
                 if copy_file(src_file, dst_file):
-                    # Get filename without extension
-                    filename_without_ext = os.path.splitext(file)[0]
-                    
                     # Add to emoji list
                     emoji_list.append({
                         "name": filename_without_ext,
@@ -272,10 +400,11 @@ def process_extra_files(extra_files_dir, assets_dir):
     return extra_files_list
 
 
-def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files=None, multinet_model_info=None):
+def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files=None, multinet_model_info=None, compressed=False):
     """Generate index.json file"""
     index_data = {
-        "version": 1
+        # Version 2 may contain compressed entries that older firmware cannot read
+        "version": 2 if compressed else 1
     }
     
     if srmodels:
@@ -344,10 +473,65 @@ def sort_key(filename):
     return extension, basename
 
 
-def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32):
+def _lz4_write_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def lz4_compress_block(data):
+    """
+    Greedy LZ4 block compressor (raw block format, no frame header),
+    decoded on the device by Lz4Decompress in main/lz4_block.cc
+    """
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    # LZ4 keeps the last 5 bytes as literals and starts no match in the last 12
+    match_limit = n - 12
+    while i < match_limit:
+        seq = data[i:i + 4]
+        ref = table.get(seq)
+        table[seq] = i
+        if ref is None or i - ref > 0xFFFF:
+            i += 1
+            continue
+
+        match_len = 4
+        end_limit = n - 5
+        while i + match_len < end_limit and data[ref + match_len] == data[i + match_len]:
+            match_len += 1
+
+        literal_len = i - anchor
+        out.append((min(literal_len, 15) << 4) | min(match_len - 4, 15))
+        if literal_len >= 15:
+            _lz4_write_length(out, literal_len - 15)
+        out += data[anchor:i]
+        out += (i - ref).to_bytes(2, byteorder='little')
+        if match_len - 4 >= 15:
+            _lz4_write_length(out, match_len - 4 - 15)
+        i += match_len
+        anchor = i
+
+    literal_len = n - anchor
+    out.append(min(literal_len, 15) << 4)
+    if literal_len >= 15:
+        _lz4_write_length(out, literal_len - 15)
+    out += data[anchor:]
+    return bytes(out)
+
+
+def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32, compress_files=None):
     """
     Simplified version of pack_assets that handles basic file packing
+
+    Files named in compress_files are stored as "ZL" + u32 raw size + LZ4 block
+    when that saves at least 10%, everything else as "ZZ" + raw data.
     """
+    compress_files = compress_files or set()
     merged_data = bytearray()
     file_info_list = []
     skip_files = ['config.json']
@@ -356,29 +540,49 @@ def pack_assets_simple(target_path, include_path, out_file, assets_path, max_nam
     os.makedirs(os.path.dirname(out_file), exist_ok=True)
     os.makedirs(include_path, exist_ok=True)
 
-    file_list = sorted(os.listdir(target_path), key=sort_key)
-    for filename in file_list:
-        if filename in skip_files:
-            continue
+    file_list = [filename for filename in sorted(os.listdir(target_path), key=sort_key)
+                 if filename not in skip_files and os.path.isfile(os.path.join(target_path, filename))]
+
+    # Offset of merged_data inside the partition: header (12 bytes) + mmap table
+    data_start = 12 + len(file_list) * (max_name_len + 12)
 
+    for filename in file_list:
         file_path = os.path.join(target_path, filename)
-        if not os.path.isfile(file_path):
-            continue
-            
         file_name = os.path.basename(file_path)
         file_size = os.path.getsize(file_path)
 
-        file_info_list.append((file_name, len(merged_data), file_size, 0, 0))
-        # Add 0x5A5A prefix to merged_data
-        merged_data.extend(b'\x5A' * 2)
+        # Pad so the data after the 0x5A5A prefix is 4-byte aligned in the mmapped partition,
+        # which lets the firmware use pixel data in place
+        while (data_start + len(merged_data) + 2) % 4 != 0:
+            merged_data.append(0)
 
         with open(file_path, 'rb') as bin_file:
             bin_data = bin_file.read()
 
+        if file_name in compress_files:
+            compressed = lz4_compress_block(bin_data)
+            if len(compressed) + 4 <= file_size * 0.9:
+                print(f'Compressed {file_name}: {file_size} -> {len(compressed) + 4} bytes')
+                file_info_list.append((file_name, len(merged_data), len(compressed) + 4, 0, 0))
+                merged_data.extend(b'ZL')
+                merged_data.extend(file_size.to_bytes(4, byteorder='little'))
+                merged_data.extend(compressed)
+                continue
+
+        file_info_list.append((file_name, len(merged_data), file_size, 0, 0))
+        # Add 0x5A5A prefix to merged_data
+        merged_data.extend(b'\x5A' * 2)
         merged_data.extend(bin_data)
 
     total_files = len(file_info_list)
 
+    # Per-entry CRC32 (prefix included) at the end of the data, so the firmware can verify
+    # entries lazily instead of summing the whole partition on every boot
+    merged_data.extend(b'CRC1')
+    for _, offset, stored_size, _, _ in file_info_list:
+        entry_crc = zlib.crc32(merged_data[offset:offset + 2 + stored_size])
+        merged_data.extend(entry_crc.to_bytes(4, byteorder='little'))
+
     mmap_table = bytearray()
     for file_name, offset, file_size, width, height in file_info_list:
         if len(file_name) > max_name_len:
@@ -547,6 +751,34 @@ def read_wake_word_type_from_sdkconfig(sdkconfig_path):
     return config_values
 
 
+def read_bool_option_from_sdkconfig(sdkconfig_path, option):
+    """
+    Return True if the bool option (e.g. CONFIG_DEFAULT_ASSETS_NATIVE_EMOJI) is enabled in sdkconfig
+    """
+    if not os.path.exists(sdkconfig_path):
+        return False
+
+    with io.open(sdkconfig_path, "r") as f:
+        for line in f:
+            if line.strip() == f'{option}=y':
+                return True
+    return False
+
+
+def read_native_emoji_from_sdkconfig(sdkconfig_path):
+    """
+    Read whether emoji images should be converted to the native panel format
+    """
+    return read_bool_option_from_sdkconfig(sdkconfig_path, 'CONFIG_DEFAULT_ASSETS_NATIVE_EMOJI')
+
+
+def read_compress_font_from_sdkconfig(sdkconfig_path):
+    """
+    Read whether the text font should be stored LZ4 compressed
+    """
+    return read_bool_option_from_sdkconfig(sdkconfig_path, 'CONFIG_DEFAULT_ASSETS_COMPRESS_FONT')
+
+
 def read_custom_wake_word_from_sdkconfig(sdkconfig_path):
     """
     Read custom wake word configuration from sdkconfig
@@ -698,7 +930,7 @@ def get_emoji_collection_path(default_emoji_collection, xiaozhi_fonts_path):
         return None
 
 
-def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None):
+def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None, native_emoji=False, compress_font=False):
     """
     Build assets using integrated functions (no external dependencies)
     """
@@ -718,11 +950,14 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font
         # Process each component
         srmodels = process_sr_models(wakenet_model_paths, multinet_model_paths, temp_build_dir, assets_dir) if (wakenet_model_paths or multinet_model_paths) else None
         text_font = process_text_font(text_font_path, assets_dir) if text_font_path else None
-        emoji_collection = process_emoji_collection(emoji_collection_path, assets_dir) if emoji_collection_path else None
+        emoji_collection = process_emoji_collection(emoji_collection_path, assets_dir, native_emoji) if emoji_collection_path else None
         extra_files = process_extra_files(extra_files_path, assets_dir) if extra_files_path else None
         
+        compress_files = {text_font} if (compress_font and text_font) else set()
+
         # Generate index.json
-        generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files, multinet_model_info)
+        generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files, multinet_model_info,
+                            bool(compress_files))
         
         # Generate config.json for packing
         config_path = generate_config_json(temp_build_dir, assets_dir)
@@ -734,7 +969,7 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font
         # Use simplified packing function
         include_path = config_data['include_path']
         image_file = config_data['image_file']
-        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']))
+        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']), compress_files)
         
         # Copy final assets.bin to output location
         if os.path.exists(image_file):
@@ -829,6 +1064,12 @@ def main():
     
     # Get emoji collection path if needed
     emoji_collection_path = get_emoji_collection_path(args.emoji_collection, args.xiaozhi_fonts_path)
+    native_emoji = read_native_emoji_from_sdkconfig(args.sdkconfig)
+    if emoji_collection_path and native_emoji:
+        print("  emoji format: RGB565A8 (native)")
+    compress_font = read_compress_font_from_sdkconfig(args.sdkconfig)
+    if text_font_path and compress_font:
+        print("  text font: LZ4 compressed")
     
     # Get extra files path if provided
     extra_files_path = args.extra_files
@@ -870,7 +1111,7 @@ def main():
     
     # Build the assets
     success = build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, 
-                                     extra_files_path, args.output, multinet_model_info)
+                                     extra_files_path, args.output, multinet_model_info, native_emoji, compress_font)
     
     if not success:
         sys.exit(1)
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""Binary delta between two application images, applied on the device by main/ota_delta.cc
+
+Patch layout (little endian):
+    header:  "XZD1" | u32 base_size | sha256(base) 32 bytes | u32 target_size
+    ops:     u8 opcode followed by varint (LEB128) arguments
+        0x01 COPY  src_offset, length                copy bytes of the running image
+        0x02 ADD   src_offset, length, runs...       base bytes plus a byte-wise difference,
+                   runs = [zero_run, literal_count, literal bytes] until length is covered
+        0x03 DATA  length, bytes                     new bytes
+        0x00 END
+
+Usage:
+    python scripts/firmware_delta.py diff old.bin new.bin patch.delta
+    python scripts/firmware_delta.py apply old.bin patch.delta out.bin
+"""
+import sys
+import time
+import struct
+import hashlib
+import argparse
+
+MAGIC = b"XZD1"
+OP_END = 0x00
+OP_COPY = 0x01
+OP_ADD = 0x02
+OP_DATA = 0x03
+
+BLOCK_SIZE = 32
+# Shorter matches cost more in opcodes than they save
+MIN_COPY = 64
+
+
+def _varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def _read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+
+
+def _encode_add(base, src, target, start, end):
+    """ADD op of target[start:end] against base[src:], None if base is too short"""
+    length = end - start
+    if src < 0 or src + length > len(base):
+        return None
+    diff = bytes((target[start + i] - base[src + i]) & 0xFF for i in range(length))
+    out = bytearray([OP_ADD])
+    out += _varint(src) + _varint(length)
+    i = 0
+    while i < length:
+        zero_start = i
+        while i < length and diff[i] == 0:
+            i += 1
+        literal_start = i
+        # A literal run ends at the first stretch of 4 zero bytes
+        while i < length and diff[i:i + 4] != b"\0\0\0\0"[:min(4, length - i)]:
+            i += 1
+        out += _varint(literal_start - zero_start) + _varint(i - literal_start)
+        out += diff[literal_start:i]
+    return bytes(out)
+
+
+def _encode_gap(base, target, start, end, src_hints):
+    """Cheapest encoding of an unmatched target range, trying ADD against each base offset hint"""
+    best = bytes([OP_DATA]) + _varint(end - start) + target[start:end]
+    for src in src_hints:
+        add_op = _encode_add(base, src, target, start, end)
+        if add_op is not None and len(add_op) < len(best):
+            best = add_op
+    return best
+
+
+def diff(base, target):
+    index = {}
+    for offset in range(0, len(base) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        index.setdefault(base[offset:offset + BLOCK_SIZE], offset)
+
+    out = bytearray(MAGIC)
+    out += struct.pack("<I", len(base))
+    out += hashlib.sha256(base).digest()
+    out += struct.pack("<I", len(target))
+
+    gap_start = 0
+    src_hint = 0  # where the base continues after the last copy
+    pos = 0
+    limit = len(target) - BLOCK_SIZE
+    while pos <= limit:
+        src = index.get(target[pos:pos + BLOCK_SIZE])
+        if src is None:
+            pos += 1
+            continue
+
+        # Extend the match backwards into the gap and forwards as far as it goes
+        start, src_start = pos, src
+        while start > gap_start and src_start > 0 and target[start - 1] == base[src_start - 1]:
+            start -= 1
+            src_start -= 1
+        end, src_end = pos + BLOCK_SIZE, src + BLOCK_SIZE
+        while end + 64 <= len(target) and src_end + 64 <= len(base) and \
+                target[end:end + 64] == base[src_end:src_end + 64]:
+            end += 64
+            src_end += 64
+        while end < len(target) and src_end < len(base) and target[end] == base[src_end]:
+            end += 1
+            src_end += 1
+
+        if end - start < MIN_COPY:
+            pos += 1
+            continue
+
+        if start > gap_start:
+            # Changed code usually sits where the base continues after the previous
+            # match, or right before the next one
+            out += _encode_gap(base, target, gap_start, start, (src_hint, src_start - (start - gap_start)))
+        out += bytes([OP_COPY]) + _varint(src_start) + _varint(end - start)
+        gap_start = pos = end
+        src_hint = src_end
+
+    if gap_start < len(target):
+        out += _encode_gap(base, target, gap_start, len(target), (src_hint,))
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply(base, patch):
+    if patch[:4] != MAGIC:
+        raise ValueError("not a delta patch")
+    base_size, = struct.unpack_from("<I", patch, 4)
+    if base_size != len(base) or hashlib.sha256(base).digest() != patch[8:40]:
+        raise ValueError("patch was made for a different base image")
+    target_size, = struct.unpack_from("<I", patch, 40)
+
+    out = bytearray()
+    pos = 44
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            src, pos = _read_varint(patch, pos)
+            length, pos = _read_varint(patch, pos)
+            out += base[src:src + length]
+        elif op == OP_ADD:
+            src, pos = _read_varint(patch, pos)
+            length, pos = _read_varint(patch, pos)
+            done = 0
+            while done < length:
+                zeros, pos = _read_varint(patch, pos)
+                out += base[src + done:src + done + zeros]
+                done += zeros
+                count, pos = _read_varint(patch, pos)
+                out += bytes((base[src + done + i] + patch[pos + i]) & 0xFF for i in range(count))
+                pos += count
+                done += count
+        elif op == OP_DATA:
+            length, pos = _read_varint(patch, pos)
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError(f"unknown opcode 0x{op:02x} at {pos - 1}")
+
+    if len(out) != target_size:
+        raise ValueError(f"patched size {len(out)} does not match {target_size}")
+    return bytes(out)
+
+
+def make_delta_file(base_path, target_path, patch_path):
+    """Write the patch and return (patch size, target size, seconds to diff, seconds to apply)"""
+    with open(base_path, "rb") as f:
+        base = f.read()
+    with open(target_path, "rb") as f:
+        target = f.read()
+
+    start = time.time()
+    patch = diff(base, target)
+    diff_time = time.time() - start
+
+    start = time.time()
+    if apply(base, patch) != target:
+        raise RuntimeError("delta patch does not reproduce the target image")
+    apply_time = time.time() - start
+
+    with open(patch_path, "wb") as f:
+        f.write(patch)
+    return len(patch), len(target), diff_time, apply_time
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Firmware delta patch tool")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("diff", help="create a patch from base to target")
+    p.add_argument("base")
+    p.add_argument("target")
+    p.add_argument("patch")
+    p = sub.add_parser("apply", help="apply a patch to a base image")
+    p.add_argument("base")
+    p.add_argument("patch")
+    p.add_argument("output")
+    args = parser.parse_args()
+
+    if args.command == "diff":
+        patch_size, target_size, diff_time, apply_time = make_delta_file(args.base, args.target, args.patch)
+        print(f"patch {patch_size} bytes ({patch_size * 100 / target_size:.1f}% of {target_size}), "
+              f"diff {diff_time:.1f}s, apply {apply_time:.1f}s")
+    else:
+        with open(args.base, "rb") as f:
+            base = f.read()
+        with open(args.patch, "rb") as f:
+            patch = f.read()
+        try:
+            result = apply(base, patch)
+        except ValueError as e:
+            print(f"[ERROR] {e}", file=sys.stderr)
+            sys.exit(1)
+        with open(args.output, "wb") as f:
+            f.write(result)
+        print(f"wrote {len(result)} bytes to {args.output}")
@@ -6,6 +6,8 @@ import argparse
 from pathlib import Path
 from typing import Optional
 
+from firmware_delta import make_delta_file
+
 # Switch to project root directory
 os.chdir(Path(__file__).resolve().parent.parent)
 
@@ -57,6 +59,26 @@ def zip_bin(name: str, version: str) -> None:
         zipf.write("build/merged-binary.bin", arcname="merged-binary.bin")
     print(f"zip bin to {output_path} done")
 
+def get_app_bin() -> Path:
+    """Application image of the last build, as listed in build/project_description.json"""
+    desc_file = Path("build/project_description.json")
+    if desc_file.exists():
+        with desc_file.open() as f:
+            app_bin = json.load(f).get("app_bin")
+        if app_bin:
+            return Path("build") / app_bin
+    return Path("build/xiaozhi_vn.bin")
+
+
+def delta_bin(name: str, version: str, base_bin: str) -> None:
+    """Write releases/v{version}_{name}.delta, a patch from base_bin to the freshly built app image"""
+    out_dir = Path("releases")
+    out_dir.mkdir(exist_ok=True)
+    output_path = out_dir / f"v{version}_{name}.delta"
+    patch_size, target_size, diff_time, apply_time = make_delta_file(base_bin, get_app_bin(), output_path)
+    print(f"delta {output_path}: {patch_size} bytes ({patch_size * 100 / target_size:.1f}% of {target_size}), "
+          f"diff {diff_time:.1f}s, apply {apply_time:.1f}s")
+
 ################################################################################
 # board / variant related functions
 ################################################################################
@@ -126,13 +148,15 @@ def _board_type_exists(board_type: str) -> bool:
 # Compile implementation
 ################################################################################
 
-def release(board_type: str, config_filename: str = "config.json", *, filter_name: Optional[str] = None) -> None:
+def release(board_type: str, config_filename: str = "config.json", *, filter_name: Optional[str] = None,
+            delta_base: Optional[str] = None) -> None:
     """Compile and package all/specified variants of the specified board_type
 
     Args:
         board_type: directory name under main/boards
         config_filename: config.json name (default: config.json)
         filter_name: if specified, only compile the build["name"] that matches
+        delta_base: if specified, also write a delta patch from this app image
     """
     cfg_path = _BOARDS_DIR / board_type / config_filename
     if not cfg_path.exists():
@@ -198,6 +222,9 @@ def release(board_type: str, config_filename: str = "config.json", *, filter_nam
         # Zip
         zip_bin(name, project_version)
 
+        if delta_base:
+            delta_bin(name, project_version, delta_base)
+
 ################################################################################
 # CLI entry
 ################################################################################
@@ -209,6 +236,7 @@ if __name__ == "__main__":
     parser.add_argument("--list-boards", action="store_true", help="列出所有支持的 board 及变体列表")
     parser.add_argument("--json", action="store_true", help="配合 --list-boards，JSON 格式输出")
     parser.add_argument("--name", help="指定变体名称，仅编译匹配的变体")
+    parser.add_argument("--delta-base", help="上一版本的 app bin，额外生成差分升级包 .delta")
 
     args = parser.parse_args()
 
@@ -231,6 +259,8 @@ if __name__ == "__main__":
             sys.exit(1)
         project_ver = get_project_version()
         zip_bin(curr_board_type, project_ver)
+        if args.delta_base:
+            delta_bin(curr_board_type, project_ver, args.delta_base)
         sys.exit(0)
 
     # Compile mode
@@ -259,4 +289,5 @@ if __name__ == "__main__":
         if bt == board_type_input and not cfg_path.exists():
             print(f"开发板 {bt} 未定义 {args.config} 配置文件，跳过")
             sys.exit(0)
-        release(bt, config_filename=args.config, filter_name=name_filter if bt == board_type_input else None)
+        release(bt, config_filename=args.config, filter_name=name_filter if bt == board_type_input else None,
+                delta_base=args.delta_base)